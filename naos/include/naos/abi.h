@@ -212,8 +212,40 @@ enum
 enum
 {
     NA_RING_FLAG_NONBLOCK = ((uint32_t)1 << 0),
+    /* Keep the ring in pages both ends map; see na_shared_ring_header_t. */
+    NA_RING_FLAG_MAPPED = ((uint32_t)1 << 1),
 };
 
+/* Layout of an NA_RING_FLAG_MAPPED ring. Producer and consumer map the ring
+ * handle with NA_MEMORY_MAP_SHARED and exchange messages without syscalls:
+ * the producer owns tail, the consumer owns head, and both indices count
+ * messages modulo 2^64. A side about to sleep sets its *_waiting word; the
+ * other side clears it and calls _na_shared_ring_notify after moving its
+ * index. Slots follow the header, slot_stride bytes apart, each starting with
+ * an na_shared_ring_slot_t. */
+#define NA_SHARED_RING_SLOT_ALIGN ((uint64_t)64)
+
+typedef struct na_shared_ring_header
+{
+    uint64_t head;
+    uint64_t consumer_waiting;
+    uint64_t reserved0[6];
+    uint64_t tail;
+    uint64_t producer_waiting;
+    uint64_t reserved1[6];
+    uint32_t slots;
+    uint32_t slot_bytes;
+    uint32_t slot_stride;
+    uint32_t reserved2;
+    uint64_t reserved3[6];
+} na_shared_ring_header_t;
+
+typedef struct na_shared_ring_slot
+{
+    uint32_t size;
+    uint32_t reserved;
+} na_shared_ring_slot_t;
+
 /* Canonical File/Stream request flags.  POSIX O_NONBLOCK is translated by
  * mlibc; it is never stored in native capability metadata. */
 enum
@@ -539,8 +571,12 @@ enum
     NA_MEMORY_MAP_WRITE = ((uint32_t)1 << 1),
     NA_MEMORY_MAP_EXEC = ((uint32_t)1 << 2),
     NA_MEMORY_MAP_SHARED = ((uint32_t)1 << 3),
+    /* Map every page before returning instead of on first access. */
+    NA_MEMORY_MAP_POPULATE = ((uint32_t)1 << 4),
 };
 
+/* offset must be page aligned for a memory object or shared ring, whose own
+ * pages are mapped; NA_STATUS_INVALID_ARGUMENT otherwise. */
 typedef struct na_memory_map_frame
 {
     uint32_t struct_size;
@@ -578,6 +614,110 @@ typedef struct na_pipe_create_frame
     na_handle_t write_end;
 } na_pipe_create_frame_t;
 
+/* Flags of _na_splice and _na_vmsplice. */
+enum
+{
+    /* Fail with NA_STATUS_WOULD_BLOCK instead of waiting for a pipe. */
+    NA_SPLICE_NONBLOCK = ((uint32_t)1 << 0),
+    /* Pipe to pipe only: the source keeps its data and shares its pages with
+     * the target, as tee does. */
+    NA_SPLICE_KEEP = ((uint32_t)1 << 1),
+};
+
+/* Move up to size bytes from source to target, at least one of which is a
+ * pipe end. Pages of a regular file, a memory object or another pipe enter a
+ * pipe by reference, without a copy; bytes leaving a pipe for a file or memory
+ * object are copied once. Offsets apply to files and memory objects and must
+ * be zero for pipes. actual is output-only. */
+typedef struct na_splice_frame
+{
+    uint32_t struct_size;
+    uint32_t flags;
+    na_handle_t source;
+    na_handle_t target;
+    uint64_t source_offset;
+    uint64_t target_offset;
+    uint64_t size;
+    uint64_t actual;
+    uint64_t reserved0;
+} na_splice_frame_t;
+
+/* Append size bytes at address to a pipe. They are copied once into pages the
+ * pipe then passes on by reference. actual is output-only. */
+typedef struct na_vmsplice_frame
+{
+    uint32_t struct_size;
+    uint32_t flags;
+    na_handle_t pipe;
+    uint64_t address;
+    uint64_t size;
+    uint64_t actual;
+    uint64_t reserved0;
+} na_vmsplice_frame_t;
+
+/* Futex operations of _s_futex. Without NA_FUTEX_PRIVATE a futex in a
+ * shared mapping is keyed by its physical page, so processes mapping the same
+ * memory object meet on it. */
+enum
+{
+    NA_FUTEX_WAKE = 1,
+    NA_FUTEX_WAIT = 2,
+    NA_FUTEX_REQUEUE = 3,
+    NA_FUTEX_CMP_REQUEUE = 4,
+    NA_FUTEX_WAKE_OP = 5,
+    NA_FUTEX_WAIT_BITSET = 6,
+    NA_FUTEX_WAKE_BITSET = 7,
+    NA_FUTEX_LOCK_PI = 8,
+    NA_FUTEX_UNLOCK_PI = 9,
+    NA_FUTEX_TRYLOCK_PI = 10,
+    NA_FUTEX_PRIVATE = 128,
+};
+
+#define NA_FUTEX_BITSET_MATCH_ANY ((uint32_t)0xFFFFFFFF)
+
+/* The word of a priority inheritance futex: the owner's thread id, and a bit
+ * the kernel sets while threads wait for it. */
+#define NA_FUTEX_WAITERS ((uint32_t)0x80000000)
+#define NA_FUTEX_TID_MASK ((uint32_t)0x3FFFFFFF)
+
+/* NA_FUTEX_WAKE_OP encodes op << 28 | cmp << 24 | oparg << 12 | cmparg, with
+ * 12 bit signed oparg and cmparg. */
+enum
+{
+    NA_FUTEX_OP_SET = 0,
+    NA_FUTEX_OP_ADD = 1,
+    NA_FUTEX_OP_OR = 2,
+    NA_FUTEX_OP_ANDN = 3,
+    NA_FUTEX_OP_XOR = 4,
+    /* Use 1 << oparg as the operand */
+    NA_FUTEX_OP_OPARG_SHIFT = 8,
+};
+
+enum
+{
+    NA_FUTEX_OP_CMP_EQ = 0,
+    NA_FUTEX_OP_CMP_NE = 1,
+    NA_FUTEX_OP_CMP_LT = 2,
+    NA_FUTEX_OP_CMP_LE = 3,
+    NA_FUTEX_OP_CMP_GT = 4,
+    NA_FUTEX_OP_CMP_GE = 5,
+};
+
+#define NA_FUTEX_OP(op, oparg, cmp, cmparg)                                                                            \
+    ((uint32_t)((((op)&0xF) << 28) | (((cmp)&0xF) << 24) | (((oparg)&0xFFF) << 12) | ((cmparg)&0xFFF)))
+
+#define NA_LOCKSTAT_NAME_BYTES 32
+
+/* Contention of one class of kernel locks, filled in by lockstat_read. */
+typedef struct na_lockstat_entry
+{
+    char name[NA_LOCKSTAT_NAME_BYTES];
+    uint64_t acquisitions;
+    uint64_t contended;
+    uint64_t total_wait_cycles;
+    uint64_t max_wait_cycles;
+} na_lockstat_entry_t;
+
 /* Syscall numbers are compact v1 native ABI assignments. */
 enum
 {
@@ -623,7 +763,13 @@ enum
     NA_SYSCALL_PROCESS_HANDLE_OPEN = 39,
     NA_SYSCALL_PROCESS_SPAWN = 40,
     NA_SYSCALL_PIPE_CREATE = 41,
-    NA_SYSCALL_COUNT = 42,
+    NA_SYSCALL_SHARED_RING_NOTIFY = 42,
+    NA_SYSCALL_THREAD_SET_NICE = 43,
+    NA_SYSCALL_LOCKSTAT_READ = 44,
+    NA_SYSCALL_INVOKE_CALL = 45,
+    NA_SYSCALL_SPLICE = 46,
+    NA_SYSCALL_VMSPLICE = 47,
+    NA_SYSCALL_COUNT = 48,
 };
 
 #ifdef __cplusplus
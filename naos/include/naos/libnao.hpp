@@ -48,6 +48,15 @@ class event_loop
         return static_cast<na_status_t>(_na_invocation_take_result(invocation, &frame));
     }
 
+    /// submit, wait_invocation and take in one system call, with no
+    /// invocation handle to cancel or close
+    static na_status_t call(na_handle_t target, const na_submit_frame_t &submit, na_result_frame_t &result)
+    {
+        if (target == NA_HANDLE_INVALID)
+            return NA_STATUS_INVALID_HANDLE;
+        return static_cast<na_status_t>(_na_invoke_call(target, &submit, &result));
+    }
+
     static na_status_t wait_invocation(na_handle_t invocation, const struct timespec *deadline = nullptr)
     {
         if (invocation == NA_HANDLE_INVALID)
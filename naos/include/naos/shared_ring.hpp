@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <naos/abi.h>
+
+namespace nao
+{
+
+/// One end of an NA_RING_FLAG_MAPPED shared ring.
+///
+/// A view does not own the mapping. Exactly one thread may use the producer
+/// calls and one thread the consumer calls. The geometry is read once on
+/// attach, so a misbehaving peer rewriting the header cannot move slots
+/// outside the mapping; slot sizes are checked against it on every pop.
+class shared_ring_view
+{
+  public:
+    shared_ring_view() = default;
+
+    explicit shared_ring_view(void *base)
+        : header_(static_cast<na_shared_ring_header_t *>(base))
+        , slots_(header_->slots)
+        , slot_bytes_(header_->slot_bytes)
+        , slot_stride_(header_->slot_stride)
+    {
+        if (slots_ == 0 || slot_stride_ < slot_stride(slot_bytes_))
+            header_ = nullptr;
+    }
+
+    static constexpr std::uint64_t slot_stride(std::uint64_t slot_bytes)
+    {
+        return (sizeof(na_shared_ring_slot_t) + slot_bytes + NA_SHARED_RING_SLOT_ALIGN - 1) &
+               ~(NA_SHARED_RING_SLOT_ALIGN - 1);
+    }
+
+    static constexpr std::uint64_t mapping_bytes(std::uint64_t slots, std::uint64_t slot_bytes)
+    {
+        return sizeof(na_shared_ring_header_t) + slots * slot_stride(slot_bytes);
+    }
+
+    /// Lay out an empty ring at \p base, which must be zeroed and hold
+    /// mapping_bytes(slots, slot_bytes) bytes.
+    static void initialize(void *base, std::uint32_t slots, std::uint32_t slot_bytes)
+    {
+        auto *header = static_cast<na_shared_ring_header_t *>(base);
+        header->slots = slots;
+        header->slot_bytes = slot_bytes;
+        header->slot_stride = static_cast<std::uint32_t>(slot_stride(slot_bytes));
+    }
+
+    bool valid() const { return header_ != nullptr; }
+    std::uint64_t slots() const { return slots_; }
+    std::uint64_t slot_bytes() const { return slot_bytes_; }
+
+    std::uint64_t queued() const
+    {
+        return __atomic_load_n(&header_->tail, __ATOMIC_ACQUIRE) - __atomic_load_n(&header_->head, __ATOMIC_ACQUIRE);
+    }
+
+    /// \return NA_STATUS_WOULD_BLOCK when the ring is full
+    na_status_t try_push(const void *data, std::uint32_t size)
+    {
+        if (size > slot_bytes_ || (size != 0 && data == nullptr))
+            return NA_STATUS_INVALID_ARGUMENT;
+        const auto tail = __atomic_load_n(&header_->tail, __ATOMIC_RELAXED);
+        if (tail - __atomic_load_n(&header_->head, __ATOMIC_ACQUIRE) >= slots_)
+            return NA_STATUS_WOULD_BLOCK;
+        auto *slot = slot_at(tail);
+        slot->size = size;
+        __builtin_memcpy(slot + 1, data, size);
+        __atomic_store_n(&header_->tail, tail + 1, __ATOMIC_RELEASE);
+        return NA_STATUS_OK;
+    }
+
+    /// Copy out the oldest message.
+    ///
+    /// \param size set to the message size, also when \p capacity is too small
+    /// \return NA_STATUS_WOULD_BLOCK when the ring is empty
+    na_status_t try_pop(void *data, std::uint32_t capacity, std::uint32_t &size)
+    {
+        size = 0;
+        const auto head = __atomic_load_n(&header_->head, __ATOMIC_RELAXED);
+        if (__atomic_load_n(&header_->tail, __ATOMIC_ACQUIRE) == head)
+            return NA_STATUS_WOULD_BLOCK;
+        const auto *slot = slot_at(head);
+        size = slot->size;
+        if (size > slot_bytes_)
+            return NA_STATUS_INVALID_MESSAGE;
+        if (size > capacity)
+            return NA_STATUS_BUFFER_TOO_SMALL;
+        __builtin_memcpy(data, slot + 1, size);
+        __atomic_store_n(&header_->head, head + 1, __ATOMIC_RELEASE);
+        return NA_STATUS_OK;
+    }
+
+    /// Producer side of the wakeup handshake. Call after a successful push;
+    /// a true result means the consumer sleeps and must be woken with
+    /// _na_shared_ring_notify.
+    bool take_consumer_wakeup() { return take_wakeup(header_->consumer_waiting); }
+    /// Consumer side counterpart of take_consumer_wakeup, called after a pop.
+    bool take_producer_wakeup() { return take_wakeup(header_->producer_waiting); }
+
+    /// Announce that the consumer is about to wait for NA_SIGNAL_READABLE.
+    ///
+    /// \return false if a message arrived meanwhile and the consumer should
+    /// pop again instead of waiting
+    bool prepare_consumer_wait()
+    {
+        __atomic_store_n(&header_->consumer_waiting, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (queued() == 0)
+            return true;
+        __atomic_store_n(&header_->consumer_waiting, 0, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    /// Announce that the producer is about to wait for NA_SIGNAL_WRITABLE.
+    bool prepare_producer_wait()
+    {
+        __atomic_store_n(&header_->producer_waiting, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (queued() >= slots_)
+            return true;
+        __atomic_store_n(&header_->producer_waiting, 0, __ATOMIC_RELAXED);
+        return false;
+    }
+
+  private:
+    static bool take_wakeup(std::uint64_t &waiting)
+    {
+        // Pairs with the fence in prepare_*_wait: either the sleeper sees the
+        // index move, or this load sees its waiting word.
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&waiting, __ATOMIC_RELAXED) == 0)
+            return false;
+        return __atomic_exchange_n(&waiting, 0, __ATOMIC_RELAXED) != 0;
+    }
+
+    na_shared_ring_slot_t *slot_at(std::uint64_t index) const
+    {
+        auto *base = reinterpret_cast<std::byte *>(header_ + 1);
+        return reinterpret_cast<na_shared_ring_slot_t *>(base + (index % slots_) * slot_stride_);
+    }
+
+    na_shared_ring_header_t *header_ = nullptr;
+    std::uint64_t slots_ = 0;
+    std::uint64_t slot_bytes_ = 0;
+    std::uint64_t slot_stride_ = 0;
+};
+
+} // namespace nao
@@ -47,6 +47,10 @@ void _s_none(void);
 void _s_log(const char *message);
 int _s_clock(int clock_index, na_time_clock_t *clock);
 int _s_futex(int *ptr, int op, int val, const na_time_clock_t *timeout);
+/* The full futex call, see NA_FUTEX_*. Requeue and wake-op pass the count of
+ * waiters to move or wake on ptr2 in place of timeout. NA_FUTEX_WAIT_BITSET
+ * and NA_FUTEX_LOCK_PI take an absolute monotonic timeout. */
+int _s_futex_ext(int *ptr, int op, int val, const na_time_clock_t *timeout, int *ptr2, int val3);
 NAOS_SYSCALL_NORETURN void _s_exit(int64_t ret);
 NAOS_SYSCALL_NORETURN void _s_exit_thread(int64_t ret);
 int _s_sleep(const na_time_clock_t *time);
@@ -88,6 +92,27 @@ na_status_t _na_process_exec(const na_process_exec_frame_t *frame);
 na_status_t _na_process_handle_open(int64_t pid, na_handle_t *result);
 na_status_t _na_process_spawn(const na_process_spawn_frame_t *frame);
 na_status_t _na_pipe_create(na_pipe_create_frame_t *frame);
+/* Wake the peer of a mapped shared ring after clearing its waiting word. */
+na_status_t _na_shared_ring_notify(na_handle_t ring);
+/* Set the nice level, -20 to 19, of the calling thread. */
+na_status_t _na_thread_set_nice(int64_t nice);
+/* Copy up to capacity lock classes into entries and store how many there are
+ * in count. NA_STATUS_NOT_SUPPORTED unless the kernel counts lock contention. */
+na_status_t _na_lockstat_read(na_lockstat_entry_t *entries, uint64_t capacity, uint64_t *count);
+/* Submit a two-way call, wait for it to complete and take its result into
+ * result as _na_invocation_take_result does. No invocation handle is created;
+ * the outcome and protocol error are reported in result. A result that does not
+ * fit the buffers of result is dropped once the call has completed.
+ * The wait has no deadline and cannot be cancelled: it ends only when the
+ * responder replies or fails the call, or when its Responder handle is closed.
+ * To bound it, use _na_invoke_submit and wait for NA_SIGNAL_COMPLETED on the
+ * Invocation handle with _na_handle_wait_many. */
+na_status_t _na_invoke_call(na_handle_t target, const na_submit_frame_t *submit, na_result_frame_t *result);
+/* Move bytes between a pipe and a pipe, file or memory object, see
+ * na_splice_frame_t. Stores the bytes moved in actual. */
+na_status_t _na_splice(na_splice_frame_t *frame);
+/* Append user memory to a pipe, see na_vmsplice_frame_t. */
+na_status_t _na_vmsplice(na_vmsplice_frame_t *frame);
 
 #ifdef __cplusplus
 }
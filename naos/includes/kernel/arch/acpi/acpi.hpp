@@ -66,6 +66,23 @@ struct numa_info
 
 freelibcxx::hash_map<u32, numa_info> get_numa_info();
 
+struct memory_affinity
+{
+    phy_addr_t base;
+    u64 length;
+    u32 domain;
+    bool hot_pluggable;
+};
+
+/// Enabled SRAT memory affinity ranges
+freelibcxx::vector<memory_affinity> get_memory_affinity_list();
+
+/// SLIT relative distances, row-major by proximity domain. Empty without a
+/// SLIT.
+///
+/// \param localities set to the number of domains per row
+freelibcxx::vector<u8> get_numa_distance(u64 &localities);
+
 void shutdown();
 void reboot();
 
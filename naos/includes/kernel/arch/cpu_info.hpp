@@ -17,6 +17,7 @@ enum class feature
     apic,
     xapic,
     x2apic,
+    tsc_deadline,
     msr,
     tsc,
     constant_tsc,
@@ -127,6 +128,11 @@ struct cpu_mesh
 
 void load_cpu_mesh(cpu_mesh &mesh);
 
+/// Package, core and thread of the logical CPU with \p apic_id, decoded with
+/// the APIC id layout of the calling CPU. numa_index is left 0, see
+/// memory::numa::cpu_node().
+logic_core_id locate(int apic_id);
+
 u64 max_basic_cpuid();
 
 const char *get_cpu_manufacturer();
@@ -55,6 +55,9 @@ class clock_event : public ::timeclock::clock_event
 
     u64 hz_ = 0;
     bool builtin_frequency_ = false;
+    bool one_shot_ = false;
+    /// TSC frequency when one-shot deadlines are armed by IA32_TSC_DEADLINE
+    u64 tsc_hz_ = 0;
     irq::registration irq_registration_;
 
     irq::request_result on_interrupt(const irq::interrupt_info *, u64) noexcept;
@@ -66,7 +69,13 @@ class clock_event : public ::timeclock::clock_event
 
     void suspend() override;
     void resume() override;
+    bool set_one_shot() override;
+    bool one_shot(::timeclock::microsecond_t delta) override;
     bool is_valid() override { return true; }
+
+    /// Use TSC-deadline mode once set_one_shot() is called
+    void use_tsc_deadline(u64 tsc_hz) { tsc_hz_ = tsc_hz; }
+    bool tsc_deadline() const { return tsc_hz_ != 0; }
 };
 
 class clock_source : public ::timeclock::clock_source
@@ -1,4 +1,5 @@
 #pragma once
+#include "freelibcxx/function_ref.hpp"
 #include "freelibcxx/optional.hpp"
 #include "freelibcxx/tuple.hpp"
 #include "kernel/common.hpp"
@@ -205,6 +206,23 @@ void enable_new_paging();
 void temp_init(bool is_bsp);
 void temp_update_uncached(void *virt, u64 pages);
 
+/// Pages invalidate() drops one at a time before a full reload is cheaper
+constexpr size_t invalidate_page_limit = 32;
+
+/// TLB flushes since boot, summed over CPUs
+struct flush_stats
+{
+    /// CR3 writes dropping every entry of the address space
+    u64 full;
+    /// Pages dropped by INVLPG
+    u64 targeted;
+    /// Address space switches that kept the entries tagged with their PCID
+    u64 kept;
+};
+
+void get_flush_stats(flush_stats &stats);
+bool has_pcid();
+
 namespace action_flags
 {
 enum
@@ -264,16 +282,15 @@ class page_table_t
 
   public:
     page_table_t();
-    page_table_t(pml4t *base)
-        : base_(base)
-        , self_(false)
-    {
-    }
+    page_table_t(pml4t *base);
     page_table_t(const page_table_t &rhs) = delete;
     page_table_t &operator=(const page_table_t &rhs) = delete;
     page_table_t(page_table_t &&rhs)
         : base_(rhs.base_)
         , self_(rhs.self_)
+        , id_(rhs.id_)
+        , generation_(rhs.generation_)
+        , cpu_mask_(rhs.cpu_mask_)
     {
         rhs.base_ = nullptr;
     }
@@ -281,8 +298,27 @@ class page_table_t
 
     ~page_table_t();
 
+    /// Receives each page unmap() releases, to free it once no CPU holds a
+    /// TLB entry for it.
+    using release_page = freelibcxx::function_ref<void(void *page)>;
+
+    /// Switch to this page table. With PCIDs the TLB entries it left on this
+    /// CPU are kept unless a present entry changed since.
     void load();
+    /// CPUs which have this page table loaded, one bit per CPU id
+    u64 cpu_mask() const { return __atomic_load_n(&cpu_mask_, __ATOMIC_SEQ_CST); }
+    /// This page table is the one loaded on the current CPU. Call with
+    /// interrupts off.
+    bool loaded_here() const;
+    /// Drop every TLB entry of the current address space on this CPU.
     static void reload();
+    /// Drop every TLB entry of every address space on this CPU.
+    static void flush_all();
+    /// Drop the TLB entry of the page holding \p virt on this CPU.
+    static void invalidate(void *virt);
+    /// Drop the TLB entries of \p pages pages from \p virt on this CPU, with
+    /// a reload past invalidate_page_limit pages.
+    static void invalidate(void *virt, size_t pages);
 
     void map(void *virt_start, size_t pages, u64 flags, u64 actions);
     void map_to(void *virt_start, size_t pages, phy_addr_t phy_start, u64 flags, u64 actions);
@@ -290,22 +326,49 @@ class page_table_t
     void big_page_map_to(void *virt_start, size_t pages, phy_addr_t phy_start, u64 flags, u64 actions);
     void huge_page_map_to(void *virt_start, size_t pages, phy_addr_t phy_start, u64 flags, u64 actions);
 
+    /// Map the 2 MiB block \p block, from memory::zones::allocate_big_page,
+    /// at the 2 MiB aligned \p virt_start. The page table on the way is
+    /// unshared first.
+    ///
+    /// \return false, leaving \p block to the caller, if anything is already
+    /// mapped in that range
+    bool map_big_page(void *virt_start, void *block, u64 flags);
+
+    /// \return true if nothing is mapped in the 2 MiB range holding \p virt,
+    /// so map_big_page() can take it. Allocates no table.
+    bool big_page_free(void *virt);
+
+    /// Handle a write to the read-only 2 MiB page holding \p virt by making
+    /// it writable, or copying it if another address space shares it.
+    ///
+    /// \return false if \p virt is not in a 2 MiB page, or no 2 MiB block is
+    /// free for the copy. A 4 KiB map() of \p virt then splits the page.
+    bool write_big_page(void *virt, u64 flags);
+
     void prepare_kernel_space();
 
     void map_kernel_space();
 
     void unmap(void *virt_start, size_t pages);
+    /// Unmap without freeing the pages, handing each one to \p release
+    /// instead.
+    void unmap(void *virt_start, size_t pages, release_page release);
 
     bool has_flags(void *virt_start, u64 flags = flags::present);
 
     void clone_readonly_to(void *virt_start, size_t pages, page_table_t *to);
 
+    /// \return the physical address of the 4 KiB page holding \p virt_start,
+    /// also inside 2 MiB and 1 GiB pages
     freelibcxx::optional<phy_addr_t> get_map(void *virt_start);
 
   private:
     void ensure(int pml4e_index, int pdpe_index, int pde_index, u64 flags, u64 actions);
     void ensure(int pml4e_index, int pdpe_index, u64 flags, u64 actions);
     void ensure(int pml4e_index, u64 flags, u64 actions);
+    /// Note a change to a present entry under \p pml4e_index, so CPUs holding
+    /// TLB entries of it by PCID drop them on the next load().
+    void changed(int pml4e_index);
 
     inline bool normalize_index(int &pml4e_index, int &pdpe_index, int &pde_index, int &pte_index)
     {
@@ -345,6 +408,10 @@ class page_table_t
   private:
     pml4t *base_;
     bool self_;
+    /// Never reused, so a PCID slot cannot mistake a new table for a freed one
+    u64 id_;
+    u64 generation_;
+    u64 cpu_mask_;
 };
 
 } // namespace arch::paging
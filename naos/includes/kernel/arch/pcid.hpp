@@ -0,0 +1,67 @@
+#pragma once
+#include "kernel/common.hpp"
+
+namespace arch::paging
+{
+/// PCIDs 1..pcid_slots handed out per CPU. PCID 0 is loaded while PCIDs are
+/// off.
+constexpr u32 pcid_slots = 8;
+
+struct pcid_choice
+{
+    u16 pcid;
+    /// The CR3 write must drop the TLB entries tagged with pcid
+    bool flush;
+};
+
+/// One CPU's assignment of PCIDs to page tables.
+///
+/// A page table keeps its PCID until the CPU needs the slot for another one,
+/// so switching back to it keeps its TLB entries. Each page table counts a
+/// generation, bumped whenever a present entry changes. The entries survive
+/// only if the generation is still the one this CPU last loaded.
+class pcid_cache
+{
+  public:
+    /// \param table_id unique, non-zero id of the page table
+    pcid_choice assign(u64 table_id, u64 generation)
+    {
+        for (u32 i = 0; i < pcid_slots; i++)
+        {
+            if (slots_[i].table_id == table_id)
+            {
+                bool flush = slots_[i].generation != generation;
+                slots_[i].generation = generation;
+                return {static_cast<u16>(i + 1), flush};
+            }
+        }
+        u32 i = next_;
+        next_ = (next_ + 1) % pcid_slots;
+        slots_[i].table_id = table_id;
+        slots_[i].generation = generation;
+        return {static_cast<u16>(i + 1), true};
+    }
+
+    /// Flush every PCID when it is next loaded, after a change this CPU
+    /// cannot attribute to one page table.
+    void invalidate_all()
+    {
+        for (auto &slot : slots_)
+        {
+            slot.generation = no_generation;
+        }
+    }
+
+  private:
+    static constexpr u64 no_generation = ~0UL;
+
+    struct slot
+    {
+        u64 table_id = 0;
+        u64 generation = no_generation;
+    };
+    slot slots_[pcid_slots];
+    u32 next_ = 0;
+};
+
+} // namespace arch::paging
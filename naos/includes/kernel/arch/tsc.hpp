@@ -23,6 +23,8 @@ class clock_source : public ::timeclock::clock_source
     void calibrate(::timeclock::clock_source *cs) override;
     u64 calibrate_tsc(::timeclock::clock_source *cs);
     u64 current() override;
+    u64 current_ns() override;
+    u64 frequency() const { return tsc_tick_second_; }
 };
 
 clock_source *make_clock();
@@ -18,7 +18,12 @@ class clock_event
     virtual void suspend() = 0;
     virtual void resume() = 0;
 
-    virtual bool one_shot(u64 milliseconds) { return false; };
+    /// Stop firing periodically. The event then fires once per one_shot().
+    /// \return false if the event only supports periodic mode
+    virtual bool set_one_shot() { return false; }
+
+    /// Fire once after \p delta. A later call replaces the pending one.
+    virtual bool one_shot(microsecond_t delta) { return false; };
 
     virtual bool is_valid() = 0;
 
@@ -17,6 +17,8 @@ class clock_source
     virtual void init() = 0;
     virtual void destroy() = 0;
     virtual u64 current() = 0;
+    /// current() in nanoseconds, for sources finer than a microsecond
+    virtual u64 current_ns() { return current() * 1000; }
     virtual u64 jiff() { return 0; };
     const char *name() const { return name_; }
 
@@ -49,6 +49,10 @@ struct load_data_t
     u64 calcing_load_fac = 0;
 
     u64 recent_load_fac = 0;
+
+    /// Clock event interrupts taken, to measure how often an idle CPU wakes.
+    /// Read through /dev/timerinfo.
+    u64 timer_interrupts = 0;
 };
 
 /// per cpu data
@@ -105,6 +109,7 @@ class cpu_data_t
     void set_tasklet_queue(void *queue) { tasklet_queue = queue; }
 
     load_data_t &edit_load_data() { return load_data; }
+    const load_data_t &get_load_data() const { return load_data; }
 
     void *get_timer_queue() { return timer_queue; }
 
@@ -0,0 +1,14 @@
+#pragma once
+#include "kernel/dev/report.hpp"
+
+namespace dev::dispatchinfo
+{
+/// Text report of the kernel invocation dispatcher: its workers, the calls
+/// stolen across CPUs and their queueing latency, and each CPU's queue depth.
+class dispatchinfo_pseudo_t final : public report_pseudo_t
+{
+  protected:
+    u64 capacity() override;
+    void render(report_writer &writer) override;
+};
+} // namespace dev::dispatchinfo
@@ -0,0 +1,14 @@
+#pragma once
+#include "kernel/dev/report.hpp"
+
+namespace dev::numainfo
+{
+/// Text report of every NUMA node: its memory and the blocks allocated from
+/// it by local and remote CPUs.
+class numainfo_pseudo_t final : public report_pseudo_t
+{
+  protected:
+    u64 capacity() override;
+    void render(report_writer &writer) override;
+};
+} // namespace dev::numainfo
@@ -0,0 +1,77 @@
+#pragma once
+#include "freelibcxx/formatter.hpp"
+#include "freelibcxx/utils.hpp"
+#include "kernel/common.hpp"
+#include "kernel/fs/vfs/pseudo.hpp"
+
+namespace dev
+{
+/// Formats a text report of whitespace separated columns into a fixed
+/// buffer, dropping what does not fit.
+class report_writer
+{
+  public:
+    report_writer(char *buffer, u64 capacity)
+        : buffer_(buffer)
+        , capacity_(capacity)
+    {
+    }
+
+    void text(const char *str, u64 len)
+    {
+        len = freelibcxx::min(len, capacity_ - size_);
+        memcpy(buffer_ + size_, str, len);
+        size_ += len;
+    }
+
+    void pad_to(u64 column_end)
+    {
+        while (size_ < column_end && size_ < capacity_)
+            buffer_[size_++] = ' ';
+    }
+
+    /// Append a space and \p value in decimal.
+    void number(u64 value)
+    {
+        char digits[24];
+        auto len = freelibcxx::uint642str(freelibcxx::span<char>(digits, sizeof(digits)), value).value_or(0);
+        text(" ", 1);
+        text(digits, len);
+    }
+
+    /// Copy the report from \p offset on, as a pseudo read_at() does.
+    u64 read_at(i64 &offset, byte *data, u64 max_size) const
+    {
+        if (offset < 0 || static_cast<u64>(offset) >= size_)
+            return 0;
+        u64 count = freelibcxx::min(max_size, size_ - static_cast<u64>(offset));
+        memcpy(data, buffer_ + offset, count);
+        offset += static_cast<i64>(count);
+        return count;
+    }
+
+    u64 size() const { return size_; }
+    u64 rest() const { return capacity_ - size_; }
+
+  private:
+    char *buffer_;
+    u64 capacity_;
+    u64 size_ = 0;
+};
+
+/// Read-only pseudo file that renders a fresh report on every read, so a
+/// reader should consume it from offset 0 in one pass.
+class report_pseudo_t : public fs::vfs::pseudo_t
+{
+  public:
+    i64 write(const byte *data, u64 size, flag_t flags) override;
+    i64 read(byte *data, u64 max_size, flag_t flags) override;
+    i64 read_at(i64 &offset, byte *data, u64 max_size, flag_t flags) override;
+    void close() override {}
+
+  protected:
+    /// \return bytes to reserve for the next render()
+    virtual u64 capacity() = 0;
+    virtual void render(report_writer &writer) = 0;
+};
+} // namespace dev
@@ -0,0 +1,13 @@
+#pragma once
+#include "kernel/dev/report.hpp"
+
+namespace dev::slabinfo
+{
+/// Text report of every slab_group, one line per group.
+class slabinfo_pseudo_t final : public report_pseudo_t
+{
+  protected:
+    u64 capacity() override;
+    void render(report_writer &writer) override;
+};
+} // namespace dev::slabinfo
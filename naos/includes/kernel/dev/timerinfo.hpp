@@ -0,0 +1,13 @@
+#pragma once
+#include "kernel/dev/report.hpp"
+
+namespace dev::timerinfo
+{
+/// Text report of the clock event interrupts and schedules each CPU has taken
+class timerinfo_pseudo_t final : public report_pseudo_t
+{
+  protected:
+    u64 capacity() override;
+    void render(report_writer &writer) override;
+};
+} // namespace dev::timerinfo
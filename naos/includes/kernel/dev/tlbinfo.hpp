@@ -0,0 +1,14 @@
+#pragma once
+#include "kernel/dev/report.hpp"
+
+namespace dev::tlbinfo
+{
+/// Text report of the TLB flushes since boot: full CR3 reloads, pages
+/// invalidated one at a time and switches that kept their PCID's entries.
+class tlbinfo_pseudo_t final : public report_pseudo_t
+{
+  protected:
+    u64 capacity() override;
+    void render(report_writer &writer) override;
+};
+} // namespace dev::tlbinfo
@@ -22,6 +22,11 @@
 #endif
 #define ENOENT -2
 
+#ifdef ESRCH
+#undef ESRCH
+#endif
+#define ESRCH -3
+
 #ifdef ECHILD
 #undef ECHILD
 #endif
@@ -92,6 +97,11 @@
 #endif
 #define ENOTTY -25
 
+#ifdef EDEADLK
+#undef EDEADLK
+#endif
+#define EDEADLK -35
+
 #ifdef EOVERFLOW
 #undef EOVERFLOW
 #endif
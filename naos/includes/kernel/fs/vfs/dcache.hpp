@@ -0,0 +1,58 @@
+#pragma once
+#include "kernel/common.hpp"
+
+namespace fs::vfs
+{
+class dentry;
+
+/// Hash of every named dentry, keyed by its parent and name.
+///
+/// Lookups take no lock. A path walk runs in a walk_scope, and a dentry
+/// unhashed by rmdir or unlink is only freed after synchronize() has waited
+/// for the walks that might still hold it. Moving a dentry to another chain
+/// bumps a sequence count, and a lookup that raced with the move retries.
+/// Changes to the hash are serialized by one lock.
+namespace dcache
+{
+
+u64 hash_name(const char *name);
+
+/// Child \p name of \p parent, or nullptr. Must run in a walk_scope.
+dentry *lookup(const dentry *parent, const char *name);
+
+void insert(dentry *entry);
+void remove(dentry *entry);
+
+/// Wait for every walk_scope entered before the call. Only needed before
+/// freeing a dentry that was_hashed().
+void synchronize();
+
+/// A read section of the hash, it may sleep
+class walk_scope
+{
+  public:
+    walk_scope();
+    ~walk_scope();
+    walk_scope(const walk_scope &) = delete;
+    walk_scope &operator=(const walk_scope &) = delete;
+
+  private:
+    u32 slot;
+    u32 epoch;
+};
+
+/// Renames, mounts and unmounts move their dentries inside a rename_scope
+class rename_scope
+{
+  public:
+    rename_scope();
+    ~rename_scope();
+    rename_scope(const rename_scope &) = delete;
+    rename_scope &operator=(const rename_scope &) = delete;
+
+  private:
+    bool interrupts;
+};
+
+} // namespace dcache
+} // namespace fs::vfs
@@ -3,6 +3,8 @@
 #include "defines.hpp"
 #include "freelibcxx/linked_list.hpp"
 #include "kernel/common.hpp"
+#include "kernel/lock.hpp"
+#include <atomic>
 
 namespace fs::vfs
 {
@@ -14,18 +16,28 @@ class dentry
 
   protected:
     const char *name;
+    u64 name_hash;
     inode *node;
     dentry *parent;
     bool loaded_child;
     bool mount_point;
+    /// Has been in the dcache, so a walk may still hold it until
+    /// dcache::synchronize()
+    bool hashed;
 
     dentry_list_t child_list;
+    lock::spinlock_t child_lock;
 
   public:
+    /// Next dentry in the dcache chain, see dcache.hpp
+    std::atomic<dentry *> hash_next;
+
     dentry();
     virtual ~dentry() = default;
 
-    virtual u64 hash() const;
+    /// Hash of the name, the dcache key together with the parent
+    u64 hash() const { return name_hash; }
+    /// Look the child up in the dcache, the caller holds a dcache::walk_scope
     dentry *find_child(const char *name) const;
     const dentry_list_t &list_children() { return child_list; }
     void set_inode(inode *node);
@@ -37,6 +49,9 @@ class dentry
     void set_name(const char *name);
     const char *get_name() const;
 
+    bool was_hashed() const { return hashed; }
+    void set_hashed() { hashed = true; }
+
     void clean_mount_point() { mount_point = false; }
     void set_mount_point() { mount_point = true; }
     bool is_mount_point() { return mount_point; }
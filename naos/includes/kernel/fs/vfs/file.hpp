@@ -64,6 +64,19 @@ class file : public kobject
     u64 size() const;
     dentry *get_entry() const;
 
+    ///
+    /// \brief take a page reference on the page cache page at \p offset
+    ///
+    /// For mapping the file, the reference is dropped when the page table
+    /// entry is unmapped.
+    /// \param offset page aligned file offset
+    /// \return kernel address of the page, or nullptr if the file is not a
+    /// readable regular file or the page cannot be loaded
+    byte *get_cached_page(u64 offset);
+    /// get_cached_page() without reading the file: nullptr also when the page
+    /// is not cached or the file is busy. For fault-around, which never waits.
+    byte *find_cached_page(u64 offset);
+
     pseudo_t *get_pseudo();
     const pseudo_t *get_pseudo() const;
     flag_t get_mode() const;
@@ -72,6 +85,10 @@ class file : public kobject
 
     static type_e type_of() { return type_e::file; }
 
+  private:
+    i64 cached_read(i64 &offset, byte *ptr, u64 max_size, flag_t flags);
+    i64 cached_write(i64 &offset, const byte *ptr, u64 size, flag_t flags);
+
   protected:
     virtual i64 iread(i64 &offset, byte *ptr, u64 max_size, flag_t flags) = 0;
     virtual i64 iwrite(i64 &offset, const byte *ptr, u64 size, flag_t flags) = 0;
@@ -5,6 +5,7 @@
 namespace fs::vfs
 {
 class pseudo_t;
+class page_cache;
 
 class inode
 {
@@ -26,6 +27,7 @@ class inode
     group_id group;
     u64 permission;
     pseudo_t *pseudo_data;
+    std::atomic<page_cache *> cache;
 
   public:
     inode()
@@ -43,9 +45,10 @@ class inode
         , group(0)
         , permission(permission_flags::all_xwr)
         , pseudo_data(nullptr)
+        , cache(nullptr)
     {
     }
-    virtual ~inode() = default;
+    virtual ~inode();
     // create file in disk
     virtual void create(dentry *entry);
 
@@ -115,5 +118,11 @@ class inode
     void set_pseudo_data(pseudo_t *f) { pseudo_data = f; }
 
     u64 get_permission() const { return permission; }
+
+    /// The cache of a regular file's pages, created on first use. nullptr if
+    /// it cannot be allocated.
+    page_cache *get_page_cache();
+    /// The page cache if one was created, for updating it after a write.
+    page_cache *find_page_cache() const { return cache.load(std::memory_order_acquire); }
 };
 } // namespace fs::vfs
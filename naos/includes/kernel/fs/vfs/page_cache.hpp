@@ -0,0 +1,83 @@
+#pragma once
+#include "freelibcxx/function_ref.hpp"
+#include "freelibcxx/hash_map.hpp"
+#include "kernel/common.hpp"
+#include "kernel/mutex.hpp"
+
+namespace fs::vfs
+{
+
+/// Pages of one inode's contents, indexed by page offset.
+///
+/// Reads and file mappings share the same buddy pages. The cache holds one
+/// reference on each page and every page table entry mapping it holds another,
+/// so a page outlives its cache while a process still maps it. Pages are
+/// released by truncate, when the inode is destroyed, and by reclaim() when
+/// memory runs out.
+class page_cache
+{
+  public:
+    /// Fill \p page with the contents at page \p index. The page is zeroed
+    /// before the call, so a short read leaves zeros behind the data.
+    using fill_page = freelibcxx::function_ref<bool(byte *page, u64 index)>;
+
+    page_cache();
+    ~page_cache();
+    page_cache(const page_cache &) = delete;
+    page_cache &operator=(const page_cache &) = delete;
+
+    ///
+    /// \brief take a page reference for mapping page \p index
+    ///
+    /// The reference is dropped when the page table entry is unmapped.
+    /// \return kernel address of the page, or nullptr if it cannot be loaded
+    byte *get(u64 index, fill_page fill);
+
+    /// get() for a page already cached, nullptr if it is not
+    byte *find(u64 index);
+
+    /// Copy [offset, offset + size) out of the cache, loading missing pages.
+    /// \return bytes copied, short only if a page cannot be loaded
+    u64 read(u64 offset, byte *destination, u64 size, fill_page fill);
+
+    /// Update the pages already cached after a write to the file. Missing
+    /// pages are loaded from the file on their next access.
+    void write(u64 offset, const byte *source, u64 size);
+
+    /// Drop the pages past \p size and clear the tail of the last one.
+    void truncate(u64 size);
+
+    /// Free up to \p pages cached pages that nothing else references, the
+    /// memory::zones reclaim hook. Writes go to the file first, so every
+    /// cached page is clean. Caches busy on their lock are skipped, so it
+    /// never sleeps. Each call visits every cache at most once and scans a
+    /// bounded run of each, resuming where the previous call stopped.
+    /// \return pages freed
+    static u64 reclaim(u64 pages);
+
+  private:
+    /// Page indices scanned by one reclaim_unused() call
+    static constexpr u64 reclaim_scan_pages = 64;
+    /// Pages freed by reclaim whose entries are not erased yet
+    static constexpr u64 max_vacated = 16;
+
+    byte *load(u64 index, fill_page fill);
+    u64 reclaim_unused(u64 pages);
+    void erase_vacated();
+
+    lock::mutex_t lock_;
+    freelibcxx::hash_map<u64, byte *> pages_;
+    /// One past the highest page index cached
+    u64 end_index_;
+    /// Next page index reclaim_unused() looks at
+    u64 reclaim_cursor_;
+    /// Entries emptied by reclaim_unused(), erased by the next holder of the
+    /// lock outside the allocator
+    u64 vacated_[max_vacated];
+    u64 vacated_count_;
+    /// Every cache, for reclaim()
+    page_cache *prev_;
+    page_cache *next_;
+};
+
+} // namespace fs::vfs
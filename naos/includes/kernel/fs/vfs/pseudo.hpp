@@ -3,8 +3,11 @@
 #include "kernel/access_context.hpp"
 #include "freelibcxx/circular_buffer.hpp"
 #include "freelibcxx/function_ref.hpp"
+#include "kernel/arch/mm.hpp"
 #include "kernel/common.hpp"
 #include "kernel/errno.hpp"
+#include "kernel/lock.hpp"
+#include "kernel/util/pipe_ring.hpp"
 namespace dev::tty
 {
 struct termios_t;
@@ -114,6 +117,9 @@ class pseudo_t
         return ENOTTY;
     }
     virtual u32 poll_events() const { return 0; }
+    /// Reads and writes use the file offset. If not, file reads and writes
+    /// do not hold the file across a blocking call.
+    virtual bool seekable() const { return true; }
     virtual bool owned_by_inode() const { return true; }
     virtual bool supports_physical_mmap() const { return false; }
     virtual bool allow_mapping(bool writable, bool shared) const
@@ -157,12 +163,32 @@ class pseudo_t
     virtual ~pseudo_t() {}
 };
 
+/// A pipe, a ring of up to ring_pages pages.
+///
+/// Readers wait on readers and writers on writers. A call wakes the other
+/// side once, before it blocks or returns, and only if it took the ring out
+/// of the state that side waits in.
 class pseudo_pipe_t : public pseudo_t
 {
-    freelibcxx::circular_buffer<byte> buffer;
-    task::wait_queue_t wait_queue;
+  public:
+    static constexpr u32 ring_pages = 16;
+    using ring_t = util::pipe_ring<ring_pages, memory::page_size>;
+    /// Hands out the page reference of the buffer for the bytes from \p done
+    /// on, false when there is nothing more
+    using page_source = freelibcxx::function_ref<bool(u64 done, util::pipe_buffer &buffer)>;
+    /// Takes the bytes of \p buffer, false if they could not be stored
+    using page_sink = freelibcxx::function_ref<bool(const util::pipe_buffer &buffer)>;
+
+  private:
+    lock::spinlock_t lock;
+    ring_t ring;
+    task::wait_queue_t readers;
+    task::wait_queue_t writers;
     std::atomic_bool is_close;
 
+    i64 wait_for(task::wait_queue_t &queue, freelibcxx::function_ref<bool()> ready, flag_t flags,
+                 interruption_check interrupted, wait_queue_registration register_wait_queue);
+
   public:
     i64 write(const byte *data, u64 size, flag_t flags) override;
     i64 read(byte *data, u64 max_size, flag_t flags) override;
@@ -170,12 +196,22 @@ class pseudo_pipe_t : public pseudo_t
                                interruption_check interrupted, wait_queue_registration register_wait_queue) override;
     i64 read_at_interruptible(i64 &offset, byte *data, u64 max_size, flag_t flags,
                               interruption_check interrupted, wait_queue_registration register_wait_queue) override;
+    bool seekable() const override { return false; }
     void close() override;
-    pseudo_pipe_t(u64 size = 512)
-        : buffer(memory::MemoryAllocatorV, size)
-        , is_close(false)
-    {
-    }
+
+    /// Link pages from \p source into the ring without copying, up to
+    /// \p size bytes. \return bytes linked, or a negative errno if none
+    i64 splice_in(u64 size, flag_t flags, page_source source);
+    /// Unlink up to \p size bytes and pass them to \p sink page by page.
+    /// \return bytes taken, or a negative errno if none
+    i64 splice_out(u64 size, flag_t flags, page_sink sink);
+    /// Move up to \p size bytes to \p target by page reference. With
+    /// \p keep, this pipe keeps its data and both share the pages.
+    /// \return bytes moved, or a negative errno if none
+    i64 splice_to(pseudo_pipe_t &target, u64 size, flag_t flags, bool keep);
+
+    pseudo_pipe_t();
+    ~pseudo_pipe_t() override;
 };
 
 } // namespace fs::vfs
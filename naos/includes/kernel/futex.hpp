@@ -0,0 +1,55 @@
+#pragma once
+#include "kernel/common.hpp"
+#include "kernel/time.hpp"
+
+namespace task
+{
+struct thread_t;
+}
+
+/// Futex wait lists.
+///
+/// A futex is keyed by the address space and virtual address of its word,
+/// or, in a shared mapping and without NA_FUTEX_PRIVATE, by the physical
+/// page and offset of the word, which every process mapping that page
+/// agrees on. Waiters hang in a hash of wait lists, and a wake only visits
+/// the waiters of its key. \p shared is false for NA_FUTEX_PRIVATE calls.
+/// Functions return 0 or a count on success, and a negative errno otherwise.
+namespace futex
+{
+struct waiter_t;
+
+/// Time limits are absolute high resolution time, no_deadline waits forever
+constexpr timeclock::microsecond_t no_deadline = 0;
+
+/// Wait while the word at \p address holds \p value, until a wake whose
+/// bitset shares a bit with \p bitset
+int wait(u64 address, bool shared, u32 value, u32 bitset, timeclock::microsecond_t deadline);
+
+/// Wake up to \p count waiters of the word at \p address whose bitset
+/// shares a bit with \p bitset
+int wake(u64 address, bool shared, u32 count, u32 bitset);
+
+/// Wake up to \p wake_count waiters at \p address and move up to
+/// \p requeue_count more to \p target. With \p compare, fail with EAGAIN
+/// unless the word at \p address holds \p value.
+int requeue(u64 address, u64 target, bool shared, u32 wake_count, u32 requeue_count, bool compare, u32 value);
+
+/// Apply the NA_FUTEX_OP \p encoded to the word at \p target, wake up to
+/// \p count waiters at \p address, and up to \p target_count at \p target
+/// if the comparison holds for the old value
+int wake_op(u64 address, u64 target, bool shared, u32 count, u32 target_count, u32 encoded);
+
+/// Take the priority inheritance lock at \p address. Its owner runs at the
+/// nice level of its most important waiter until it unlocks. With \p try_only,
+/// fail with EAGAIN instead of waiting.
+int lock_pi(u64 address, bool try_only, timeclock::microsecond_t deadline);
+
+/// Hand the priority inheritance lock at \p address to its most important
+/// waiter, or free it
+int unlock_pi(u64 address);
+
+/// Drop \p thread from the wait list it hangs in, before it is freed
+void remove(task::thread_t *thread);
+
+} // namespace futex
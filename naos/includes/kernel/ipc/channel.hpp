@@ -3,6 +3,7 @@
 #include "freelibcxx/vector.hpp"
 #include "kernel/capability.hpp"
 #include "kernel/ipc/bounded_queue.hpp"
+#include "kernel/ipc/signal_source.hpp"
 #include "kernel/lock.hpp"
 #include "kernel/mm/new.hpp"
 #include "kernel/resource.hpp"
@@ -15,6 +16,8 @@ namespace naos::ipc
 
 class channel_state;
 
+inline lock::lock_class channel_lock_class("channel");
+
 class channel_message
 {
   public:
@@ -57,6 +60,7 @@ class raw_channel_endpoint : public kobject
     void on_capability_release(capability::location where) override;
     void on_capability_handoff(capability::location from, capability::location to) override;
     na_signal_t capability_signals() const override;
+    signal_source *capability_signal_source() override;
 
     channel_state *state() const { return state_; }
     u8 side() const { return side_; }
@@ -78,6 +82,7 @@ class channel_state
     channel_state &operator=(const channel_state &) = delete;
 
     na_signal_t signals(u8 side) const;
+    signal_source *observers(u8 side) { return side > 1 ? nullptr : &observers_[side]; }
     na_status_t enqueue(u8 sender, channel_message *message, capability::transfer_record_list &records,
                         task::resource_table_t &resources);
     na_status_t enqueue_kernel(u8 sender, channel_message *message, capability::transfer_record_list &records,
@@ -106,6 +111,21 @@ class channel_state
 
     u8 side_for(const raw_channel_endpoint *endpoint) const;
 
+    /// Mark the state reachable in collection \p epoch.
+    /// \return false if it was already marked in this epoch
+    bool mark(u64 epoch)
+    {
+        if (mark_epoch_ == epoch)
+            return false;
+        mark_epoch_ = epoch;
+        return true;
+    }
+    bool marked(u64 epoch) const { return mark_epoch_ == epoch; }
+
+    /// Intrusive registry links, protected by the registry lock.
+    channel_state *registry_prev = nullptr;
+    channel_state *registry_next = nullptr;
+
   private:
     struct queue
     {
@@ -127,16 +147,22 @@ class channel_state
         u64 resources;
     };
 
+    na_signal_t signals_locked(u8 side) const;
+    void owner_released(u8 side);
+
     queue *queues_[2];
+    signal_source observers_[2];
     u64 max_messages_;
     u64 max_bytes_;
     u64 max_resources_;
-    mutable lock::spinlock_t lock_;
+    mutable lock::spinlock_t lock_{channel_lock_class};
     std::atomic_uint64_t owners_[2];
     std::atomic_uint64_t roots_[2];
     std::atomic_uint64_t active_operations_;
     std::atomic_uint64_t active_claims_;
     std::atomic_uint64_t endpoint_objects_;
+    /// Written by the orphan collector and by registration.
+    u64 mark_epoch_;
     bool valid_;
 
   public:
@@ -163,7 +189,14 @@ na_status_t wait_many(task::resource_table_t &resources, na_wait_item_t *items,
 na_status_t wait_for_signal(task::resource_table_t &resources, na_handle_t handle, na_signal_t signals,
                             timeclock::microsecond_t deadline);
 
-void collect_orphaned_channels();
+/// Ask the reclaim worker to look for unreachable channel cycles.
+///
+/// Channel states request this themselves when they lose their last root,
+/// their last endpoint object or their last in-flight operation, so callers
+/// only need it after dropping channel references by other means.
+void request_orphan_collection();
+void init_channel_reclaim_worker();
+/// Wake waiters blocked on objects without their own signal source.
 void notify_channel_waiters();
 
 } // namespace naos::ipc
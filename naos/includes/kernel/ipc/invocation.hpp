@@ -126,6 +126,15 @@ class invocation_state
     void restore_result(freelibcxx::vector<byte> &&bytes, capability::transfer_record_list &&resources);
     na_status_t commit_result();
 
+    /// The caller waits in invoke_call and takes the result itself, with no
+    /// Invocation handle. Set before the request is published.
+    void mark_synchronous() { synchronous_ = true; }
+    bool synchronous() const { return synchronous_; }
+    /// Block until a result or failure is published. Not interruptible, as
+    /// documented for _na_invoke_call: the responder side always publishes one
+    /// when it replies, fails or is closed.
+    void wait_completed();
+
   private:
     void release_result_budget_locked();
     bool publish_locked(na_execution_outcome_t outcome, na_outcome_reason_t reason, freelibcxx::vector<byte> &&bytes,
@@ -146,6 +155,7 @@ class invocation_state
     bool client_closed_;
     bool cancellation_requested_;
     bool result_budget_reserved_;
+    bool synchronous_ = false;
     task::wait_queue_t *execution_wait_queue_ = nullptr;
     na_execution_outcome_t execution_outcome_;
     na_outcome_reason_t outcome_reason_;
@@ -304,10 +314,41 @@ na_status_t receive_protocol(task::resource_table_t &resources, na_handle_t endp
                              na_channel_receive_frame_t *frame);
 na_status_t invocation_cancel(task::resource_table_t &resources, na_handle_t invocation);
 na_status_t invocation_take_result(task::resource_table_t &resources, na_handle_t invocation, na_result_frame_t *frame);
+/// Submit a two-way call, wait for it and take its result, without an
+/// Invocation handle
+na_status_t invoke_call(task::resource_table_t &resources, na_handle_t target, const na_submit_frame_t *submit,
+                        na_result_frame_t *result);
 na_status_t responder_reply(task::resource_table_t &resources, na_handle_t responder, const na_reply_frame_t *frame);
 na_status_t responder_fail(task::resource_table_t &resources, na_handle_t responder, const na_fail_frame_t *frame);
 
 void notify_invocation_waiters();
 void init_kernel_dispatch_worker();
 
+/// Kernel invocation dispatcher counters since boot
+struct dispatch_stats
+{
+    /// Per-CPU dispatch queues
+    u64 cpus;
+    u64 workers;
+    /// Workers waiting for a call
+    u64 idle;
+    /// Workers blocked in a file or process wait
+    u64 blocked;
+    /// Calls started, and those taken from another CPU's queue
+    u64 dispatched;
+    u64 stolen;
+    /// Time calls spent queued before a worker started them
+    u64 total_latency_ns;
+    u64 max_latency_ns;
+};
+
+struct dispatch_queue_stats
+{
+    u64 depth;
+    u64 max_depth;
+};
+
+void get_dispatch_stats(dispatch_stats &stats);
+void get_dispatch_queue_stats(u32 cpu, dispatch_queue_stats &stats);
+
 } // namespace naos::ipc
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "kernel/common.hpp"
+#include "naos/abi.h"
+
+namespace naos::ipc
+{
+
+/// One wait registration on one kernel object.
+///
+/// A waiter embeds one observer per wait item and links it into the list of
+/// the object it waits on, so a signal change only visits the waiters of that
+/// object. The list owner performs all synchronization around these classes.
+struct signal_observer
+{
+    signal_observer *prev = nullptr;
+    signal_observer *next = nullptr;
+    /// Signal bits whose assertion must wake the waiter.
+    na_signal_t signals = 0;
+    /// Last notification round which collected this observer.
+    u64 round = 0;
+    void *waiter = nullptr;
+};
+
+class signal_observer_list
+{
+  public:
+    signal_observer_list() = default;
+    signal_observer_list(const signal_observer_list &) = delete;
+    signal_observer_list &operator=(const signal_observer_list &) = delete;
+
+    void link(signal_observer *observer)
+    {
+        observer->prev = tail_;
+        observer->next = nullptr;
+        observer->round = 0;
+        if (tail_ != nullptr)
+            tail_->next = observer;
+        else
+            head_ = observer;
+        tail_ = observer;
+        count_++;
+    }
+
+    void unlink(signal_observer *observer)
+    {
+        if (observer->prev != nullptr)
+            observer->prev->next = observer->next;
+        else
+            head_ = observer->next;
+        if (observer->next != nullptr)
+            observer->next->prev = observer->prev;
+        else
+            tail_ = observer->prev;
+        observer->prev = nullptr;
+        observer->next = nullptr;
+        count_--;
+    }
+
+    /// Start a notification. Each round collects an observer at most once
+    /// even if the notifier has to drop its lock between batches.
+    u64 next_round()
+    {
+        round_++;
+        if (round_ == 0)
+            round_++;
+        return round_;
+    }
+
+    /// Collect up to \p capacity waiters interested in any of \p raised that
+    /// have not been collected in \p round yet.
+    ///
+    /// \return the number of waiters stored into \p waiters
+    u64 collect(na_signal_t raised, u64 round, void **waiters, u64 capacity)
+    {
+        u64 count = 0;
+        for (auto *observer = head_; observer != nullptr && count < capacity; observer = observer->next)
+        {
+            if ((observer->signals & raised) == 0 || observer->round == round)
+                continue;
+            observer->round = round;
+            waiters[count++] = observer->waiter;
+        }
+        return count;
+    }
+
+    bool empty() const { return head_ == nullptr; }
+    u64 size() const { return count_; }
+
+  private:
+    signal_observer *head_ = nullptr;
+    signal_observer *tail_ = nullptr;
+    u64 count_ = 0;
+    u64 round_ = 0;
+};
+
+} // namespace naos::ipc
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "kernel/clock.hpp"
+#include "kernel/ipc/signal_observer.hpp"
+#include "kernel/lock.hpp"
+#include "kernel/wait.hpp"
+#include <atomic>
+
+namespace naos::ipc
+{
+
+/// The sleeping side of one wait_many/wait_for_signal call.
+///
+/// Lives on the waiting thread's stack. Sources pin it while waking it, and
+/// the destructor waits for those pins, so it must be unregistered from every
+/// source before it goes out of scope.
+class signal_waiter
+{
+  public:
+    signal_waiter();
+    ~signal_waiter();
+
+    signal_waiter(const signal_waiter &) = delete;
+    signal_waiter &operator=(const signal_waiter &) = delete;
+
+    u64 generation() const { return generation_.load(std::memory_order_acquire); }
+    /// Sleep until a source wakes this waiter after \p generation was read.
+    void wait(u64 generation);
+    void wake();
+    /// Deadline timer handler, wakes only this waiter. Arm it with the
+    /// waiter pinned; the handler drops the pin, or the owner does if it
+    /// cancels the timer first.
+    void deadline_expired(timeclock::microsecond_t) noexcept
+    {
+        wake();
+        unpin();
+    }
+
+    void pin() { pins_.fetch_add(1, std::memory_order_relaxed); }
+    void unpin() { pins_.fetch_sub(1, std::memory_order_release); }
+
+  private:
+    task::wait_queue_t queue_;
+    std::atomic_uint64_t generation_;
+    std::atomic_uint64_t pins_;
+};
+
+/// Per-object list of waiters, keyed by the signal bits they wait for.
+class signal_source
+{
+  public:
+    signal_source() = default;
+    signal_source(const signal_source &) = delete;
+    signal_source &operator=(const signal_source &) = delete;
+
+    void observe(signal_observer &observer, signal_waiter &waiter, na_signal_t signals);
+    void forget(signal_observer &observer);
+
+    ///
+    /// \brief wake the waiters interested in newly asserted signals
+    ///
+    /// \param raised signal bits which changed from clear to set
+    /// \return number of waiters woken
+    u64 notify(na_signal_t raised);
+
+  private:
+    lock::spinlock_t lock_;
+    signal_observer_list observers_;
+};
+
+} // namespace naos::ipc
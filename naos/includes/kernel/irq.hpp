@@ -11,8 +11,6 @@ enum hard_vector
     local_apic_timer = 128,
     // sent function to excute on other cpu
     IPI_call = 250,
-    // send task to other cpu
-    IPI_reschedule = 251,
     IPI_tlb = 252,
 };
 } // namespace hard_vector
@@ -8,6 +8,11 @@ namespace capability
 enum class location : u8;
 }
 
+namespace naos::ipc
+{
+class signal_source;
+}
+
 class kobject
 {
   public:
@@ -50,6 +55,9 @@ class kobject
     virtual void on_capability_release(capability::location) {}
     virtual void on_capability_handoff(capability::location, capability::location) {}
     virtual na_signal_t capability_signals() const { return 0; }
+    /// Objects returning a source here must notify it when a signal bit is
+    /// raised. Waiters on other objects are woken by notify_channel_waiters.
+    virtual naos::ipc::signal_source *capability_signal_source() { return nullptr; }
     virtual u64 capability_state() const { return 0; }
 
     template <typename T> T *get()
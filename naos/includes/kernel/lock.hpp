@@ -1,161 +1,157 @@
 #pragma once
 #include "arch/klib.hpp"
 #include "kernel/common.hpp"
+#include "kernel/util/queued_lock.hpp"
 #include <atomic>
 
 /// locks aren't disable interrupt, use it by 'ucontext::guard'
 namespace lock
 {
 constexpr int stack_frame_count = 3;
-///\brief Not nestable, unfair spinlock
+
+/// Contention statistics of every lock of one kind. They are only counted
+/// when the kernel is built with LOCKSTAT, and read by the lockstat_read
+/// syscall.
+struct lock_class
+{
+    const char *name;
+    std::atomic_uint64_t acquisitions{0};
+    std::atomic_uint64_t contended{0};
+    std::atomic_uint64_t total_wait_cycles{0};
+    std::atomic_uint64_t max_wait_cycles{0};
+    /// Classes that took a lock at least once, newest first
+    lock_class *next = nullptr;
+    std::atomic_bool listed{false};
+
+    explicit constexpr lock_class(const char *name)
+        : name(name)
+    {
+    }
+    lock_class(const lock_class &) = delete;
+    lock_class &operator=(const lock_class &) = delete;
+};
+
+/// The class of locks constructed without one
+extern lock_class spinlock_class;
+extern lock_class rw_lock_class;
+
+/// The first class in the list of classes that took a lock
+lock_class *first_class();
+
+#ifdef LOCKSTAT
+void record_acquire(lock_class &cls);
+void record_wait(lock_class &cls, u64 cycles);
+#endif
+
+///\brief Not nestable, fair queued spinlock
 struct spinlock_t
 {
   private:
-    std::atomic_bool lock_m;
+    util::queued_spinlock lock_m;
+#ifdef LOCKSTAT
+    lock_class *class_m;
+#endif
 #ifdef _DEBUG
     stack_frame_t frames[stack_frame_count];
-    std::atomic_uint64_t wait_times;
     u64 tid = 0;
     u64 pid = 0;
 #endif
+
+    void lock_slow();
+
   public:
     spinlock_t()
-        : lock_m(false)
+        : spinlock_t(spinlock_class)
+    {
+    }
+    explicit spinlock_t(lock_class &cls)
+#ifdef LOCKSTAT
+        : class_m(&cls)
+#endif
     {
+        (void)cls;
     }
     spinlock_t(const spinlock_t &) = delete;
     spinlock_t &operator=(const spinlock_t &) = delete;
     void lock()
     {
-        bool target = false;
-        do
-        {
-            cpu_pause();
-            target = false;
-#ifdef _DEBUG
-            wait_times++;
+        if (unlikely(!lock_m.try_lock()))
+            lock_slow();
+#ifdef LOCKSTAT
+        record_acquire(*class_m);
 #endif
-        } while (!lock_m.compare_exchange_strong(target, true));
 #ifdef _DEBUG
         // get_stackframes(2, frames, stack_frame_count);
         get_task_id(pid, tid);
-        wait_times = 0;
 #endif
     }
 
-    bool try_lock()
-    {
-        bool target = false;
-        return lock_m.compare_exchange_strong(target, true);
-    }
+    bool try_lock() { return lock_m.try_lock(); }
 
-    void unlock() { lock_m.store(false); }
+    void unlock() { lock_m.unlock(); }
 };
 
-/// read write lock
+/// read write lock, writers waiting keep new readers out
 struct rw_lock_t
 {
   private:
-    std::atomic_uint64_t lock_m = ATOMIC_FLAG_INIT;
-    static_assert(sizeof(lock_m) == 8);
+    util::queued_rwlock lock_m;
+#ifdef LOCKSTAT
+    lock_class *class_m;
+#endif
 #ifdef _DEBUG
     stack_frame_t frames[stack_frame_count];
-    std::atomic_uint64_t wait_times;
     u64 tid = 0;
     u64 pid = 0;
 #endif
 
+    void lock_read_slow();
+    void lock_write_slow();
+
   public:
-    rw_lock_t() = default;
+    rw_lock_t()
+        : rw_lock_t(rw_lock_class)
+    {
+    }
+    explicit rw_lock_t(lock_class &cls)
+#ifdef LOCKSTAT
+        : class_m(&cls)
+#endif
+    {
+        (void)cls;
+    }
     rw_lock_t(const rw_lock_t &) = delete;
     rw_lock_t &operator=(const rw_lock_t &) = delete;
 
     void lock_read()
     {
-        u64 exp;
-        do
-        {
-            // while (lock_m == 0x8000000000000000UL)
-            cpu_pause();
-#ifdef _DEBUG
-            wait_times++;
-#endif
-
-            exp = lock_m & 0x7FFFFFFFFFFFFFFFUL;
-        } while (!lock_m.compare_exchange_strong(exp, exp + 1));
-#ifdef _DEBUG
-        // get_stackframes(2, frames, stack_frame_count);
-        get_task_id(pid, tid);
-        wait_times = 0;
+        if (unlikely(!lock_m.lock_read_fast()))
+            lock_read_slow();
+#ifdef LOCKSTAT
+        record_acquire(*class_m);
 #endif
     }
 
     void lock_write()
     {
-        u64 exp;
-        do
-        {
-            // while (lock_m != 0)
-            cpu_pause();
-#ifdef _DEBUG
-            wait_times++;
+        if (unlikely(!lock_m.try_lock_write()))
+            lock_write_slow();
+#ifdef LOCKSTAT
+        record_acquire(*class_m);
 #endif
-            exp = 0;
-        } while (!lock_m.compare_exchange_strong(exp, 0x8000000000000000UL));
 #ifdef _DEBUG
         // get_stackframes(2, frames, stack_frame_count);
         get_task_id(pid, tid);
-        wait_times = 0;
 #endif
     }
 
-    bool try_lock_read()
-    {
-        u64 val = lock_m.load(std::memory_order_acquire);
-        if (val == 0x8000000000000000UL)
-            return false;
-        u64 exp = val & 0x7FFFFFFFFFFFFFFFUL;
-        return lock_m.compare_exchange_strong(exp, exp + 1);
-    }
+    bool try_lock_read() { return lock_m.try_lock_read(); }
 
-    bool try_lock_write()
-    {
-        u64 exp;
-        if (lock_m.load(std::memory_order_acquire) != 0)
-            return false;
-        exp = 0;
-        return lock_m.compare_exchange_strong(exp, 0x8000000000000000UL);
-    }
+    bool try_lock_write() { return lock_m.try_lock_write(); }
 
-    void unlock_read()
-    {
-        u64 exp;
-        do
-        {
-#ifdef _DEBUG
-            if (lock_m & 0x8000000000000000UL)
-            {
-                /// TODO: state is invalid.
-            }
-#endif
-            exp = lock_m.load(std::memory_order_acquire) & 0x7FFFFFFFFFFFFFFFUL;
-        } while (!lock_m.compare_exchange_strong(exp, exp - 1));
-    }
+    void unlock_read() { lock_m.unlock_read(); }
 
-    void unlock_write()
-    {
-        u64 exp;
-        do
-        {
-#ifdef _DEBUG
-            if (lock_m == 0)
-            {
-                /// TODO: state is invalid.
-            }
-#endif
-            exp = 0x8000000000000000UL;
-        } while (!lock_m.compare_exchange_strong(exp, 0));
-    }
+    void unlock_write() { lock_m.unlock_write(); }
 };
 
 } // namespace lock
@@ -0,0 +1,38 @@
+#pragma once
+#include "kernel/common.hpp"
+
+/// 2 MiB pages mapped by a single page directory entry.
+namespace memory::big_page
+{
+constexpr u64 size = 0x200000;
+constexpr u64 pages = size / 0x1000;
+
+constexpr u64 align_down(u64 address) { return address & ~(size - 1); }
+constexpr u64 align_up(u64 address) { return (address + size - 1) & ~(size - 1); }
+
+/// \return true if the big page holding \p address lies wholly inside
+/// [start, end)
+constexpr bool fits(u64 start, u64 end, u64 address)
+{
+    u64 base = align_down(address);
+    return base >= start && base < end && end - base >= size;
+}
+
+/// The big pages inside [start, end), as [first, last). Empty when first ==
+/// last.
+struct span
+{
+    u64 first;
+    u64 last;
+};
+
+constexpr span inner(u64 start, u64 end)
+{
+    u64 first = align_up(start);
+    u64 last = align_down(end);
+    if (first < start || first >= last)
+        return {start, start};
+    return {first, last};
+}
+
+} // namespace memory::big_page
@@ -0,0 +1,78 @@
+#pragma once
+#include "kernel/common.hpp"
+#include "kernel/mm/page.hpp"
+
+namespace memory
+{
+
+/// Free buddy blocks of one order, linked through their head page.
+/// The owner synchronizes access.
+class page_list
+{
+  public:
+    void push(page *p)
+    {
+        p->set_free_next(head_);
+        head_ = p;
+        count_++;
+    }
+
+    page *pop()
+    {
+        page *p = head_;
+        if (p != nullptr)
+        {
+            head_ = p->get_free_next();
+            p->set_free_next(nullptr);
+            count_--;
+        }
+        return p;
+    }
+
+    u64 size() const { return count_; }
+
+  private:
+    page *head_ = nullptr;
+    u64 count_ = 0;
+};
+
+/// One CPU's free block cache in front of a zone's buddy allocator.
+///
+/// Only that CPU touches it, with interrupts disabled. Lists are refilled from
+/// and drained to the buddy allocator batch(order) blocks at a time, so one
+/// zone lock round trip covers many single-block allocations or frees.
+struct cpu_pages
+{
+    /// Cached orders: blocks of 1, 2, 4 and 8 pages.
+    static constexpr int orders = 4;
+
+    /// A list above high(order) blocks gives batch(order) of them back.
+    static constexpr u64 high(int order) { return 64 >> order; }
+    static constexpr u64 batch(int order) { return 16 >> order; }
+
+    page_list lists[orders];
+
+    u64 cached_pages() const
+    {
+        u64 pages = 0;
+        for (int order = 0; order < orders; order++)
+            pages += lists[order].size() << order;
+        return pages;
+    }
+};
+static_assert(sizeof(cpu_pages) == 64);
+
+/// \return the buddy order of a block holding \p pages pages
+constexpr int page_order(u64 pages)
+{
+    int order = 0;
+    while ((1UL << order) < pages)
+        order++;
+    return order;
+}
+
+static_assert(page_order(1) == 0);
+static_assert(page_order(3) == 2);
+static_assert(page_order(8) == 3);
+
+} // namespace memory
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "freelibcxx/vector.hpp"
+#include "kernel/ipc/signal_source.hpp"
 #include "kernel/kobject.hpp"
 #include "kernel/lock.hpp"
 #include "kernel/mm/new.hpp"
@@ -9,11 +10,18 @@
 namespace naos::data_plane
 {
 
+/// Memory shared between processes.
+///
+/// The contents live in buddy pages owned by the object. Shared mappings map
+/// those pages directly, each mapped page table entry holding one page
+/// reference, so the pages outlive the object while any process maps them.
 class memory_object final : public kobject
 {
   public:
     memory_object(u64 size, u32 flags);
-    ~memory_object() override = default;
+    ~memory_object() override;
+    memory_object(const memory_object &) = delete;
+    memory_object &operator=(const memory_object &) = delete;
 
     static type_e type_of() { return type_e::memory_object; }
 
@@ -22,12 +30,31 @@ class memory_object final : public kobject
     na_status_t read(u64 offset, byte *destination, u64 size, u64 &actual) const;
     na_status_t write(u64 offset, const byte *source, u64 size, u64 &actual);
 
-    u64 size() const;
+    u64 size() const { return size_; }
     u32 flags() const { return flags_; }
+    /// Kernel address of \p offset, valid up to the end of its page.
+    byte *data_at(u64 offset) const;
+    ipc::signal_source *capability_signal_source() override { return &observers_; }
+
+    ///
+    /// \brief take a page reference for mapping the page holding \p offset
+    ///
+    /// The reference is dropped when the page table entry is unmapped.
+    /// \return physical address of the page, or nullptr if \p offset is out of range
+    phy_addr_t share_page(u64 offset);
+    /// Kernel address of the page holding \p offset with a page reference
+    /// taken for the caller, or nullptr if \p offset is out of range
+    byte *reference_page(u64 offset);
 
   private:
-    mutable lock::spinlock_t lock_;
-    freelibcxx::vector<byte> bytes_;
+    void release_pages();
+
+    ipc::signal_source observers_;
+    /// Kernel virtual addresses of the backing pages. Fixed at construction,
+    /// so readers and writers need no lock.
+    byte **pages_;
+    u64 page_count_;
+    u64 size_;
     u32 flags_;
 };
 
@@ -40,11 +67,20 @@ class shared_ring final : public kobject
     static type_e type_of() { return type_e::shared_ring; }
 
     bool valid() const { return valid_; }
-    u64 slots() const { return slots_.size(); }
+    /// Whether the ring lives in memory mapped by both ends (NA_RING_FLAG_MAPPED).
+    bool mapped() const { return header_ != nullptr; }
+    u64 slots() const { return slot_count_; }
     u64 slot_bytes() const { return slot_bytes_; }
     u64 queued() const;
     na_signal_t capability_signals() const override;
+    ipc::signal_source *capability_signal_source() override { return &observers_; }
 
+    /// The pages holding a mapped ring, for memory_map.
+    const khandle &mapping() const { return mapping_; }
+    /// Wake the waiters of a mapped ring whose peer moved an index.
+    na_status_t notify_mapped();
+
+    /// Copy protocol, only for rings without NA_RING_FLAG_MAPPED.
     na_status_t push(freelibcxx::vector<byte> &&bytes);
     na_status_t claim_pop(freelibcxx::vector<byte> &snapshot);
     void cancel_pop();
@@ -61,8 +97,16 @@ class shared_ring final : public kobject
         freelibcxx::vector<byte> bytes;
     };
 
+    na_signal_t signals_locked() const;
+    u64 mapped_queued() const;
+
     mutable lock::spinlock_t lock_;
+    ipc::signal_source observers_;
     freelibcxx::vector<slot> slots_;
+    /// Mapped mode: the memory_object holding the header and slots.
+    khandle mapping_;
+    na_shared_ring_header_t *header_;
+    u64 slot_count_;
     u64 slot_bytes_;
     u64 head_;
     u64 tail_;
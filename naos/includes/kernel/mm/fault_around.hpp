@@ -0,0 +1,31 @@
+#pragma once
+#include "kernel/common.hpp"
+
+namespace memory::vm
+{
+/// Pages one fault maps in file, memory object and physical mappings, so a
+/// sequential scan faults once per window instead of once per page.
+constexpr u64 fault_around_pages = 16;
+
+/// Page addresses [first, last)
+struct page_window
+{
+    u64 first;
+    u64 last;
+};
+
+/// The window of fault_around_pages pages holding \p page, aligned to its own
+/// size and clipped to [start, end). \p page lies in [start, end).
+constexpr page_window fault_around(u64 start, u64 end, u64 page, u64 page_size = 0x1000)
+{
+    u64 bytes = fault_around_pages * page_size;
+    u64 first = page & ~(bytes - 1);
+    u64 last = first + bytes;
+    if (first < start)
+        first = start;
+    if (last > end || last < first)
+        last = end;
+    return {first, last};
+}
+
+} // namespace memory::vm
@@ -0,0 +1,69 @@
+#pragma once
+#include "kernel/common.hpp"
+
+namespace memory::tlb
+{
+/// Ranges one batch keeps before it flushes the whole address space instead
+constexpr u32 max_flush_ranges = 8;
+
+/// Page ranges to invalidate, gathered over one unmap or protection change.
+/// Adjacent and overlapping ranges are merged.
+class flush_ranges
+{
+  public:
+    struct range
+    {
+        u64 start;
+        u64 pages;
+    };
+
+    /// \param start page aligned address
+    void add(u64 start, u64 pages, u64 page_size = 0x1000)
+    {
+        if (full_ || pages == 0)
+        {
+            return;
+        }
+        u64 end = start + pages * page_size;
+        for (u32 i = 0; i < count_; i++)
+        {
+            auto &r = ranges_[i];
+            u64 r_end = r.start + r.pages * page_size;
+            if (start <= r_end && end >= r.start)
+            {
+                u64 first = start < r.start ? start : r.start;
+                u64 last = end > r_end ? end : r_end;
+                r.start = first;
+                r.pages = (last - first) / page_size;
+                return;
+            }
+        }
+        if (count_ == max_flush_ranges)
+        {
+            full_ = true;
+            return;
+        }
+        ranges_[count_++] = {start, pages};
+    }
+
+    /// Flush the whole address space
+    void add_all() { full_ = true; }
+
+    void clear()
+    {
+        count_ = 0;
+        full_ = false;
+    }
+
+    bool empty() const { return count_ == 0 && !full_; }
+    bool full() const { return full_; }
+    u32 count() const { return count_; }
+    const range &at(u32 index) const { return ranges_[index]; }
+
+  private:
+    range ranges_[max_flush_ranges];
+    u32 count_ = 0;
+    bool full_ = false;
+};
+
+} // namespace memory::tlb
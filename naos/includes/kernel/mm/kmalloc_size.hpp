@@ -0,0 +1,59 @@
+#pragma once
+#include "kernel/common.hpp"
+
+/// kmalloc size classes and their constant-time lookup.
+namespace memory::kmalloc_size
+{
+
+constexpr u64 sizes[] = {8,   16,  24,  32,  40,  48,   56,   64,   80,   96,   112,  128,  160, 192,
+                         256, 384, 448, 512, 768, 960, 1024, 1536, 2048, 3072, 4096, 6144, 8192};
+constexpr u64 class_count = sizeof(sizes) / sizeof(sizes[0]);
+constexpr u64 max_size = sizes[class_count - 1];
+
+/// Classes up to small_limit are looked up in 8-byte steps, the rest in
+/// 512-byte steps. Every class size is a multiple of its step.
+constexpr u64 small_limit = 1024;
+constexpr u64 small_step = 8;
+constexpr u64 large_step = 512;
+
+struct lookup_table
+{
+    u8 small[small_limit / small_step + 1];
+    u8 large[max_size / large_step + 1];
+};
+
+constexpr u8 first_fit(u64 size)
+{
+    u8 index = 0;
+    while (sizes[index] < size)
+        index++;
+    return index;
+}
+
+constexpr lookup_table build_table()
+{
+    lookup_table table{};
+    for (u64 i = 0; i <= small_limit / small_step; i++)
+        table.small[i] = first_fit(i * small_step);
+    for (u64 i = 0; i <= max_size / large_step; i++)
+        table.large[i] = first_fit(i * large_step);
+    return table;
+}
+
+inline constexpr lookup_table table = build_table();
+
+/// \return index into sizes of the smallest class holding \p size, which
+/// must not exceed max_size
+constexpr u64 class_of(u64 size)
+{
+    if (size <= small_limit)
+        return table.small[(size + small_step - 1) / small_step];
+    return table.large[(size + large_step - 1) / large_step];
+}
+
+static_assert(class_of(0) == 0);
+static_assert(sizes[class_of(1)] == 8);
+static_assert(sizes[class_of(1025)] == 1536);
+static_assert(sizes[class_of(max_size)] == max_size);
+
+} // namespace memory::kmalloc_size
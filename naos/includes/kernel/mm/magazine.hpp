@@ -0,0 +1,120 @@
+#pragma once
+#include "kernel/common.hpp"
+
+namespace memory
+{
+
+/// A stack of free objects cached in front of a slab_group.
+///
+/// Sized so that a page holds a whole number of magazines.
+struct magazine
+{
+    static constexpr u64 capacity = 30;
+
+    magazine *next = nullptr;
+    u64 rounds = 0;
+    void *objects[capacity];
+
+    bool empty() const { return rounds == 0; }
+    bool full() const { return rounds == capacity; }
+};
+static_assert(sizeof(magazine) == 256);
+
+/// Singly linked magazine stack. The owner synchronizes access.
+class magazine_list
+{
+  public:
+    void push(magazine *m)
+    {
+        m->next = head_;
+        head_ = m;
+        count_++;
+    }
+
+    magazine *pop()
+    {
+        magazine *m = head_;
+        if (m != nullptr)
+        {
+            head_ = m->next;
+            m->next = nullptr;
+            count_--;
+        }
+        return m;
+    }
+
+    u64 size() const { return count_; }
+
+  private:
+    magazine *head_ = nullptr;
+    u64 count_ = 0;
+};
+
+/// The loaded and previous magazines of one CPU (Bonwick, "Magazines and
+/// Vmem", 2001). Only that CPU touches it, with interrupts disabled, so the
+/// fast paths below take no lock.
+struct magazine_pair
+{
+    magazine *loaded = nullptr;
+    magazine *previous = nullptr;
+
+    /// \return a cached object, or nullptr when both magazines are empty
+    void *pop()
+    {
+        if (loaded == nullptr)
+            return nullptr;
+        if (loaded->empty())
+        {
+            if (previous == nullptr || previous->empty())
+                return nullptr;
+            swap();
+        }
+        return loaded->objects[--loaded->rounds];
+    }
+
+    /// \return false when both magazines are full or missing
+    bool push(void *object)
+    {
+        if (loaded == nullptr)
+            return false;
+        if (loaded->full())
+        {
+            if (previous == nullptr || !previous->empty())
+                return false;
+            swap();
+        }
+        loaded->objects[loaded->rounds++] = object;
+        return true;
+    }
+
+    /// Give a full magazine to this CPU after pop() failed.
+    ///
+    /// \return the empty magazine it replaces, for the depot's empty list
+    magazine *exchange_for_full(magazine *full)
+    {
+        magazine *spare = previous;
+        previous = loaded;
+        loaded = full;
+        return spare;
+    }
+
+    /// Give an empty magazine to this CPU after push() failed.
+    ///
+    /// \return the full magazine it replaces, or nullptr if the CPU had none
+    magazine *exchange_for_empty(magazine *empty)
+    {
+        magazine *spare = previous;
+        previous = loaded;
+        loaded = empty;
+        return spare;
+    }
+
+    void swap()
+    {
+        magazine *m = loaded;
+        loaded = previous;
+        previous = m;
+    }
+};
+
+} // namespace memory
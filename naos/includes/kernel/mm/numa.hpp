@@ -0,0 +1,52 @@
+#pragma once
+#include "kernel/arch/cpu.hpp"
+#include "kernel/common.hpp"
+#include "numa_topology.hpp"
+
+/// NUMA nodes from the ACPI SRAT and SLIT. Without ACPI, or without an SRAT,
+/// everything is node 0.
+namespace memory::numa
+{
+
+/// Tag zones with their node and learn which APIC ids belong to which node.
+/// Runs once on the BSP, after ACPI and all memory zones are initialized.
+void init();
+
+/// Record the node of \p cpu. Each CPU calls this once its APIC id is known.
+void bind_cpu(arch::cpu::cpuid_t cpu, u32 apic_id);
+
+u32 node_count();
+u8 cpu_node(arch::cpu::cpuid_t cpu);
+
+/// \return the node all CPUs in \p cpu_mask belong to, or no_node if they
+/// span several nodes
+u8 node_of_cpu_mask(u64 cpu_mask);
+
+/// The node the calling thread should allocate from: the node its CPU
+/// affinity confines it to, else the node of the CPU it runs on.
+u8 preferred_node();
+
+/// Zone indices in the order allocations preferring \p node try them.
+///
+/// \param count set to the number of indices
+const u8 *zone_order(u8 node, int &count);
+
+/// Count blocks allocated from or freed to \p node by the calling CPU.
+void count_alloc(u8 node, u64 blocks = 1);
+void count_free(u8 node);
+
+struct node_stats
+{
+    u32 domain;
+    u64 cpu_mask;
+    u64 total_pages;
+    u64 free_pages;
+    /// blocks allocated from this node, by CPUs on it and by other CPUs
+    u64 local_allocs;
+    u64 remote_allocs;
+    u64 frees;
+};
+
+void get_stats(u8 node, node_stats &stats);
+
+} // namespace memory::numa
@@ -0,0 +1,103 @@
+#pragma once
+#include "kernel/common.hpp"
+
+namespace memory::numa
+{
+constexpr u32 max_nodes = 8;
+constexpr u8 no_node = 0xFF;
+
+/// ACPI proximity domains compacted into node indices, and for each node the
+/// order in which allocations fall back to the other nodes.
+///
+/// Domains are sparse 32-bit numbers; nodes are dense and follow ascending
+/// domain order, so node 0 is the lowest domain.
+class topology
+{
+  public:
+    topology() { reset_fallback(); }
+
+    /// \return false when max_nodes other domains are already known
+    bool add_domain(u32 domain)
+    {
+        u32 i = 0;
+        while (i < count_ && domains_[i] < domain)
+            i++;
+        if (i < count_ && domains_[i] == domain)
+            return true;
+        if (count_ == max_nodes)
+            return false;
+        for (u32 j = count_; j > i; j--)
+            domains_[j] = domains_[j - 1];
+        domains_[i] = domain;
+        count_++;
+        reset_fallback();
+        return true;
+    }
+
+    /// \return the node of \p domain, or no_node if it was never added
+    u8 node_of(u32 domain) const
+    {
+        for (u32 i = 0; i < count_; i++)
+        {
+            if (domains_[i] == domain)
+                return static_cast<u8>(i);
+        }
+        return no_node;
+    }
+
+    u32 domain_of(u8 node) const { return domains_[node]; }
+
+    /// At least one node exists, even without any domain.
+    u32 node_count() const { return count_ == 0 ? 1 : count_; }
+
+    /// Order each node's fallback list by \p distance(from_domain, to_domain),
+    /// nearest first and ties by node index. A node is always first in its
+    /// own list.
+    template <typename Distance> void build_fallback(Distance distance)
+    {
+        for (u32 from = 0; from < node_count(); from++)
+        {
+            u8 *order = fallback_[from];
+            order[0] = static_cast<u8>(from);
+            u32 size = 1;
+            for (u32 to = 0; to < node_count(); to++)
+            {
+                if (to == from)
+                    continue;
+                u32 d = distance(domains_[from], domains_[to]);
+                u32 i = size;
+                while (i > 1 && distance(domains_[from], domains_[order[i - 1]]) > d)
+                {
+                    order[i] = order[i - 1];
+                    i--;
+                }
+                order[i] = static_cast<u8>(to);
+                size++;
+            }
+        }
+    }
+
+    /// \return node_count() nodes, \p node first
+    const u8 *fallback(u8 node) const { return fallback_[node]; }
+
+  private:
+    void reset_fallback()
+    {
+        for (u32 from = 0; from < max_nodes; from++)
+        {
+            fallback_[from][0] = static_cast<u8>(from);
+            u32 size = 1;
+            for (u32 to = 0; to < max_nodes; to++)
+            {
+                if (to != from)
+                    fallback_[from][size++] = static_cast<u8>(to);
+            }
+        }
+    }
+
+    u32 domains_[max_nodes] = {};
+    u32 count_ = 0;
+    u8 fallback_[max_nodes][max_nodes];
+};
+
+} // namespace memory::numa
@@ -0,0 +1,22 @@
+#pragma once
+#include "kernel/common.hpp"
+#include "naos/abi.h"
+
+/// The bytes of a memory object a mapping covers.
+namespace memory::object_window
+{
+constexpr u64 page_size = 0x1000;
+
+/// Check a mapping of [offset, offset + length) of an object \p size bytes
+/// long. The mapping maps the object's own pages, so \p offset must be page
+/// aligned.
+constexpr na_status_t check(u64 offset, u64 length, u64 size)
+{
+    if ((offset & (page_size - 1)) != 0)
+        return NA_STATUS_INVALID_ARGUMENT;
+    if (offset > size || length > size - offset)
+        return NA_STATUS_INVALID_ARGUMENT;
+    return NA_STATUS_OK;
+}
+
+} // namespace memory::object_window
@@ -43,10 +43,13 @@ class page
     void remove_flags(u32 flags) { flags_ &= ~flags; }
     bool has_flags(u32 flags) { return flags_ & flags; }
 
-    u32 get_ref_count() const { return ref_count_; }
-    void clear_ref_count() { ref_count_ = 0; }
-    void add_ref_count() { ref_count_++; }
-    void remove_ref_count() { ref_count_--; }
+    // Reference counts change without the zone lock, so they are atomic.
+    u32 get_ref_count() const { return __atomic_load_n(&ref_count_, __ATOMIC_ACQUIRE); }
+    void clear_ref_count() { __atomic_store_n(&ref_count_, 0, __ATOMIC_RELEASE); }
+    void set_ref_count(u32 count) { __atomic_store_n(&ref_count_, count, __ATOMIC_RELEASE); }
+    void add_ref_count() { __atomic_add_fetch(&ref_count_, 1, __ATOMIC_RELAXED); }
+    /// \return the remaining count
+    u32 remove_ref_count() { return __atomic_sub_fetch(&ref_count_, 1, __ATOMIC_ACQ_REL); }
 
     void set_buddy_order(int order) { buddy_order = order; }
     int get_buddy_order() const { return buddy_order; }
@@ -57,6 +60,10 @@ class page
     u16 page_table_counter() const { return page_table_next_entries_; }
     void set_page_table_counter(u16 c) { page_table_next_entries_ = c; }
 
+    /// Link of a free block on a per-CPU page_list
+    void set_free_next(page *next) { free_next_ = next; }
+    page *get_free_next() const { return free_next_; }
+
   private:
     u32 flags_;
     u32 ref_count_;
@@ -72,7 +79,11 @@ class page
     };
 
     u8 buddy_order;
-    void *mapping_;
+    union
+    {
+        void *mapping_;
+        page *free_next_;
+    };
 };
 
 void init_pages();
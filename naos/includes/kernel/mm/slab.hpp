@@ -1,11 +1,15 @@
 #pragma once
 #include "../lock.hpp"
 #include "freelibcxx/bit_set.hpp"
+#include "freelibcxx/function_ref.hpp"
 #include "freelibcxx/hash_map.hpp"
 #include "freelibcxx/linked_list.hpp"
 #include "freelibcxx/string.hpp"
+#include "kernel/arch/cpu.hpp"
 #include "kernel/common.hpp"
 #include "list_node_cache.hpp"
+#include "magazine.hpp"
+#include "slab_color.hpp"
 
 #define NewSlabGroup(domain, struct, align, flags)                                                                     \
     domain->create_new_slab_group(sizeof(struct), freelibcxx::string(memory::KernelCommonAllocatorV, #struct), align,  \
@@ -36,27 +40,94 @@ struct slab
         , next(nullptr) {};
 };
 
+/// A snapshot of one slab_group's counters. Counts of calls are cumulative;
+/// readers get rates from the difference of two snapshots.
+struct slab_group_stats
+{
+    u64 object_size;
+    u64 object_stride;
+    u64 objects;
+    /// includes objects cached in magazines
+    u64 objects_used;
+    u64 slabs;
+    u64 pages;
+    u32 objects_per_slab;
+    u32 pages_per_slab;
+    u64 colors;
+    /// alloc() and free() calls
+    u64 allocs;
+    u64 frees;
+    /// calls that reached the slab layer, i.e. magazine misses
+    u64 slab_allocs;
+    u64 slab_frees;
+    /// objects held in the depot's full magazines
+    u64 depot_objects;
+};
+
+inline lock::lock_class slab_depot_lock_class("slab_depot");
+inline lock::lock_class slab_lock_class("slab");
+inline lock::lock_class slab_pool_lock_class("slab_pool");
+
 /// A same slab list set
+///
+/// alloc() and free() go through a per-CPU magazine_pair first and only take
+/// the depot or slab locks when the local magazines run empty or full.
 class slab_group
 {
   private:
-    lock::rw_lock_t slab_lock;
+    /// One CPU's magazines and call counters, padded so two CPUs never
+    /// share a cache line.
+    struct cpu_cache
+    {
+        magazine_pair pair;
+        u64 allocs;
+        u64 frees;
+        u64 padding[4];
+    };
+    static_assert(sizeof(cpu_cache) == 64);
+
+    /// Full magazines the depot keeps before returning rounds to the slabs.
+    static constexpr u64 depot_full_limit = 8;
+
+    cpu_cache cpu_caches[arch::cpu::max_cpu_support];
+    lock::spinlock_t depot_lock{slab_depot_lock_class};
+    magazine_list depot_full;
+    magazine_list depot_empty;
+
+    lock::rw_lock_t slab_lock{slab_lock_class};
     const u64 obj_align_size;
     const u64 size;
     freelibcxx::string name;
-    u32 color_offset;
+    slab_color color;
     u64 flags;
     u64 align;
     u32 node_pre_slab;
     u32 page_pre_slab;
     u64 all_obj_count;
     u64 all_obj_used;
+    u64 slab_count;
+    u64 slab_allocs;
+    u64 slab_frees;
     slab *free_head, *used_head;
 
+    /// Every constructed group, for statistics. Groups are never destroyed.
+    slab_group *next_group;
+    static slab_group *group_list;
+    static lock::spinlock_t group_list_lock;
+
   private:
     slab *new_memory_node();
     void delete_memory_node(slab *s);
 
+    void *slab_alloc();
+    void slab_free(void *ptr);
+
+    magazine *depot_take_full();
+    magazine *depot_take_empty();
+    void depot_put_full(magazine *m);
+    void depot_put_empty(magazine *m);
+    void drain(magazine *m);
+
   public:
     slab_group(u64 size, const char *name, u64 align, u64 flags);
 
@@ -64,15 +135,24 @@ class slab_group
     u64 get_size() const { return size; }
     void *alloc();
     void free(void *ptr);
+    /// Return the rounds of the depot's full magazines to the slabs.
+    /// Objects cached in per-CPU magazines stay where they are.
+    ///
+    /// \return number of objects returned
     int shrink();
+    void get_stats(slab_group_stats &stats);
     static slab_group *get_group_from(void *ptr);
+
+    /// Call \p fn for every group until it returns false. The group list is
+    /// locked meanwhile, so \p fn must not create a slab_group.
+    static void for_each(freelibcxx::function_ref<bool(slab_group &)> fn);
 };
 
 /// The slab_group collection of the specified domain
 struct slab_cache_pool
 {
   private:
-    lock::rw_lock_t group_lock;
+    lock::rw_lock_t group_lock{slab_pool_lock_class};
     freelibcxx::hash_map<freelibcxx::string, slab_group *> map;
 
   public:
@@ -0,0 +1,44 @@
+#pragma once
+#include "kernel/common.hpp"
+
+namespace memory
+{
+
+/// Rotating cache colors of a slab_group.
+///
+/// A slab rarely fills its pages exactly. Shifting the first object of each
+/// new slab by one more cache line of that slack makes objects at the same
+/// index in different slabs map to different cache sets (Bonwick, "The Slab
+/// Allocator", 1994).
+class slab_color
+{
+  public:
+    static constexpr u64 cache_line_size = 64;
+
+    slab_color() = default;
+
+    /// \param slack bytes left over after the header and objects of a slab
+    /// \param align object alignment, a power of two
+    slab_color(u64 slack, u64 align)
+        : step_(align > cache_line_size ? align : cache_line_size)
+        , count_(slack / step_ + 1)
+    {
+    }
+
+    /// \return the byte offset for the next slab
+    u32 take()
+    {
+        u32 offset = static_cast<u32>(next_ * step_);
+        next_ = next_ + 1 == count_ ? 0 : next_ + 1;
+        return offset;
+    }
+
+    u64 count() const { return count_; }
+
+  private:
+    u64 step_ = cache_line_size;
+    u64 count_ = 1;
+    u64 next_ = 0;
+};
+
+} // namespace memory
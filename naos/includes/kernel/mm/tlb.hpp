@@ -0,0 +1,52 @@
+#pragma once
+#include "freelibcxx/vector.hpp"
+#include "kernel/arch/paging.hpp"
+#include "kernel/common.hpp"
+#include "kernel/mm/flush_ranges.hpp"
+
+namespace memory::tlb
+{
+
+/// TLB shootdown of one page table.
+///
+/// Gathers the ranges an unmap or protection change touched, then drops their
+/// TLB entries on this CPU and sends one call to every other CPU which has the
+/// page table loaded. Pages unmapped through the batch are freed only after
+/// every CPU dropped its entries.
+///
+/// flush() waits for the other CPUs. Never flush while holding a spinlock
+/// another CPU may spin on with interrupts off, such as info_t::paging_spin_:
+/// declare the batch before taking the lock, it flushes when it goes out of
+/// scope.
+class batch
+{
+  public:
+    explicit batch(arch::paging::page_table_t &table);
+    ~batch();
+    batch(const batch &) = delete;
+    batch &operator=(const batch &) = delete;
+
+    void add(u64 start, u64 pages) { ranges_.add(start, pages); }
+    void add_all() { ranges_.add_all(); }
+
+    /// Unmap \p pages pages from \p start and flush them with this batch.
+    void unmap(u64 start, u64 pages);
+
+    void flush();
+
+  private:
+    arch::paging::page_table_t &table_;
+    flush_ranges ranges_;
+    freelibcxx::vector<void *> released_;
+};
+
+/// Drop the TLB entries of a kernel space range on every CPU. Other CPUs flush
+/// asynchronously, so this is safe under any lock.
+void flush_kernel(u64 start, u64 pages);
+
+/// Switch every CPU which still has \p table loaded, lazily for a kernel
+/// thread or on this CPU, to the kernel page table. Call before destroying
+/// it, no thread may load it again.
+void release(arch::paging::page_table_t &table);
+
+} // namespace memory::tlb
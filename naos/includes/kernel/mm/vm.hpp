@@ -3,6 +3,7 @@
 #include "freelibcxx/hash_map.hpp"
 #include "freelibcxx/skip_list.hpp"
 #include "freelibcxx/vector.hpp"
+#include "kernel/arch/mm.hpp"
 #include "kernel/arch/paging.hpp"
 #include "kernel/common.hpp"
 #include "kernel/handle.hpp"
@@ -65,6 +66,9 @@ enum class page_fault_method
     physical,
 };
 
+inline lock::lock_class vm_list_lock_class("vm_list");
+inline lock::lock_class vm_paging_lock_class("vm_paging");
+
 class vm_allocator
 {
   public:
@@ -72,7 +76,7 @@ class vm_allocator
 
   private:
     list_t list;
-    lock::rw_lock_t list_lock;
+    lock::rw_lock_t list_lock{vm_list_lock_class};
     u64 range_top, range_bottom;
 
   public:
@@ -91,7 +95,9 @@ class vm_allocator
         range_bottom = bottom;
     }
 
-    const vm_t *allocate_map(u64 size, u64 flags, page_fault_method method, u64 user_data);
+    /// \param align alignment of the start address, a power of two
+    const vm_t *allocate_map(u64 size, u64 flags, page_fault_method method, u64 user_data,
+                             u64 align = memory::page_size);
     void deallocate_map(const vm_t *vm);
     bool deallocate_map(u64 p);
 
@@ -155,6 +161,12 @@ class info_t
 
     bool expand(page_fault_method method, u64 alignment_page, u64 access_address, vm_t *item);
 
+    /// Map every page of the VMA starting at \p start now instead of on
+    /// fault.
+    ///
+    /// \return false if a page could not be loaded
+    bool populate(u64 start);
+
   private:
     bool expand_brk(u64 alignment_page, u64 access_address, vm_t *item);
     bool expand_vm(u64 alignment_page, u64 access_address, vm_t *item);
@@ -162,6 +174,17 @@ class info_t
     bool expand_file(u64 alignment_page, u64 access_address, vm_t *item);
     bool expand_memory_object(u64 alignment_page, u64 access_address, vm_t *item);
     bool expand_physical(u64 alignment_page, u64 access_address, vm_t *item);
+    /// Map a new page at \p page. With \p only_missing, leave a page that is
+    /// already mapped alone.
+    ///
+    /// \return kernel address of the new page, or nullptr if none was mapped
+    byte *map_fresh_page(u64 page, u64 page_flags, bool only_missing);
+    /// Map the page cache page of a file mapping. Returns false if the file has
+    /// no page to share, so the caller reads a private copy. With
+    /// \p only_missing, a page that is mapped is left alone and a page that is
+    /// not cached yet is not read either.
+    bool map_cached_page(u64 page, vm_t *item, bool only_missing);
+    bool load_memory_object_page(u64 page, vm_t *item, bool only_missing);
     void restore_fork_disallowed_mappings();
 
   private:
@@ -170,7 +193,7 @@ class info_t
 
     const vm_t *heap_vm_;
     u64 heap_top_;
-    lock::spinlock_t paging_spin_;
+    lock::spinlock_t paging_spin_{vm_paging_lock_class};
 };
 
 /// map struct
@@ -1,7 +1,9 @@
 #pragma once
 #include "freelibcxx/allocator.hpp"
+#include "kernel/arch/cpu.hpp"
 #include "kernel/common.hpp"
 #include "kernel/lock.hpp"
+#include "kernel/mm/cpu_pages.hpp"
 #include "kernel/mm/page.hpp"
 #include "kernel/types.hpp"
 #include "ucontext.h"
@@ -9,6 +11,13 @@
 namespace memory
 {
 
+inline lock::lock_class zone_lock_class("zone");
+
+/// A physical memory range managed by a buddy allocator.
+///
+/// Blocks of up to cpu_pages::orders orders are allocated and freed through
+/// per-CPU lists and reach the buddy allocator, under the zone lock, in
+/// batches.
 class zone
 {
   public:
@@ -17,6 +26,8 @@ class zone
     /// tell buddy system memory needs to be reserved
     void tag_alloc(phy_addr_t start, phy_addr_t end);
 
+    /// Free pages, including those cached by any CPU. Other CPUs' caches
+    /// are read without synchronization, so the sum is approximate.
     u64 free_pages() const;
     u64 total_pages() const { return page_count; }
 
@@ -26,16 +37,38 @@ class zone
     phy_addr_t allocate_range_beg() const { return start; }
     phy_addr_t allocate_range_end() const { return allocate_end; }
 
+    /// NUMA node of this memory, see memory::numa
+    u8 node() const { return node_; }
+    void set_node(u8 node) { node_ = node; }
+
     page *page_beg() const { return address_to_page(start); }
     page *page_end() const;
 
     phy_addr_t malloc(u64 pages);
+    /// Allocate up to \p count single pages, taking the zone lock at most once
+    ///
+    /// \param out receives virtual addresses
+    /// \return number of pages allocated
+    u64 malloc_pages(u64 count, void **out);
     void page_add_reference(phy_addr_t ptr);
     void free(phy_addr_t ptr);
+    /// Turn the allocated block at \p ptr into single-page blocks, each with
+    /// the block's reference count. They are freed one by one and merge back
+    /// in the buddy allocator.
+    void split(phy_addr_t ptr);
+    /// Return the current CPU's cached blocks to the buddy allocator.
+    void drain_local();
 
     page *address_to_page(phy_addr_t ptr) const;
     phy_addr_t page_to_address(page *p) const;
 
+  private:
+    // Callers of buddy_alloc and buddy_free hold spin.
+    page *buddy_alloc(u64 pages);
+    void buddy_free(page *p);
+    page *cpu_alloc(int order);
+    void cpu_free(page *p, int order);
+
   private:
     phy_addr_t start;
     phy_addr_t allocate_end;
@@ -44,15 +77,23 @@ class zone
     u64 page_count;
     page *page_array;
     void *impl;
+    u8 node_ = 0;
 
-    lock::spinlock_t spin;
+    lock::spinlock_t spin{zone_lock_class};
 
     u64 impl_ptr_[64 / sizeof(u64)];
+
+    cpu_pages cpu_pages_[arch::cpu::max_cpu_support];
 };
 
 class zones : public freelibcxx::Allocator
 {
   public:
+    /// Free up to \p pages pages held by a cache. Runs in the allocating
+    /// context, so it must not sleep or allocate.
+    /// \return pages freed
+    using reclaim_hook = u64 (*)(u64 pages);
+
     zones(int count, int high_memory_index)
         : high_memory_index_(high_memory_index)
         , count_(count)
@@ -77,6 +118,24 @@ class zones : public freelibcxx::Allocator
     // virtual address
     void deallocate(void *ptr) noexcept override;
 
+    /// Allocate up to \p count single pages. Unlike allocate() this does not
+    /// panic when memory runs out.
+    ///
+    /// \param out receives virtual addresses, each freed with deallocate()
+    /// \return number of pages allocated
+    u64 allocate_pages(u64 count, void **out) noexcept;
+
+    /// Called when memory runs out, before allocate() panics and before
+    /// allocate_pages() comes back short
+    void set_reclaim_hook(reclaim_hook hook) { reclaim_ = hook; }
+
+    /// Allocate a 2 MiB block that is 2 MiB aligned in physical memory, for a
+    /// big page mapping. Returns nullptr instead of panicking.
+    void *allocate_big_page() noexcept;
+
+    /// \see zone::split
+    void split(void *ptr);
+
     void page_add_reference(void *ptr);
 
     page *get_page(void *ptr);
@@ -103,8 +162,17 @@ class zones : public freelibcxx::Allocator
     };
 
   private:
+    /// Try the zones of the preferred NUMA node first.
+    void *try_allocate(u64 pages);
+    /// Return the blocks cached by every CPU to the buddy allocators, waiting
+    /// for the other CPUs to drain theirs. Each may hold the buddies a larger
+    /// block needs, or the last free pages.
+    void drain_all();
+    u64 try_allocate_pages(u64 count, void **out);
+
     bool high_memory_init_ = false;
     int high_memory_index_;
+    reclaim_hook reclaim_ = nullptr;
 
     /// zone element count
     int count_;
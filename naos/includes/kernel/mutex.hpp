@@ -22,6 +22,8 @@ struct mutex_t
         };
     }
 
+    bool try_lock() { return !lock_m.test_and_set(std::memory_order_acquire); }
+
     void unlock()
     {
         lock_m.clear(std::memory_order_release);
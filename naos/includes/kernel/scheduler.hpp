@@ -5,8 +5,6 @@
 
 namespace task::scheduler
 {
-using thread_list_t = freelibcxx::linked_list<task::thread_t *>;
-
 enum class scheduler_class : flag_t
 {
     round_robin,
@@ -79,6 +77,15 @@ class scheduler
     ///
     virtual void commit_migrate(thread_t *thd) = 0;
 
+    ///
+    /// \brief run a thread just woken by the running one next
+    ///
+    /// \param from the running thread, giving up its CPU
+    /// \param to the woken thread, ready on this CPU
+    /// \note optional, the default keeps the usual wakeup order
+    ///
+    virtual void yield_to(thread_t *from, thread_t *to) {}
+
     /// Initialize per cpu data
     virtual void init_cpu() = 0;
     virtual void destroy_cpu() = 0;
@@ -98,11 +105,22 @@ void add(thread_t *thread, scheduler_class scher);
 void remove(thread_t *thread, remove_func, u64 user_data);
 void update_state(thread_t *thread, thread_state state);
 void update_state_sync(thread_t *thread, thread_state state);
-bool reschedule_task_push(thread_t *task, u32 cpuid);
-bool reschedule_task_pull(thread_t *task);
 
 ExportC void schedule();
 
+/// While in scope, a thread the current thread wakes on its own CPU runs as
+/// soon as the current thread reaches a scheduling point, as when it hands a
+/// synchronous request to a server or a reply back to a waiting client.
+class sync_wakeup_scope
+{
+  public:
+    sync_wakeup_scope() { current()->attributes |= thread_attributes::sync_wakeup; }
+    ~sync_wakeup_scope() { current()->attributes &= ~thread_attributes::sync_wakeup; }
+
+    sync_wakeup_scope(const sync_wakeup_scope &) = delete;
+    sync_wakeup_scope &operator=(const sync_wakeup_scope &) = delete;
+};
+
 bool migrate_pre_check();
 
 } // namespace task::scheduler
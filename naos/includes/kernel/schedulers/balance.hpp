@@ -0,0 +1,68 @@
+#pragma once
+#include "kernel/common.hpp"
+
+namespace task::scheduler
+{
+/// Where a CPU sits in the machine. CPUs on one core share its caches, CPUs
+/// in one package share the last level cache.
+struct cpu_place
+{
+    u8 node = 0;
+    u8 package = 0;
+    u8 core = 0;
+};
+
+/// Balancing domains, from the closest to the widest
+enum class balance_domain : u8
+{
+    core,
+    package,
+    node,
+    system,
+};
+
+/// The closest domain holding both \p a and \p b
+constexpr balance_domain domain_between(cpu_place a, cpu_place b)
+{
+    if (a.node != b.node)
+        return balance_domain::system;
+    if (a.package != b.package)
+        return balance_domain::node;
+    if (a.core != b.core)
+        return balance_domain::package;
+    return balance_domain::core;
+}
+
+constexpr u32 no_victim = 0xFFFF'FFFF;
+
+/// Pick the CPU \p self pulls a thread from: the busiest CPU of the closest
+/// domain in which some CPU has at least \p min_surplus more waiting threads
+/// than \p self. Ties go to the first CPU after \p self, so CPUs stealing at
+/// once spread over equally busy victims.
+///
+/// \param waiting threads waiting in each CPU's run queues
+/// \return the CPU id, or no_victim
+constexpr u32 find_victim(u32 self, const cpu_place *places, const u64 *waiting, u32 count, u64 min_surplus)
+{
+    for (u8 domain = 0; domain <= static_cast<u8>(balance_domain::system); domain++)
+    {
+        u32 victim = no_victim;
+        u64 most = waiting[self] + min_surplus - 1;
+        for (u32 n = 1; n < count; n++)
+        {
+            u32 i = (self + n) % count;
+            if (static_cast<u8>(domain_between(places[self], places[i])) > domain)
+                continue;
+            if (waiting[i] > most)
+            {
+                most = waiting[i];
+                victim = i;
+            }
+        }
+        if (victim != no_victim)
+            return victim;
+    }
+    return no_victim;
+}
+
+} // namespace task::scheduler
@@ -0,0 +1,76 @@
+#pragma once
+#include "kernel/common.hpp"
+
+namespace task::scheduler::cfs
+{
+constexpr i64 nice_min = -20;
+constexpr i64 nice_max = 19;
+constexpr u64 nice_0_weight = 1024;
+
+/// Load weight of nice -20 .. 19. Each level is about 1.25 times the next, so
+/// one nice step moves about 10% of the CPU between two busy threads.
+constexpr u64 nice_to_weight[nice_max - nice_min + 1] = {
+    88761, 71755, 56483, 46273, 36291, // -20
+    29154, 23254, 18705, 14949, 11916, // -15
+    9548,  7620,  6100,  4904,  3906,  // -10
+    3121,  2501,  1991,  1586,  1277,  // -5
+    1024,  820,   655,   526,   423,   // 0
+    335,   272,   215,   172,   137,   // 5
+    110,   87,    70,    56,    45,    // 10
+    36,    29,    23,    18,    15,    // 15
+};
+
+constexpr i64 clamp_nice(i64 nice) { return nice < nice_min ? nice_min : (nice > nice_max ? nice_max : nice); }
+
+constexpr u64 weight_of(i64 nice) { return nice_to_weight[clamp_nice(nice) - nice_min]; }
+
+/// Virtual runtime charged for \p delta of real runtime at \p weight
+constexpr i64 calc_delta(u64 delta, u64 weight) { return static_cast<i64>(delta * nice_0_weight / weight); }
+
+/// Virtual runtime of a thread waking up on a queue at \p min_vruntime.
+///
+/// A sleeper gets at most \p credit ahead of the queue, so it runs soon but
+/// cannot bank the time it slept. A thread that ran ahead keeps its lead.
+constexpr i64 place_woken(i64 vtime, i64 min_vruntime, i64 credit)
+{
+    i64 floor = min_vruntime - credit;
+    return vtime > floor ? vtime : floor;
+}
+
+/// Virtual runtime on a new queue for a thread that left its old one \p lag
+/// ahead of (or behind) that queue's min_vruntime
+constexpr i64 place_migrated(i64 lag, i64 min_vruntime, i64 credit)
+{
+    return place_woken(min_vruntime + lag, min_vruntime, credit);
+}
+
+/// The queue's min_vruntime never goes back. It follows the smallest of the
+/// running thread and the leftmost waiting one.
+constexpr i64 advance_min_vruntime(i64 min_vruntime, bool has_current, i64 current, bool has_first, i64 first)
+{
+    i64 target = min_vruntime;
+    if (has_current && has_first)
+        target = current < first ? current : first;
+    else if (has_current)
+        target = current;
+    else if (has_first)
+        target = first;
+    return target > min_vruntime ? target : min_vruntime;
+}
+
+/// A woken thread preempts the running one if it is behind by more than the
+/// wakeup granularity, measured at the woken thread's weight.
+constexpr bool wakeup_preempt(i64 current, i64 woken, u64 granularity, u64 woken_weight)
+{
+    return current - woken > calc_delta(granularity, woken_weight);
+}
+
+/// A thread handed the CPU by yield_to runs before the leftmost one only
+/// while it is no more than the wakeup granularity ahead of it, so repeated
+/// handoffs cannot keep the leftmost thread waiting.
+constexpr bool buddy_eligible(i64 buddy, i64 leftmost, u64 granularity, u64 buddy_weight)
+{
+    return buddy - leftmost <= calc_delta(granularity, buddy_weight);
+}
+
+} // namespace task::scheduler::cfs
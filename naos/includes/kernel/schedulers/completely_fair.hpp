@@ -32,11 +32,16 @@ class completely_fair_scheduler : public scheduler
 
     void commit_migrate(thread_t *thd) override;
 
+    void yield_to(thread_t *from, thread_t *to) override;
+
     void init_cpu() override;
     void destroy_cpu() override;
     completely_fair_scheduler();
 
   private:
     task::thread_t *pick_available_task();
+    /// How far behind the queue's min_vruntime a woken or migrated thread
+    /// may be placed, in virtual nanoseconds
+    i64 sleeper_credit() const { return static_cast<i64>(sched_min_granularity_us * 1000); }
 };
 } // namespace task::scheduler
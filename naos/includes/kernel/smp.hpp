@@ -9,9 +9,11 @@ void init();
 /// tlb shutdown
 void flush_all_tlb();
 
-void reschedule_cpu(u32 cpuid);
-
 /// call per cpu function
 void call_cpu(u32 cpuid, cpu::call_cpu_func_t, u64 user_data);
 
+/// run the calls queued for this cpu. A cpu waiting for another one with
+/// interrupts off calls it, so two cpus waiting on each other still progress.
+void run_calls();
+
 } // namespace SMP
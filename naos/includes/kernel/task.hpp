@@ -6,10 +6,14 @@
 #include "kernel/common.hpp"
 #include "kernel/fs/vfs/native_directory.hpp"
 #include "kernel/mm/new.hpp"
+#include "kernel/mm/numa_topology.hpp"
 #include "kernel/time.hpp"
+#include "kernel/util/intrusive_list.hpp"
+#include "kernel/util/intrusive_rbtree.hpp"
 #include "lock.hpp"
 #include "resource.hpp"
 #include "signal.hpp"
+#include "timer.hpp"
 #include "types.hpp"
 #include "wait.hpp"
 #include <atomic>
@@ -21,6 +25,10 @@ namespace task::scheduler
 {
 class scheduler;
 }
+namespace futex
+{
+struct waiter_t;
+}
 
 namespace dev::tty
 {
@@ -176,6 +184,8 @@ enum attributes : flag_t
     real_time = 32,
     on_migrate = 128,
     job_control_stopped = 256,
+    /// Threads woken now are run next on this CPU, see scheduler::sync_wakeup_scope
+    sync_wakeup = 512,
 };
 } // namespace thread_attributes
 struct preempt_t
@@ -226,6 +236,10 @@ struct thread_t
     process_t *process;
     scheduler::scheduler *scheduler;
     void *schedule_data;
+    /// Links in the run queue or blocked list of the scheduler. A thread is in
+    /// at most one of them at a time.
+    util::rb_node<thread_t> run_node;
+    util::list_node<thread_t> queue_node;
     ::arch::task::register_info_t *register_info;
     /// The kernel context RSP value
     void *kernel_stack_top;
@@ -239,15 +253,28 @@ struct thread_t
     /// -128 - 128, minimum value means a CPU bound thread, maximum value means a IO
     /// bound thread, the default value is 0.
     i8 dynamic_priority = 0;
+    /// CFS nice level from -20 (largest CPU share) to 19, inherited by
+    /// threads and forks it creates
+    i8 nice = 0;
+    /// The nice level before waiters for priority inheritance futexes the
+    /// thread holds lent it theirs. Both under the process thread_list_lock.
+    i8 pi_base_nice = 0;
+    bool pi_boosted = false;
+    /// Bumped whenever a waiter lends its nice level
+    u32 pi_generation = 0;
     /// run in cpu core
     u32 cpuid = 0;
     cpu_mask_t cpumask;
+    /// The NUMA node cpumask confines the thread to, which its page
+    /// allocations prefer, or memory::numa::no_node
+    u8 numa_node = memory::numa::no_node;
     statistics_t statistics;
     preempt_t preempt_data;
     wait_queue_t wait_queue;
     std::atomic_int wait_counter;
     u64 error_code = 0;
     wait_queue_t *do_wait_queue_now = nullptr;
+    futex::waiter_t *futex_waiter = nullptr;
     std::atomic_uint32_t wait_queue_wake_refs{0};
     void *tcb = 0;
 
@@ -256,6 +283,12 @@ struct thread_t
     // process may have concurrent syscalls touching different user buffers.
     volatile bool usercopy_active = false;
     volatile u64 usercopy_resume = 0;
+    /// A usercopy under a spinlock: any fault on it recovers without
+    /// being handled
+    volatile bool usercopy_no_fault = false;
+
+    /// Wakes the thread from do_sleep
+    timer::timer_entry sleep_timer;
 
     void wake_from_sleep(timeclock::microsecond_t) noexcept;
 
@@ -393,6 +426,11 @@ void continue_process(process_t *process, flag_t flags = 0);
 
 process_t *find_pid(process_id pid);
 thread_t *find_tid(process_t *process, thread_id tid);
+/// Call \p fn with the thread \p tid of \p process, which cannot exit
+/// meanwhile.
+///
+/// \return false if there is no such thread
+bool visit_tid(process_t *process, thread_id tid, freelibcxx::function_ref<void(thread_t *)> fn);
 
 /// Create a new session for a process and make it the session and process-group
 /// leader. Returns a negative kernel errno on failure, or the new session id.
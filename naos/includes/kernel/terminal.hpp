@@ -934,7 +934,9 @@ class terminal_manager
     mutable lock::spinlock_t manager_lock_;
     int cur_ = -1;
     int pending_switch_ = -1;
-    timer::watcher_id framebuffer_handoff_watcher_ = timer::invalid_watcher_id;
+    /// Forces the user framebuffer writer off if it does not hand off in time
+    timer::timer_entry framebuffer_handoff_timer_;
+    bool framebuffer_handoff_pending_ = false;
 
     void force_framebuffer_handoff(timeclock::microsecond_t expiration) noexcept;
 };
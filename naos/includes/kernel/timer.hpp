@@ -3,12 +3,35 @@
 #include "freelibcxx/delegate.hpp"
 #include "kernel/common.hpp"
 #include "kernel/types.hpp"
+#include "kernel/util/timer_wheel.hpp"
+#include <atomic>
 namespace timer
 {
 
 using timer_handler = freelibcxx::delegate<void(timeclock::microsecond_t) noexcept>;
-using watcher_id = u64;
-constexpr watcher_id invalid_watcher_id = 0;
+struct cpu_timer_t;
+
+///
+/// \brief a timer embedded in its owner
+///
+/// Arm it to call a handler at a deadline. It can be armed again once it fired
+/// or was canceled, and canceled from any CPU. The owner must cancel it before
+/// freeing it.
+struct timer_entry
+{
+    util::wheel_node<timer_entry> node;
+    timeclock::microsecond_t expires = 0;
+    timer_handler handler;
+    /// The CPU it is armed on, nullptr when it is not armed
+    std::atomic<cpu_timer_t *> base = nullptr;
+
+    timer_entry() = default;
+    timer_entry(const timer_entry &) = delete;
+    timer_entry &operator=(const timer_entry &) = delete;
+
+    bool armed() const { return base.load(std::memory_order_acquire) != nullptr; }
+};
+
 void init();
 
 ///
@@ -17,10 +40,21 @@ void init();
 /// \note the time of each CPU is not synchronized
 timeclock::microsecond_t get_high_resolution_time();
 
+/// get_high_resolution_time() in nanoseconds, as fine as the clock source
+timeclock::nanosecond_t get_high_resolution_time_ns();
+
 void busywait(timeclock::microsecond_t duration);
 
-[[nodiscard]] watcher_id schedule_after(timeclock::microsecond_t duration, timer_handler handler);
-[[nodiscard]] watcher_id schedule_at(timeclock::microsecond_t deadline, timer_handler handler);
-bool cancel(watcher_id id);
+/// Arm \p entry on this CPU to call \p handler at \p deadline, moving it here
+/// if it is armed elsewhere. One entry must not be armed from two CPUs at once.
+///
+/// \return false and leave it disarmed if \p deadline has passed
+bool arm_at(timer_entry &entry, timeclock::microsecond_t deadline, timer_handler handler);
+void arm_after(timer_entry &entry, timeclock::microsecond_t duration, timer_handler handler);
+
+/// Disarm \p entry, from any CPU.
+///
+/// \return false if it was not armed: its handler has run, or is running
+bool cancel(timer_entry &entry);
 
 } // namespace timer
@@ -14,8 +14,18 @@ namespace naos::usercopy
 // between valid_range() and the actual copy.
 na_status_t copy_from(void *destination, u64 source, u64 size);
 na_status_t copy_to(u64 destination, const void *source, u64 size);
+/// Atomically replace the aligned user word at \p address with \p desired if
+/// it holds \p expected. \p expected is set to the value found, so the
+/// exchange happened if it did not change.
+na_status_t compare_exchange(u64 address, u32 &expected, u32 desired);
+/// compare_exchange() for callers holding spinlocks. A missing or read-only
+/// page is not faulted in, the call returns NA_STATUS_FAULT instead, and the
+/// caller faults it in with compare_exchange() after dropping its locks.
+na_status_t compare_exchange_no_fault(u64 address, u32 &expected, u32 desired);
 
 bool recover_page_fault(regs_t *regs);
+/// Recover a fault of compare_exchange_no_fault() before it is handled
+bool recover_no_fault(regs_t *regs);
 
 inline bool valid_range(u64 address, u64 size)
 {
@@ -0,0 +1,73 @@
+#pragma once
+#include "kernel/common.hpp"
+#include "naos/abi.h"
+
+namespace util
+{
+/// The read-modify-write and comparison of a NA_FUTEX_WAKE_OP call
+class futex_wake_op
+{
+  public:
+    explicit futex_wake_op(u32 encoded)
+        : op_((encoded >> 28) & 0x7)
+        , cmp_((encoded >> 24) & 0xF)
+        , oparg_(sign_extend((encoded >> 12) & 0xFFF))
+        , cmparg_(sign_extend(encoded & 0xFFF))
+    {
+        if (encoded & (static_cast<u32>(NA_FUTEX_OP_OPARG_SHIFT) << 28))
+            oparg_ = static_cast<i32>(1U << (static_cast<u32>(oparg_) & 31));
+    }
+
+    bool valid() const { return op_ <= NA_FUTEX_OP_XOR && cmp_ <= NA_FUTEX_OP_CMP_GE; }
+
+    /// The value the second futex word is set to when it holds \p old
+    u32 apply(u32 old) const
+    {
+        const auto arg = static_cast<u32>(oparg_);
+        switch (op_)
+        {
+        case NA_FUTEX_OP_SET:
+            return arg;
+        case NA_FUTEX_OP_ADD:
+            return old + arg;
+        case NA_FUTEX_OP_OR:
+            return old | arg;
+        case NA_FUTEX_OP_ANDN:
+            return old & ~arg;
+        default:
+            return old ^ arg;
+        }
+    }
+
+    /// Whether the waiters of the second word are woken too, given its
+    /// value \p old before apply()
+    bool compare(u32 old) const
+    {
+        const auto value = static_cast<i32>(old);
+        switch (cmp_)
+        {
+        case NA_FUTEX_OP_CMP_EQ:
+            return value == cmparg_;
+        case NA_FUTEX_OP_CMP_NE:
+            return value != cmparg_;
+        case NA_FUTEX_OP_CMP_LT:
+            return value < cmparg_;
+        case NA_FUTEX_OP_CMP_LE:
+            return value <= cmparg_;
+        case NA_FUTEX_OP_CMP_GT:
+            return value > cmparg_;
+        default:
+            return value >= cmparg_;
+        }
+    }
+
+  private:
+    static i32 sign_extend(u32 field) { return static_cast<i32>(field << 20) >> 20; }
+
+    u32 op_;
+    u32 cmp_;
+    i32 oparg_;
+    i32 cmparg_;
+};
+
+} // namespace util
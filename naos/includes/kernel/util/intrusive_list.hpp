@@ -0,0 +1,75 @@
+#pragma once
+#include "kernel/common.hpp"
+
+namespace util
+{
+/// Links of a T in one intrusive_list at a time
+template <typename T> struct list_node
+{
+    T *prev = nullptr;
+    T *next = nullptr;
+    bool linked = false;
+};
+
+/// A doubly linked list threaded through the list_node member \p Node of its
+/// items. It never allocates, and removing an item is O(1).
+template <typename T, list_node<T> T::*Node> class intrusive_list
+{
+  public:
+    intrusive_list() = default;
+    intrusive_list(const intrusive_list &) = delete;
+    intrusive_list &operator=(const intrusive_list &) = delete;
+
+    bool empty() const { return head_ == nullptr; }
+    u64 size() const { return size_; }
+    T *front() const { return head_; }
+    static T *next(T *item) { return (item->*Node).next; }
+    static bool linked(const T *item) { return (item->*Node).linked; }
+
+    void push_back(T *item)
+    {
+        auto &node = item->*Node;
+        node.prev = tail_;
+        node.next = nullptr;
+        node.linked = true;
+        if (tail_ != nullptr)
+            (tail_->*Node).next = item;
+        else
+            head_ = item;
+        tail_ = item;
+        size_++;
+    }
+
+    T *pop_front()
+    {
+        T *item = head_;
+        if (item != nullptr)
+            remove(item);
+        return item;
+    }
+
+    /// \p item must be in this list
+    void remove(T *item)
+    {
+        auto &node = item->*Node;
+        if (node.prev != nullptr)
+            (node.prev->*Node).next = node.next;
+        else
+            head_ = node.next;
+        if (node.next != nullptr)
+            (node.next->*Node).prev = node.prev;
+        else
+            tail_ = node.prev;
+        node.prev = nullptr;
+        node.next = nullptr;
+        node.linked = false;
+        size_--;
+    }
+
+  private:
+    T *head_ = nullptr;
+    T *tail_ = nullptr;
+    u64 size_ = 0;
+};
+
+} // namespace util
@@ -0,0 +1,320 @@
+#pragma once
+#include "kernel/common.hpp"
+
+namespace util
+{
+/// Links of a T in one intrusive_rbtree at a time
+template <typename T> struct rb_node
+{
+    T *parent = nullptr;
+    T *left = nullptr;
+    T *right = nullptr;
+    bool red = false;
+    bool linked = false;
+};
+
+/// A red-black tree threaded through the rb_node member \p Node of its items,
+/// ordered by \p Less. It never allocates, insert and erase are O(log n), and
+/// the smallest item is cached so first() is O(1).
+///
+/// Equal items are kept in insertion order. An item's key must not change
+/// while it is in the tree.
+template <typename T, rb_node<T> T::*Node, typename Less> class intrusive_rbtree
+{
+  public:
+    intrusive_rbtree() = default;
+    intrusive_rbtree(const intrusive_rbtree &) = delete;
+    intrusive_rbtree &operator=(const intrusive_rbtree &) = delete;
+
+    bool empty() const { return root_ == nullptr; }
+    u64 size() const { return size_; }
+    T *first() const { return leftmost_; }
+    static bool linked(const T *item) { return (item->*Node).linked; }
+
+    /// The item after \p item in order, or nullptr
+    static T *next(T *item)
+    {
+        if (right(item) != nullptr)
+        {
+            T *x = right(item);
+            while (left(x) != nullptr)
+                x = left(x);
+            return x;
+        }
+        T *x = item;
+        T *p = parent(x);
+        while (p != nullptr && x == right(p))
+        {
+            x = p;
+            p = parent(p);
+        }
+        return p;
+    }
+
+    void insert(T *item)
+    {
+        T *p = nullptr;
+        T *cur = root_;
+        bool go_left = false;
+        bool is_leftmost = true;
+        while (cur != nullptr)
+        {
+            p = cur;
+            go_left = Less()(item, cur);
+            if (go_left)
+            {
+                cur = left(cur);
+            }
+            else
+            {
+                cur = right(cur);
+                is_leftmost = false;
+            }
+        }
+
+        auto &node = item->*Node;
+        node.parent = p;
+        node.left = nullptr;
+        node.right = nullptr;
+        node.red = true;
+        node.linked = true;
+        if (p == nullptr)
+            root_ = item;
+        else if (go_left)
+            left(p) = item;
+        else
+            right(p) = item;
+        if (is_leftmost)
+            leftmost_ = item;
+        size_++;
+        insert_fixup(item);
+    }
+
+    /// \p item must be in this tree
+    void erase(T *z)
+    {
+        if (z == leftmost_)
+            leftmost_ = next(z);
+
+        T *y = z;
+        T *x;
+        T *x_parent;
+        bool removed_red = red(y);
+        if (left(z) == nullptr)
+        {
+            x = right(z);
+            x_parent = parent(z);
+            transplant(z, x);
+        }
+        else if (right(z) == nullptr)
+        {
+            x = left(z);
+            x_parent = parent(z);
+            transplant(z, x);
+        }
+        else
+        {
+            y = right(z);
+            while (left(y) != nullptr)
+                y = left(y);
+            removed_red = red(y);
+            x = right(y);
+            if (parent(y) == z)
+            {
+                x_parent = y;
+            }
+            else
+            {
+                x_parent = parent(y);
+                transplant(y, x);
+                right(y) = right(z);
+                parent(right(y)) = y;
+            }
+            transplant(z, y);
+            left(y) = left(z);
+            parent(left(y)) = y;
+            red(y) = red(z);
+        }
+        if (!removed_red)
+            erase_fixup(x, x_parent);
+
+        auto &node = z->*Node;
+        node.parent = nullptr;
+        node.left = nullptr;
+        node.right = nullptr;
+        node.linked = false;
+        size_--;
+    }
+
+  private:
+    static T *&parent(T *item) { return (item->*Node).parent; }
+    static T *&left(T *item) { return (item->*Node).left; }
+    static T *&right(T *item) { return (item->*Node).right; }
+    static bool &red(T *item) { return (item->*Node).red; }
+    static bool is_red(T *item) { return item != nullptr && red(item); }
+
+    /// Put \p v where \p u hangs
+    void transplant(T *u, T *v)
+    {
+        T *p = parent(u);
+        if (p == nullptr)
+            root_ = v;
+        else if (u == left(p))
+            left(p) = v;
+        else
+            right(p) = v;
+        if (v != nullptr)
+            parent(v) = p;
+    }
+
+    void rotate_left(T *x)
+    {
+        T *y = right(x);
+        right(x) = left(y);
+        if (left(y) != nullptr)
+            parent(left(y)) = x;
+        transplant(x, y);
+        left(y) = x;
+        parent(x) = y;
+    }
+
+    void rotate_right(T *x)
+    {
+        T *y = left(x);
+        left(x) = right(y);
+        if (right(y) != nullptr)
+            parent(right(y)) = x;
+        transplant(x, y);
+        right(y) = x;
+        parent(x) = y;
+    }
+
+    void insert_fixup(T *z)
+    {
+        while (is_red(parent(z)))
+        {
+            // A red parent is never the root, so the grandparent exists
+            T *p = parent(z);
+            T *g = parent(p);
+            if (p == left(g))
+            {
+                T *uncle = right(g);
+                if (is_red(uncle))
+                {
+                    red(p) = false;
+                    red(uncle) = false;
+                    red(g) = true;
+                    z = g;
+                    continue;
+                }
+                if (z == right(p))
+                {
+                    z = p;
+                    rotate_left(z);
+                    p = parent(z);
+                }
+                red(p) = false;
+                red(g) = true;
+                rotate_right(g);
+            }
+            else
+            {
+                T *uncle = left(g);
+                if (is_red(uncle))
+                {
+                    red(p) = false;
+                    red(uncle) = false;
+                    red(g) = true;
+                    z = g;
+                    continue;
+                }
+                if (z == left(p))
+                {
+                    z = p;
+                    rotate_right(z);
+                    p = parent(z);
+                }
+                red(p) = false;
+                red(g) = true;
+                rotate_left(g);
+            }
+        }
+        red(root_) = false;
+    }
+
+    /// \p x, possibly nullptr, carries an extra black below \p x_parent
+    void erase_fixup(T *x, T *x_parent)
+    {
+        while (x != root_ && !is_red(x))
+        {
+            if (x == left(x_parent))
+            {
+                T *w = right(x_parent);
+                if (is_red(w))
+                {
+                    red(w) = false;
+                    red(x_parent) = true;
+                    rotate_left(x_parent);
+                    w = right(x_parent);
+                }
+                if (!is_red(left(w)) && !is_red(right(w)))
+                {
+                    red(w) = true;
+                    x = x_parent;
+                    x_parent = parent(x);
+                    continue;
+                }
+                if (!is_red(right(w)))
+                {
+                    red(left(w)) = false;
+                    red(w) = true;
+                    rotate_right(w);
+                    w = right(x_parent);
+                }
+                red(w) = red(x_parent);
+                red(x_parent) = false;
+                red(right(w)) = false;
+                rotate_left(x_parent);
+            }
+            else
+            {
+                T *w = left(x_parent);
+                if (is_red(w))
+                {
+                    red(w) = false;
+                    red(x_parent) = true;
+                    rotate_right(x_parent);
+                    w = left(x_parent);
+                }
+                if (!is_red(left(w)) && !is_red(right(w)))
+                {
+                    red(w) = true;
+                    x = x_parent;
+                    x_parent = parent(x);
+                    continue;
+                }
+                if (!is_red(left(w)))
+                {
+                    red(right(w)) = false;
+                    red(w) = true;
+                    rotate_left(w);
+                    w = left(x_parent);
+                }
+                red(w) = red(x_parent);
+                red(x_parent) = false;
+                red(left(w)) = false;
+                rotate_right(x_parent);
+            }
+            x = root_;
+            break;
+        }
+        if (x != nullptr)
+            red(x) = false;
+    }
+
+    T *root_ = nullptr;
+    T *leftmost_ = nullptr;
+    u64 size_ = 0;
+};
+
+} // namespace util
@@ -0,0 +1,177 @@
+#pragma once
+#include "kernel/common.hpp"
+
+namespace util
+{
+/// A run of bytes in one page of a pipe_ring
+struct pipe_buffer
+{
+    byte *page = nullptr;
+    u32 offset = 0;
+    u32 length = 0;
+    /// Someone else holds a reference to the page too, so writes must not
+    /// append to it
+    bool shared = false;
+};
+
+/// The data of a pipe, as a ring of page-sized buffers.
+///
+/// Each buffer owns one reference to its page. Writes copy into the last
+/// page while it has room and take a fresh page otherwise, reads copy out
+/// a page at a time and hand drained pages back. Whole buffers move between
+/// rings by reference. The ring takes no locks and allocates nothing, the
+/// page callbacks allocate, reference and release pages.
+template <u32 Slots, u64 PageSize> class pipe_ring
+{
+    static_assert(Slots > 0);
+
+  public:
+    pipe_ring() = default;
+    pipe_ring(const pipe_ring &) = delete;
+    pipe_ring &operator=(const pipe_ring &) = delete;
+
+    u64 bytes() const { return bytes_; }
+    u32 count() const { return count_; }
+    u32 free_slots() const { return Slots - count_; }
+    bool empty() const { return count_ == 0; }
+
+    /// A write can copy at least one byte
+    bool writable() const { return count_ < Slots || tail_room() != 0; }
+
+    /// The \p index th buffer from the oldest
+    const pipe_buffer &at(u32 index) const { return slots_[(head_ + index) % Slots]; }
+
+    /// Copy up to \p size bytes in. \p alloc returns a fresh page or nullptr.
+    /// \return bytes copied
+    template <typename Alloc> u64 write(const byte *source, u64 size, Alloc alloc)
+    {
+        u64 done = 0;
+        while (done < size)
+        {
+            u64 room = tail_room();
+            if (room == 0)
+            {
+                if (count_ == Slots)
+                    break;
+                byte *page = alloc();
+                if (page == nullptr)
+                    break;
+                slots_[(head_ + count_) % Slots] = pipe_buffer{page, 0, 0, false};
+                count_++;
+                room = PageSize;
+            }
+            auto &tail = slots_[(head_ + count_ - 1) % Slots];
+            const u64 chunk = room < size - done ? room : size - done;
+            __builtin_memcpy(tail.page + tail.offset + tail.length, source + done, chunk);
+            tail.length += chunk;
+            bytes_ += chunk;
+            done += chunk;
+        }
+        return done;
+    }
+
+    /// Copy up to \p size bytes out, passing drained pages to \p release.
+    /// \return bytes copied
+    template <typename Release> u64 read(byte *destination, u64 size, Release release)
+    {
+        u64 done = 0;
+        while (done < size && count_ != 0)
+        {
+            auto &head = slots_[head_];
+            const u64 chunk = head.length < size - done ? head.length : size - done;
+            __builtin_memcpy(destination + done, head.page + head.offset, chunk);
+            head.offset += chunk;
+            head.length -= chunk;
+            bytes_ -= chunk;
+            done += chunk;
+            if (head.length == 0)
+                drop_front(release);
+        }
+        return done;
+    }
+
+    /// Append \p buffer, taking over its page reference. False without a
+    /// free slot.
+    bool push(const pipe_buffer &buffer)
+    {
+        if (count_ == Slots)
+            return false;
+        slots_[(head_ + count_) % Slots] = buffer;
+        count_++;
+        bytes_ += buffer.length;
+        return true;
+    }
+
+    /// Take up to \p size bytes of the oldest buffer into \p out, which owns
+    /// a page reference afterwards. When the buffer is split, \p reference
+    /// takes the reference for the part that stays, and both parts become
+    /// shared. False if the ring is empty.
+    template <typename Reference> bool pop(u64 size, pipe_buffer &out, Reference reference)
+    {
+        if (count_ == 0 || size == 0)
+            return false;
+        auto &head = slots_[head_];
+        if (head.length <= size)
+        {
+            out = head;
+            bytes_ -= head.length;
+            head = pipe_buffer{};
+            head_ = (head_ + 1) % Slots;
+            count_--;
+            return true;
+        }
+        reference(head.page);
+        head.shared = true;
+        out = pipe_buffer{head.page, head.offset, static_cast<u32>(size), true};
+        head.offset += size;
+        head.length -= size;
+        bytes_ -= size;
+        return true;
+    }
+
+    /// A second buffer for the first \p size bytes of the \p index th one,
+    /// leaving the ring as it is. \p reference takes the page reference of
+    /// the copy, and both become shared.
+    template <typename Reference> pipe_buffer share(u32 index, u64 size, Reference reference)
+    {
+        auto &buffer = slots_[(head_ + index) % Slots];
+        reference(buffer.page);
+        buffer.shared = true;
+        return pipe_buffer{buffer.page, buffer.offset, static_cast<u32>(size < buffer.length ? size : buffer.length),
+                           true};
+    }
+
+    /// Drop the oldest buffer
+    template <typename Release> void drop_front(Release release)
+    {
+        auto &head = slots_[head_];
+        bytes_ -= head.length;
+        release(head.page);
+        head = pipe_buffer{};
+        head_ = (head_ + 1) % Slots;
+        count_--;
+    }
+
+    template <typename Release> void clear(Release release)
+    {
+        while (count_ != 0)
+            drop_front(release);
+    }
+
+  private:
+    /// Bytes the newest buffer can still take
+    u64 tail_room() const
+    {
+        if (count_ == 0)
+            return 0;
+        const auto &tail = slots_[(head_ + count_ - 1) % Slots];
+        return tail.shared ? 0 : PageSize - tail.offset - tail.length;
+    }
+
+    pipe_buffer slots_[Slots];
+    u32 head_ = 0;
+    u32 count_ = 0;
+    u64 bytes_ = 0;
+};
+
+} // namespace util
@@ -0,0 +1,206 @@
+#pragma once
+#include "kernel/common.hpp"
+#include <atomic>
+
+namespace util
+{
+/// A waiter in the queue of a queued_spinlock. It is only used while its
+/// owner waits, so one per CPU and nesting level of lock contexts suffices.
+struct alignas(64) queue_node
+{
+    std::atomic<queue_node *> next{nullptr};
+    std::atomic_bool granted{false};
+};
+
+/// A fair spinlock in the style of MCS locks.
+///
+/// The word holds the held bit and the tail of the waiter queue. Each waiter
+/// spins on its own queue_node until its predecessor hands it the head of
+/// the queue, and only the head spins on the word. Waiters take the lock in
+/// arrival order, and a release moves one cache line to one CPU.
+class queued_spinlock
+{
+  public:
+    static constexpr u64 held = 1;
+
+    queued_spinlock() = default;
+    queued_spinlock(const queued_spinlock &) = delete;
+    queued_spinlock &operator=(const queued_spinlock &) = delete;
+
+    bool is_locked() const { return (word_.load(std::memory_order_relaxed) & held) != 0; }
+    bool is_contended() const { return (word_.load(std::memory_order_relaxed) & ~held) != 0; }
+
+    /// Take the lock if it is free and nobody queues for it
+    bool try_lock()
+    {
+        u64 expect = 0;
+        return word_.compare_exchange_strong(expect, held, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+
+    void unlock() { word_.fetch_and(~held, std::memory_order_release); }
+
+    /// Queue on \p node until the lock is taken. \p relax is called while
+    /// spinning.
+    template <typename Relax> void lock_queued(queue_node *node, Relax relax)
+    {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        node->granted.store(false, std::memory_order_relaxed);
+        const u64 self = reinterpret_cast<u64>(node);
+
+        u64 word = word_.load(std::memory_order_relaxed);
+        while (!word_.compare_exchange_weak(word, (word & held) | self, std::memory_order_acq_rel,
+                                            std::memory_order_relaxed))
+        {
+        }
+        auto *prev = reinterpret_cast<queue_node *>(word & ~held);
+        if (prev != nullptr)
+        {
+            prev->next.store(node, std::memory_order_release);
+            while (!node->granted.load(std::memory_order_acquire))
+                relax();
+        }
+
+        // Head of the queue, wait for the holder
+        for (;;)
+        {
+            word = word_.load(std::memory_order_acquire);
+            if (word & held)
+            {
+                relax();
+                continue;
+            }
+            if (word == self)
+            {
+                // Nobody behind, empty the queue
+                if (word_.compare_exchange_strong(word, held, std::memory_order_acquire, std::memory_order_relaxed))
+                    return;
+                continue;
+            }
+            if (word_.compare_exchange_strong(word, word | held, std::memory_order_acquire, std::memory_order_relaxed))
+                break;
+        }
+
+        queue_node *next;
+        while ((next = node->next.load(std::memory_order_acquire)) == nullptr)
+            relax();
+        next->granted.store(true, std::memory_order_release);
+    }
+
+    /// Spin for the lock without a queue_node, ahead of any queue. Only for
+    /// contexts nested deeper than there are nodes.
+    template <typename Relax> void lock_unqueued(Relax relax)
+    {
+        for (;;)
+        {
+            u64 word = word_.load(std::memory_order_relaxed);
+            if (!(word & held) &&
+                word_.compare_exchange_weak(word, word | held, std::memory_order_acquire, std::memory_order_relaxed))
+                return;
+            relax();
+        }
+    }
+
+  private:
+    std::atomic<u64> word_{0};
+};
+
+/// A writer-preferring reader-writer spinlock.
+///
+/// Readers and writers that cannot take it at once queue on a
+/// queued_spinlock, so they are served in arrival order. A waiting writer
+/// sets the waiting bit, which sends new readers to the queue behind it
+/// instead of letting them starve it.
+class queued_rwlock
+{
+  public:
+    static constexpr u64 writer_held = 1;
+    static constexpr u64 writer_waiting = 2;
+    static constexpr u64 writer_mask = writer_held | writer_waiting;
+    static constexpr u64 reader_bias = 1UL << 8;
+
+    queued_rwlock() = default;
+    queued_rwlock(const queued_rwlock &) = delete;
+    queued_rwlock &operator=(const queued_rwlock &) = delete;
+
+    u64 readers() const { return word_.load(std::memory_order_relaxed) / reader_bias; }
+    bool is_write_locked() const { return (word_.load(std::memory_order_relaxed) & writer_held) != 0; }
+    bool has_waiting_writer() const { return (word_.load(std::memory_order_relaxed) & writer_waiting) != 0; }
+
+    bool try_lock_read()
+    {
+        u64 word = word_.load(std::memory_order_relaxed);
+        if (word & writer_mask)
+            return false;
+        word = word_.fetch_add(reader_bias, std::memory_order_acquire);
+        if (!(word & writer_mask))
+            return true;
+        word_.fetch_sub(reader_bias, std::memory_order_relaxed);
+        return false;
+    }
+
+    bool try_lock_write()
+    {
+        u64 expect = 0;
+        return word_.compare_exchange_strong(expect, writer_held, std::memory_order_acquire,
+                                             std::memory_order_relaxed);
+    }
+
+    /// Count a reader in, true if no writer holds or waits for the lock
+    bool lock_read_fast()
+    {
+        return !(word_.fetch_add(reader_bias, std::memory_order_acquire) & writer_mask);
+    }
+
+    /// Finish a read lock lock_read_fast() failed to take.
+    ///
+    /// An interrupt may come in while its CPU holds the read lock, and a
+    /// queued writer waits for that reader, so \p nested readers only wait
+    /// for the writer holding the lock and pass waiting ones. \p lock_queue
+    /// and \p unlock_queue take and release queue().
+    template <typename Lock, typename Unlock, typename Relax>
+    void lock_read_slow(bool nested, Lock lock_queue, Unlock unlock_queue, Relax relax)
+    {
+        if (!nested)
+        {
+            word_.fetch_sub(reader_bias, std::memory_order_relaxed);
+            lock_queue();
+            word_.fetch_add(reader_bias, std::memory_order_acquire);
+        }
+        while (word_.load(std::memory_order_acquire) & writer_held)
+            relax();
+        if (!nested)
+            unlock_queue();
+    }
+
+    /// Take the write lock after try_lock_write() failed
+    template <typename Lock, typename Unlock, typename Relax>
+    void lock_write_slow(Lock lock_queue, Unlock unlock_queue, Relax relax)
+    {
+        lock_queue();
+        if (!try_lock_write())
+        {
+            word_.fetch_or(writer_waiting, std::memory_order_relaxed);
+            for (;;)
+            {
+                u64 expect = writer_waiting;
+                if (word_.load(std::memory_order_relaxed) == writer_waiting &&
+                    word_.compare_exchange_strong(expect, writer_held, std::memory_order_acquire,
+                                                  std::memory_order_relaxed))
+                    break;
+                relax();
+            }
+        }
+        unlock_queue();
+    }
+
+    void unlock_read() { word_.fetch_sub(reader_bias, std::memory_order_release); }
+    void unlock_write() { word_.fetch_and(~writer_held, std::memory_order_release); }
+
+    queued_spinlock &queue() { return queue_; }
+
+  private:
+    std::atomic<u64> word_{0};
+    queued_spinlock queue_;
+};
+
+} // namespace util
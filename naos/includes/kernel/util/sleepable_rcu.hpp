@@ -0,0 +1,95 @@
+#pragma once
+#include "kernel/common.hpp"
+#include <atomic>
+
+namespace util
+{
+/// Read-side sections that may sleep, in the style of SRCU.
+///
+/// A reader counts itself into one of two epochs on its slot, usually its
+/// CPU, and writes nothing shared with readers on other slots. synchronize()
+/// sends new readers to the other epoch and waits for the counters of the
+/// old one to drain, so an object unlinked before the call is unreachable
+/// once it returns.
+///
+/// A reader's increment and the writer's switch are both followed by a full
+/// fence. If the writer's scan misses an increment, the reader's fence comes
+/// after the writer's, and the reader already sees the unlink.
+///
+/// A reader may load the epoch, stall, and count itself in after a later
+/// switch, into the epoch that is now idle. synchronize() therefore first
+/// waits for the idle epoch to drain, then switches and waits for the one
+/// it leaves, like SRCU.
+template <u32 Slots> class sleepable_rcu
+{
+    static_assert(Slots > 0);
+
+  public:
+    sleepable_rcu() = default;
+    sleepable_rcu(const sleepable_rcu &) = delete;
+    sleepable_rcu &operator=(const sleepable_rcu &) = delete;
+
+    /// Enter a read section on \p slot, returns the epoch to pass to
+    /// read_unlock()
+    u32 read_lock(u32 slot)
+    {
+        const u32 current = epoch();
+        read_lock(slot, current);
+        return current;
+    }
+
+    /// The two halves of read_lock(): the epoch new readers enter, and
+    /// counting in to an epoch loaded earlier
+    u32 epoch() const { return epoch_.load(std::memory_order_relaxed) & 1; }
+    void read_lock(u32 slot, u32 epoch)
+    {
+        slots_[slot % Slots].readers[epoch & 1].fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void read_unlock(u32 slot, u32 epoch)
+    {
+        slots_[slot % Slots].readers[epoch].fetch_sub(1, std::memory_order_release);
+    }
+
+    /// Wait for every read section entered before the call. \p relax is
+    /// called while waiting.
+    template <typename Relax> void synchronize(Relax relax)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (writing_.exchange(true, std::memory_order_acquire))
+            relax();
+        // Stragglers that counted in to the idle epoch after the last switch
+        const u32 old = epoch();
+        while (readers(old ^ 1) != 0)
+            relax();
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        epoch_.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (readers(old) != 0)
+            relax();
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        writing_.store(false, std::memory_order_release);
+    }
+
+    /// Readers in \p epoch, only exact while no reader enters it
+    i64 readers(u32 epoch) const
+    {
+        i64 sum = 0;
+        for (u32 i = 0; i < Slots; i++)
+            sum += slots_[i].readers[epoch & 1].load(std::memory_order_acquire);
+        return sum;
+    }
+
+  private:
+    struct alignas(64) slot_t
+    {
+        std::atomic<i64> readers[2] = {0, 0};
+    };
+
+    slot_t slots_[Slots];
+    std::atomic<u32> epoch_{0};
+    std::atomic_bool writing_{false};
+};
+
+} // namespace util
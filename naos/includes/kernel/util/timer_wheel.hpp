@@ -0,0 +1,218 @@
+#pragma once
+#include "kernel/common.hpp"
+
+namespace util
+{
+/// Links of a T in one timer_wheel at a time
+template <typename T> struct wheel_node
+{
+    T *prev = nullptr;
+    T *next = nullptr;
+    /// The tick the item expires at
+    u64 tick = 0;
+    /// Level * slots + slot, or overflow_slot
+    u16 slot = 0;
+    bool linked = false;
+};
+
+/// A hierarchical timing wheel threaded through the wheel_node member \p Node
+/// of its items. It never allocates, and insert and erase are O(1).
+///
+/// Level l has 64 slots of 64^l ticks each. An item is kept on the lowest
+/// level whose slot tells its tick apart from now(), and moves down a level
+/// when time reaches its slot. Items past the top level wait in an overflow
+/// list until the top level wraps. Bitmaps of non-empty slots let the wheel
+/// skip idle time without walking every tick, so a tickless CPU can sleep up
+/// to next_tick().
+template <typename T, wheel_node<T> T::*Node, u64 Levels = 5> class timer_wheel
+{
+  public:
+    static constexpr u64 slot_bits = 6;
+    static constexpr u64 slots = 1UL << slot_bits;
+    static constexpr u16 overflow_slot = Levels * slots;
+    static constexpr u64 no_tick = ~0UL;
+    static_assert(Levels * slot_bits < 64);
+
+    explicit timer_wheel(u64 now = 0)
+        : now_(now)
+    {
+    }
+    timer_wheel(const timer_wheel &) = delete;
+    timer_wheel &operator=(const timer_wheel &) = delete;
+
+    bool empty() const { return size_ == 0; }
+    u64 size() const { return size_; }
+    /// The first tick not expired yet
+    u64 now() const { return now_; }
+    static bool linked(const T *item) { return (item->*Node).linked; }
+
+    /// Expire \p item at \p tick. A tick before now() expires at now().
+    void insert(T *item, u64 tick)
+    {
+        auto &node = item->*Node;
+        node.tick = tick;
+        node.linked = true;
+        size_++;
+        place(item);
+    }
+
+    /// \p item must be in this wheel
+    void erase(T *item)
+    {
+        unlink(item);
+        (item->*Node).linked = false;
+        size_--;
+    }
+
+    /// The next tick the wheel has work at: an item expires, or a slot moves
+    /// down a level. no_tick if the wheel is empty.
+    u64 next_tick() const
+    {
+        u64 level;
+        u64 slot;
+        return find_next(level, slot);
+    }
+
+    /// Remove and return an item expired at \p tick, or nullptr once there is
+    /// none. Items of one tick come out in insertion order.
+    T *pop_expired(u64 tick)
+    {
+        for (;;)
+        {
+            u64 level;
+            u64 slot;
+            u64 next = find_next(level, slot);
+            if (next == no_tick || next > tick)
+            {
+                if (now_ > tick)
+                    return nullptr;
+                now_ = tick + 1;
+                // A slot starting right at the new now() has to move down
+                // before anything is inserted under it
+                if (next != now_ || level == 0)
+                    return nullptr;
+            }
+            else if (next > now_)
+            {
+                now_ = next;
+            }
+            if (level == 0)
+            {
+                T *item = heads_[slot];
+                erase(item);
+                return item;
+            }
+            cascade(level == Levels ? overflow_slot : static_cast<u16>(level * slots + slot));
+        }
+    }
+
+  private:
+    static constexpr u64 level_shift(u64 level) { return level * slot_bits; }
+    static constexpr u64 slot_index(u64 tick, u64 level) { return (tick >> level_shift(level)) & (slots - 1); }
+
+    /// The earliest slot with work, and the tick that work is due
+    u64 find_next(u64 &level, u64 &slot) const
+    {
+        for (level = 0; level < Levels; level++)
+        {
+            if (pending_[level] == 0)
+                continue;
+            // Every non-empty slot is at or after the slot of now()
+            slot = __builtin_ctzl(pending_[level]);
+            const u64 shift = level_shift(level);
+            const u64 base = (now_ >> (shift + slot_bits)) << (shift + slot_bits);
+            const u64 start = base | (slot << shift);
+            return start > now_ ? start : now_;
+        }
+        if (overflow_ != nullptr)
+        {
+            slot = 0;
+            return ((now_ >> level_shift(Levels)) + 1) << level_shift(Levels);
+        }
+        return no_tick;
+    }
+
+    void place(T *item)
+    {
+        auto &node = item->*Node;
+        const u64 tick = node.tick > now_ ? node.tick : now_;
+        const u64 diff = tick ^ now_;
+        u16 index;
+        if (diff >> level_shift(Levels) != 0)
+        {
+            index = overflow_slot;
+        }
+        else
+        {
+            const u64 level = diff == 0 ? 0 : (63 - __builtin_clzl(diff)) / slot_bits;
+            index = static_cast<u16>(level * slots + slot_index(tick, level));
+            pending_[level] |= 1UL << (index % slots);
+        }
+        node.slot = index;
+        // Append, so one slot keeps insertion order
+        T *&head = head_of(index);
+        node.next = nullptr;
+        if (head == nullptr)
+        {
+            node.prev = item;
+            head = item;
+        }
+        else
+        {
+            // The head's prev is the tail
+            T *tail = (head->*Node).prev;
+            node.prev = tail;
+            (tail->*Node).next = item;
+            (head->*Node).prev = item;
+        }
+    }
+
+    void unlink(T *item)
+    {
+        auto &node = item->*Node;
+        T *&head = head_of(node.slot);
+        if (head == item)
+        {
+            head = node.next;
+            if (head != nullptr)
+                (head->*Node).prev = node.prev;
+        }
+        else
+        {
+            (node.prev->*Node).next = node.next;
+            if (node.next != nullptr)
+                (node.next->*Node).prev = node.prev;
+            else
+                (head->*Node).prev = node.prev;
+        }
+        if (head == nullptr && node.slot != overflow_slot)
+            pending_[node.slot / slots] &= ~(1UL << (node.slot % slots));
+        node.prev = nullptr;
+        node.next = nullptr;
+    }
+
+    /// Move every item of slot \p index down to where it belongs at now()
+    void cascade(u16 index)
+    {
+        T *item = head_of(index);
+        head_of(index) = nullptr;
+        if (index != overflow_slot)
+            pending_[index / slots] &= ~(1UL << (index % slots));
+        while (item != nullptr)
+        {
+            T *next = (item->*Node).next;
+            place(item);
+            item = next;
+        }
+    }
+
+    T *&head_of(u16 index) { return index == overflow_slot ? overflow_ : heads_[index]; }
+
+    T *heads_[Levels * slots] = {};
+    T *overflow_ = nullptr;
+    u64 pending_[Levels] = {};
+    u64 now_;
+    u64 size_ = 0;
+};
+
+} // namespace util
@@ -344,6 +344,59 @@ freelibcxx::hash_map<u32, numa_info> get_numa_info()
     return ret;
 }
 
+freelibcxx::vector<memory_affinity> get_memory_affinity_list()
+{
+    freelibcxx::vector<memory_affinity> ret(memory::MemoryAllocatorV);
+    auto srat = load_table<ACPI_TABLE_SRAT>(ACPI_SIG_SRAT, false);
+    if (srat == nullptr)
+    {
+        return ret;
+    }
+    ACPI_SUBTABLE_HEADER *header = reinterpret_cast<ACPI_SUBTABLE_HEADER *>((char *)srat + sizeof(*srat));
+    while ((char *)header < (char *)srat + srat->Header.Length)
+    {
+        if (header->Type == ACPI_SRAT_TYPE_MEMORY_AFFINITY)
+        {
+            ACPI_SRAT_MEM_AFFINITY *affinity = reinterpret_cast<ACPI_SRAT_MEM_AFFINITY *>(header);
+            if ((affinity->Flags & ACPI_SRAT_MEM_ENABLED) && affinity->Length != 0)
+            {
+                memory_affinity info;
+                info.base = phy_addr_t::from(affinity->BaseAddress);
+                info.length = affinity->Length;
+                info.domain = affinity->ProximityDomain;
+                info.hot_pluggable = affinity->Flags & ACPI_SRAT_MEM_HOT_PLUGGABLE;
+                ret.push_back(info);
+            }
+        }
+
+        header = reinterpret_cast<ACPI_SUBTABLE_HEADER *>((char *)header + header->Length);
+    }
+    return ret;
+}
+
+freelibcxx::vector<u8> get_numa_distance(u64 &localities)
+{
+    freelibcxx::vector<u8> ret(memory::MemoryAllocatorV);
+    localities = 0;
+    auto slit = load_table<ACPI_TABLE_SLIT>(ACPI_SIG_SLIT, false);
+    if (slit == nullptr)
+    {
+        return ret;
+    }
+    u64 count = slit->LocalityCount;
+    if (sizeof(*slit) - sizeof(slit->Entry) + count * count > slit->Header.Length)
+    {
+        trace::warning("SLIT is truncated, locality count ", count);
+        return ret;
+    }
+    for (u64 i = 0; i < count * count; i++)
+    {
+        ret.push_back(slit->Entry[i]);
+    }
+    localities = count;
+    return ret;
+}
+
 void shutdown()
 {
     trace::info("shutdown");
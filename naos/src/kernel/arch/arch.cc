@@ -14,6 +14,7 @@
 #include "kernel/common.hpp"
 #include "kernel/mm/memory.hpp"
 #include "kernel/mm/mm.hpp"
+#include "kernel/mm/numa.hpp"
 #include "kernel/terminal.hpp"
 #include "kernel/trace.hpp"
 namespace arch
@@ -95,6 +96,8 @@ void init(const kernel_start_args *args)
             trace::debug("ACPI init");
             ACPI::init();
         }
+        // Before APIC init, where each CPU binds to its node.
+        memory::numa::init();
 
         trace::debug("APIC init");
         APIC::local_init();
@@ -127,6 +127,8 @@ bool has_feature(feature f)
             ret_cpu_feature(0x1, edx, 9);
         case feature::x2apic:
             ret_cpu_feature(0x1, ecx, 21);
+        case feature::tsc_deadline:
+            ret_cpu_feature(0x1, ecx, 24);
         case feature::msr:
             ret_cpu_feature(0x1, edx, 5);
         case feature::tsc:
@@ -301,6 +303,16 @@ freelibcxx::tuple<int, int> get_apic_bits()
 
 const char *get_cpu_manufacturer() { return family_name; }
 
+logic_core_id locate(int apic_id)
+{
+    auto [core_bits, logic_bits] = get_apic_bits();
+    logic_core_id id;
+    id.chip_index = apic_id >> (core_bits + logic_bits);
+    id.core_index = (apic_id >> logic_bits) & ((1 << core_bits) - 1);
+    id.logic_index = apic_id & ((1 << logic_bits) - 1);
+    return id;
+}
+
 void load_cpu_mesh(cpu_mesh &mesh)
 {
     int config_cpu_count = cmdline::get_int("cpu_num", 0);
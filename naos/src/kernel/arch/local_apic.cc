@@ -8,9 +8,11 @@
 #include "kernel/arch/paging.hpp"
 #include "kernel/arch/pit.hpp"
 #include "kernel/cmdline.hpp"
+#include "kernel/cpu.hpp"
 #include "kernel/irq.hpp"
 #include "kernel/mm/memory.hpp"
 #include "kernel/mm/new.hpp"
+#include "kernel/mm/numa.hpp"
 #include "kernel/mm/vm.hpp"
 #include "kernel/trace.hpp"
 #include "kernel/types.hpp"
@@ -241,6 +243,7 @@ void local_init()
     id = read_register(id_register) >> 24;
 
     cpu::current().set_apic_id(id);
+    memory::numa::bind_cpu(cpu::id(), id);
     if (arch::cpu::current().is_bsp())
     {
         if (version > 0xf)
@@ -334,6 +337,7 @@ irq::request_result clock_event::on_interrupt(const irq::interrupt_info *, u64)
 {
     if (likely(!is_suspend_.load() && id_ == cpu::current().get_apic_id()))
     {
+        ::cpu::current().edit_load_data().timer_interrupts++;
         jiff_.fetch_add(1);
         irq::raise_soft_irq(irq::soft_vector::timer);
         return irq::request_result::ok;
@@ -428,13 +432,55 @@ void clock_event::resume()
 
         uctx::UninterruptibleContext icu;
 
-        write_register(timer_initial_count_register, counter_);
         write_register(timer_divide_register, divide_);
-        write_register(timer_current_count_register, counter_);
+        if (!one_shot_)
+        {
+            write_register(timer_initial_count_register, counter_);
+            write_register(timer_current_count_register, counter_);
+        }
         local_enable(lvt_index::timer);
     }
 }
 
+constexpr u64 ia32_tsc_deadline = 0x6E0;
+
+bool clock_event::set_one_shot()
+{
+    uctx::UninterruptibleContext icu;
+    // A zero initial count stops the periodic countdown
+    write_register(timer_initial_count_register, 0);
+    u32 lvt = read_register(lvt_index_array[lvt_index::timer]) & ~(0b11U << 17);
+    if (tsc_hz_ != 0)
+    {
+        lvt |= 0b10 << 17;
+    }
+    write_register(lvt_index_array[lvt_index::timer], lvt);
+    one_shot_ = true;
+    return true;
+}
+
+bool clock_event::one_shot(::timeclock::microsecond_t delta)
+{
+    if (!one_shot_)
+        return false;
+    uctx::UninterruptibleContext icu;
+    if (tsc_hz_ != 0)
+    {
+        // Split so delta * tsc_hz_ cannot overflow
+        u64 ticks = delta / 1000'000UL * tsc_hz_ + delta % 1000'000UL * tsc_hz_ / 1000'000UL;
+        _wrmsr(ia32_tsc_deadline, _rdtsc() + freelibcxx::max(ticks, 1UL));
+        return true;
+    }
+    // The counter runs at the bus frequency over the divider, a longer delta
+    // fires early and is armed again. Split like the TSC ticks, dividing
+    // first would drop the fraction of a MHz.
+    const u64 counter_hz = bus_frequency_ / divide_value(divide_);
+    u64 count = delta / 1000'000UL * counter_hz + delta % 1000'000UL * counter_hz / 1000'000UL;
+    count = freelibcxx::min(freelibcxx::max(count, 1UL), 0xFFFF'FFFFUL);
+    write_register(timer_initial_count_register, count);
+    return true;
+}
+
 void clock_source::init() {}
 
 void clock_source::destroy() {}
@@ -4,6 +4,7 @@
 #include "kernel/arch/cpu_info.hpp"
 #include "kernel/arch/klib.hpp"
 #include "kernel/arch/mm.hpp"
+#include "kernel/arch/pcid.hpp"
 #include "kernel/arch/smp.hpp"
 #include "kernel/common.hpp"
 #include "kernel/kernel.hpp"
@@ -72,6 +73,71 @@ inline int get_bits(u64 addr, u8 start_bit, u8 bit_count) { return (addr >> star
 
 lock::spinlock_t share_spin;
 
+namespace
+{
+/// TLB flushes of one CPU. A CPU only adds to its own row.
+struct alignas(64) flush_counters
+{
+    u64 full;
+    u64 targeted;
+    u64 kept;
+};
+
+struct alignas(64) cpu_tables
+{
+    /// Page table in CR3, whose cpu_mask_ holds this CPU's bit
+    page_table_t *loaded;
+    pcid_cache cache;
+    /// kernel_generation when this CPU last dropped every PCID
+    u64 kernel_generation;
+};
+
+constexpr u64 cr4_pcid_enable = 1UL << 17;
+constexpr u64 cr3_no_flush = 1UL << 63;
+/// CR3 without the PCID in bits 0-11
+constexpr u64 cr3_address_mask = 0x000F'FFFF'FFFF'F000UL;
+
+flush_counters counters[cpu::max_cpu_support];
+cpu_tables tables[cpu::max_cpu_support];
+bool pcid_enabled = false;
+u64 last_table_id = 0;
+/// Generation of the kernel half, which every page table shares
+u64 kernel_generation = 0;
+
+flush_counters &current_counters() { return counters[cpu::has_init() ? cpu::id() : 0]; }
+
+void count(u64 &counter, u64 n = 1) { __atomic_add_fetch(&counter, n, __ATOMIC_RELAXED); }
+
+/// Turn on PCIDs on this CPU. CR3 must still hold PCID 0.
+void enable_pcid()
+{
+    if (!cpu_info::has_feature(cpu_info::feature::pcid))
+    {
+        return;
+    }
+    u64 cr4;
+    __asm__ __volatile__("movq %%cr4, %0	\n\t" : "=r"(cr4) : :);
+    cr4 |= cr4_pcid_enable;
+    __asm__ __volatile__("movq %0, %%cr4	\n\t" : : "r"(cr4) : "memory");
+    pcid_enabled = true;
+}
+} // namespace
+
+void get_flush_stats(flush_stats &stats)
+{
+    stats.full = 0;
+    stats.targeted = 0;
+    stats.kept = 0;
+    for (u32 i = 0; i < cpu::max_cpu_support; i++)
+    {
+        stats.full += __atomic_load_n(&counters[i].full, __ATOMIC_RELAXED);
+        stats.targeted += __atomic_load_n(&counters[i].targeted, __ATOMIC_RELAXED);
+        stats.kept += __atomic_load_n(&counters[i].kept, __ATOMIC_RELAXED);
+    }
+}
+
+bool has_pcid() { return pcid_enabled; }
+
 template <typename PageTable, typename PageEntry>
     requires page_table<PageTable>
 bool share_page_entry(PageTable &base, PageEntry &entry, u64 flags, u64 actions)
@@ -106,7 +172,8 @@ bool share_page_entry(PageTable &base, PageEntry &entry, u64 flags, u64 actions)
             memory::page *page = memory::global_zones->get_page(next[i].get_addr());
             page->add_ref_count();
 
-            next[i].set_flags(readonly_flags);
+            // A 2 MiB entry stays a leaf; its block is shared like a table.
+            next[i].set_flags(readonly_flags | (next[i].flags() & flags::big_page));
             (*p)[i] = next[i];
             new_counter++;
         }
@@ -122,6 +189,54 @@ bool share_page_entry(PageTable &base, PageEntry &entry, u64 flags, u64 actions)
     return true;
 }
 
+/// Demote the 2 MiB page at \p pd[index] to a page table of 4 KiB entries
+/// with the same flags. A block mapped only here is split in place. A block
+/// still shared after fork is copied, because the other address space keeps
+/// mapping it whole.
+void split_big_page(pdt &pd, int index)
+{
+    auto &pde = pd[index];
+    u64 entry_flags = pde.flags() & ~(flags::big_page | flags::accessed | flags::dirty);
+    byte *block = static_cast<byte *>(pde.get_addr());
+    phy_addr_t physical = pde.get_phy_addr();
+    memory::page *head = memory::global_zones->get_page(block);
+    auto *table = new_page_table<pt>();
+
+    if (head == nullptr)
+    {
+        // device memory
+        for (u64 i = 0; i < big_pages; i++)
+        {
+            (*table)[i].set_phy_addr((physical + i * frame_size::size_4kb)());
+        }
+    }
+    else if (head->get_ref_count() == 1)
+    {
+        memory::global_zones->split(block);
+        for (u64 i = 0; i < big_pages; i++)
+        {
+            (*table)[i].set_addr(block + i * frame_size::size_4kb);
+        }
+    }
+    else
+    {
+        for (u64 i = 0; i < big_pages; i++)
+        {
+            void *page = memory::KernelBuddyAllocatorV->allocate(frame_size::size_4kb, 0);
+            memcpy(page, block + i * frame_size::size_4kb, frame_size::size_4kb);
+            (*table)[i].set_addr(page);
+        }
+        memory::KernelBuddyAllocatorV->deallocate(block);
+    }
+    for (u64 i = 0; i < big_pages; i++)
+    {
+        (*table)[i].set_flags(entry_flags);
+    }
+    page_table2page(*table)->set_page_table_counter(big_pages);
+    pde.set_next(table);
+    pde.set_flags(entry_flags);
+}
+
 template <typename PageTable>
     requires page_table<PageTable>
 int counter(PageTable &base)
@@ -278,6 +393,10 @@ void temp_update_uncached(void *virt, u64 pages)
 
 void init_ap()
 {
+    if (pcid_enabled)
+    {
+        enable_pcid();
+    }
     auto &kernel_paging = memory::kernel_vm_info->paging();
     kernel_paging.load();
 }
@@ -310,6 +429,12 @@ void init()
     }
     trace::debug("Map address ", trace::hex(0), "-", trace::hex(max_maped_memory), "->", virt_start, "-",
                  trace::hex(memory::minimum_kernel_addr + max_maped_memory));
+
+    enable_pcid();
+    if (pcid_enabled)
+    {
+        trace::debug("PCID enabled");
+    }
 }
 
 NoReturn void error_map()
@@ -328,14 +453,26 @@ pml4t *current()
 {
     u64 v;
     __asm__ __volatile__("movq %%cr3, %0	\n\t" : "=r"(v) : :);
-    return memory::pa2va<pml4t *>(phy_addr_t::from(v));
+    return memory::pa2va<pml4t *>(phy_addr_t::from(v & cr3_address_mask));
 }
 
 page_table_t::page_table_t()
     : self_(true)
+    , id_(__atomic_add_fetch(&last_table_id, 1, __ATOMIC_RELAXED))
+    , generation_(0)
+    , cpu_mask_(0)
 {
     base_ = new_page_table<pml4t>();
 }
+
+page_table_t::page_table_t(pml4t *base)
+    : base_(base)
+    , self_(false)
+    , id_(__atomic_add_fetch(&last_table_id, 1, __ATOMIC_RELAXED))
+    , generation_(0)
+    , cpu_mask_(0)
+{
+}
 page_table_t &page_table_t::operator=(page_table_t &&rhs)
 {
     if (&rhs == this)
@@ -349,6 +486,9 @@ page_table_t &page_table_t::operator=(page_table_t &&rhs)
 
     base_ = rhs.base_;
     self_ = rhs.self_;
+    id_ = rhs.id_;
+    generation_ = rhs.generation_;
+    cpu_mask_ = rhs.cpu_mask_;
 
     rhs.base_ = nullptr;
 
@@ -363,11 +503,60 @@ page_table_t::~page_table_t()
     }
 }
 
-void page_table_t::load() { __asm__ __volatile__("movq %0, %%cr3	\n\t" : : "r"(memory::va2pa(base_)()) : "memory"); }
+void page_table_t::load()
+{
+    u64 cr3 = reinterpret_cast<u64>(memory::va2pa(base_)());
+    uctx::UninterruptibleContext icu;
+    auto &state = tables[cpu::id()];
+    if (state.loaded != this)
+    {
+        // Set before reading the generation, pairs with changed() before
+        // cpu_mask(): a shootdown either reaches this CPU or this load sees
+        // the change.
+        const u64 bit = 1UL << cpu::id();
+        if (state.loaded != nullptr)
+        {
+            __atomic_fetch_and(&state.loaded->cpu_mask_, ~bit, __ATOMIC_SEQ_CST);
+        }
+        __atomic_fetch_or(&cpu_mask_, bit, __ATOMIC_SEQ_CST);
+        state.loaded = this;
+    }
+    if (!pcid_enabled)
+    {
+        count(current_counters().full);
+        __asm__ __volatile__("movq %0, %%cr3	\n\t" : : "r"(cr3) : "memory");
+        return;
+    }
+
+    u64 kernel = __atomic_load_n(&kernel_generation, __ATOMIC_SEQ_CST);
+    if (state.kernel_generation != kernel)
+    {
+        // Kernel entries are cached under every PCID
+        state.cache.invalidate_all();
+        state.kernel_generation = kernel;
+    }
+    // Read before the CR3 write, a change racing with it flushes again next time.
+    auto choice = state.cache.assign(id_, __atomic_load_n(&generation_, __ATOMIC_SEQ_CST));
+    cr3 |= choice.pcid;
+    if (choice.flush)
+    {
+        count(current_counters().full);
+    }
+    else
+    {
+        cr3 |= cr3_no_flush;
+        count(current_counters().kept);
+    }
+    __asm__ __volatile__("movq %0, %%cr3	\n\t" : : "r"(cr3) : "memory");
+}
+
+bool page_table_t::loaded_here() const { return (cpu_mask() >> cpu::id()) & 1; }
 
 void page_table_t::reload()
 {
+    // Writing CR3 back drops the entries of its PCID only
     u64 c = 0;
+    count(current_counters().full);
     __asm__ __volatile__("movq %%cr3, %0	\n\t"
                          "movq %0, %%cr3	\n\t"
                          : "+g"(c)
@@ -375,6 +564,49 @@ void page_table_t::reload()
                          : "memory");
 }
 
+void page_table_t::flush_all()
+{
+    if (pcid_enabled)
+    {
+        uctx::UninterruptibleContext icu;
+        tables[cpu::id()].cache.invalidate_all();
+    }
+    reload();
+}
+
+void page_table_t::invalidate(void *virt)
+{
+    count(current_counters().targeted);
+    __asm__ __volatile__("invlpg (%0)	\n\t" : : "r"(virt) : "memory");
+}
+
+void page_table_t::invalidate(void *virt, size_t pages)
+{
+    if (pages > invalidate_page_limit)
+    {
+        reload();
+        return;
+    }
+    auto p = reinterpret_cast<byte *>(virt);
+    for (size_t i = 0; i < pages; i++, p += frame_size::size_4kb)
+    {
+        __asm__ __volatile__("invlpg (%0)	\n\t" : : "r"(p) : "memory");
+    }
+    count(current_counters().targeted, pages);
+}
+
+void page_table_t::changed(int pml4e_index)
+{
+    if (pml4e_index >= 256)
+    {
+        __atomic_add_fetch(&kernel_generation, 1, __ATOMIC_SEQ_CST);
+    }
+    else
+    {
+        __atomic_add_fetch(&generation_, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
 void page_table_t::map(void *virt_start, size_t pages, u64 flags, u64 actions)
 {
     // virtual address doesn't align of 4kb
@@ -408,6 +640,7 @@ void page_table_t::map(void *virt_start, size_t pages, u64 flags, u64 actions)
             {
                 error_map();
             }
+            changed(pml4e_index);
             auto page = memory::global_zones->get_page(old_addr);
             if (page->get_ref_count() >= 1)
             {
@@ -465,6 +698,10 @@ void page_table_t::map_to(void *virt_start, size_t pages, phy_addr_t phy_start,
         {
             page_table2page((*base_)[pml4e_index][pdpe_index][pde_index].next())->add_page_table_counter();
         }
+        else
+        {
+            changed(pml4e_index);
+        }
         pe.set_phy_addr(phy_start());
         pe.set_flags(flags);
 
@@ -503,6 +740,10 @@ void page_table_t::big_page_map_to(void *virt_start, size_t pages, phy_addr_t ph
         {
             page_table2page((*base_)[pml4e_index][pdpe_index].next())->add_page_table_counter();
         }
+        else
+        {
+            changed(pml4e_index);
+        }
         pde.set_phy_addr(phy_start());
         pde.set_flags(flags | flags::big_page);
 
@@ -542,6 +783,10 @@ void page_table_t::huge_page_map_to(void *virt_start, size_t pages, phy_addr_t p
         {
             page_table2page((*base_)[pml4e_index].next())->add_page_table_counter();
         }
+        else
+        {
+            changed(pml4e_index);
+        }
         pdpe.set_phy_addr(phy_start());
         pdpe.set_flags(flags | flags::huge_page);
 
@@ -549,6 +794,100 @@ void page_table_t::huge_page_map_to(void *virt_start, size_t pages, phy_addr_t p
     }
 }
 
+bool page_table_t::map_big_page(void *virt_start, void *block, u64 flags)
+{
+    auto p = reinterpret_cast<uintptr_t>(virt_start);
+    if (p & (frame_size::size_2mb - 1))
+    {
+        error_map();
+    }
+    flags |= flags::present;
+
+    auto index = from_virt_addr(p);
+    auto [pml4e_index, pdpe_index, pde_index, pte_index] = index.unpack();
+
+    ensure(pml4e_index, pdpe_index, flags, action_flags::override | action_flags::copy_all);
+
+    auto &pdpe = (*base_)[pml4e_index][pdpe_index];
+    auto &pde = pdpe[pde_index];
+    if (pde.is_present())
+    {
+        return false;
+    }
+    page_table2page(pdpe.next())->add_page_table_counter();
+    pde.set_addr(block);
+    pde.set_flags(flags | flags::big_page);
+    return true;
+}
+
+bool page_table_t::big_page_free(void *virt)
+{
+    auto p = memory::align_down(reinterpret_cast<u64>(virt), frame_size::size_2mb);
+
+    auto index = from_virt_addr(p);
+    auto [pml4e_index, pdpe_index, pde_index, pte_index] = index.unpack();
+
+    auto &pml4e = (*base_)[pml4e_index];
+    if (!pml4e.is_present())
+    {
+        return true;
+    }
+    auto &pdpe = pml4e[pdpe_index];
+    if (!pdpe.is_present())
+    {
+        return true;
+    }
+    if (pdpe.is_big_page())
+    {
+        return false;
+    }
+    return !pdpe[pde_index].is_present();
+}
+
+bool page_table_t::write_big_page(void *virt, u64 flags)
+{
+    auto p = memory::align_down(reinterpret_cast<u64>(virt), frame_size::size_2mb);
+
+    auto index = from_virt_addr(p);
+    auto [pml4e_index, pdpe_index, pde_index, pte_index] = index.unpack();
+
+    auto &pml4e = (*base_)[pml4e_index];
+    if (!pml4e.is_present())
+    {
+        return false;
+    }
+    auto &pdpe = pml4e[pdpe_index];
+    if (!pdpe.is_present() || pdpe.is_big_page())
+    {
+        return false;
+    }
+    if (!pdpe[pde_index].is_present() || !pdpe[pde_index].is_big_page())
+    {
+        return false;
+    }
+    flags |= flags::present;
+
+    // Unsharing the tables on the way takes a reference on the block for
+    // every copied directory.
+    ensure(pml4e_index, pdpe_index, flags, action_flags::cow | action_flags::override);
+    auto &pde = (*base_)[pml4e_index][pdpe_index][pde_index];
+    void *block = pde.get_addr();
+    if (memory::global_zones->get_page_reference(block) != 1)
+    {
+        void *copy = memory::global_zones->allocate_big_page();
+        if (copy == nullptr)
+        {
+            return false;
+        }
+        memcpy(copy, block, frame_size::size_2mb);
+        memory::KernelBuddyAllocatorV->deallocate(block);
+        pde.set_addr(copy);
+        changed(pml4e_index);
+    }
+    pde.set_flags(flags | flags::big_page);
+    return true;
+}
+
 void page_table_t::prepare_kernel_space()
 {
     for (int pml4e_index = 256; pml4e_index < 512; pml4e_index++)
@@ -579,6 +918,11 @@ void page_table_t::map_kernel_space()
 }
 
 void page_table_t::unmap(void *virt_start, size_t pages)
+{
+    unmap(virt_start, pages, [](void *page) { memory::KernelBuddyAllocatorV->deallocate(page); });
+}
+
+void page_table_t::unmap(void *virt_start, size_t pages, release_page release)
 {
     auto p = reinterpret_cast<uintptr_t>(virt_start);
     if (p & (frame_size::size_4kb - 1))
@@ -632,6 +976,50 @@ void page_table_t::unmap(void *virt_start, size_t pages)
             }
             break;
         }
+        if (!skip && pde->is_big_page())
+        {
+            ensure(pml4e_index, pdpe_index, pde->flags() & ~flags::big_page,
+                   action_flags::cow | action_flags::override | action_flags::copy_all);
+            pml4e = &(*base_)[pml4e_index];
+            pdpe = &(*pml4e)[pdpe_index];
+            pde = &(*pdpe)[pde_index];
+
+            changed(pml4e_index);
+            if (pte_index != 0 || pages - i < big_pages)
+            {
+                // Partial unmap, continue at 4 KiB granularity
+                split_big_page(pdpe->next(), pde_index);
+            }
+            else
+            {
+                const phy_addr_t block_physical = pde->get_phy_addr();
+                if (memory::global_zones->which(block_physical) != nullptr)
+                    release(pde->get_addr());
+                pde->set_flags(0);
+
+                auto pdpe_page = page_table2page(pdpe->next());
+                auto pml4e_page = page_table2page(pml4e->next());
+
+                kassert(pdpe_page->page_table_counter() > 0, "invalid status");
+                pdpe_page->sub_page_table_counter();
+                if (pdpe_page->page_table_counter() == 0)
+                {
+                    delete_page_table(&pdpe->next());
+                    pdpe->set_flags(0);
+
+                    kassert(pml4e_page->page_table_counter() > 0, "invalid status");
+                    pml4e_page->sub_page_table_counter();
+                }
+
+                if (pml4e_page->page_table_counter() == 0)
+                {
+                    delete_page_table(&pml4e->next());
+                    pml4e->set_flags(0);
+                }
+                skip_level = 2;
+                skip = true;
+            }
+        }
         if (!skip)
         {
             // auto rest = pages - i;
@@ -683,9 +1071,10 @@ void page_table_t::unmap(void *virt_start, size_t pages)
                 kassert(memory::global_zones->get_page_reference(pde->get_addr()) == 1, "pml4e ", pml4e_index, " pdpe ",
                         pdpe_index, " pde ", pde_index, " check status fail ", trace::hex(addr));
 
+                changed(pml4e_index);
                 const phy_addr_t leaf_physical = memory::va2pa(pte->get_addr());
                 if (memory::global_zones->which(leaf_physical) != nullptr)
-                    memory::KernelBuddyAllocatorV->deallocate(pte->get_addr());
+                    release(pte->get_addr());
                 pte->set_flags(0);
 
                 auto pde_page = page_table2page(pde->next());
@@ -751,7 +1140,7 @@ void page_table_t::unmap(void *virt_start, size_t pages)
     }
 }
 
-// return need add counter
+// return true if a present entry now points to a copy of its table
 template <typename PageTable>
     requires page_table<PageTable>
 bool ensure_single(PageTable &base, int index, u64 flags, u64 actions)
@@ -780,24 +1169,39 @@ bool ensure_single(PageTable &base, int index, u64 flags, u64 actions)
                 "!=", page_table2page(base)->page_table_counter());
     }
 
-    return true;
+    return false;
 }
 
 void page_table_t::ensure(int pml4e_index, int pdpe_index, int pde_index, u64 flags, u64 actions)
 {
     ensure(pml4e_index, pdpe_index, flags, actions);
-    ensure_single((*base_)[pml4e_index][pdpe_index].next(), pde_index, flags, actions);
+    auto &pd = (*base_)[pml4e_index][pdpe_index].next();
+    if (pd[pde_index].is_present() && pd[pde_index].is_big_page())
+    {
+        split_big_page(pd, pde_index);
+        changed(pml4e_index);
+    }
+    if (ensure_single(pd, pde_index, flags, actions))
+    {
+        changed(pml4e_index);
+    }
 }
 
 void page_table_t::ensure(int pml4e_index, int pdpe_index, u64 flags, u64 actions)
 {
     ensure(pml4e_index, flags, actions);
-    ensure_single((*base_)[pml4e_index].next(), pdpe_index, flags, actions);
+    if (ensure_single((*base_)[pml4e_index].next(), pdpe_index, flags, actions))
+    {
+        changed(pml4e_index);
+    }
 }
 
 void page_table_t::ensure(int pml4e_index, u64 flags, u64 actions)
 {
-    ensure_single(*base_, pml4e_index, flags, actions);
+    if (ensure_single(*base_, pml4e_index, flags, actions))
+    {
+        changed(pml4e_index);
+    }
 }
 
 bool page_table_t::has_flags(void *virt_start, u64 flags)
@@ -857,7 +1261,7 @@ freelibcxx::optional<phy_addr_t> page_table_t::get_map(void *virt_start)
     }
     if (pdpe.is_big_page())
     {
-        return pdpe.get_phy_addr();
+        return pdpe.get_phy_addr() + static_cast<ptrdiff_t>(p & (frame_size::size_1gb - 1));
     }
     auto &pde = pdpe[pde_index];
     if (!pde.is_present())
@@ -866,7 +1270,7 @@ freelibcxx::optional<phy_addr_t> page_table_t::get_map(void *virt_start)
     }
     if (pde.is_big_page())
     {
-        return pde.get_phy_addr();
+        return pde.get_phy_addr() + static_cast<ptrdiff_t>(p & (frame_size::size_2mb - 1));
     }
     auto &pte = pde[pte_index];
     if (!pte.is_present())
@@ -899,6 +1303,7 @@ void page_table_t::clone_readonly_to(void *virt_start, size_t pages, page_table_
         flags &= ~flags::writable;
 
         src.set_flags(flags);
+        changed(pml4e_index);
 
         dst = src;
         to_page->add_page_table_counter();
@@ -87,6 +87,13 @@ void clock_source::calibrate(::timeclock::clock_source *cs)
 
 u64 clock_source::current() { return (_rdtsc() - begin_tsc_) * 1000'000UL / tsc_tick_second_; }
 
+u64 clock_source::current_ns()
+{
+    u64 ticks = _rdtsc() - begin_tsc_;
+    // Split so ticks * 10^9 cannot overflow
+    return ticks / tsc_tick_second_ * 1000'000'000UL + ticks % tsc_tick_second_ * 1000'000'000UL / tsc_tick_second_;
+}
+
 clock_source *make_clock()
 {
     if (arch::cpu_info::has_feature(arch::cpu_info::feature::constant_tsc))
@@ -0,0 +1,49 @@
+#include "kernel/dev/dispatchinfo.hpp"
+#include "kernel/ipc/invocation.hpp"
+
+namespace dev::dispatchinfo
+{
+namespace
+{
+constexpr u64 line_capacity = 256;
+
+constexpr const char header[] = "# cpus workers idle blocked dispatched stolen total_latency_ns max_latency_ns\n";
+constexpr const char queue_header[] = "# cpu depth max_depth\n";
+} // namespace
+
+u64 dispatchinfo_pseudo_t::capacity()
+{
+    naos::ipc::dispatch_stats stats;
+    naos::ipc::get_dispatch_stats(stats);
+    return sizeof(header) + sizeof(queue_header) + (stats.cpus + 1) * line_capacity;
+}
+
+void dispatchinfo_pseudo_t::render(report_writer &writer)
+{
+    naos::ipc::dispatch_stats stats;
+    naos::ipc::get_dispatch_stats(stats);
+    writer.text(header, sizeof(header) - 1);
+    writer.text("dispatch", 8);
+    writer.number(stats.cpus);
+    writer.number(stats.workers);
+    writer.number(stats.idle);
+    writer.number(stats.blocked);
+    writer.number(stats.dispatched);
+    writer.number(stats.stolen);
+    writer.number(stats.total_latency_ns);
+    writer.number(stats.max_latency_ns);
+    writer.text("\n", 1);
+
+    writer.text(queue_header, sizeof(queue_header) - 1);
+    for (u32 cpu = 0; cpu < stats.cpus; cpu++)
+    {
+        naos::ipc::dispatch_queue_stats queue;
+        naos::ipc::get_dispatch_queue_stats(cpu, queue);
+        writer.text("cpu", 3);
+        writer.number(cpu);
+        writer.number(queue.depth);
+        writer.number(queue.max_depth);
+        writer.text("\n", 1);
+    }
+}
+} // namespace dev::dispatchinfo
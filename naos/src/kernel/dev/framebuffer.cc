@@ -85,9 +85,10 @@ void framebuffer_pseudo_t::force_offline()
         return;
 
     trace::warning("forcing framebuffer owner offline pid=", process->pid);
-    // Do not edit a foreign address space from this CPU: this kernel has no
-    // TLB shootdown primitive yet. Process teardown unmaps the framebuffer
-    // and releases the writer lease on the owning process's CPU.
+    // This runs from the terminal timer and holds no reference to the owner's
+    // address space, so it must not unmap it here. Teardown unmaps the
+    // framebuffer on the owner's side, with its own vma locking and TLB
+    // shootdown, and releases the writer lease.
     task::exit_process(process, -EIO, 0);
 }
 
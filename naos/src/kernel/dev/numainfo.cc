@@ -0,0 +1,34 @@
+#include "kernel/dev/numainfo.hpp"
+#include "kernel/mm/numa.hpp"
+
+namespace dev::numainfo
+{
+namespace
+{
+constexpr u64 line_capacity = 256;
+
+constexpr const char header[] = "# node domain cpus pages free_pages local_allocs remote_allocs frees\n";
+} // namespace
+
+u64 numainfo_pseudo_t::capacity() { return sizeof(header) + memory::numa::node_count() * line_capacity; }
+
+void numainfo_pseudo_t::render(report_writer &writer)
+{
+    writer.text(header, sizeof(header) - 1);
+    for (u32 node = 0; node < memory::numa::node_count(); node++)
+    {
+        memory::numa::node_stats stats;
+        memory::numa::get_stats(static_cast<u8>(node), stats);
+        writer.text("node", 4);
+        writer.number(node);
+        writer.number(stats.domain);
+        writer.number(stats.cpu_mask);
+        writer.number(stats.total_pages);
+        writer.number(stats.free_pages);
+        writer.number(stats.local_allocs);
+        writer.number(stats.remote_allocs);
+        writer.number(stats.frees);
+        writer.text("\n", 1);
+    }
+}
+} // namespace dev::numainfo
@@ -0,0 +1,38 @@
+#include "kernel/dev/report.hpp"
+#include "kernel/errno.hpp"
+#include "kernel/mm/memory.hpp"
+
+namespace dev
+{
+i64 report_pseudo_t::write(const byte *data, u64 size, flag_t flags)
+{
+    (void)data;
+    (void)size;
+    (void)flags;
+    return EACCES;
+}
+
+i64 report_pseudo_t::read(byte *data, u64 max_size, flag_t flags)
+{
+    i64 offset = 0;
+    return read_at(offset, data, max_size, flags);
+}
+
+i64 report_pseudo_t::read_at(i64 &offset, byte *data, u64 max_size, flag_t flags)
+{
+    (void)flags;
+    if (offset < 0)
+        return EINVAL;
+
+    const u64 size = capacity();
+    char *buffer = static_cast<char *>(memory::KernelCommonAllocatorV->allocate(size, 8));
+    if (buffer == nullptr)
+        return ENOMEM;
+
+    report_writer writer(buffer, size);
+    render(writer);
+    u64 count = writer.read_at(offset, data, max_size);
+    memory::KernelCommonAllocatorV->deallocate(buffer);
+    return static_cast<i64>(count);
+}
+} // namespace dev
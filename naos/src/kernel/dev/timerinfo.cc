@@ -0,0 +1,28 @@
+#include "kernel/dev/timerinfo.hpp"
+#include "kernel/cpu.hpp"
+
+namespace dev::timerinfo
+{
+namespace
+{
+constexpr u64 line_capacity = 128;
+
+constexpr const char header[] = "# cpu timer_interrupts schedules\n";
+} // namespace
+
+u64 timerinfo_pseudo_t::capacity() { return sizeof(header) + cpu::count() * line_capacity; }
+
+void timerinfo_pseudo_t::render(report_writer &writer)
+{
+    writer.text(header, sizeof(header) - 1);
+    for (u32 id = 0; id < cpu::count(); id++)
+    {
+        const auto &load = cpu::get(id).get_load_data();
+        writer.text("cpu", 3);
+        writer.number(id);
+        writer.number(load.timer_interrupts);
+        writer.number(load.schedule_times);
+        writer.text("\n", 1);
+    }
+}
+} // namespace dev::timerinfo
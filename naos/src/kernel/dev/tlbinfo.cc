@@ -0,0 +1,27 @@
+#include "kernel/dev/tlbinfo.hpp"
+#include "kernel/arch/paging.hpp"
+
+namespace dev::tlbinfo
+{
+namespace
+{
+constexpr u64 line_capacity = 128;
+
+constexpr const char header[] = "# pcid full targeted kept\n";
+} // namespace
+
+u64 tlbinfo_pseudo_t::capacity() { return sizeof(header) + line_capacity; }
+
+void tlbinfo_pseudo_t::render(report_writer &writer)
+{
+    arch::paging::flush_stats stats;
+    arch::paging::get_flush_stats(stats);
+    writer.text(header, sizeof(header) - 1);
+    writer.text("tlb", 3);
+    writer.number(arch::paging::has_pcid() ? 1 : 0);
+    writer.number(stats.full);
+    writer.number(stats.targeted);
+    writer.number(stats.kept);
+    writer.text("\n", 1);
+}
+} // namespace dev::tlbinfo
@@ -0,0 +1,137 @@
+#include "kernel/fs/vfs/dcache.hpp"
+#include "kernel/arch/cpu.hpp"
+#include "kernel/arch/klib.hpp"
+#include "kernel/fs/vfs/dentry.hpp"
+#include "kernel/lock.hpp"
+#include "kernel/task.hpp"
+#include "kernel/ucontext.hpp"
+#include "kernel/util/sleepable_rcu.hpp"
+#include <atomic>
+
+namespace fs::vfs::dcache
+{
+namespace
+{
+constexpr u64 bucket_count = 4096;
+static_assert((bucket_count & (bucket_count - 1)) == 0);
+
+std::atomic<dentry *> buckets[bucket_count];
+
+lock::lock_class hash_lock_class("dcache_hash");
+lock::lock_class rename_lock_class("dcache_rename");
+lock::spinlock_t hash_lock(hash_lock_class);
+lock::spinlock_t rename_lock(rename_lock_class);
+
+/// Odd while a rename_scope moves dentries between chains
+std::atomic<u64> rename_seq{0};
+
+util::sleepable_rcu<arch::cpu::max_cpu_support> walkers;
+
+std::atomic<dentry *> &bucket(const dentry *parent, u64 name_hash)
+{
+    u64 h = (reinterpret_cast<u64>(parent) ^ name_hash) * 0x9E3779B97F4A7C15UL;
+    h ^= h >> 32;
+    return buckets[h & (bucket_count - 1)];
+}
+
+u32 current_slot() { return arch::cpu::has_init() ? arch::cpu::id() : 0; }
+
+} // namespace
+
+u64 hash_name(const char *name)
+{
+    // FNV-1a
+    u64 h = 0xCBF29CE484222325UL;
+    for (; *name != 0; name++)
+    {
+        h ^= static_cast<u8>(*name);
+        h *= 0x100000001B3UL;
+    }
+    return h;
+}
+
+dentry *lookup(const dentry *parent, const char *name)
+{
+    const u64 h = hash_name(name);
+    auto &head = bucket(parent, h);
+    for (;;)
+    {
+        u64 seq = rename_seq.load(std::memory_order_acquire);
+        if (seq & 1)
+        {
+            cpu_pause();
+            continue;
+        }
+        dentry *found = nullptr;
+        for (auto d = head.load(std::memory_order_acquire); d != nullptr;
+             d = d->hash_next.load(std::memory_order_acquire))
+        {
+            if (d->hash() == h && d->get_parent() == parent && strcmp(d->get_name(), name) == 0)
+            {
+                found = d;
+                break;
+            }
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (rename_seq.load(std::memory_order_relaxed) == seq)
+            return found;
+    }
+}
+
+void insert(dentry *entry)
+{
+    if (entry->get_name() == nullptr)
+        return;
+    auto &head = bucket(entry->get_parent(), entry->hash());
+    uctx::RawSpinLockUninterruptibleContext icu(hash_lock);
+    entry->set_hashed();
+    entry->hash_next.store(head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    head.store(entry, std::memory_order_release);
+}
+
+void remove(dentry *entry)
+{
+    auto *link = &bucket(entry->get_parent(), entry->hash());
+    uctx::RawSpinLockUninterruptibleContext icu(hash_lock);
+    for (auto d = link->load(std::memory_order_relaxed); d != nullptr; d = link->load(std::memory_order_relaxed))
+    {
+        if (d == entry)
+        {
+            // Leave hash_next alone, a walk standing on the entry goes on
+            link->store(entry->hash_next.load(std::memory_order_relaxed), std::memory_order_release);
+            return;
+        }
+        link = &d->hash_next;
+    }
+}
+
+void synchronize()
+{
+    walkers.synchronize([] { task::thread_yield(); });
+}
+
+walk_scope::walk_scope()
+    : slot(current_slot())
+    , epoch(walkers.read_lock(slot))
+{
+}
+
+walk_scope::~walk_scope() { walkers.read_unlock(slot, epoch); }
+
+rename_scope::rename_scope()
+{
+    interrupts = arch::idt::save_and_disable();
+    rename_lock.lock();
+    rename_seq.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+rename_scope::~rename_scope()
+{
+    rename_seq.fetch_add(1, std::memory_order_release);
+    rename_lock.unlock();
+    if (interrupts)
+        arch::idt::enable();
+}
+
+} // namespace fs::vfs::dcache
@@ -1,31 +1,32 @@
 #include "kernel/fs/vfs/dentry.hpp"
+#include "kernel/fs/vfs/dcache.hpp"
 #include "kernel/fs/vfs/inode.hpp"
 #include "kernel/fs/vfs/mm.hpp"
 #include "kernel/fs/vfs/super_block.hpp"
+#include "kernel/ucontext.hpp"
 
 namespace fs::vfs
 {
+namespace
+{
+lock::lock_class dentry_children_lock_class("dentry_children");
+} // namespace
+
 dentry::dentry()
-    : loaded_child(false)
+    : name(nullptr)
+    , name_hash(0)
+    , node(nullptr)
+    , parent(nullptr)
+    , loaded_child(false)
     , mount_point(false)
+    , hashed(false)
     , child_list(memory::KernelCommonAllocatorV)
-
+    , child_lock(dentry_children_lock_class)
+    , hash_next(nullptr)
 {
 }
 
-u64 dentry::hash() const { return 0; }
-
-dentry *dentry::find_child(const char *name) const
-{
-    for (auto &d : child_list)
-    {
-        if (strcmp(name, d->name) == 0)
-        {
-            return d;
-        }
-    }
-    return nullptr;
-}
+dentry *dentry::find_child(const char *name) const { return dcache::lookup(this, name); }
 
 void dentry::set_parent(dentry *parent) { this->parent = parent; }
 
@@ -35,7 +36,11 @@ void dentry::set_inode(inode *node) { this->node = node; }
 
 inode *dentry::get_inode() const { return node; }
 
-void dentry::set_name(const char *name) { this->name = name; }
+void dentry::set_name(const char *name)
+{
+    this->name = name;
+    name_hash = name == nullptr ? 0 : dcache::hash_name(name);
+}
 
 const char *dentry::get_name() const { return name; }
 
@@ -43,8 +48,20 @@ void dentry::load_child() { node->get_super_block()->fill_dentry(this); }
 
 void dentry::save_child() { node->get_super_block()->save_dentry(this); }
 
-void dentry::add_child(dentry *child) { child_list.push_back(child); }
+void dentry::add_child(dentry *child)
+{
+    {
+        uctx::RawSpinLockUninterruptibleContext icu(child_lock);
+        child_list.push_back(child);
+    }
+    dcache::insert(child);
+}
 
-void dentry::remove_child(dentry *child) { child_list.remove(child_list.find(child)); }
+void dentry::remove_child(dentry *child)
+{
+    dcache::remove(child);
+    uctx::RawSpinLockUninterruptibleContext icu(child_lock);
+    child_list.remove(child_list.find(child));
+}
 
 } // namespace fs::vfs
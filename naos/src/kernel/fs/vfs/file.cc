@@ -3,9 +3,11 @@
 #include "kernel/errno.hpp"
 #include "kernel/fs/vfs/dentry.hpp"
 #include "kernel/fs/vfs/inode.hpp"
+#include "kernel/fs/vfs/page_cache.hpp"
 #include "kernel/fs/vfs/pseudo.hpp"
 #include "kernel/fs/vfs/super_block.hpp"
 #include "kernel/fs/vfs/vfs.hpp"
+#include "kernel/mm/memory.hpp"
 #include <limits>
 
 namespace fs::vfs
@@ -136,6 +138,9 @@ bool file::native_truncate(u64 length)
     if (entry == nullptr || entry->get_inode() == nullptr || (mode & fs::mode::write) == 0)
         return false;
     entry->get_inode()->set_size(length);
+    auto *cache = entry->get_inode()->find_page_cache();
+    if (cache != nullptr)
+        cache->truncate(length);
     if (offset > static_cast<i64>(length))
         offset = static_cast<i64>(length);
     return true;
@@ -175,43 +180,65 @@ dentry *file::get_entry() const { return entry; }
 i64 file::read(byte *ptr, u64 max_size, flag_t flags, pseudo_t::interruption_check interrupted,
                pseudo_t::wait_queue_registration register_wait_queue)
 {
-    file_lock_guard guard(io_lock_);
-    if (entry == nullptr || entry->get_inode() == nullptr || (mode & fs::mode::read) == 0)
-        return EBADF;
-    if (max_size != 0 && ptr == nullptr)
-        return EFAULT;
-    if (max_size == 0)
-        return 0;
-    auto type = entry->get_inode()->get_type();
-    if (type == fs::inode_type_t::file || type == fs::inode_type_t::directory || type == fs::inode_type_t::symbolink)
-        return iread(offset, ptr, max_size, flags);
+    pseudo_t *pd = nullptr;
+    flag_t io_mode = 0;
+    {
+        file_lock_guard guard(io_lock_);
+        if (entry == nullptr || entry->get_inode() == nullptr || (mode & fs::mode::read) == 0)
+            return EBADF;
+        if (max_size != 0 && ptr == nullptr)
+            return EFAULT;
+        if (max_size == 0)
+            return 0;
+        auto type = entry->get_inode()->get_type();
+        if (type == fs::inode_type_t::file)
+            return cached_read(offset, ptr, max_size, flags);
+        if (type == fs::inode_type_t::directory || type == fs::inode_type_t::symbolink)
+            return iread(offset, ptr, max_size, flags);
 
-    auto *pd = entry->get_inode()->get_pseudo_data();
-    if (pd == nullptr)
-        return EFAILED;
-    return pd->read_at_interruptible(offset, ptr, max_size, mode | flags, interrupted, register_wait_queue);
+        pd = entry->get_inode()->get_pseudo_data();
+        if (pd == nullptr)
+            return EFAILED;
+        io_mode = mode | flags;
+        if (pd->seekable())
+            return pd->read_at_interruptible(offset, ptr, max_size, io_mode, interrupted, register_wait_queue);
+    }
+    // Both ends of a pipe are one file, a blocked reader must not keep the
+    // writer out
+    i64 no_offset = 0;
+    return pd->read_at_interruptible(no_offset, ptr, max_size, io_mode, interrupted, register_wait_queue);
 }
 
 i64 file::write(const byte *ptr, u64 size, flag_t flags, pseudo_t::interruption_check interrupted,
                 pseudo_t::wait_queue_registration register_wait_queue)
 {
-    file_lock_guard guard(io_lock_);
-    if (entry == nullptr || entry->get_inode() == nullptr || (mode & fs::mode::write) == 0)
-        return EBADF;
-    if (size != 0 && ptr == nullptr)
-        return EFAULT;
-    if (size == 0)
-        return 0;
-    if ((mode & fs::mode::append) != 0)
-        offset = static_cast<i64>(entry->get_inode()->get_size());
-    auto type = entry->get_inode()->get_type();
-    if (type == fs::inode_type_t::file || type == fs::inode_type_t::directory || type == fs::inode_type_t::symbolink)
-        return iwrite(offset, ptr, size, flags);
-
-    auto *pd = entry->get_inode()->get_pseudo_data();
-    if (pd == nullptr)
-        return -1;
-    return pd->write_at_interruptible(offset, ptr, size, mode | flags, interrupted, register_wait_queue);
+    pseudo_t *pd = nullptr;
+    flag_t io_mode = 0;
+    {
+        file_lock_guard guard(io_lock_);
+        if (entry == nullptr || entry->get_inode() == nullptr || (mode & fs::mode::write) == 0)
+            return EBADF;
+        if (size != 0 && ptr == nullptr)
+            return EFAULT;
+        if (size == 0)
+            return 0;
+        if ((mode & fs::mode::append) != 0)
+            offset = static_cast<i64>(entry->get_inode()->get_size());
+        auto type = entry->get_inode()->get_type();
+        if (type == fs::inode_type_t::file)
+            return cached_write(offset, ptr, size, flags);
+        if (type == fs::inode_type_t::directory || type == fs::inode_type_t::symbolink)
+            return iwrite(offset, ptr, size, flags);
+
+        pd = entry->get_inode()->get_pseudo_data();
+        if (pd == nullptr)
+            return -1;
+        io_mode = mode | flags;
+        if (pd->seekable())
+            return pd->write_at_interruptible(offset, ptr, size, io_mode, interrupted, register_wait_queue);
+    }
+    i64 no_offset = 0;
+    return pd->write_at_interruptible(no_offset, ptr, size, io_mode, interrupted, register_wait_queue);
 }
 
 i64 file::pread(i64 offset, byte *ptr, u64 max_size, flag_t flags, pseudo_t::interruption_check interrupted,
@@ -230,8 +257,9 @@ i64 file::pread(i64 offset, byte *ptr, u64 max_size, flag_t flags, pseudo_t::int
         if (max_size == 0)
             return 0;
         auto type = entry->get_inode()->get_type();
-        if (type == fs::inode_type_t::file || type == fs::inode_type_t::directory ||
-            type == fs::inode_type_t::symbolink)
+        if (type == fs::inode_type_t::file)
+            return cached_read(offset, ptr, max_size, flags);
+        if (type == fs::inode_type_t::directory || type == fs::inode_type_t::symbolink)
             return iread(offset, ptr, max_size, flags);
 
         pd = entry->get_inode()->get_pseudo_data();
@@ -260,8 +288,9 @@ i64 file::pwrite(i64 offset, const byte *ptr, u64 size, flag_t flags, pseudo_t::
             return 0;
 
         auto type = entry->get_inode()->get_type();
-        if (type == fs::inode_type_t::file || type == fs::inode_type_t::directory ||
-            type == fs::inode_type_t::symbolink)
+        if (type == fs::inode_type_t::file)
+            return cached_write(offset, ptr, size, flags);
+        if (type == fs::inode_type_t::directory || type == fs::inode_type_t::symbolink)
             return iwrite(offset, ptr, size, flags);
 
         pd = entry->get_inode()->get_pseudo_data();
@@ -273,6 +302,79 @@ i64 file::pwrite(i64 offset, const byte *ptr, u64 size, flag_t flags, pseudo_t::
     return pd->write_at_interruptible(current_offset, ptr, size, io_mode, interrupted, register_wait_queue);
 }
 
+byte *file::get_cached_page(u64 page_offset)
+{
+    file_lock_guard guard(io_lock_);
+    if (entry == nullptr || entry->get_inode() == nullptr || (mode & fs::mode::read) == 0 ||
+        entry->get_inode()->get_type() != fs::inode_type_t::file || (page_offset & (memory::page_size - 1)) != 0)
+        return nullptr;
+    auto *cache = entry->get_inode()->get_page_cache();
+    if (cache == nullptr)
+        return nullptr;
+    return cache->get(page_offset / memory::page_size, [this](byte *page, u64 index) {
+        i64 page_start = static_cast<i64>(index * memory::page_size);
+        return iread(page_start, page, memory::page_size, 0) >= 0;
+    });
+}
+
+byte *file::find_cached_page(u64 page_offset)
+{
+    if (!io_lock_.try_lock())
+        return nullptr;
+    byte *page = nullptr;
+    if (entry != nullptr && entry->get_inode() != nullptr && (mode & fs::mode::read) != 0 &&
+        entry->get_inode()->get_type() == fs::inode_type_t::file && (page_offset & (memory::page_size - 1)) == 0)
+    {
+        auto *cache = entry->get_inode()->find_page_cache();
+        if (cache != nullptr)
+            page = cache->find(page_offset / memory::page_size);
+    }
+    io_lock_.unlock();
+    return page;
+}
+
+// Called with io_lock_ held. Pages missing from the cache are read through
+// iread, so the filesystem sees whole page reads at page offsets.
+i64 file::cached_read(i64 &offset, byte *ptr, u64 max_size, flag_t flags)
+{
+    auto *node = entry->get_inode();
+    auto *cache = node->get_page_cache();
+    if (cache == nullptr || offset < 0)
+        return iread(offset, ptr, max_size, flags);
+
+    const u64 file_size = node->get_size();
+    const u64 start = static_cast<u64>(offset);
+    if (start >= file_size)
+        return 0;
+    if (max_size > file_size - start)
+        max_size = file_size - start;
+
+    u64 done = cache->read(start, ptr, max_size, [this, flags](byte *page, u64 index) {
+        i64 page_start = static_cast<i64>(index * memory::page_size);
+        return iread(page_start, page, memory::page_size, flags) >= 0;
+    });
+    offset += static_cast<i64>(done);
+    if (done < max_size)
+    {
+        // No page for the cache, read the rest directly.
+        auto rest = iread(offset, ptr + done, max_size - done, flags);
+        if (rest > 0)
+            done += static_cast<u64>(rest);
+    }
+    return static_cast<i64>(done);
+}
+
+// Called with io_lock_ held.
+i64 file::cached_write(i64 &offset, const byte *ptr, u64 size, flag_t flags)
+{
+    const i64 start = offset;
+    auto written = iwrite(offset, ptr, size, flags);
+    auto *cache = entry->get_inode()->find_page_cache();
+    if (written > 0 && cache != nullptr)
+        cache->write(static_cast<u64>(start), ptr, static_cast<u64>(written));
+    return written;
+}
+
 pseudo_t *file::get_pseudo()
 {
     if (entry == nullptr || entry->get_inode() == nullptr)
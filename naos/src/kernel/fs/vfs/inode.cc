@@ -1,8 +1,41 @@
 #include "kernel/fs/vfs/inode.hpp"
 #include "kernel/clock.hpp"
 #include "kernel/fs/vfs/dentry.hpp"
+#include "kernel/fs/vfs/page_cache.hpp"
+#include "kernel/mm/memory.hpp"
+#include "kernel/mm/new.hpp"
 namespace fs::vfs
 {
+inode::~inode()
+{
+    auto *pages = cache.load(std::memory_order_acquire);
+    if (pages != nullptr)
+    {
+        memory::Delete<>(memory::KernelCommonAllocatorV, pages);
+    }
+}
+
+page_cache *inode::get_page_cache()
+{
+    auto *pages = cache.load(std::memory_order_acquire);
+    if (pages != nullptr)
+    {
+        return pages;
+    }
+    auto *created = memory::New<page_cache>(memory::KernelCommonAllocatorV);
+    if (created == nullptr)
+    {
+        return nullptr;
+    }
+    // Another file description of this inode may have won the race.
+    if (!cache.compare_exchange_strong(pages, created, std::memory_order_acq_rel))
+    {
+        memory::Delete<>(memory::KernelCommonAllocatorV, created);
+        return pages;
+    }
+    return created;
+}
+
 bool inode::has_permission(flag_t pf, user_id uid, group_id gid)
 {
     if (uid == owner)
@@ -0,0 +1,277 @@
+#include "kernel/fs/vfs/page_cache.hpp"
+#include "freelibcxx/utils.hpp"
+#include "kernel/lock.hpp"
+#include "kernel/mm/memory.hpp"
+#include "kernel/mm/zone.hpp"
+#include "kernel/ucontext.hpp"
+
+namespace fs::vfs
+{
+namespace
+{
+class cache_lock_guard
+{
+  public:
+    explicit cache_lock_guard(lock::mutex_t &lock)
+        : lock_(lock)
+    {
+        lock_.lock();
+    }
+
+    ~cache_lock_guard() { lock_.unlock(); }
+
+    cache_lock_guard(const cache_lock_guard &) = delete;
+    cache_lock_guard &operator=(const cache_lock_guard &) = delete;
+
+  private:
+    lock::mutex_t &lock_;
+};
+
+lock::lock_class cache_list_lock_class("page_cache_list");
+lock::spinlock_t cache_list_lock(cache_list_lock_class);
+page_cache *cache_list = nullptr;
+/// Where the next reclaim() starts, so every cache gives up pages in turn
+page_cache *reclaim_cursor = nullptr;
+u64 cache_count = 0;
+} // namespace
+
+page_cache::page_cache()
+    : pages_(memory::KernelCommonAllocatorV)
+    , end_index_(0)
+    , reclaim_cursor_(0)
+    , vacated_count_(0)
+    , prev_(nullptr)
+{
+    uctx::RawSpinLockUninterruptibleContext icu(cache_list_lock);
+    next_ = cache_list;
+    if (next_ != nullptr)
+    {
+        next_->prev_ = this;
+    }
+    cache_list = this;
+    cache_count++;
+}
+
+page_cache::~page_cache()
+{
+    {
+        uctx::RawSpinLockUninterruptibleContext icu(cache_list_lock);
+        if (prev_ != nullptr)
+        {
+            prev_->next_ = next_;
+        }
+        else
+        {
+            cache_list = next_;
+        }
+        if (next_ != nullptr)
+        {
+            next_->prev_ = prev_;
+        }
+        if (reclaim_cursor == this)
+        {
+            reclaim_cursor = next_;
+        }
+        cache_count--;
+    }
+    for (auto &item : pages_)
+    {
+        if (item.value != nullptr)
+        {
+            memory::free_page(item.value);
+        }
+    }
+}
+
+u64 page_cache::reclaim(u64 pages)
+{
+    u64 freed = 0;
+    uctx::RawSpinLockUninterruptibleContext icu(cache_list_lock);
+    for (u64 visited = 0; visited < cache_count && freed < pages; visited++)
+    {
+        auto *cache = reclaim_cursor != nullptr ? reclaim_cursor : cache_list;
+        reclaim_cursor = cache->next_;
+        // The allocation may come from under this cache's lock
+        if (!cache->lock_.try_lock())
+        {
+            continue;
+        }
+        freed += cache->reclaim_unused(pages - freed);
+        cache->lock_.unlock();
+    }
+    return freed;
+}
+
+u64 page_cache::reclaim_unused(u64 pages)
+{
+    u64 freed = 0;
+    for (u64 scanned = 0; scanned < reclaim_scan_pages && scanned < end_index_ && freed < pages &&
+                          vacated_count_ < max_vacated;
+         scanned++)
+    {
+        if (reclaim_cursor_ >= end_index_)
+        {
+            reclaim_cursor_ = 0;
+        }
+        const u64 index = reclaim_cursor_++;
+        auto *slot = pages_.get_ptr(index);
+        // Mapped or spliced pages hold another reference
+        if (slot == nullptr || *slot == nullptr || memory::global_zones->get_page_reference(*slot) != 1)
+        {
+            continue;
+        }
+        memory::free_page(*slot);
+        // Removing would free the entry from the allocator being refilled, so
+        // the slot is emptied here and erased by erase_vacated()
+        *slot = nullptr;
+        vacated_[vacated_count_++] = index;
+        freed++;
+    }
+    return freed;
+}
+
+void page_cache::erase_vacated()
+{
+    for (u64 i = 0; i < vacated_count_; i++)
+    {
+        auto page = pages_.get(vacated_[i]);
+        // load() may have filled it again
+        if (page.has_value() && page.value() == nullptr)
+        {
+            pages_.remove(vacated_[i]);
+        }
+    }
+    vacated_count_ = 0;
+}
+
+byte *page_cache::load(u64 index, fill_page fill)
+{
+    auto cached = pages_.get(index);
+    if (cached.has_value())
+    {
+        if (cached.value() != nullptr)
+        {
+            return cached.value();
+        }
+        pages_.remove(index);
+    }
+    byte *page = nullptr;
+    // Short instead of panicking like malloc_page(), the caller falls back to
+    // reading the file directly.
+    if (memory::global_zones->allocate_pages(1, reinterpret_cast<void **>(&page)) != 1)
+    {
+        return nullptr;
+    }
+    memset(page, 0, memory::page_size);
+    if (!fill(page, index))
+    {
+        memory::free_page(page);
+        return nullptr;
+    }
+    pages_.insert(index, page);
+    if (index >= end_index_)
+    {
+        end_index_ = index + 1;
+    }
+    return page;
+}
+
+byte *page_cache::get(u64 index, fill_page fill)
+{
+    cache_lock_guard guard(lock_);
+    erase_vacated();
+    byte *page = load(index, fill);
+    if (page != nullptr)
+    {
+        memory::global_zones->page_add_reference(page);
+    }
+    return page;
+}
+
+byte *page_cache::find(u64 index)
+{
+    cache_lock_guard guard(lock_);
+    auto cached = pages_.get(index);
+    if (!cached.has_value() || cached.value() == nullptr)
+    {
+        return nullptr;
+    }
+    memory::global_zones->page_add_reference(cached.value());
+    return cached.value();
+}
+
+u64 page_cache::read(u64 offset, byte *destination, u64 size, fill_page fill)
+{
+    u64 done = 0;
+    while (done < size)
+    {
+        const u64 position = offset + done;
+        // Copied without the lock, the destination may fault in a mapping of
+        // this cache. The reference keeps the page from truncate and reclaim.
+        byte *page = get(position / memory::page_size, fill);
+        if (page == nullptr)
+        {
+            break;
+        }
+        const u64 in_page = position % memory::page_size;
+        const u64 chunk = freelibcxx::min(memory::page_size - in_page, size - done);
+        memcpy(destination + done, page + in_page, chunk);
+        memory::free_page(page);
+        done += chunk;
+    }
+    return done;
+}
+
+void page_cache::write(u64 offset, const byte *source, u64 size)
+{
+    cache_lock_guard guard(lock_);
+    u64 done = 0;
+    while (done < size)
+    {
+        const u64 position = offset + done;
+        const u64 in_page = position % memory::page_size;
+        const u64 chunk = freelibcxx::min(memory::page_size - in_page, size - done);
+        auto page = pages_.get(position / memory::page_size);
+        if (page.has_value() && page.value() != nullptr)
+        {
+            memcpy(page.value() + in_page, source + done, chunk);
+        }
+        done += chunk;
+    }
+}
+
+void page_cache::truncate(u64 size)
+{
+    cache_lock_guard guard(lock_);
+    erase_vacated();
+    const u64 first = (size + memory::page_size - 1) / memory::page_size;
+    for (u64 index = first; index < end_index_; index++)
+    {
+        auto page = pages_.get(index);
+        if (page.has_value())
+        {
+            pages_.remove(index);
+            if (page.value() != nullptr)
+            {
+                memory::free_page(page.value());
+            }
+        }
+    }
+    if (end_index_ > first)
+    {
+        end_index_ = first;
+    }
+
+    // The file may grow again, the bytes past the new end must read as zeros.
+    const u64 in_page = size % memory::page_size;
+    if (in_page != 0)
+    {
+        auto page = pages_.get(size / memory::page_size);
+        if (page.has_value() && page.value() != nullptr)
+        {
+            memset(page.value() + in_page, 0, memory::page_size - in_page);
+        }
+    }
+}
+
+} // namespace fs::vfs
@@ -1,7 +1,71 @@
 #include "kernel/fs/vfs/pseudo.hpp"
+#include "freelibcxx/utils.hpp"
 #include "kernel/fs/vfs/defines.hpp"
+#include "kernel/mm/memory.hpp"
+#include "kernel/mm/zone.hpp"
+#include "kernel/ucontext.hpp"
 namespace fs::vfs
 {
+namespace
+{
+lock::lock_class pipe_lock_class("pipe");
+
+byte *alloc_page() { return reinterpret_cast<byte *>(memory::malloc_page()); }
+
+void release_page(byte *page) { memory::free_page(page); }
+
+void reference_page(byte *page) { memory::global_zones->page_add_reference(page); }
+
+/// Lock two pipes, each once, in address order
+class pipe_pair_lock
+{
+  public:
+    pipe_pair_lock(lock::spinlock_t &a, lock::spinlock_t &b)
+        : first_(&a < &b ? a : b)
+        , second_(&a < &b ? b : a)
+    {
+        first_.lock();
+        second_.lock();
+    }
+    ~pipe_pair_lock()
+    {
+        second_.unlock();
+        first_.unlock();
+    }
+    pipe_pair_lock(const pipe_pair_lock &) = delete;
+    pipe_pair_lock &operator=(const pipe_pair_lock &) = delete;
+
+  private:
+    uctx::UninterruptibleContext icu_;
+    lock::spinlock_t &first_;
+    lock::spinlock_t &second_;
+};
+} // namespace
+
+pseudo_pipe_t::pseudo_pipe_t()
+    : lock(pipe_lock_class)
+    , is_close(false)
+{
+}
+
+pseudo_pipe_t::~pseudo_pipe_t() { ring.clear(release_page); }
+
+i64 pseudo_pipe_t::wait_for(task::wait_queue_t &queue, freelibcxx::function_ref<bool()> ready, flag_t flags,
+                            interruption_check interrupted, wait_queue_registration register_wait_queue)
+{
+    if (flags & rw_flags::no_block)
+        return EAGAIN;
+    if (interrupted != nullptr && interrupted())
+        return EINTR;
+    if (register_wait_queue != nullptr)
+        register_wait_queue(&queue);
+    queue.do_wait([this, ready, interrupted] {
+        return is_close || ready() || (interrupted != nullptr && interrupted());
+    });
+    if (interrupted != nullptr && interrupted())
+        return EINTR;
+    return 0;
+}
 
 i64 pseudo_pipe_t::write(const byte *data, u64 size, flag_t flags)
 {
@@ -12,31 +76,40 @@ i64 pseudo_pipe_t::write(const byte *data, u64 size, flag_t flags)
 i64 pseudo_pipe_t::write_at_interruptible(i64 &, const byte *data, u64 size, flag_t flags,
                                            interruption_check interrupted, wait_queue_registration register_wait_queue)
 {
-    for (u64 i = 0; i < size; i++)
+    u64 done = 0;
+    bool wake_readers = false;
+    while (done < size)
     {
-        while ((buffer.full() && !(flags & rw_flags::override)) || is_close)
+        u64 copied = 0;
+        bool closed;
         {
-            if (i > 0)
-                return i;
-            if (is_close)
-                return -1;
-            if (flags & rw_flags::no_block)
-                return -1;
-            if (interrupted != nullptr && interrupted())
-                return EINTR;
-            wait_queue.do_wake_up();
-            if (register_wait_queue != nullptr)
-                register_wait_queue(&wait_queue);
-            wait_queue.do_wait([this, interrupted] {
-                return is_close || !buffer.full() || (interrupted != nullptr && interrupted());
-            });
-            if (interrupted != nullptr && interrupted())
-                return EINTR;
+            // A page at a time, so readers are not held off for long
+            uctx::RawSpinLockUninterruptibleContext icu(lock);
+            closed = is_close;
+            if (!closed)
+            {
+                if (!ring.writable() && (flags & rw_flags::override))
+                    ring.drop_front(release_page);
+                const bool was_empty = ring.empty();
+                copied = ring.write(data + done, freelibcxx::min(size - done, memory::page_size), alloc_page);
+                wake_readers |= was_empty && copied != 0;
+            }
         }
-        buffer.write(data[i]);
+        done += copied;
+        if (copied != 0)
+            continue;
+        if (done > 0)
+            break;
+        if (closed)
+            return -1;
+        const auto ret = wait_for(
+            writers, [this] { return ring.writable(); }, flags, interrupted, register_wait_queue);
+        if (ret != 0)
+            return ret;
     }
-    wait_queue.do_wake_up();
-    return size;
+    if (wake_readers)
+        readers.do_wake_up();
+    return done;
 }
 
 i64 pseudo_pipe_t::read(byte *data, u64 max_size, flag_t flags)
@@ -48,37 +121,202 @@ i64 pseudo_pipe_t::read(byte *data, u64 max_size, flag_t flags)
 i64 pseudo_pipe_t::read_at_interruptible(i64 &, byte *data, u64 max_size, flag_t flags,
                                           interruption_check interrupted, wait_queue_registration register_wait_queue)
 {
-    for (u64 i = 0; i < max_size; i++)
+    u64 done = 0;
+    bool wake_writers = false;
+    while (done < max_size)
+    {
+        u64 copied = 0;
+        {
+            uctx::RawSpinLockUninterruptibleContext icu(lock);
+            const bool was_full = ring.free_slots() == 0;
+            copied = ring.read(data + done, freelibcxx::min(max_size - done, memory::page_size), release_page);
+            wake_writers |= was_full && copied != 0;
+        }
+        done += copied;
+        if (copied != 0)
+            continue;
+        if (done > 0)
+            break;
+        if (is_close)
+            return -1;
+        const auto ret = wait_for(
+            readers, [this] { return !ring.empty(); }, flags, interrupted, register_wait_queue);
+        if (ret != 0)
+            return ret;
+    }
+    if (wake_writers)
+        writers.do_wake_up();
+    return done;
+}
+
+i64 pseudo_pipe_t::splice_in(u64 size, flag_t flags, page_source source)
+{
+    u64 done = 0;
+    i64 error = 0;
+    bool wake_readers = false;
+    util::pipe_buffer buffer;
+    bool holding = false;
+    while (done < size)
+    {
+        bool closed;
+        bool room;
+        {
+            uctx::RawSpinLockUninterruptibleContext icu(lock);
+            closed = is_close;
+            room = ring.free_slots() != 0;
+        }
+        if (closed)
+        {
+            error = -1;
+            break;
+        }
+        if (!room)
+        {
+            if (done > 0)
+                break;
+            error = wait_for(
+                writers, [this] { return ring.free_slots() != 0; }, flags, nullptr, nullptr);
+            if (error != 0)
+                break;
+            continue;
+        }
+        // Fetch the page without the lock, the source may sleep
+        if (!holding)
+        {
+            if (!source(done, buffer) || buffer.length == 0)
+                break;
+            holding = true;
+        }
+        bool pushed = false;
+        {
+            uctx::RawSpinLockUninterruptibleContext icu(lock);
+            if (!is_close)
+            {
+                const bool was_empty = ring.empty();
+                pushed = ring.push(buffer);
+                wake_readers |= was_empty && pushed;
+            }
+        }
+        if (pushed)
+        {
+            done += buffer.length;
+            holding = false;
+        }
+    }
+    if (holding)
+        release_page(buffer.page);
+    if (wake_readers)
+        readers.do_wake_up();
+    return done > 0 ? static_cast<i64>(done) : error;
+}
+
+i64 pseudo_pipe_t::splice_out(u64 size, flag_t flags, page_sink sink)
+{
+    u64 done = 0;
+    i64 error = 0;
+    bool wake_writers = false;
+    while (done < size)
     {
-        while (buffer.empty())
+        util::pipe_buffer buffer;
+        bool popped;
+        {
+            uctx::RawSpinLockUninterruptibleContext icu(lock);
+            const bool was_full = ring.free_slots() == 0;
+            popped = ring.pop(size - done, buffer, reference_page);
+            wake_writers |= was_full && popped;
+        }
+        if (!popped)
         {
-            if (i > 0)
-                return i;
+            if (done > 0)
+                break;
             if (is_close)
-                return -1;
-            if (flags & rw_flags::no_block)
-                return -1;
-            if (interrupted != nullptr && interrupted())
-                return EINTR;
-            wait_queue.do_wake_up();
-            if (register_wait_queue != nullptr)
-                register_wait_queue(&wait_queue);
-            wait_queue.do_wait([this, interrupted] {
-                return is_close || !buffer.empty() || (interrupted != nullptr && interrupted());
-            });
-            if (interrupted != nullptr && interrupted())
-                return EINTR;
+            {
+                error = -1;
+                break;
+            }
+            error = wait_for(
+                readers, [this] { return !ring.empty(); }, flags, nullptr, nullptr);
+            if (error != 0)
+                break;
+            continue;
+        }
+        // The sink may sleep, so it runs on the unlinked buffer
+        const bool stored = sink(buffer);
+        release_page(buffer.page);
+        if (!stored)
+        {
+            error = EFAILED;
+            break;
+        }
+        done += buffer.length;
+    }
+    if (wake_writers)
+        writers.do_wake_up();
+    return done > 0 ? static_cast<i64>(done) : error;
+}
+
+i64 pseudo_pipe_t::splice_to(pseudo_pipe_t &target, u64 size, flag_t flags, bool keep)
+{
+    if (&target == this)
+        return EINVAL;
+    u64 done = 0;
+    i64 error = 0;
+    bool wake_readers = false;
+    bool wake_writers = false;
+    while (done < size)
+    {
+        bool closed = false;
+        bool source_empty = false;
+        {
+            // The ring calls do not sleep, so a whole pass runs under one hold
+            // and a tee's slot index never outlives it
+            pipe_pair_lock guard(lock, target.lock);
+            closed = is_close || target.is_close;
+            const bool was_full = ring.free_slots() == 0;
+            const bool was_empty = target.ring.empty();
+            u32 index = 0;
+            while (!closed && done < size && index < ring.count() && target.ring.free_slots() != 0)
+            {
+                util::pipe_buffer buffer;
+                if (keep)
+                    buffer = ring.share(index++, size - done, reference_page);
+                else
+                    ring.pop(size - done, buffer, reference_page);
+                target.ring.push(buffer);
+                done += buffer.length;
+            }
+            source_empty = index >= ring.count();
+            wake_writers |= was_full && !keep && ring.free_slots() != 0;
+            wake_readers |= was_empty && !target.ring.empty();
+        }
+        if (done > 0)
+            break;
+        if (closed)
+        {
+            error = -1;
+            break;
         }
-        buffer.read(&data[i]);
+        if (source_empty)
+            error = wait_for(
+                readers, [this] { return !ring.empty(); }, flags, nullptr, nullptr);
+        else
+            error = target.wait_for(
+                target.writers, [&target] { return target.ring.free_slots() != 0; }, flags, nullptr, nullptr);
+        if (error != 0)
+            break;
     }
-    wait_queue.do_wake_up();
-    return max_size;
+    if (wake_writers)
+        writers.do_wake_up();
+    if (wake_readers)
+        target.readers.do_wake_up();
+    return done > 0 ? static_cast<i64>(done) : error;
 }
 
 void pseudo_pipe_t::close()
 {
     is_close = true;
-    wait_queue.do_wake_up();
+    readers.do_wake_up();
+    writers.do_wake_up();
 }
 
 } // namespace fs::vfs
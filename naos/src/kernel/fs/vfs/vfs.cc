@@ -1,6 +1,7 @@
 #include "kernel/fs/vfs/vfs.hpp"
 #include "freelibcxx/vector.hpp"
 #include "kernel/fs/stat.hpp"
+#include "kernel/fs/vfs/dcache.hpp"
 #include "kernel/fs/vfs/defines.hpp"
 #include "kernel/fs/vfs/dentry.hpp"
 #include "kernel/fs/vfs/file.hpp"
@@ -9,12 +10,14 @@
 #include "kernel/fs/vfs/mm.hpp"
 #include "kernel/fs/vfs/mount.hpp"
 #include "kernel/fs/vfs/nameidata.hpp"
+#include "kernel/fs/vfs/page_cache.hpp"
 #include "kernel/fs/vfs/pseudo.hpp"
 #include "kernel/fs/vfs/super_block.hpp"
 #include "kernel/handle.hpp"
 #include "kernel/mm/list_node_cache.hpp"
 #include "kernel/mm/slab.hpp"
 #include "kernel/mm/vm.hpp"
+#include "kernel/mm/zone.hpp"
 #include "kernel/trace.hpp"
 
 namespace fs::vfs
@@ -44,6 +47,7 @@ void init()
 {
     trace::debug("VFS init");
     data = memory::New<data_t>(memory::KernelCommonAllocatorV);
+    memory::global_zones->set_reclaim_hook(page_cache::reclaim);
 }
 
 int register_fs(file_system *fs)
@@ -360,6 +364,8 @@ void rmdir(dentry *entry)
     su_block->write_inode(entry->get_inode());
     if (entry->get_inode()->get_ref_count() == 0)
     {
+        if (entry->was_hashed())
+            dcache::synchronize();
         su_block->dealloc_inode(entry->get_inode());
         su_block->dealloc_dentry(entry);
     }
@@ -384,17 +390,23 @@ dentry *rename(const char *new_path, dentry *old, dentry *root, dentry *cur_dir)
 
     if (name_len <= 0)
         return nullptr;
-    if (old->get_name() != nullptr)
-    {
-        memory::KernelCommonAllocatorV->deallocate((void *)old->get_name());
-    }
 
+    auto old_name = old->get_name();
     auto cname = (char *)memory::KernelCommonAllocatorV->allocate(name_len, 1);
     memcpy(cname, (const void *)idata.entry_buffer->name, name_len);
-    old->set_name(cname);
-    old->get_parent()->remove_child(old);
-    old->set_parent(idata.last_available_entry);
-    old->get_parent()->add_child(old);
+    {
+        dcache::rename_scope scope;
+        old->get_parent()->remove_child(old);
+        old->set_name(cname);
+        old->set_parent(idata.last_available_entry);
+        old->get_parent()->add_child(old);
+    }
+    if (old_name != nullptr)
+    {
+        // A walk may still compare against the old name
+        dcache::synchronize();
+        memory::KernelCommonAllocatorV->deallocate((void *)old_name);
+    }
 
     old->get_inode()->rename(old);
     return old;
@@ -421,6 +433,7 @@ u64 next_path_entry_str(const char *&name, char *buffer)
 
 dentry *path_walk(const char *name, dentry *root, dentry *cur_dir, flag_t flags, nameidata &idata)
 {
+    dcache::walk_scope walk;
     dentry *prev_entry = cur_dir;
     char *entry_buffer = idata.entry_buffer->name;
     if (*name == 0)
@@ -564,6 +577,7 @@ bool mount(file_system *fs, const char *dev, const char *path, dentry *path_root
         new_root->set_parent(dir->get_parent());
         new_root->set_name(dir->get_name());
         new_root->set_mount_point();
+        dcache::rename_scope scope;
         dir->get_parent()->remove_child(dir);
         dir->get_parent()->add_child(new_root);
     }
@@ -585,9 +599,12 @@ bool umount(const char *path, dentry *path_root, dentry *cur_dir)
         {
             if (mnt->mount_entry != nullptr)
             {
-                dir->get_parent()->remove_child(sb->get_root());
-                dir->get_parent()->add_child(mnt->mount_entry);
-                sb->get_root()->set_name("/");
+                {
+                    dcache::rename_scope scope;
+                    dir->get_parent()->remove_child(sb->get_root());
+                    dir->get_parent()->add_child(mnt->mount_entry);
+                    sb->get_root()->set_name("/");
+                }
                 data->mount_list.remove(mnt);
             }
             else
@@ -758,7 +775,10 @@ bool unlink(dentry *entry)
                 inode->set_pseudo_data(nullptr);
             }
         }
-        // link count is 0, delete file
+        // link count is 0, delete file. Anonymous entries were never hashed,
+        // so no walk can hold them.
+        if (entry->was_hashed())
+            dcache::synchronize();
         su->dealloc_inode(inode);
         su->dealloc_dentry(entry);
     }
@@ -966,7 +986,7 @@ handle_t<file> open_pipe()
         return {};
     }
     node->create_pseudo(entry, inode_type_t::pipe, 4096);
-    auto ps = memory::New<fs::vfs::pseudo_pipe_t>(memory::KernelCommonAllocatorV, memory::page_size);
+    auto ps = memory::New<fs::vfs::pseudo_pipe_t>(memory::KernelCommonAllocatorV);
     node->set_pseudo_data(ps);
 
     handle_t<file> f = entry->get_inode()->get_super_block()->alloc_file();
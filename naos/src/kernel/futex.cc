@@ -0,0 +1,731 @@
+#include "kernel/futex.hpp"
+#include "kernel/errno.hpp"
+#include "kernel/lock.hpp"
+#include "kernel/mm/new.hpp"
+#include "kernel/mm/vm.hpp"
+#include "kernel/scheduler.hpp"
+#include "kernel/schedulers/cfs_weight.hpp"
+#include "kernel/task.hpp"
+#include "kernel/timer.hpp"
+#include "kernel/ucontext.hpp"
+#include "kernel/usercopy.hpp"
+#include "kernel/util/futex_op.hpp"
+#include "kernel/util/intrusive_list.hpp"
+#include "naos/abi.h"
+#include <atomic>
+
+namespace futex
+{
+/// Private keys name the address space by its vm::info_t, a kernel address,
+/// and shared keys a physical page, which is never one
+struct key_t
+{
+    u64 space = 0;
+    u64 offset = 0;
+
+    bool operator==(const key_t &rhs) const { return space == rhs.space && offset == rhs.offset; }
+};
+
+struct bucket_t;
+
+struct waiter_t
+{
+    task::thread_t *thread;
+    key_t key;
+    u32 bitset;
+    /// Waits for a priority inheritance lock
+    bool pi;
+    /// The thread holding that lock, which this waiter lends its nice level
+    task::thread_t *owner = nullptr;
+    /// The bucket the waiter hangs in. Requeues move it, so it is only
+    /// trusted with the lock of that bucket held.
+    std::atomic<bucket_t *> bucket{nullptr};
+    /// Set, under the bucket lock, when a wake takes the waiter off its list
+    std::atomic_bool woken{false};
+    util::list_node<waiter_t> node;
+};
+
+lock::lock_class bucket_lock_class("futex_bucket");
+lock::lock_class table_lock_class("futex_table");
+
+struct bucket_t
+{
+    lock::spinlock_t lock{bucket_lock_class};
+    util::intrusive_list<waiter_t, &waiter_t::node> waiters;
+};
+
+namespace
+{
+using waiter_list_t = util::intrusive_list<waiter_t, &waiter_t::node>;
+
+constexpr u64 initial_buckets = 64;
+constexpr u64 max_buckets = 1UL << 16;
+
+/// Taken for reading around every bucket lock, and for writing to grow the
+/// table
+lock::rw_lock_t table_lock(table_lock_class);
+bucket_t *buckets = nullptr;
+u64 bucket_count = 0;
+std::atomic_uint64_t waiter_count = 0;
+
+u64 hash(const key_t &key)
+{
+    u64 h = (key.space ^ (key.offset >> 2)) * 0x9E3779B97F4A7C15UL;
+    return h ^ (h >> 32);
+}
+
+/// Caller holds table_lock
+bucket_t &bucket_of(const key_t &key) { return buckets[hash(key) & (bucket_count - 1)]; }
+
+/// Rehash every waiter into \p count buckets. Waiters stay where they are
+/// while they sleep, so the table only grows.
+void grow(u64 count)
+{
+    auto *fresh = memory::NewArray<bucket_t>(memory::KernelCommonAllocatorV, count);
+    auto fresh_count = count;
+    {
+        uctx::RawWriteLockUninterruptibleContext ctx(table_lock);
+        if (bucket_count < count)
+        {
+            for (u64 i = 0; i < bucket_count; i++)
+            {
+                while (auto *w = buckets[i].waiters.pop_front())
+                {
+                    auto &to = fresh[hash(w->key) & (count - 1)];
+                    to.waiters.push_back(w);
+                    w->bucket.store(&to, std::memory_order_relaxed);
+                }
+            }
+            auto *old = buckets;
+            fresh_count = bucket_count;
+            buckets = fresh;
+            bucket_count = count;
+            fresh = old;
+        }
+    }
+    if (fresh != nullptr)
+        memory::DeleteArray(memory::KernelCommonAllocatorV, fresh, fresh_count);
+}
+
+void ensure_table()
+{
+    {
+        uctx::RawReadLockUninterruptibleContext ctx(table_lock);
+        if (buckets != nullptr)
+            return;
+    }
+    grow(initial_buckets);
+}
+
+/// Grow the table once waiters outnumber buckets twice
+void check_load()
+{
+    u64 count;
+    {
+        uctx::RawReadLockUninterruptibleContext ctx(table_lock);
+        if (waiter_count.load(std::memory_order_relaxed) <= bucket_count * 2 || bucket_count >= max_buckets)
+            return;
+        count = bucket_count * 2;
+    }
+    grow(count);
+}
+
+int make_key(u64 address, bool shared, key_t &key)
+{
+    if ((address & (sizeof(u32) - 1)) != 0)
+        return EINVAL;
+    if (!is_user_space_range(reinterpret_cast<const void *>(address), sizeof(u32)))
+        return EFAULT;
+    auto *mm = static_cast<memory::vm::info_t *>(task::current_process()->mm_info);
+    if (shared)
+    {
+        auto *vm = mm->vma().get_vm_area(address);
+        if (vm != nullptr && (vm->flags & memory::vm::flags::shared))
+        {
+            // Fault the page in, then name it by its frame
+            u32 value = 0;
+            if (naos::usercopy::copy_from(&value, address, sizeof(value)) != NA_STATUS_OK)
+                return EFAULT;
+            auto phy = mm->paging().get_map(reinterpret_cast<void *>(address));
+            if (!phy.has_value())
+                return EFAULT;
+            key.space = reinterpret_cast<u64>(phy.value()());
+            key.offset = address & (memory::page_size - 1);
+            return 0;
+        }
+    }
+    key.space = reinterpret_cast<u64>(mm);
+    key.offset = address;
+    return 0;
+}
+
+int read_word(u64 address, u32 &value)
+{
+    return naos::usercopy::copy_from(&value, address, sizeof(value)) == NA_STATUS_OK ? 0 : EFAULT;
+}
+
+u32 tid_of(task::thread_t *thread) { return static_cast<u32>(thread->tid) & NA_FUTEX_TID_MASK; }
+
+/// Threads taken off their wait lists under a bucket lock, woken once it is
+/// released. The wake reference keeps each from being freed until then.
+class wake_batch
+{
+  public:
+    static constexpr u32 capacity = 16;
+
+    bool full() const { return size_ == capacity; }
+
+    void add(bucket_t &bucket, waiter_t *w)
+    {
+        bucket.waiters.remove(w);
+        waiter_count.fetch_sub(1, std::memory_order_relaxed);
+        auto *thread = w->thread;
+        thread->wait_queue_wake_refs.fetch_add(1, std::memory_order_relaxed);
+        threads_[size_++] = thread;
+        // The waiter may return once it sees this
+        w->woken.store(true, std::memory_order_release);
+    }
+
+    void run()
+    {
+        for (u32 i = 0; i < size_; i++)
+        {
+            task::scheduler::update_state_sync(threads_[i], task::thread_state::ready);
+            threads_[i]->wait_queue_wake_refs.fetch_sub(1, std::memory_order_release);
+        }
+        size_ = 0;
+    }
+
+  private:
+    task::thread_t *threads_[capacity];
+    u32 size_ = 0;
+};
+
+/// Hang \p w in \p bucket and stop its thread. Caller holds the bucket lock.
+void enqueue(bucket_t &bucket, waiter_t &w)
+{
+    w.bucket.store(&bucket, std::memory_order_relaxed);
+    bucket.waiters.push_back(&w);
+    waiter_count.fetch_add(1, std::memory_order_relaxed);
+    auto *thd = w.thread;
+    thd->futex_waiter = &w;
+    thd->attributes |= task::thread_attributes::need_schedule;
+    task::scheduler::update_state(thd, task::thread_state::stop);
+}
+
+/// Lock the bucket \p w hangs in, following it across requeues. Caller
+/// holds table_lock.
+///
+/// \return nullptr if \p w was woken and hangs nowhere
+bucket_t *lock_bucket_of(waiter_t &w)
+{
+    for (;;)
+    {
+        // A woken waiter's bucket may be gone with the table grown since
+        if (w.woken.load(std::memory_order_acquire))
+            return nullptr;
+        auto *bucket = w.bucket.load(std::memory_order_relaxed);
+        bucket->lock.lock();
+        if (w.woken.load(std::memory_order_relaxed))
+        {
+            bucket->lock.unlock();
+            return nullptr;
+        }
+        if (w.bucket.load(std::memory_order_relaxed) == bucket)
+            return bucket;
+        bucket->lock.unlock();
+    }
+}
+
+/// Sleep until \p w is woken or \p deadline passes. The thread was stopped
+/// by enqueue().
+///
+/// \return whether it was woken
+bool sleep(waiter_t &w, timeclock::microsecond_t deadline)
+{
+    auto *thd = w.thread;
+    const bool armed =
+        deadline != no_deadline &&
+        timer::arm_at(thd->sleep_timer, deadline, timer::timer_handler::bind<&task::thread_t::wake_from_sleep>(*thd));
+    bool woken = false;
+    for (;;)
+    {
+        if (!w.woken.load(std::memory_order_acquire) && (deadline == no_deadline || armed))
+            task::scheduler::schedule();
+
+        uctx::RawReadLockUninterruptibleContext ctx(table_lock);
+        auto *bucket = lock_bucket_of(w);
+        woken = bucket == nullptr;
+        const bool expired = deadline != no_deadline && timer::get_high_resolution_time() >= deadline;
+        if (!woken && expired)
+        {
+            bucket->waiters.remove(&w);
+            waiter_count.fetch_sub(1, std::memory_order_relaxed);
+        }
+        // Running already, this drops a stop still pending; otherwise the
+        // thread was made ready by something else, a signal or the
+        // scheduler, and waits on
+        task::scheduler::update_state(thd, woken || expired ? task::thread_state::ready : task::thread_state::stop);
+        if (bucket != nullptr)
+            bucket->lock.unlock();
+        if (woken || expired)
+            break;
+    }
+    (void)timer::cancel(thd->sleep_timer);
+    thd->futex_waiter = nullptr;
+    return woken;
+}
+
+bool matches(const waiter_t *w, const key_t &key, u32 bitset)
+{
+    return w->key == key && !w->pi && (w->bitset & bitset) != 0;
+}
+
+/// Lock two buckets, each once, in address order
+class bucket_pair_lock
+{
+  public:
+    bucket_pair_lock(bucket_t &a, bucket_t &b)
+        : first_(&a < &b ? a : b)
+        , second_(&a < &b ? b : a)
+    {
+        first_.lock.lock();
+        if (&second_ != &first_)
+            second_.lock.lock();
+    }
+    ~bucket_pair_lock()
+    {
+        if (&second_ != &first_)
+            second_.lock.unlock();
+        first_.lock.unlock();
+    }
+    bucket_pair_lock(const bucket_pair_lock &) = delete;
+    bucket_pair_lock &operator=(const bucket_pair_lock &) = delete;
+
+  private:
+    bucket_t &first_;
+    bucket_t &second_;
+};
+
+/// Lend \p nice to the thread \p tid of the current process if it is more
+/// important than the one the thread runs at. Caller holds the bucket lock.
+///
+/// \return the thread, or nullptr if there is none
+task::thread_t *lend_nice(u32 tid, i8 nice)
+{
+    task::thread_t *found = nullptr;
+    task::visit_tid(task::current_process(), tid, [nice, &found](task::thread_t *owner) {
+        found = owner;
+        owner->pi_generation++;
+        if (nice >= owner->nice)
+            return;
+        if (!owner->pi_boosted)
+        {
+            owner->pi_base_nice = owner->nice;
+            owner->pi_boosted = true;
+        }
+        owner->nice = nice;
+    });
+    return found;
+}
+
+/// Take back the nice levels lent to the current thread, except those of
+/// waiters on the priority inheritance locks it still holds
+void restore_nice()
+{
+    auto *thd = task::current();
+    auto &thread_lock = thd->process->thread_list_lock;
+    for (;;)
+    {
+        u32 generation;
+        {
+            uctx::RawSpinLockUninterruptibleContext icu(thread_lock);
+            if (!thd->pi_boosted)
+                return;
+            generation = thd->pi_generation;
+        }
+        // Bucket locks come before the thread lock, so the waiters are
+        // scanned first and the result dropped if a lender came meanwhile
+        i8 lent = task::scheduler::cfs::nice_max;
+        bool any = false;
+        {
+            uctx::RawReadLockUninterruptibleContext ctx(table_lock);
+            for (u64 i = 0; i < bucket_count; i++)
+            {
+                uctx::RawSpinLockContext bucket_ctx(buckets[i].lock);
+                for (auto *w = buckets[i].waiters.front(); w != nullptr; w = waiter_list_t::next(w))
+                {
+                    if (w->pi && w->owner == thd && w->thread->nice <= lent)
+                    {
+                        lent = w->thread->nice;
+                        any = true;
+                    }
+                }
+            }
+        }
+        uctx::RawSpinLockUninterruptibleContext icu(thread_lock);
+        if (thd->pi_generation != generation)
+            continue;
+        if (any && lent < thd->pi_base_nice)
+        {
+            thd->nice = lent;
+        }
+        else
+        {
+            thd->nice = thd->pi_base_nice;
+            thd->pi_boosted = false;
+        }
+        return;
+    }
+}
+
+/// The most important waiter for the priority inheritance lock \p key,
+/// the first of them on a tie
+waiter_t *first_pi_waiter(bucket_t &bucket, const key_t &key, waiter_t *skip)
+{
+    waiter_t *best = nullptr;
+    for (auto *w = bucket.waiters.front(); w != nullptr; w = waiter_list_t::next(w))
+    {
+        if (w != skip && w->pi && w->key == key && (best == nullptr || w->thread->nice < best->thread->nice))
+            best = w;
+    }
+    return best;
+}
+
+} // namespace
+
+int wait(u64 address, bool shared, u32 value, u32 bitset, timeclock::microsecond_t deadline)
+{
+    if (bitset == 0)
+        return EINVAL;
+    key_t key;
+    if (auto ret = make_key(address, shared, key); ret != 0)
+        return ret;
+    u32 current = 0;
+    // Fault the word in before reading it with interrupts off
+    if (read_word(address, current) != 0)
+        return EFAULT;
+    if (current != value)
+        return EAGAIN;
+    ensure_table();
+
+    waiter_t w;
+    w.thread = task::current();
+    w.key = key;
+    w.bitset = bitset;
+    w.pi = false;
+    {
+        uctx::RawReadLockUninterruptibleContext ctx(table_lock);
+        auto &bucket = bucket_of(key);
+        uctx::RawSpinLockContext bucket_ctx(bucket.lock);
+        // A waker changes the word before it takes the bucket lock
+        if (read_word(address, current) != 0)
+            return EFAULT;
+        if (current != value)
+            return EAGAIN;
+        enqueue(bucket, w);
+    }
+    check_load();
+    return sleep(w, deadline) ? 0 : ETIMEDOUT;
+}
+
+int wake(u64 address, bool shared, u32 count, u32 bitset)
+{
+    if (bitset == 0)
+        return EINVAL;
+    key_t key;
+    if (auto ret = make_key(address, shared, key); ret != 0)
+        return ret;
+    ensure_table();
+
+    wake_batch batch;
+    u32 woken = 0;
+    bool more = true;
+    while (more && woken < count)
+    {
+        more = false;
+        {
+            uctx::RawReadLockUninterruptibleContext ctx(table_lock);
+            auto &bucket = bucket_of(key);
+            uctx::RawSpinLockContext bucket_ctx(bucket.lock);
+            auto *w = bucket.waiters.front();
+            while (w != nullptr && woken < count)
+            {
+                auto *next = waiter_list_t::next(w);
+                if (matches(w, key, bitset))
+                {
+                    if (batch.full())
+                    {
+                        more = true;
+                        break;
+                    }
+                    batch.add(bucket, w);
+                    woken++;
+                }
+                w = next;
+            }
+        }
+        batch.run();
+    }
+    return static_cast<int>(woken);
+}
+
+int requeue(u64 address, u64 target, bool shared, u32 wake_count, u32 requeue_count, bool compare, u32 value)
+{
+    key_t key;
+    key_t target_key;
+    if (auto ret = make_key(address, shared, key); ret != 0)
+        return ret;
+    if (auto ret = make_key(target, shared, target_key); ret != 0)
+        return ret;
+    u32 current = 0;
+    if (compare && read_word(address, current) != 0)
+        return EFAULT;
+    ensure_table();
+
+    wake_batch batch;
+    u32 woken = 0;
+    u32 moved = 0;
+    bool first_pass = true;
+    bool more = true;
+    while (more)
+    {
+        more = false;
+        {
+            uctx::RawReadLockUninterruptibleContext ctx(table_lock);
+            auto &bucket = bucket_of(key);
+            auto &target_bucket = bucket_of(target_key);
+            bucket_pair_lock pair(bucket, target_bucket);
+            if (compare && first_pass)
+            {
+                if (read_word(address, current) != 0)
+                    return EFAULT;
+                if (current != value)
+                    return EAGAIN;
+            }
+            first_pass = false;
+
+            auto *w = bucket.waiters.front();
+            while (w != nullptr)
+            {
+                auto *next = waiter_list_t::next(w);
+                if (w->key == key && !w->pi)
+                {
+                    if (woken < wake_count)
+                    {
+                        if (batch.full())
+                        {
+                            more = true;
+                            break;
+                        }
+                        batch.add(bucket, w);
+                        woken++;
+                    }
+                    else if (moved < requeue_count)
+                    {
+                        // Moved waiters wake with the target, no herd
+                        // rushes for the word they waited on
+                        if (!(key == target_key))
+                        {
+                            bucket.waiters.remove(w);
+                            w->key = target_key;
+                            target_bucket.waiters.push_back(w);
+                            w->bucket.store(&target_bucket, std::memory_order_relaxed);
+                        }
+                        moved++;
+                    }
+                    else
+                    {
+                        break;
+                    }
+                }
+                w = next;
+            }
+        }
+        batch.run();
+    }
+    return static_cast<int>(woken + moved);
+}
+
+int wake_op(u64 address, u64 target, bool shared, u32 count, u32 target_count, u32 encoded)
+{
+    util::futex_wake_op op(encoded);
+    if (!op.valid())
+        return ENOTSUP;
+    if ((target & (sizeof(u32) - 1)) != 0)
+        return EINVAL;
+
+    u32 old = 0;
+    if (read_word(target, old) != 0)
+        return EFAULT;
+    for (;;)
+    {
+        u32 expected = old;
+        if (naos::usercopy::compare_exchange(target, expected, op.apply(old)) != NA_STATUS_OK)
+            return EFAULT;
+        if (expected == old)
+            break;
+        old = expected;
+    }
+
+    // A waiter checks the word under its bucket lock, so waking after the
+    // update loses no waiter
+    int woken = wake(address, shared, count, NA_FUTEX_BITSET_MATCH_ANY);
+    if (woken < 0)
+        return woken;
+    if (op.compare(old))
+    {
+        int target_woken = wake(target, shared, target_count, NA_FUTEX_BITSET_MATCH_ANY);
+        if (target_woken < 0)
+            return target_woken;
+        woken += target_woken;
+    }
+    return woken;
+}
+
+int lock_pi(u64 address, bool try_only, timeclock::microsecond_t deadline)
+{
+    key_t key;
+    // Owners are named by thread id, which is only unique in a process
+    if (auto ret = make_key(address, false, key); ret != 0)
+        return ret;
+    auto *thd = task::current();
+    const u32 tid = tid_of(thd);
+    ensure_table();
+
+    waiter_t w;
+    w.thread = thd;
+    w.key = key;
+    w.bitset = NA_FUTEX_BITSET_MATCH_ANY;
+    w.pi = true;
+    for (;;)
+    {
+        u32 word = 0;
+        if (naos::usercopy::compare_exchange(address, word, tid) != NA_STATUS_OK)
+            return EFAULT;
+        if (word == 0)
+            return 0;
+        if ((word & NA_FUTEX_TID_MASK) == tid)
+            return EDEADLK;
+        if (try_only)
+            return EAGAIN;
+
+        uctx::RawReadLockUninterruptibleContext ctx(table_lock);
+        auto &bucket = bucket_of(key);
+        uctx::RawSpinLockContext bucket_ctx(bucket.lock);
+        if (read_word(address, word) != 0)
+            return EFAULT;
+        u32 expected = word;
+        // A fault here, say a copy on write after fork, goes back to the
+        // exchange above, which faults the page in without the locks
+        if ((word & NA_FUTEX_TID_MASK) == 0)
+        {
+            // Released meanwhile, keep the waiters bit for the others
+            if (naos::usercopy::compare_exchange_no_fault(address, expected, word | tid) != NA_STATUS_OK)
+                continue;
+            if (expected == word)
+                return 0;
+            continue;
+        }
+        // The owner now unlocks through the kernel
+        if (naos::usercopy::compare_exchange_no_fault(address, expected, word | NA_FUTEX_WAITERS) != NA_STATUS_OK)
+            continue;
+        if (expected != word)
+            continue;
+        w.owner = lend_nice(word & NA_FUTEX_TID_MASK, thd->nice);
+        if (w.owner == nullptr)
+            return ESRCH;
+        enqueue(bucket, w);
+        break;
+    }
+    check_load();
+    // unlock_pi hands the lock over before it wakes us
+    return sleep(w, deadline) ? 0 : ETIMEDOUT;
+}
+
+int unlock_pi(u64 address)
+{
+    key_t key;
+    if (auto ret = make_key(address, false, key); ret != 0)
+        return ret;
+    auto *thd = task::current();
+    const u32 tid = tid_of(thd);
+    ensure_table();
+
+    wake_batch batch;
+    for (;;)
+    {
+        // The exchange below runs under spinlocks, fault the word in for
+        // writing first. An exchange of 0 for 0 leaves any value alone.
+        u32 probe = 0;
+        if (naos::usercopy::compare_exchange(address, probe, 0) != NA_STATUS_OK)
+            return EFAULT;
+
+        bool faulted = false;
+        {
+            uctx::RawReadLockUninterruptibleContext ctx(table_lock);
+            auto &bucket = bucket_of(key);
+            uctx::RawSpinLockContext bucket_ctx(bucket.lock);
+            for (;;)
+            {
+                u32 word = 0;
+                if (read_word(address, word) != 0)
+                    return EFAULT;
+                if ((word & NA_FUTEX_TID_MASK) != tid)
+                    return EPERM;
+
+                auto *next = first_pi_waiter(bucket, key, nullptr);
+                u32 handoff = 0;
+                if (next != nullptr)
+                    handoff = tid_of(next->thread) | (first_pi_waiter(bucket, key, next) ? NA_FUTEX_WAITERS : 0);
+                u32 expected = word;
+                // Paged out again since the probe
+                if (naos::usercopy::compare_exchange_no_fault(address, expected, handoff) != NA_STATUS_OK)
+                {
+                    faulted = true;
+                    break;
+                }
+                if (expected != word)
+                    continue;
+
+                if (next != nullptr)
+                {
+                    batch.add(bucket, next);
+                    // The other waiters now lend to the heir
+                    for (auto *w = bucket.waiters.front(); w != nullptr; w = waiter_list_t::next(w))
+                    {
+                        if (w->pi && w->key == key)
+                            w->owner = next->thread;
+                    }
+                    if (auto *heir = first_pi_waiter(bucket, key, nullptr))
+                        lend_nice(tid_of(next->thread), heir->thread->nice);
+                }
+                break;
+            }
+        }
+        if (!faulted)
+            break;
+    }
+    batch.run();
+    restore_nice();
+    return 0;
+}
+
+void remove(task::thread_t *thread)
+{
+    auto *w = thread->futex_waiter;
+    if (w == nullptr)
+        return;
+    {
+        uctx::RawReadLockUninterruptibleContext ctx(table_lock);
+        if (auto *bucket = lock_bucket_of(*w))
+        {
+            bucket->waiters.remove(w);
+            waiter_count.fetch_sub(1, std::memory_order_relaxed);
+            bucket->lock.unlock();
+        }
+    }
+    thread->futex_waiter = nullptr;
+}
+
+} // namespace futex
@@ -3,7 +3,9 @@
 #include "kernel/arch/klib.hpp"
 #include "kernel/mm/memory.hpp"
 #include "kernel/mm/new.hpp"
+#include "kernel/task.hpp"
 #include "kernel/timer.hpp"
+#include "kernel/trace.hpp"
 #include "kernel/ucontext.hpp"
 #include "kernel/usercopy.hpp"
 #include <limits>
@@ -13,10 +15,19 @@ namespace naos::ipc
 namespace
 {
 lock::spinlock_t registry_lock;
-freelibcxx::linked_list<channel_state *> *registry = nullptr;
-lock::spinlock_t waiters_lock;
-task::wait_queue_t *waiters = nullptr;
-std::atomic_uint64_t wait_generation{0};
+channel_state *registry_head = nullptr;
+channel_state *registry_tail = nullptr;
+
+// Orphan collection runs on its own kernel thread, so channel operations
+// never pay for a walk over every live channel.
+task::wait_queue_t *reclaim_wait = nullptr;
+std::atomic_bool reclaim_pending{false};
+// Protected by registry_lock.
+u64 reclaim_epoch = 0;
+// States visited per hold of registry_lock by a collection.
+constexpr u64 registry_scan_batch = 64;
+// Waiters on objects that do not publish a signal source of their own.
+signal_source fallback_waiters;
 
 std::atomic_uint64_t global_messages{0};
 std::atomic_uint64_t global_bytes{0};
@@ -79,34 +90,34 @@ channel_message **allocate_queue_storage(u64 capacity)
 bool register_state(channel_state *state)
 {
     uctx::RawSpinLockUninterruptibleContext icu(registry_lock);
-    if (registry == nullptr)
-    {
-        registry = memory::New<freelibcxx::linked_list<channel_state *>>(memory::KernelCommonAllocatorV,
-                                                                         memory::KernelCommonAllocatorV);
-        if (registry == nullptr)
-            return false;
-    }
-    registry->push_back(state);
+    // A state created while a collection runs was never seen by its root
+    // scan; count it as reachable for that pass.
+    state->mark(reclaim_epoch);
+    state->registry_prev = registry_tail;
+    state->registry_next = nullptr;
+    if (registry_tail != nullptr)
+        registry_tail->registry_next = state;
+    else
+        registry_head = state;
+    registry_tail = state;
     return true;
 }
 
 void unregister_state(channel_state *state)
 {
     uctx::RawSpinLockUninterruptibleContext icu(registry_lock);
-    if (registry == nullptr)
+    if (state->registry_prev != nullptr)
+        state->registry_prev->registry_next = state->registry_next;
+    else if (registry_head == state)
+        registry_head = state->registry_next;
+    else
         return;
-    auto iterator = registry->begin();
-    while (iterator != registry->end() && *iterator != state)
-        ++iterator;
-    if (iterator != registry->end())
-        registry->remove(iterator);
-}
-
-void ensure_waiters()
-{
-    uctx::RawSpinLockUninterruptibleContext icu(waiters_lock);
-    if (waiters == nullptr)
-        waiters = memory::New<task::wait_queue_t>(memory::KernelCommonAllocatorV);
+    if (state->registry_next != nullptr)
+        state->registry_next->registry_prev = state->registry_prev;
+    else
+        registry_tail = state->registry_prev;
+    state->registry_prev = nullptr;
+    state->registry_next = nullptr;
 }
 
 na_status_t copy_from_user(void *destination, u64 source, u64 size)
@@ -138,25 +149,175 @@ bool wait_condition(wait_request *request)
     return false;
 }
 
-void wait_deadline_wakeup(timeclock::microsecond_t) noexcept
+struct wait_registration
 {
-    wait_generation.fetch_add(1, std::memory_order_acq_rel);
-    if (waiters != nullptr)
-        waiters->do_wake_up();
+    signal_observer observer;
+    signal_source *source = nullptr;
+    khandle object;
+};
+
+/// Block until one of the request items is signaled or the deadline passes.
+///
+/// Each item is registered on the signal source of its object, so only a
+/// signal change on one of these objects wakes the caller.
+na_status_t block_on_items(wait_request *request, timeclock::microsecond_t deadline)
+{
+    const bool timed = deadline != std::numeric_limits<u64>::max();
+    const u64 count = request->items->size();
+    auto *registrations = memory::NewArray<wait_registration>(memory::KernelCommonAllocatorV, count);
+    if (registrations == nullptr)
+        return NA_STATUS_RESOURCE_EXHAUSTED;
+
+    signal_waiter waiter;
+    for (u64 i = 0; i < count; i++)
+    {
+        auto &item = (*request->items)[i];
+        auto &registration = registrations[i];
+        capability::entry entry;
+        na_signal_t interest = ~na_signal_t(0);
+        registration.source = &fallback_waiters;
+        if (request->resources->lookup_native(item.handle, entry) && entry.object)
+        {
+            auto *source = entry.object->capability_signal_source();
+            if (source != nullptr)
+            {
+                // Closing the handle during the wait only clears its signals;
+                // the object reference keeps the source alive until forget.
+                registration.object = std::move(entry.object);
+                registration.source = source;
+                interest = item.signals;
+            }
+        }
+        registration.source->observe(registration.observer, waiter, interest);
+    }
+
+    // The deadline wakes this waiter alone. A handler that already started
+    // when the timer is canceled holds the pin until it is done.
+    timer::timer_entry deadline_timer;
+    bool deadline_armed = false;
+    if (timed)
+    {
+        waiter.pin();
+        deadline_armed = timer::arm_at(deadline_timer, deadline,
+                                       timer::timer_handler::bind<&signal_waiter::deadline_expired>(waiter));
+        if (!deadline_armed)
+            waiter.unpin();
+    }
+
+    na_status_t status = NA_STATUS_OK;
+    for (;;)
+    {
+        const auto generation = waiter.generation();
+        if (wait_condition(request))
+            break;
+        if (timed && timer::get_high_resolution_time() >= deadline)
+        {
+            status = NA_STATUS_WAIT_TIMED_OUT;
+            break;
+        }
+        waiter.wait(generation);
+    }
+    if (deadline_armed && timer::cancel(deadline_timer))
+        waiter.unpin();
+
+    for (u64 i = 0; i < count; i++)
+        registrations[i].source->forget(registrations[i].observer);
+    memory::DeleteArray<>(memory::KernelCommonAllocatorV, registrations, count);
+    return status;
 }
 
-bool contains_state(const freelibcxx::vector<channel_state *> &states, channel_state *needle, u64 *index = nullptr)
+/// Visit every registered state, at most registry_scan_batch of them per hold
+/// of registry_lock, so a collection never keeps interrupts off for the whole
+/// registry. Only the reclaim worker unregisters states, so the saved cursor
+/// stays registered while the lock is dropped. States registered meanwhile are
+/// appended and visited too.
+template <typename Visit> void scan_registry(Visit &&visit)
 {
-    for (u64 i = 0; i < states.size(); i++)
+    channel_state *cursor = nullptr;
+    bool started = false;
+    for (;;)
     {
-        if (states.data()[i] == needle)
+        uctx::RawSpinLockUninterruptibleContext icu(registry_lock);
+        auto *state = started ? cursor : registry_head;
+        started = true;
+        for (u64 visited = 0; state != nullptr && visited < registry_scan_batch; visited++)
         {
-            if (index != nullptr)
-                *index = i;
-            return true;
+            visit(state);
+            state = state->registry_next;
         }
+        if (state == nullptr)
+            return;
+        cursor = state;
+    }
+}
+
+/// Delete every channel state that no root can reach.
+///
+/// A state is live when one of its sides sits in a handle table, when an
+/// operation or receive claim is in flight, or when one of its endpoints is
+/// queued in a live state. Marks are epoch numbers stored in the states, so
+/// the pass is linear in the number of states plus queued endpoints.
+void collect_orphaned_channels()
+{
+    u64 epoch = 0;
+    {
+        uctx::RawSpinLockUninterruptibleContext icu(registry_lock);
+        epoch = ++reclaim_epoch;
+    }
+    // A state that gains a root after it was visited is not reaped, the
+    // orphan scan below checks can_reap() again.
+    freelibcxx::vector<channel_state *> work(memory::KernelCommonAllocatorV);
+    scan_registry([&](channel_state *state) {
+        if (state->has_root() || !state->can_reap())
+        {
+            state->mark(epoch);
+            work.push_back(state);
+        }
+    });
+
+    // Only this thread deletes states, and a reachable state keeps its queued
+    // endpoints (and so their states) alive, so the walk needs no registry lock.
+    freelibcxx::vector<channel_state *> targets(memory::KernelCommonAllocatorV);
+    for (u64 index = 0; index < work.size(); index++)
+    {
+        targets.clear();
+        work[index]->collect_reachable_states(targets);
+        for (auto *target : targets)
+        {
+            if (target->mark(epoch))
+                work.push_back(target);
+        }
+    }
+
+    freelibcxx::vector<channel_state *> orphans(memory::KernelCommonAllocatorV);
+    scan_registry([&](channel_state *state) {
+        if (!state->marked(epoch) && state->can_reap())
+            orphans.push_back(state);
+    });
+
+    // Drop messages for the whole unreachable set before deleting any state.
+    // An in-transit endpoint can point back to another orphaned channel; doing
+    // this one state at a time can destroy the target state while its endpoint
+    // object still holds the target's raw state pointer.
+    for (auto *state : orphans)
+        state->discard_orphan_messages();
+    for (auto *state : orphans)
+    {
+        if (!state->can_reap() || state->endpoint_object_count() != 0)
+            continue;
+        unregister_state(state);
+        memory::Delete<>(memory::KernelCommonAllocatorV, state);
+    }
+}
+
+void channel_reclaim_worker(task::thread_start_info_t *)
+{
+    for (;;)
+    {
+        reclaim_wait->do_wait([] { return reclaim_pending.load(std::memory_order_acquire); });
+        reclaim_pending.store(false, std::memory_order_release);
+        collect_orphaned_channels();
     }
-    return false;
 }
 } // namespace
 
@@ -210,6 +371,7 @@ channel_state::channel_state(u64 max_messages, u64 max_bytes, u64 max_resources)
     , active_operations_(0)
     , active_claims_(0)
     , endpoint_objects_(0)
+    , mark_epoch_(0)
     , valid_(false)
 {
     queues_[0] =
@@ -249,6 +411,11 @@ na_signal_t channel_state::signals(u8 side) const
         return 0;
     auto &lock = const_cast<lock::spinlock_t &>(lock_);
     uctx::RawSpinLockUninterruptibleContext icu(lock);
+    return signals_locked(side);
+}
+
+na_signal_t channel_state::signals_locked(u8 side) const
+{
     const auto &queue = *queues_[side];
     const auto &send_queue = *queues_[1 - side];
     const u8 peer = 1 - side;
@@ -284,9 +451,11 @@ na_status_t channel_state::enqueue(u8 sender, channel_message *message, capabili
     const u8 receiver = 1 - sender;
     na_status_t result = NA_STATUS_OK;
     bool restore = false;
+    bool was_empty = false;
     {
         uctx::RawSpinLockUninterruptibleContext icu(lock_);
         auto &queue = *queues_[receiver];
+        was_empty = queue.fifo.empty();
         if (owners_[receiver].load(std::memory_order_acquire) == 0)
         {
             result = NA_STATUS_PEER_CLOSED;
@@ -343,8 +512,8 @@ na_status_t channel_state::enqueue(u8 sender, channel_message *message, capabili
     }
     else if (result == NA_STATUS_OK)
         resources.commit_native_batch(records);
-    if (result == NA_STATUS_OK)
-        notify_channel_waiters();
+    if (result == NA_STATUS_OK && was_empty)
+        observers_[receiver].notify(NA_SIGNAL_READABLE);
     return result;
 }
 
@@ -360,9 +529,11 @@ na_status_t channel_state::enqueue_kernel(u8 sender, channel_message *message,
     const u8 receiver = 1 - sender;
     na_status_t result = NA_STATUS_OK;
     bool failed = false;
+    bool was_empty = false;
     {
         uctx::RawSpinLockUninterruptibleContext icu(lock_);
         auto &queue = *queues_[receiver];
+        was_empty = queue.fifo.empty();
         if (owners_[receiver].load(std::memory_order_acquire) == 0)
         {
             result = NA_STATUS_PEER_CLOSED;
@@ -412,8 +583,8 @@ na_status_t channel_state::enqueue_kernel(u8 sender, channel_message *message,
             }
         }
     }
-    if (result == NA_STATUS_OK)
-        notify_channel_waiters();
+    if (result == NA_STATUS_OK && was_empty)
+        observers_[receiver].notify(NA_SIGNAL_READABLE);
     return result;
 }
 
@@ -437,41 +608,37 @@ bool channel_state::cancel_receive(u8 side, channel_message *message)
 {
     if (!valid_ || side > 1 || message == nullptr)
         return false;
-    bool cancelled = false;
-    {
-        uctx::RawSpinLockUninterruptibleContext icu(lock_);
-        auto &queue = *queues_[side];
-        if (!queue.fifo.is_claimed() || queue.fifo.front() != message)
-            return false;
-        queue.fifo.cancel_claim();
-        active_claims_.fetch_sub(1, std::memory_order_acq_rel);
-        cancelled = true;
-    }
-    if (cancelled)
-        notify_channel_waiters();
-    return cancelled;
+    // Signals do not depend on the claim, so cancelling raises nothing.
+    uctx::RawSpinLockUninterruptibleContext icu(lock_);
+    auto &queue = *queues_[side];
+    if (!queue.fifo.is_claimed() || queue.fifo.front() != message)
+        return false;
+    queue.fifo.cancel_claim();
+    active_claims_.fetch_sub(1, std::memory_order_acq_rel);
+    return true;
 }
 
 bool channel_state::commit_receive(u8 side, channel_message *message)
 {
     if (!valid_ || side > 1 || message == nullptr)
         return false;
-    bool committed = false;
+    const u8 peer = 1 - side;
+    na_signal_t raised = 0;
     {
         uctx::RawSpinLockUninterruptibleContext icu(lock_);
         auto &queue = *queues_[side];
         if (!queue.fifo.is_claimed() || queue.fifo.front() != message)
             return false;
+        const auto before = signals_locked(peer);
         queue.fifo.commit_claim();
         queue.bytes -= message->byte_count();
         queue.resources -= message->resource_count();
         active_claims_.fetch_sub(1, std::memory_order_acq_rel);
         release_global(message->byte_count(), message->resource_count());
-        committed = true;
+        raised = signals_locked(peer) & ~before;
     }
-    if (committed)
-        notify_channel_waiters();
-    return committed;
+    observers_[peer].notify(raised);
+    return true;
 }
 
 bool channel_state::discard(u8 side, channel_message *&message)
@@ -479,24 +646,32 @@ bool channel_state::discard(u8 side, channel_message *&message)
     message = nullptr;
     if (!valid_ || side > 1)
         return false;
+    const u8 peer = 1 - side;
+    na_signal_t raised = 0;
     {
         uctx::RawSpinLockUninterruptibleContext icu(lock_);
         auto &queue = *queues_[side];
         if (queue.fifo.empty() || !queue.fifo.claim_front())
             return false;
+        const auto before = signals_locked(peer);
         message = queue.fifo.front();
         queue.fifo.commit_claim();
         queue.bytes -= message->byte_count();
         queue.resources -= message->resource_count();
         release_global(message->byte_count(), message->resource_count());
+        raised = signals_locked(peer) & ~before;
     }
-    notify_channel_waiters();
+    observers_[peer].notify(raised);
     return true;
 }
 
 void channel_state::endpoint_object_created() { endpoint_objects_.fetch_add(1, std::memory_order_acq_rel); }
 
-void channel_state::endpoint_object_destroyed() { endpoint_objects_.fetch_sub(1, std::memory_order_acq_rel); }
+void channel_state::endpoint_object_destroyed()
+{
+    if (endpoint_objects_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        request_orphan_collection();
+}
 
 void channel_state::kernel_owner_acquired(u8 side)
 {
@@ -507,7 +682,7 @@ void channel_state::kernel_owner_acquired(u8 side)
 void channel_state::kernel_owner_released(u8 side)
 {
     if (side <= 1)
-        owners_[side].fetch_sub(1, std::memory_order_acq_rel);
+        owner_released(side);
 }
 
 void channel_state::capability_acquired(u8 side, capability::location where)
@@ -523,14 +698,25 @@ void channel_state::capability_released(u8 side, capability::location where)
 {
     if (side > 1)
         return;
-    owners_[side].fetch_sub(1, std::memory_order_acq_rel);
-    if (where == capability::location::table_root)
-        roots_[side].fetch_sub(1, std::memory_order_acq_rel);
+    if (where == capability::location::table_root && roots_[side].fetch_sub(1, std::memory_order_acq_rel) == 1)
+        request_orphan_collection();
+    owner_released(side);
+}
+
+void channel_state::owner_released(u8 side)
+{
+    if (owners_[side].fetch_sub(1, std::memory_order_acq_rel) == 1)
+        observers_[1 - side].notify(NA_SIGNAL_PEER_CLOSED);
 }
 
 void channel_state::begin_operation() { active_operations_.fetch_add(1, std::memory_order_acq_rel); }
 
-void channel_state::end_operation() { active_operations_.fetch_sub(1, std::memory_order_acq_rel); }
+void channel_state::end_operation()
+{
+    // A collection may have skipped this state while the operation ran.
+    if (active_operations_.fetch_sub(1, std::memory_order_acq_rel) == 1 && !has_root())
+        request_orphan_collection();
+}
 
 bool channel_state::has_root() const
 {
@@ -574,8 +760,10 @@ void channel_state::discard_orphan_messages()
     discarded.ensure(max_messages_ * 2);
     if (max_messages_ != 0 && discarded.data() == nullptr)
         return;
+    na_signal_t raised[2] = {0, 0};
     {
         uctx::RawSpinLockUninterruptibleContext icu(lock_);
+        const na_signal_t before[2] = {signals_locked(0), signals_locked(1)};
         for (auto *queue : queues_)
         {
             while (!queue->fifo.empty())
@@ -590,8 +778,11 @@ void channel_state::discard_orphan_messages()
                 discarded.push_back(message);
             }
         }
+        raised[0] = signals_locked(0) & ~before[0];
+        raised[1] = signals_locked(1) & ~before[1];
     }
-    notify_channel_waiters();
+    observers_[0].notify(raised[0]);
+    observers_[1].notify(raised[1]);
     for (auto *message : discarded)
         memory::Delete<>(memory::KernelCommonAllocatorV, message);
 }
@@ -637,6 +828,11 @@ void raw_channel_endpoint::on_capability_handoff(capability::location from, capa
 
 na_signal_t raw_channel_endpoint::capability_signals() const { return state_ == nullptr ? 0 : state_->signals(side_); }
 
+signal_source *raw_channel_endpoint::capability_signal_source()
+{
+    return state_ == nullptr ? nullptr : state_->observers(side_);
+}
+
 void raw_channel_endpoint::begin_operation()
 {
     if (state_ != nullptr)
@@ -670,10 +866,10 @@ na_status_t create_raw_channel_with_options(khandle &left, khandle &right, na_ch
     auto right_endpoint = handle_t<raw_channel_endpoint>::make(state, 1);
     if (!left_endpoint || !right_endpoint)
     {
+        // Registered states are deleted only by the reclaim worker.
         left_endpoint.reset();
         right_endpoint.reset();
-        unregister_state(state);
-        memory::Delete<>(memory::KernelCommonAllocatorV, state);
+        request_orphan_collection();
         return NA_STATUS_RESOURCE_EXHAUSTED;
     }
     left = left_endpoint;
@@ -813,7 +1009,6 @@ na_status_t send_raw_channel(task::resource_table_t &resources, na_handle_t endp
     status = channel->state()->enqueue(channel->side(), message, records, resources);
     if (status != NA_STATUS_OK)
         memory::Delete<>(memory::KernelCommonAllocatorV, message);
-    collect_orphaned_channels();
     return finish(status);
 }
 
@@ -850,7 +1045,6 @@ na_status_t send_raw_channel_kernel(task::resource_table_t &resources, na_handle
     const auto status = channel->state()->enqueue(channel->side(), message, records, resources);
     if (status != NA_STATUS_OK)
         memory::Delete<>(memory::KernelCommonAllocatorV, message);
-    collect_orphaned_channels();
     return finish(status);
 }
 
@@ -883,7 +1077,6 @@ na_status_t send_raw_channel_kernel(const khandle &endpoint, const byte *bytes,
     const auto status = channel->state()->enqueue_kernel(channel->side(), message, records);
     if (status != NA_STATUS_OK)
         memory::Delete<>(memory::KernelCommonAllocatorV, message);
-    collect_orphaned_channels();
     return finish(status);
 }
 
@@ -1002,7 +1195,6 @@ na_status_t receive_raw_channel(task::resource_table_t &resources, na_handle_t e
         return finish(NA_STATUS_RESOURCE_EXHAUSTED);
     }
     memory::Delete<>(memory::KernelCommonAllocatorV, message);
-    collect_orphaned_channels();
     return finish(NA_STATUS_OK);
 }
 
@@ -1073,7 +1265,6 @@ na_status_t receive_raw_channel_kernel(task::resource_table_t &resources, na_han
         return finish(NA_STATUS_RESOURCE_EXHAUSTED);
     }
     memory::Delete<>(memory::KernelCommonAllocatorV, message);
-    collect_orphaned_channels();
     return finish(NA_STATUS_OK);
 }
 
@@ -1092,12 +1283,8 @@ na_status_t discard_raw_channel(task::resource_table_t &resources, na_handle_t e
     const bool discarded = channel->state()->discard(channel->side(), message);
     channel->end_operation();
     if (!discarded)
-    {
-        collect_orphaned_channels();
         return NA_STATUS_WOULD_BLOCK;
-    }
     memory::Delete<>(memory::KernelCommonAllocatorV, message);
-    collect_orphaned_channels();
     return NA_STATUS_OK;
 }
 
@@ -1127,45 +1314,13 @@ na_status_t wait_many(task::resource_table_t &resources, na_wait_item_t *items,
     wait_request request{&resources, &snapshot};
     if (!wait_condition(&request))
     {
-        timer::watcher_id deadline_watcher = timer::invalid_watcher_id;
         if (deadline == 0)
             return NA_STATUS_WOULD_BLOCK;
-        if (deadline != std::numeric_limits<u64>::max())
-        {
-            if (timer::get_high_resolution_time() >= deadline)
-                return NA_STATUS_WAIT_TIMED_OUT;
-            ensure_waiters();
-            if (waiters == nullptr)
-                return NA_STATUS_RESOURCE_EXHAUSTED;
-            deadline_watcher = timer::schedule_at(deadline, timer::timer_handler::bind<&wait_deadline_wakeup>());
-            for (;;)
-            {
-                const auto generation = wait_generation.load(std::memory_order_acquire);
-                if (wait_condition(&request))
-                    break;
-                if (timer::get_high_resolution_time() >= deadline)
-                    break;
-                waiters->do_wait(
-                    [generation] { return wait_generation.load(std::memory_order_acquire) != generation; });
-            }
-            (void)timer::cancel(deadline_watcher);
-            if (!wait_condition(&request) && timer::get_high_resolution_time() >= deadline)
-                return NA_STATUS_WAIT_TIMED_OUT;
-        }
-        else
-        {
-            ensure_waiters();
-            if (waiters == nullptr)
-                return NA_STATUS_RESOURCE_EXHAUSTED;
-            for (;;)
-            {
-                const auto generation = wait_generation.load(std::memory_order_acquire);
-                if (wait_condition(&request))
-                    break;
-                waiters->do_wait(
-                    [generation] { return wait_generation.load(std::memory_order_acquire) != generation; });
-            }
-        }
+        if (deadline != std::numeric_limits<u64>::max() && timer::get_high_resolution_time() >= deadline)
+            return NA_STATUS_WAIT_TIMED_OUT;
+        const auto status = block_on_items(&request, deadline);
+        if (status != NA_STATUS_OK)
+            return status;
     }
     if (copy_to_user(reinterpret_cast<u64>(items), snapshot.data(), count * sizeof(na_wait_item_t)) != NA_STATUS_OK)
         return NA_STATUS_FAULT;
@@ -1191,108 +1346,34 @@ na_status_t wait_for_signal(task::resource_table_t &resources, na_handle_t handl
     wait_request request{&resources, &snapshot};
     if (!wait_condition(&request))
     {
-        timer::watcher_id deadline_watcher = timer::invalid_watcher_id;
         if (deadline == 0)
             return NA_STATUS_WOULD_BLOCK;
-        if (deadline != std::numeric_limits<u64>::max())
-        {
-            if (timer::get_high_resolution_time() >= deadline)
-                return NA_STATUS_WAIT_TIMED_OUT;
-            ensure_waiters();
-            if (waiters == nullptr)
-                return NA_STATUS_RESOURCE_EXHAUSTED;
-            deadline_watcher = timer::schedule_at(deadline, timer::timer_handler::bind<&wait_deadline_wakeup>());
-        }
-        else
-        {
-            ensure_waiters();
-            if (waiters == nullptr)
-                return NA_STATUS_RESOURCE_EXHAUSTED;
-        }
-        for (;;)
-        {
-            const auto generation = wait_generation.load(std::memory_order_acquire);
-            if (wait_condition(&request))
-                break;
-            waiters->do_wait([generation] { return wait_generation.load(std::memory_order_acquire) != generation; });
-        }
-        if (deadline_watcher != timer::invalid_watcher_id)
-            (void)timer::cancel(deadline_watcher);
-        if (!wait_condition(&request) && deadline != std::numeric_limits<u64>::max() &&
-            timer::get_high_resolution_time() >= deadline)
+        if (deadline != std::numeric_limits<u64>::max() && timer::get_high_resolution_time() >= deadline)
             return NA_STATUS_WAIT_TIMED_OUT;
+        return block_on_items(&request, deadline);
     }
     return NA_STATUS_OK;
 }
 
-void notify_channel_waiters()
-{
-    wait_generation.fetch_add(1, std::memory_order_acq_rel);
-    if (waiters != nullptr)
-        waiters->do_wake_up();
-}
+void notify_channel_waiters() { fallback_waiters.notify(~na_signal_t(0)); }
 
-void collect_orphaned_channels()
+void request_orphan_collection()
 {
-    uctx::RawSpinLockUninterruptibleContext registry_icu(registry_lock);
-    if (registry == nullptr || registry->empty())
+    if (reclaim_pending.exchange(true, std::memory_order_acq_rel))
         return;
+    if (reclaim_wait != nullptr)
+        reclaim_wait->do_wake_up();
+}
 
-    freelibcxx::vector<channel_state *> states(memory::KernelCommonAllocatorV);
-    for (auto state : *registry)
-        states.push_back(state);
-    freelibcxx::vector<u8> marked(memory::KernelCommonAllocatorV);
-    marked.ensure(states.size());
-    if (states.size() != 0 && marked.data() == nullptr)
+void init_channel_reclaim_worker()
+{
+    if (reclaim_wait != nullptr)
         return;
-    for (u64 i = 0; i < states.size(); i++)
-        marked.push_back(0);
-
-    freelibcxx::vector<channel_state *> work(memory::KernelCommonAllocatorV);
-    for (u64 i = 0; i < states.size(); i++)
-    {
-        if (states[i]->has_root() || !states[i]->can_reap())
-        {
-            marked[i] = 1;
-            work.push_back(states[i]);
-        }
-    }
-    for (u64 index = 0; index < work.size(); index++)
-    {
-        freelibcxx::vector<channel_state *> targets(memory::KernelCommonAllocatorV);
-        work[index]->collect_reachable_states(targets);
-        for (auto target : targets)
-        {
-            u64 target_index = 0;
-            if (contains_state(states, target, &target_index) && marked[target_index] == 0)
-            {
-                marked[target_index] = 1;
-                work.push_back(target);
-            }
-        }
-    }
-
-    // Drop messages for the whole unreachable set before deleting any state.
-    // An in-transit endpoint can point back to another orphaned channel; doing
-    // this one state at a time can destroy the target state while its endpoint
-    // object still holds the target's raw state pointer.
-    for (u64 i = 0; i < states.size(); i++)
-    {
-        if (marked[i] == 0 && states[i]->can_reap())
-            states[i]->discard_orphan_messages();
-    }
-    for (u64 i = 0; i < states.size(); i++)
-    {
-        auto *state = states[i];
-        if (marked[i] != 0 || !state->can_reap() || state->endpoint_object_count() != 0)
-            continue;
-        auto iterator = registry->begin();
-        while (iterator != registry->end() && *iterator != state)
-            ++iterator;
-        if (iterator != registry->end())
-            registry->remove(iterator);
-        memory::Delete<>(memory::KernelCommonAllocatorV, state);
-    }
+    reclaim_wait = memory::New<task::wait_queue_t>(memory::KernelCommonAllocatorV);
+    if (reclaim_wait == nullptr)
+        trace::panic("Unable to allocate channel reclaim queue");
+    if (task::create_kernel_process(channel_reclaim_worker, nullptr, 0) == nullptr)
+        trace::panic("Unable to create channel reclaim worker");
 }
 
 } // namespace naos::ipc
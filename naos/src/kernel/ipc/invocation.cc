@@ -1,7 +1,7 @@
 #include "kernel/ipc/invocation.hpp"
 #include "kernel/ipc/channel.hpp"
 
-#include "freelibcxx/linked_list.hpp"
+#include "kernel/arch/cpu.hpp"
 #include "kernel/arch/klib.hpp"
 #include "kernel/errno.hpp"
 #include "kernel/fs/stat.hpp"
@@ -13,6 +13,7 @@
 #include "kernel/mm/data_plane.hpp"
 #include "kernel/mm/memory.hpp"
 #include "kernel/mm/new.hpp"
+#include "kernel/scheduler.hpp"
 #include "kernel/service_directory.hpp"
 #include "kernel/task.hpp"
 #include "kernel/terminal_views.hpp"
@@ -20,6 +21,7 @@
 #include "kernel/trace.hpp"
 #include "kernel/ucontext.hpp"
 #include "kernel/usercopy.hpp"
+#include "kernel/util/intrusive_list.hpp"
 #include "naos/canonical.hpp"
 #include "naos/generated/system/Directory.hpp"
 #include "naos/generated/system/File.hpp"
@@ -45,6 +47,7 @@ constexpr u64 no_deadline = 0;
 struct deadline_watch
 {
     handle_t<invocation_state> state;
+    timer::timer_entry timer;
 
     explicit deadline_watch(const handle_t<invocation_state> &state)
         : state(state)
@@ -72,6 +75,8 @@ struct kernel_dispatch_request
     u64 method_id;
     freelibcxx::vector<byte> bytes;
     capability::transfer_record_list resources;
+    timeclock::nanosecond_t queued_at = 0;
+    util::list_node<kernel_dispatch_request> node;
 
     kernel_dispatch_request(handle_t<invocation_state> state, capability::entry target,
                             handle_t<task::process_object> caller, u64 method_id)
@@ -88,40 +93,160 @@ struct kernel_dispatch_request
     kernel_dispatch_request &operator=(const kernel_dispatch_request &) = delete;
 };
 
+lock::lock_class dispatch_queue_class("kernel_dispatch_queue");
+
+/// Kernel calls submitted on one CPU. Its workers take from the front, and
+/// workers with nothing to do steal from the queues of other CPUs.
 struct kernel_dispatch_queue
 {
-    lock::spinlock_t lock;
-    task::wait_queue_t wait;
-    freelibcxx::linked_list<kernel_dispatch_request *> requests;
-    std::atomic_uint64_t pending{0};
+    lock::spinlock_t lock{dispatch_queue_class};
+    util::intrusive_list<kernel_dispatch_request, &kernel_dispatch_request::node> requests;
+    std::atomic_uint64_t depth{0};
+    std::atomic_uint64_t max_depth{0};
 
-    kernel_dispatch_queue()
-        : requests(memory::KernelCommonAllocatorV)
-    {
-    }
-
-    void enqueue(kernel_dispatch_request *request)
+    void push(kernel_dispatch_request *request)
     {
+        u64 new_depth;
         {
             uctx::RawSpinLockUninterruptibleContext guard(lock);
             requests.push_back(request);
-            pending.fetch_add(1, std::memory_order_release);
+            new_depth = depth.fetch_add(1, std::memory_order_relaxed) + 1;
+        }
+        u64 max = max_depth.load(std::memory_order_relaxed);
+        while (new_depth > max && !max_depth.compare_exchange_weak(max, new_depth, std::memory_order_relaxed))
+        {
         }
-        wait.do_wake_up(1);
     }
 
     kernel_dispatch_request *pop()
     {
-        uctx::RawSpinLockUninterruptibleContext guard(lock);
-        if (requests.empty())
+        if (depth.load(std::memory_order_relaxed) == 0)
             return nullptr;
+        uctx::RawSpinLockUninterruptibleContext guard(lock);
         auto *request = requests.pop_front();
-        pending.fetch_sub(1, std::memory_order_release);
+        if (request != nullptr)
+            depth.fetch_sub(1, std::memory_order_relaxed);
         return request;
     }
 };
 
-kernel_dispatch_queue *kernel_dispatcher = nullptr;
+/// Workers not blocked in a call that the pool keeps busy per CPU
+constexpr u32 dispatch_workers_per_cpu = 1;
+constexpr u32 min_dispatch_workers = 4;
+constexpr u32 max_dispatch_workers = 128;
+
+/// The kernel call workers, shared by the per-CPU queues.
+///
+/// The pool is elastic: when a call is queued and no worker is idle, the
+/// manager starts another worker, unless enough of them are still running
+/// calls. A worker blocked in a pipe, tty or process wait does not count as
+/// running, so blocked readers no longer hold up the calls behind them.
+/// Workers are never retired, the pool only grows up to max_dispatch_workers.
+struct kernel_dispatch_pool
+{
+    kernel_dispatch_queue queues[arch::cpu::max_cpu_support];
+    u32 queue_count = 1;
+    u32 concurrency = min_dispatch_workers;
+
+    task::wait_queue_t idle_wait;
+    task::wait_queue_t manager_wait;
+    std::atomic_uint64_t pending{0};
+    std::atomic_uint32_t workers{0};
+    std::atomic_uint32_t idle{0};
+    std::atomic_uint32_t blocked{0};
+    std::atomic_bool grow_requested{false};
+
+    std::atomic_uint64_t dispatched{0};
+    std::atomic_uint64_t stolen{0};
+    std::atomic_uint64_t total_latency_ns{0};
+    std::atomic_uint64_t max_latency_ns{0};
+
+    bool should_grow() const
+    {
+        const u32 all = workers.load(std::memory_order_acquire);
+        const u32 running = all - freelibcxx::min(all, blocked.load(std::memory_order_acquire));
+        return pending.load(std::memory_order_acquire) != 0 && idle.load(std::memory_order_acquire) == 0 &&
+               all < max_dispatch_workers && running < concurrency;
+    }
+
+    void request_growth()
+    {
+        if (!should_grow() || grow_requested.exchange(true, std::memory_order_acq_rel))
+            return;
+        manager_wait.do_wake_up(1);
+    }
+
+    void enqueue(kernel_dispatch_request *request)
+    {
+        request->queued_at = timer::get_high_resolution_time_ns();
+        u32 cpu = arch::cpu::has_init() ? arch::cpu::current().get_id() : 0;
+        pending.fetch_add(1, std::memory_order_release);
+        queues[cpu < queue_count ? cpu : 0].push(request);
+        if (idle.load(std::memory_order_acquire) != 0)
+            idle_wait.do_wake_up(1);
+        else
+            request_growth();
+    }
+
+    /// The oldest call of this CPU, or else of the next CPU that has one
+    kernel_dispatch_request *take()
+    {
+        const u32 home = arch::cpu::current().get_id();
+        for (u32 i = 0; i < queue_count; i++)
+        {
+            auto *request = queues[(home + i) % queue_count].pop();
+            if (request == nullptr)
+                continue;
+            pending.fetch_sub(1, std::memory_order_acq_rel);
+            if (i != 0)
+                stolen.fetch_add(1, std::memory_order_relaxed);
+            return request;
+        }
+        return nullptr;
+    }
+
+    void record_latency(const kernel_dispatch_request &request)
+    {
+        const auto now = timer::get_high_resolution_time_ns();
+        const u64 latency = now > request.queued_at ? now - request.queued_at : 0;
+        dispatched.fetch_add(1, std::memory_order_relaxed);
+        total_latency_ns.fetch_add(latency, std::memory_order_relaxed);
+        u64 max = max_latency_ns.load(std::memory_order_relaxed);
+        while (latency > max && !max_latency_ns.compare_exchange_weak(max, latency, std::memory_order_relaxed))
+        {
+        }
+    }
+};
+
+kernel_dispatch_pool *kernel_dispatcher = nullptr;
+
+/// Marks the calling worker blocked for as long as it is alive, once
+/// block() was called, so the pool can start another worker meanwhile
+class dispatch_block_scope
+{
+  public:
+    dispatch_block_scope() = default;
+    dispatch_block_scope(const dispatch_block_scope &) = delete;
+    dispatch_block_scope &operator=(const dispatch_block_scope &) = delete;
+
+    ~dispatch_block_scope()
+    {
+        if (blocked_)
+            kernel_dispatcher->blocked.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    void block()
+    {
+        if (blocked_ || kernel_dispatcher == nullptr)
+            return;
+        blocked_ = true;
+        kernel_dispatcher->blocked.fetch_add(1, std::memory_order_acq_rel);
+        kernel_dispatcher->request_growth();
+    }
+
+  private:
+    bool blocked_ = false;
+};
 
 void kernel_dispatch_worker(task::thread_start_info_t *info);
 
@@ -392,6 +517,7 @@ class file_call_wait_registration
 
     void register_queue(task::wait_queue_t *queue)
     {
+        block_.block();
         if (queue_ != nullptr && queue_ != queue)
             state_.clear_execution_wait_queue(queue_);
         queue_ = queue;
@@ -402,8 +528,55 @@ class file_call_wait_registration
   private:
     invocation_state &state_;
     task::wait_queue_t *queue_ = nullptr;
+    dispatch_block_scope block_;
 };
 
+/// Encode a response whose only field is file data, reading up to \p size
+/// bytes straight into the place the data takes in \p destination rather
+/// than into a buffer of their own. The canonical wire writes bytes as a
+/// fixed width length and the data, so the message ends with the data and
+/// its header is as long for every length: only the length is patched once
+/// the read returns. \p size is clamped so the reply fits a kernel payload.
+///
+/// \param read reads up to its capacity into its byte pointer, returning
+/// the count or a negative errno
+/// \param result the read result; on failure \p destination is left empty
+template <typename Response, typename Encoder, typename Read>
+na_status_t read_response_in_place(freelibcxx::vector<byte> &destination, u64 size, Encoder encoder, Read read,
+                                   i64 &result)
+{
+    constexpr u64 max_header_bytes = 64;
+    destination.resize(max_header_bytes, byte{});
+    const Response empty{naoidl::bounded_bytes{nullptr, 0}};
+    u64 header_bytes = 0;
+    if (destination.data() == nullptr ||
+        !encoder(reinterpret_cast<u8 *>(destination.data()), max_header_bytes, empty, header_bytes) ||
+        header_bytes < sizeof(u32) || header_bytes > max_kernel_payload)
+        return NA_STATUS_RESOURCE_EXHAUSTED;
+    if (size > max_kernel_payload - header_bytes)
+        size = max_kernel_payload - header_bytes;
+    destination.resize(header_bytes + size, byte{});
+    if (destination.data() == nullptr)
+        return NA_STATUS_RESOURCE_EXHAUSTED;
+    auto *data = destination.data() + header_bytes;
+    result = read(data, size);
+    if (result < 0)
+    {
+        destination.clear();
+        return NA_STATUS_OK;
+    }
+    // The data already sits where the encoder puts it, the length right before
+    naos::canonical::writer length(reinterpret_cast<u8 *>(data) - sizeof(u32), sizeof(u32));
+    length.put_u32(static_cast<u32>(result));
+    if (!length.good() || static_cast<u64>(result) > size)
+    {
+        destination.clear();
+        return NA_STATUS_RESOURCE_EXHAUSTED;
+    }
+    destination.resize(header_bytes + static_cast<u64>(result), byte{});
+    return NA_STATUS_OK;
+}
+
 na_status_t publish_file_call(invocation_state &state, fs::vfs::file &file, u64 scope, u64 method_id,
                               const freelibcxx::vector<byte> &request)
 {
@@ -454,43 +627,39 @@ na_status_t publish_file_call(invocation_state &state, fs::vfs::file &file, u64
                 size = decoded.size;
                 flags = (decoded.flags & NA_IO_FLAG_NONBLOCK) != 0 ? fs::rw_flags::no_block : 0;
             }
-            response.resize(size, byte{});
             file_call_wait_registration wait_registration(state);
-            const i64 result =
-                pread
-                    ? file.pread(
-                          offset, response.data(), size, flags,
-                          [&wait_registration] { return wait_registration.interrupted(); },
-                          [&wait_registration](task::wait_queue_t *queue) { wait_registration.register_queue(queue); })
-                    : file.read(
-                          response.data(), size, flags,
-                          [&wait_registration] { return wait_registration.interrupted(); },
-                          [&wait_registration](task::wait_queue_t *queue) { wait_registration.register_queue(queue); });
-            if (result < 0)
-                return state.complete_reply(empty_bytes(), empty_resources(), result) ? NA_STATUS_OK
-                                                                                      : NA_STATUS_PEER_CLOSED;
-            const naoidl::bounded_bytes data{reinterpret_cast<const u8 *>(response.data()), static_cast<u32>(result)};
-            auto encoded_response = freelibcxx::vector<byte>(allocator);
-            bool encoded = false;
+            auto read = [&](byte *data, u64 capacity) {
+                return pread
+                           ? file.pread(
+                                 offset, data, capacity, flags,
+                                 [&wait_registration] { return wait_registration.interrupted(); },
+                                 [&wait_registration](task::wait_queue_t *queue) {
+                                     wait_registration.register_queue(queue);
+                                 })
+                           : file.read(
+                                 data, capacity, flags,
+                                 [&wait_registration] { return wait_registration.interrupted(); },
+                                 [&wait_registration](task::wait_queue_t *queue) {
+                                     wait_registration.register_queue(queue);
+                                 });
+            };
+            i64 result = 0;
+            na_status_t status;
             if (scope == NA_SCOPE_STREAM)
-            {
-                naos::system::Stream::readv_response value{data};
-                encoded = encode_message(encoded_response, value, naos::system::Stream::encode_readv_response);
-            }
+                status = read_response_in_place<naos::system::Stream::readv_response>(
+                    response, size, naos::system::Stream::encode_readv_response, read, result);
             else if (method_id == NA_METHOD_FILE_PREADV)
-            {
-                naos::system::File::preadv_response value{data};
-                encoded = encode_message(encoded_response, value, naos::system::File::encode_preadv_response);
-            }
+                status = read_response_in_place<naos::system::File::preadv_response>(
+                    response, size, naos::system::File::encode_preadv_response, read, result);
             else
-            {
-                naos::system::File::readv_response value{data};
-                encoded = encode_message(encoded_response, value, naos::system::File::encode_readv_response);
-            }
-            if (!encoded)
-                return NA_STATUS_RESOURCE_EXHAUSTED;
-            return state.complete_reply(std::move(encoded_response), empty_resources()) ? NA_STATUS_OK
-                                                                                        : NA_STATUS_PEER_CLOSED;
+                status = read_response_in_place<naos::system::File::readv_response>(
+                    response, size, naos::system::File::encode_readv_response, read, result);
+            if (status != NA_STATUS_OK)
+                return status;
+            if (result < 0)
+                return state.complete_reply(empty_bytes(), empty_resources(), result) ? NA_STATUS_OK
+                                                                                      : NA_STATUS_PEER_CLOSED;
+            return state.complete_reply(std::move(response), empty_resources()) ? NA_STATUS_OK : NA_STATUS_PEER_CLOSED;
         }();
     }
 
@@ -531,47 +700,42 @@ na_status_t publish_file_call(invocation_state &state, fs::vfs::file &file, u64
             }
             if (size > max_kernel_payload)
                 return NA_STATUS_INVALID_MESSAGE;
-            response.resize(size, byte{});
             file_call_wait_registration wait_registration(state);
-            const i64 result =
-                scope == NA_SCOPE_STREAM || method_id == NA_METHOD_FILE_READ
-                    ? file.read(
-                          response.data(), size, flags,
-                          [&wait_registration] { return wait_registration.interrupted(); },
-                          [&wait_registration](task::wait_queue_t *queue) { wait_registration.register_queue(queue); })
-                    : file.pread(
-                          offset, response.data(), size, flags,
-                          [&wait_registration] { return wait_registration.interrupted(); },
-                          [&wait_registration](task::wait_queue_t *queue) { wait_registration.register_queue(queue); });
+            auto read = [&](byte *data, u64 capacity) {
+                return scope == NA_SCOPE_STREAM || method_id == NA_METHOD_FILE_READ
+                           ? file.read(
+                                 data, capacity, flags,
+                                 [&wait_registration] { return wait_registration.interrupted(); },
+                                 [&wait_registration](task::wait_queue_t *queue) {
+                                     wait_registration.register_queue(queue);
+                                 })
+                           : file.pread(
+                                 offset, data, capacity, flags,
+                                 [&wait_registration] { return wait_registration.interrupted(); },
+                                 [&wait_registration](task::wait_queue_t *queue) {
+                                     wait_registration.register_queue(queue);
+                                 });
+            };
+            i64 result = 0;
+            na_status_t status;
+            if (scope == NA_SCOPE_STREAM)
+                status = read_response_in_place<naos::system::Stream::read_response>(
+                    response, size, naos::system::Stream::encode_read_response, read, result);
+            else if (method_id == NA_METHOD_FILE_PREAD)
+                status = read_response_in_place<naos::system::File::pread_response>(
+                    response, size, naos::system::File::encode_pread_response, read, result);
+            else
+                status = read_response_in_place<naos::system::File::read_response>(
+                    response, size, naos::system::File::encode_read_response, read, result);
+            if (status != NA_STATUS_OK)
+                return status;
             if (result < 0)
             {
-                response.clear();
                 append_u64(response, static_cast<u64>(-result));
                 return state.complete_reply(std::move(response), empty_resources(), result) ? NA_STATUS_OK
                                                                                             : NA_STATUS_PEER_CLOSED;
             }
-            const naoidl::bounded_bytes data{reinterpret_cast<const u8 *>(response.data()), static_cast<u32>(result)};
-            auto encoded_response = freelibcxx::vector<byte>(allocator);
-            if (scope == NA_SCOPE_STREAM)
-            {
-                naos::system::Stream::read_response encoded{data};
-                if (!encode_message(encoded_response, encoded, naos::system::Stream::encode_read_response))
-                    return NA_STATUS_RESOURCE_EXHAUSTED;
-            }
-            else if (method_id == NA_METHOD_FILE_PREAD)
-            {
-                naos::system::File::pread_response encoded{data};
-                if (!encode_message(encoded_response, encoded, naos::system::File::encode_pread_response))
-                    return NA_STATUS_RESOURCE_EXHAUSTED;
-            }
-            else
-            {
-                naos::system::File::read_response encoded{data};
-                if (!encode_message(encoded_response, encoded, naos::system::File::encode_read_response))
-                    return NA_STATUS_RESOURCE_EXHAUSTED;
-            }
-            return state.complete_reply(std::move(encoded_response), empty_resources()) ? NA_STATUS_OK
-                                                                                        : NA_STATUS_PEER_CLOSED;
+            return state.complete_reply(std::move(response), empty_resources()) ? NA_STATUS_OK : NA_STATUS_PEER_CLOSED;
         }();
     }
 
@@ -1481,10 +1645,14 @@ na_status_t publish_process_call(invocation_state &state, task::process_object &
             return NA_STATUS_INVALID_MESSAGE;
         i64 status = 0;
         process_id waited_pid = 0;
+        dispatch_block_scope block;
         const auto result = static_cast<i64>(task::wait_process_handle(
             caller, target, static_cast<flag_t>(decoded.flags), status, waited_pid,
             [&state] { return state.execution_interrupted(); },
-            [&state](task::wait_queue_t *queue) { state.set_execution_wait_queue(queue); }));
+            [&state, &block](task::wait_queue_t *queue) {
+                block.block();
+                state.set_execution_wait_queue(queue);
+            }));
         if (state.execution_interrupted())
             return NA_STATUS_PEER_CLOSED;
         if (result != 0)
@@ -1507,10 +1675,14 @@ na_status_t publish_process_call(invocation_state &state, task::process_object &
             return NA_STATUS_INVALID_MESSAGE;
         i64 status = 0;
         process_id waited_pid = 0;
+        dispatch_block_scope block;
         const auto result = task::wait_process_children(
             caller, decoded.pid, static_cast<flag_t>(decoded.flags), status, waited_pid,
             [&state] { return state.execution_interrupted(); },
-            [&state](task::wait_queue_t *queue) { state.set_execution_wait_queue(queue); });
+            [&state, &block](task::wait_queue_t *queue) {
+                block.block();
+                state.set_execution_wait_queue(queue);
+            });
         if (state.execution_interrupted())
             return NA_STATUS_PEER_CLOSED;
         if (result != 0)
@@ -2303,17 +2475,52 @@ void execute_kernel_dispatch(kernel_dispatch_request &request)
 
 void kernel_dispatch_worker(task::thread_start_info_t *)
 {
+    auto &pool = *kernel_dispatcher;
     for (;;)
     {
-        kernel_dispatcher->wait.do_wait([] { return kernel_dispatcher->pending.load(std::memory_order_acquire) != 0; });
-        auto *request = kernel_dispatcher->pop();
+        auto *request = pool.take();
         if (request == nullptr)
+        {
+            pool.idle.fetch_add(1, std::memory_order_acq_rel);
+            pool.idle_wait.do_wait([&pool] { return pool.pending.load(std::memory_order_acquire) != 0; });
+            pool.idle.fetch_sub(1, std::memory_order_acq_rel);
             continue;
+        }
+        pool.record_latency(*request);
         execute_kernel_dispatch(*request);
         memory::Delete<>(memory::KernelCommonAllocatorV, request);
     }
 }
 
+bool start_kernel_dispatch_worker()
+{
+    kernel_dispatcher->workers.fetch_add(1, std::memory_order_acq_rel);
+    if (task::create_kernel_process(kernel_dispatch_worker, nullptr, 0) != nullptr)
+        return true;
+    kernel_dispatcher->workers.fetch_sub(1, std::memory_order_acq_rel);
+    return false;
+}
+
+/// Starts workers on request. Workers are created here rather than where a
+/// call is queued, so they never inherit a user process's descriptors.
+void kernel_dispatch_manager(task::thread_start_info_t *)
+{
+    auto &pool = *kernel_dispatcher;
+    for (;;)
+    {
+        pool.manager_wait.do_wait([&pool] { return pool.grow_requested.load(std::memory_order_acquire); });
+        pool.grow_requested.store(false, std::memory_order_release);
+        while (pool.should_grow())
+        {
+            if (!start_kernel_dispatch_worker())
+            {
+                trace::warning("Unable to grow kernel invocation dispatcher");
+                break;
+            }
+        }
+    }
+}
+
 bool endpoint_is_client(capability::entry &entry, protocol_endpoint *&endpoint)
 {
     if (entry.meta.binding != NA_BINDING_CLIENT_END || !entry.object)
@@ -2404,17 +2611,48 @@ void init_kernel_dispatch_worker()
 {
     if (kernel_dispatcher != nullptr)
         return;
-    kernel_dispatcher = memory::New<kernel_dispatch_queue>(memory::KernelCommonAllocatorV);
+    kernel_dispatcher = memory::New<kernel_dispatch_pool>(memory::KernelCommonAllocatorV);
     if (kernel_dispatcher == nullptr)
         trace::panic("Unable to allocate kernel invocation dispatcher");
-    constexpr u64 worker_count = 4;
-    for (u64 worker = 0; worker < worker_count; worker++)
-    {
-        if (task::create_kernel_process(kernel_dispatch_worker, nullptr, 0) == nullptr)
+    const u32 cpus = static_cast<u32>(freelibcxx::min<u64>(arch::cpu::count(), arch::cpu::max_cpu_support));
+    kernel_dispatcher->queue_count = freelibcxx::max(cpus, 1U);
+    kernel_dispatcher->concurrency =
+        freelibcxx::max(kernel_dispatcher->queue_count * dispatch_workers_per_cpu, min_dispatch_workers);
+    if (task::create_kernel_process(kernel_dispatch_manager, nullptr, 0) == nullptr)
+        trace::panic("Unable to create kernel invocation dispatcher");
+    for (u32 worker = 0; worker < kernel_dispatcher->concurrency; worker++)
+    {
+        if (!start_kernel_dispatch_worker())
             trace::panic("Unable to create kernel invocation dispatcher");
     }
 }
 
+void get_dispatch_stats(dispatch_stats &stats)
+{
+    stats = {};
+    auto *pool = kernel_dispatcher;
+    if (pool == nullptr)
+        return;
+    stats.cpus = pool->queue_count;
+    stats.workers = pool->workers.load(std::memory_order_relaxed);
+    stats.idle = pool->idle.load(std::memory_order_relaxed);
+    stats.blocked = pool->blocked.load(std::memory_order_relaxed);
+    stats.dispatched = pool->dispatched.load(std::memory_order_relaxed);
+    stats.stolen = pool->stolen.load(std::memory_order_relaxed);
+    stats.total_latency_ns = pool->total_latency_ns.load(std::memory_order_relaxed);
+    stats.max_latency_ns = pool->max_latency_ns.load(std::memory_order_relaxed);
+}
+
+void get_dispatch_queue_stats(u32 cpu, dispatch_queue_stats &stats)
+{
+    stats = {};
+    auto *pool = kernel_dispatcher;
+    if (pool == nullptr || cpu >= pool->queue_count)
+        return;
+    stats.depth = pool->queues[cpu].depth.load(std::memory_order_relaxed);
+    stats.max_depth = pool->queues[cpu].max_depth.load(std::memory_order_relaxed);
+}
+
 protocol_descriptor::protocol_descriptor(const na_protocol_descriptor_t &descriptor)
     : kobject(type_e::protocol_descriptor)
     , descriptor_(descriptor)
@@ -2720,8 +2958,7 @@ na_status_t invocation_state::arm_deadline(const handle_t<invocation_state> &sel
     auto *watch = memory::New<deadline_watch>(memory::KernelCommonAllocatorV, self);
     if (watch == nullptr)
         return NA_STATUS_RESOURCE_EXHAUSTED;
-    if (timer::schedule_at(operation_deadline_, timer::timer_handler::bind<&deadline_watch::invoke>(*watch)) ==
-        timer::invalid_watcher_id)
+    if (!timer::arm_at(watch->timer, operation_deadline_, timer::timer_handler::bind<&deadline_watch::invoke>(*watch)))
     {
         memory::Delete<>(memory::KernelCommonAllocatorV, watch);
         expire_deadline();
@@ -2793,6 +3030,14 @@ void invocation_state::expire_deadline()
     }
 }
 
+void invocation_state::wait_completed()
+{
+    const auto completed = [this] { return (signals() & NA_SIGNAL_COMPLETED) != 0; };
+    while (!wait_queue_.do_wait(completed))
+    {
+    }
+}
+
 void invocation_state::close_client()
 {
     task::wait_queue_t *execution_wait_queue = nullptr;
@@ -3502,8 +3747,11 @@ namespace
 {
 na_status_t invoke_submit_impl(task::resource_table_t &resources, na_handle_t target_handle,
                                const na_submit_frame_t *frame, na_handle_t *invocation, bool oneway,
-                               bool invocation_output_is_user)
+                               bool invocation_output_is_user, handle_t<invocation_state> *call_state = nullptr)
 {
+    // A synchronous call hands its state to the caller instead of installing
+    // an Invocation handle
+    const bool install = !oneway && call_state == nullptr;
     na_submit_frame_t values{};
     auto status = copy_frame(values, frame);
     if (status != NA_STATUS_OK)
@@ -3511,11 +3759,13 @@ na_status_t invoke_submit_impl(task::resource_table_t &resources, na_handle_t ta
     status = validate_submit_frame(values, oneway);
     if (status != NA_STATUS_OK)
         return status;
-    if (!oneway && invocation_output_is_user && !valid_user_output(invocation))
+    if (install && invocation_output_is_user && !valid_user_output(invocation))
         return NA_STATUS_FAULT;
-    if (!oneway && !invocation_output_is_user && invocation == nullptr)
+    if (install && !invocation_output_is_user && invocation == nullptr)
         return NA_STATUS_INVALID_ARGUMENT;
-    if (oneway && invocation != nullptr)
+    if (!install && invocation != nullptr)
+        return NA_STATUS_INVALID_ARGUMENT;
+    if (oneway && call_state != nullptr)
         return NA_STATUS_INVALID_ARGUMENT;
     if (naos::usercopy::ranges_overlap(reinterpret_cast<u64>(frame), sizeof(*frame), values.request,
                                        values.request_bytes) ||
@@ -3598,7 +3848,7 @@ na_status_t invoke_submit_impl(task::resource_table_t &resources, na_handle_t ta
     invocation_metadata.features = target.meta.features;
     invocation_metadata.meta_rights = NA_RIGHT_TRANSFER | NA_RIGHT_WAIT | NA_RIGHT_INSPECT;
     handle_t<invocation_object> invocation_object_handle;
-    if (!oneway)
+    if (install)
     {
         invocation_object_handle = handle_t<invocation_object>::make(state);
         if (!invocation_object_handle)
@@ -3615,7 +3865,7 @@ na_status_t invoke_submit_impl(task::resource_table_t &resources, na_handle_t ta
                                                         task::current_process()->pid);
         if (request == nullptr)
         {
-            if (!oneway)
+            if (install)
                 resources.close_native(invocation_handle);
             return NA_STATUS_RESOURCE_EXHAUSTED;
         }
@@ -3625,7 +3875,8 @@ na_status_t invoke_submit_impl(task::resource_table_t &resources, na_handle_t ta
             if (!responder)
             {
                 memory::Delete<>(memory::KernelCommonAllocatorV, request);
-                resources.close_native(invocation_handle);
+                if (install)
+                    resources.close_native(invocation_handle);
                 return NA_STATUS_RESOURCE_EXHAUSTED;
             }
             capability::metadata responder_metadata = invocation_metadata;
@@ -3638,13 +3889,15 @@ na_status_t invoke_submit_impl(task::resource_table_t &resources, na_handle_t ta
         if (status != NA_STATUS_OK)
         {
             memory::Delete<>(memory::KernelCommonAllocatorV, request);
-            if (!oneway)
+            if (install)
                 resources.close_native(invocation_handle);
             return status;
         }
         request->bytes = std::move(bytes);
         request->resources = std::move(records);
         request->source_resources = &resources;
+        if (call_state != nullptr)
+            state->mark_synchronous();
         bool queued = false;
         status = client_endpoint->state()->enqueue(request, &queued);
         (void)queued;
@@ -3652,11 +3905,11 @@ na_status_t invoke_submit_impl(task::resource_table_t &resources, na_handle_t ta
         {
             const auto restore_status = resources.restore_native_batch(request->resources);
             memory::Delete<>(memory::KernelCommonAllocatorV, request);
-            if (!oneway)
+            if (install)
                 resources.close_native(invocation_handle);
             return restore_status == NA_STATUS_OK ? status : restore_status;
         }
-        if (!oneway)
+        if (install)
         {
             if (invocation_output_is_user)
                 status = naos::usercopy::copy_to(reinterpret_cast<u64>(invocation), &invocation_handle,
@@ -3678,12 +3931,14 @@ na_status_t invoke_submit_impl(task::resource_table_t &resources, na_handle_t ta
                 return status;
             }
         }
+        if (call_state != nullptr)
+            *call_state = std::move(state);
         return NA_STATUS_OK;
     }
 
     if (kernel_dispatcher == nullptr)
     {
-        if (!oneway)
+        if (install)
             resources.close_native(invocation_handle);
         return NA_STATUS_RESOURCE_EXHAUSTED;
     }
@@ -3691,7 +3946,7 @@ na_status_t invoke_submit_impl(task::resource_table_t &resources, na_handle_t ta
     auto caller = handle_t<task::process_object>::make(task::current_process());
     if (!caller)
     {
-        if (!oneway)
+        if (install)
             resources.close_native(invocation_handle);
         return NA_STATUS_RESOURCE_EXHAUSTED;
     }
@@ -3700,7 +3955,7 @@ na_status_t invoke_submit_impl(task::resource_table_t &resources, na_handle_t ta
     status = resources.take_native_batch(dispositions.data(), dispositions.size(), target_handle, records);
     if (status != NA_STATUS_OK)
     {
-        if (!oneway)
+        if (install)
             resources.close_native(invocation_handle);
         return status;
     }
@@ -3710,15 +3965,20 @@ na_status_t invoke_submit_impl(task::resource_table_t &resources, na_handle_t ta
     if (request == nullptr)
     {
         const auto restore_status = resources.restore_native_batch(records);
-        if (!oneway)
+        if (install)
             resources.close_native(invocation_handle);
         return restore_status == NA_STATUS_OK ? NA_STATUS_RESOURCE_EXHAUSTED : restore_status;
     }
     request->bytes = std::move(bytes);
     request->resources = std::move(records);
+    if (call_state != nullptr)
+    {
+        state->mark_synchronous();
+        *call_state = state;
+    }
     kernel_dispatcher->enqueue(request);
 
-    if (!oneway)
+    if (install)
     {
         if (invocation_output_is_user)
             status = naos::usercopy::copy_to(reinterpret_cast<u64>(invocation), &invocation_handle,
@@ -3923,10 +4183,10 @@ na_status_t invocation_cancel(task::resource_table_t &resources, na_handle_t inv
     return invocation->state()->cancel(nullptr) ? NA_STATUS_OK : NA_STATUS_ALREADY_CONSUMED;
 }
 
-na_status_t invocation_take_result(task::resource_table_t &resources, na_handle_t invocation_handle,
-                                   na_result_frame_t *frame)
+namespace
+{
+na_status_t copy_result_frame(na_result_frame_t &values, const na_result_frame_t *frame)
 {
-    na_result_frame_t values{};
     auto status = copy_frame(values, frame);
     if (status != NA_STATUS_OK)
         return status;
@@ -3934,19 +4194,21 @@ na_status_t invocation_take_result(task::resource_table_t &resources, na_handle_
         return NA_STATUS_INVALID_ARGUMENT;
     if (values.byte_capacity > max_kernel_payload || values.resource_capacity > NA_CHANNEL_MAX_RESOURCES)
         return NA_STATUS_INVALID_ARGUMENT;
+    return NA_STATUS_OK;
+}
 
-    capability::entry entry;
-    if (!resources.lookup_native(invocation_handle, entry) || !entry.object)
-        return NA_STATUS_INVALID_HANDLE;
-    if (entry.meta.binding != NA_BINDING_INVOCATION)
-        return NA_STATUS_WRONG_BINDING;
-    auto *invocation = entry.object->get<invocation_object>();
-    if (invocation == nullptr)
-        return NA_STATUS_WRONG_BINDING;
+/// Move the completed result of \p invocation into the caller's buffers and
+/// handle table, and describe it in \p frame
+na_status_t take_result(task::resource_table_t &resources, invocation_state *invocation, na_result_frame_t *frame)
+{
+    na_result_frame_t values{};
+    auto status = copy_result_frame(values, frame);
+    if (status != NA_STATUS_OK)
+        return status;
 
     freelibcxx::vector<byte> bytes(memory::MemoryAllocatorV);
     capability::transfer_record_list records(memory::KernelCommonAllocatorV);
-    status = invocation->state()->claim_result(values, bytes, records);
+    status = invocation->claim_result(values, bytes, records);
     if (status != NA_STATUS_OK)
     {
         write_frame(frame, values);
@@ -3955,7 +4217,7 @@ na_status_t invocation_take_result(task::resource_table_t &resources, na_handle_
     if (!naos::usercopy::valid_output_range(values.bytes, values.byte_capacity) ||
         !naos::usercopy::valid_output_range(values.resources, values.resource_capacity * sizeof(na_handle_t)))
     {
-        invocation->state()->restore_result(std::move(bytes), std::move(records));
+        invocation->restore_result(std::move(bytes), std::move(records));
         return NA_STATUS_FAULT;
     }
     if (naos::usercopy::ranges_overlap(reinterpret_cast<u64>(frame), sizeof(*frame), values.bytes, bytes.size()) ||
@@ -3964,7 +4226,7 @@ na_status_t invocation_take_result(task::resource_table_t &resources, na_handle_
         naos::usercopy::ranges_overlap(values.bytes, bytes.size(), values.resources,
                                        records.size() * sizeof(na_handle_t)))
     {
-        invocation->state()->restore_result(std::move(bytes), std::move(records));
+        invocation->restore_result(std::move(bytes), std::move(records));
         return NA_STATUS_INVALID_ARGUMENT;
     }
 
@@ -3983,7 +4245,7 @@ na_status_t invocation_take_result(task::resource_table_t &resources, na_handle_
     if (status != NA_STATUS_OK)
     {
         resources.rollback_native(reserved);
-        invocation->state()->restore_result(std::move(bytes), std::move(records));
+        invocation->restore_result(std::move(bytes), std::move(records));
         return status;
     }
     for (u64 i = 0; i < records.size(); i++)
@@ -3997,10 +4259,10 @@ na_status_t invocation_take_result(task::resource_table_t &resources, na_handle_
         for (auto handle : reserved)
             resources.close_native(handle);
         resources.rollback_native(reserved);
-        invocation->state()->restore_result(std::move(bytes), std::move(records));
+        invocation->restore_result(std::move(bytes), std::move(records));
         return status;
     }
-    status = invocation->state()->commit_result();
+    status = invocation->commit_result();
     if (status != NA_STATUS_OK)
     {
         for (auto handle : reserved)
@@ -4010,6 +4272,48 @@ na_status_t invocation_take_result(task::resource_table_t &resources, na_handle_
     return NA_STATUS_OK;
 }
 
+} // namespace
+
+na_status_t invocation_take_result(task::resource_table_t &resources, na_handle_t invocation_handle,
+                                   na_result_frame_t *frame)
+{
+    capability::entry entry;
+    if (!resources.lookup_native(invocation_handle, entry) || !entry.object)
+        return NA_STATUS_INVALID_HANDLE;
+    if (entry.meta.binding != NA_BINDING_INVOCATION)
+        return NA_STATUS_WRONG_BINDING;
+    auto *invocation = entry.object->get<invocation_object>();
+    if (invocation == nullptr)
+        return NA_STATUS_WRONG_BINDING;
+    return take_result(resources, invocation->state(), frame);
+}
+
+na_status_t invoke_call(task::resource_table_t &resources, na_handle_t target, const na_submit_frame_t *submit,
+                        na_result_frame_t *result)
+{
+    // Refuse a result frame that could never be filled before the call runs
+    na_result_frame_t values{};
+    auto status = copy_result_frame(values, result);
+    if (status != NA_STATUS_OK)
+        return status;
+    if (!naos::usercopy::valid_output_range(values.bytes, values.byte_capacity) ||
+        !naos::usercopy::valid_output_range(values.resources, values.resource_capacity * sizeof(na_handle_t)))
+        return NA_STATUS_FAULT;
+
+    handle_t<invocation_state> state;
+    {
+        task::scheduler::sync_wakeup_scope handoff;
+        status = invoke_submit_impl(resources, target, submit, nullptr, false, true, &state);
+    }
+    if (status != NA_STATUS_OK)
+        return status;
+    state->wait_completed();
+    status = take_result(resources, state.operator&(), result);
+    // As closing the Invocation handle would, drop a result that was not taken
+    state->close_client();
+    return status;
+}
+
 na_status_t responder_reply(task::resource_table_t &resources, na_handle_t responder_handle,
                             const na_reply_frame_t *frame)
 {
@@ -4062,7 +4366,17 @@ na_status_t responder_reply(task::resource_table_t &resources, na_handle_t respo
     status = resources.take_native_batch(dispositions.data(), dispositions.size(), responder_handle, records);
     if (status != NA_STATUS_OK)
         return status;
-    const bool replied = responder->state()->complete_reply(bytes, records, 0, &resources);
+    bool replied = false;
+    if (responder->state()->synchronous())
+    {
+        // The client waits in invoke_call, run it before finishing here
+        task::scheduler::sync_wakeup_scope handoff;
+        replied = responder->state()->complete_reply(bytes, records, 0, &resources);
+    }
+    else
+    {
+        replied = responder->state()->complete_reply(bytes, records, 0, &resources);
+    }
     if (!replied)
     {
         const auto restore_status = resources.restore_native_batch(records);
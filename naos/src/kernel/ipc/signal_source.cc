@@ -0,0 +1,89 @@
+#include "kernel/ipc/signal_source.hpp"
+
+#include "kernel/arch/klib.hpp"
+#include "kernel/ucontext.hpp"
+
+namespace naos::ipc
+{
+namespace
+{
+/// Waiters woken per lock hold. Wakeups may IPI another CPU and spin for
+/// completion, so they are issued with the source lock dropped.
+constexpr u64 notify_batch = 16;
+} // namespace
+
+signal_waiter::signal_waiter()
+    : generation_(0)
+    , pins_(0)
+{
+}
+
+signal_waiter::~signal_waiter()
+{
+    while (pins_.load(std::memory_order_acquire) != 0)
+        cpu_pause();
+}
+
+void signal_waiter::wait(u64 generation)
+{
+    queue_.do_wait([this, generation] { return generation_.load(std::memory_order_acquire) != generation; });
+}
+
+void signal_waiter::wake()
+{
+    generation_.fetch_add(1, std::memory_order_acq_rel);
+    queue_.do_wake_up();
+}
+
+void signal_source::observe(signal_observer &observer, signal_waiter &waiter, na_signal_t signals)
+{
+    observer.signals = signals;
+    observer.waiter = &waiter;
+    uctx::RawSpinLockUninterruptibleContext icu(lock_);
+    observers_.link(&observer);
+}
+
+void signal_source::forget(signal_observer &observer)
+{
+    uctx::RawSpinLockUninterruptibleContext icu(lock_);
+    observers_.unlink(&observer);
+}
+
+u64 signal_source::notify(na_signal_t raised)
+{
+    if (raised == 0)
+        return 0;
+
+    u64 round = 0;
+    {
+        uctx::RawSpinLockUninterruptibleContext icu(lock_);
+        if (observers_.empty())
+            return 0;
+        round = observers_.next_round();
+    }
+
+    u64 woken = 0;
+    void *batch[notify_batch];
+    for (;;)
+    {
+        u64 count = 0;
+        {
+            uctx::RawSpinLockUninterruptibleContext icu(lock_);
+            count = observers_.collect(raised, round, batch, notify_batch);
+            for (u64 i = 0; i < count; i++)
+                static_cast<signal_waiter *>(batch[i])->pin();
+        }
+        for (u64 i = 0; i < count; i++)
+        {
+            auto *waiter = static_cast<signal_waiter *>(batch[i]);
+            waiter->wake();
+            waiter->unpin();
+        }
+        woken += count;
+        if (count < notify_batch)
+            break;
+    }
+    return woken;
+}
+
+} // namespace naos::ipc
@@ -0,0 +1,122 @@
+#include "kernel/lock.hpp"
+#include "kernel/arch/cpu.hpp"
+#include "kernel/preempt.hpp"
+
+namespace lock
+{
+lock_class spinlock_class("spinlock");
+lock_class rw_lock_class("rw_lock");
+
+namespace
+{
+/// Thread, soft irq, interrupt and exception context can each wait for one
+/// lock on a CPU at a time
+constexpr u32 node_levels = 4;
+
+struct cpu_nodes_t
+{
+    util::queue_node nodes[node_levels];
+    u32 depth = 0;
+};
+
+cpu_nodes_t cpu_nodes[arch::cpu::max_cpu_support];
+
+std::atomic<lock_class *> class_list = nullptr;
+
+void relax() { cpu_pause(); }
+
+void queue_lock(util::queued_spinlock &lock)
+{
+    if (unlikely(!arch::cpu::has_init()))
+    {
+        lock.lock_unqueued(relax);
+        return;
+    }
+    // The node belongs to this CPU until the lock is taken
+    task::disable_preempt();
+    auto &cpu = cpu_nodes[arch::cpu::current().get_id()];
+    if (likely(cpu.depth < node_levels))
+    {
+        auto *node = &cpu.nodes[cpu.depth++];
+        lock.lock_queued(node, relax);
+        cpu.depth--;
+    }
+    else
+    {
+        lock.lock_unqueued(relax);
+    }
+    task::enable_preempt();
+}
+
+/// A reader that may have interrupted a reader of the same lock on its CPU
+bool nested_context()
+{
+    if (unlikely(!arch::cpu::has_init()))
+        return false;
+    auto &cpu = arch::cpu::current();
+    return cpu.is_in_interrupt_context() || cpu.is_in_exception_context() || cpu.in_soft_irq();
+}
+
+} // namespace
+
+void spinlock_t::lock_slow()
+{
+#ifdef LOCKSTAT
+    const u64 start = _rdtsc();
+#endif
+    queue_lock(lock_m);
+#ifdef LOCKSTAT
+    record_wait(*class_m, _rdtsc() - start);
+#endif
+}
+
+void rw_lock_t::lock_read_slow()
+{
+#ifdef LOCKSTAT
+    const u64 start = _rdtsc();
+#endif
+    lock_m.lock_read_slow(
+        nested_context(), [this]() { queue_lock(lock_m.queue()); }, [this]() { lock_m.queue().unlock(); }, relax);
+#ifdef LOCKSTAT
+    record_wait(*class_m, _rdtsc() - start);
+#endif
+}
+
+void rw_lock_t::lock_write_slow()
+{
+#ifdef LOCKSTAT
+    const u64 start = _rdtsc();
+#endif
+    lock_m.lock_write_slow([this]() { queue_lock(lock_m.queue()); }, [this]() { lock_m.queue().unlock(); }, relax);
+#ifdef LOCKSTAT
+    record_wait(*class_m, _rdtsc() - start);
+#endif
+}
+
+lock_class *first_class() { return class_list.load(std::memory_order_acquire); }
+
+#ifdef LOCKSTAT
+void record_acquire(lock_class &cls)
+{
+    cls.acquisitions.fetch_add(1, std::memory_order_relaxed);
+    if (likely(cls.listed.load(std::memory_order_relaxed)) || cls.listed.exchange(true))
+        return;
+    lock_class *head = class_list.load(std::memory_order_relaxed);
+    do
+    {
+        cls.next = head;
+    } while (!class_list.compare_exchange_weak(head, &cls, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void record_wait(lock_class &cls, u64 cycles)
+{
+    cls.contended.fetch_add(1, std::memory_order_relaxed);
+    cls.total_wait_cycles.fetch_add(cycles, std::memory_order_relaxed);
+    u64 max = cls.max_wait_cycles.load(std::memory_order_relaxed);
+    while (cycles > max && !cls.max_wait_cycles.compare_exchange_weak(max, cycles, std::memory_order_relaxed))
+    {
+    }
+}
+#endif
+
+} // namespace lock
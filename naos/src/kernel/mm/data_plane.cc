@@ -1,7 +1,9 @@
 #include "kernel/mm/data_plane.hpp"
 
+#include "freelibcxx/utils.hpp"
 #include "kernel/ipc/channel.hpp"
 #include "kernel/mm/memory.hpp"
+#include "naos/shared_ring.hpp"
 
 namespace naos::data_plane
 {
@@ -20,23 +22,49 @@ void copy_bytes(byte *destination, const byte *source, u64 size)
 
 memory_object::memory_object(u64 size, u32 flags)
     : kobject(type_of())
-    , bytes_(memory::MemoryAllocatorV)
+    , pages_(nullptr)
+    , page_count_(0)
+    , size_(0)
     , flags_(flags)
 {
-    if (size <= NA_MEMORY_OBJECT_MAX_BYTES)
+    if (size == 0 || size > NA_MEMORY_OBJECT_MAX_BYTES)
+        return;
+    const u64 pages = (size + memory::page_size - 1) / memory::page_size;
+    pages_ = reinterpret_cast<byte **>(
+        memory::KernelCommonAllocatorV->allocate(sizeof(byte *) * pages, alignof(byte *)));
+    if (pages_ == nullptr)
+        return;
+    // Unlike malloc_page(), the bulk allocation returns short instead of
+    // panicking, so a user-sized request cannot take the kernel down.
+    page_count_ = memory::global_zones->allocate_pages(pages, reinterpret_cast<void **>(pages_));
+    if (page_count_ < pages)
     {
-        resize_bytes(bytes_, size);
-        if (size == 0 || bytes_.data() != nullptr)
-            return;
+        release_pages();
+        return;
     }
-    bytes_.clear();
+    for (u64 i = 0; i < page_count_; i++)
+        memset(pages_[i], 0, memory::page_size);
+    size_ = size;
 }
 
-bool memory_object::readable(u64 offset, u64 size) const { return valid_extent(offset, size, bytes_.size()); }
+memory_object::~memory_object() { release_pages(); }
+
+void memory_object::release_pages()
+{
+    for (u64 i = 0; i < page_count_; i++)
+        memory::free_page(pages_[i]);
+    if (pages_ != nullptr)
+        memory::KernelCommonAllocatorV->deallocate(pages_);
+    pages_ = nullptr;
+    page_count_ = 0;
+    size_ = 0;
+}
+
+bool memory_object::readable(u64 offset, u64 size) const { return valid_extent(offset, size, size_); }
 
 bool memory_object::writable(u64 offset, u64 size) const
 {
-    return (flags_ & NA_MEMORY_FLAG_READ_ONLY) == 0 && valid_extent(offset, size, bytes_.size());
+    return (flags_ & NA_MEMORY_FLAG_READ_ONLY) == 0 && valid_extent(offset, size, size_);
 }
 
 na_status_t memory_object::read(u64 offset, byte *destination, u64 size, u64 &actual) const
@@ -44,11 +72,16 @@ na_status_t memory_object::read(u64 offset, byte *destination, u64 size, u64 &ac
     actual = 0;
     if (size != 0 && destination == nullptr)
         return NA_STATUS_INVALID_ARGUMENT;
-    uctx::RawSpinLockUninterruptibleContext context(lock_);
-    if (!valid_extent(offset, size, bytes_.size()))
+    if (!readable(offset, size))
         return NA_STATUS_INVALID_ARGUMENT;
-    copy_bytes(destination, bytes_.data() + offset, size);
-    actual = size;
+    while (actual < size)
+    {
+        const u64 position = offset + actual;
+        const u64 in_page = position % memory::page_size;
+        const u64 chunk = freelibcxx::min(memory::page_size - in_page, size - actual);
+        memcpy(destination + actual, pages_[position / memory::page_size] + in_page, chunk);
+        actual += chunk;
+    }
     return NA_STATUS_OK;
 }
 
@@ -57,23 +90,49 @@ na_status_t memory_object::write(u64 offset, const byte *source, u64 size, u64 &
     actual = 0;
     if (size != 0 && source == nullptr)
         return NA_STATUS_INVALID_ARGUMENT;
-    uctx::RawSpinLockUninterruptibleContext context(lock_);
     if (!writable(offset, size))
         return (flags_ & NA_MEMORY_FLAG_READ_ONLY) != 0 ? NA_STATUS_ACCESS_DENIED : NA_STATUS_INVALID_ARGUMENT;
-    copy_bytes(bytes_.data() + offset, source, size);
-    actual = size;
+    while (actual < size)
+    {
+        const u64 position = offset + actual;
+        const u64 in_page = position % memory::page_size;
+        const u64 chunk = freelibcxx::min(memory::page_size - in_page, size - actual);
+        memcpy(pages_[position / memory::page_size] + in_page, source + actual, chunk);
+        actual += chunk;
+    }
     return NA_STATUS_OK;
 }
 
-u64 memory_object::size() const
+byte *memory_object::data_at(u64 offset) const
 {
-    uctx::RawSpinLockUninterruptibleContext context(lock_);
-    return bytes_.size();
+    if (offset >= size_)
+        return nullptr;
+    return pages_[offset / memory::page_size] + offset % memory::page_size;
+}
+
+phy_addr_t memory_object::share_page(u64 offset)
+{
+    const u64 index = offset / memory::page_size;
+    if (offset >= size_ || index >= page_count_)
+        return nullptr;
+    memory::global_zones->page_add_reference(pages_[index]);
+    return memory::va2pa(pages_[index]);
+}
+
+byte *memory_object::reference_page(u64 offset)
+{
+    const u64 index = offset / memory::page_size;
+    if (offset >= size_ || index >= page_count_)
+        return nullptr;
+    memory::global_zones->page_add_reference(pages_[index]);
+    return pages_[index];
 }
 
 shared_ring::shared_ring(u64 slots, u64 slot_bytes, u32 flags)
     : kobject(type_of())
     , slots_(memory::KernelCommonAllocatorV)
+    , header_(nullptr)
+    , slot_count_(0)
     , slot_bytes_(slot_bytes)
     , head_(0)
     , tail_(0)
@@ -85,6 +144,18 @@ shared_ring::shared_ring(u64 slots, u64 slot_bytes, u32 flags)
     if (slots == 0 || slots > NA_SHARED_RING_MAX_SLOTS || slot_bytes == 0 ||
         slot_bytes > NA_SHARED_RING_MAX_SLOT_BYTES || slots > NA_SHARED_RING_MAX_BYTES / slot_bytes)
         return;
+    if ((flags & NA_RING_FLAG_MAPPED) != 0)
+    {
+        auto object = handle_t<memory_object>::make(nao::shared_ring_view::mapping_bytes(slots, slot_bytes), 0);
+        if (!object || object->size() == 0)
+            return;
+        header_ = reinterpret_cast<na_shared_ring_header_t *>(object->data_at(0));
+        nao::shared_ring_view::initialize(header_, static_cast<u32>(slots), static_cast<u32>(slot_bytes));
+        mapping_ = std::move(object);
+        slot_count_ = slots;
+        valid_ = true;
+        return;
+    }
     slots_.ensure(slots);
     if (slots_.capacity() < slots)
         return;
@@ -99,21 +170,46 @@ shared_ring::shared_ring(u64 slots, u64 slot_bytes, u32 flags)
             return;
         }
     }
+    slot_count_ = slots;
     valid_ = true;
 }
 
 u64 shared_ring::queued() const
 {
+    if (mapped())
+        return mapped_queued();
     uctx::RawSpinLockUninterruptibleContext context(lock_);
     return count_;
 }
 
+u64 shared_ring::mapped_queued() const
+{
+    // Both indices are written from user space; clamp rather than trust them.
+    const u64 tail = __atomic_load_n(&header_->tail, __ATOMIC_ACQUIRE);
+    const u64 queued = tail - __atomic_load_n(&header_->head, __ATOMIC_ACQUIRE);
+    return queued > slot_count_ ? slot_count_ : queued;
+}
+
 na_signal_t shared_ring::capability_signals() const
 {
     uctx::RawSpinLockUninterruptibleContext context(lock_);
+    return signals_locked();
+}
+
+na_signal_t shared_ring::signals_locked() const
+{
     na_signal_t signals = 0;
     if (!valid_)
         return signals;
+    if (mapped())
+    {
+        const u64 queued = mapped_queued();
+        if (queued != 0)
+            signals |= NA_SIGNAL_READABLE;
+        if (queued < slot_count_)
+            signals |= NA_SIGNAL_WRITABLE;
+        return signals;
+    }
     if (count_ != 0)
         signals |= NA_SIGNAL_READABLE;
     if (count_ < slots_.size() && !pop_claimed_)
@@ -121,13 +217,32 @@ na_signal_t shared_ring::capability_signals() const
     return signals;
 }
 
+na_status_t shared_ring::notify_mapped()
+{
+    if (!mapped())
+        return NA_STATUS_NOT_SUPPORTED;
+    // The kernel does not see the index moves, so it cannot tell which bit
+    // was raised. Waiters recheck the header after waking.
+    na_signal_t current = 0;
+    {
+        uctx::RawSpinLockUninterruptibleContext context(lock_);
+        current = signals_locked();
+    }
+    observers_.notify(current);
+    return NA_STATUS_OK;
+}
+
 na_status_t shared_ring::push(freelibcxx::vector<byte> &&bytes)
 {
+    if (mapped())
+        return NA_STATUS_NOT_SUPPORTED;
     if (!valid_ || bytes.size() > slot_bytes_)
         return NA_STATUS_INVALID_ARGUMENT;
     na_status_t result = NA_STATUS_OK;
+    bool was_empty = false;
     {
         uctx::RawSpinLockUninterruptibleContext context(lock_);
+        was_empty = count_ == 0;
         if (count_ == slots_.size())
             result = NA_STATUS_WOULD_BLOCK;
         else
@@ -145,14 +260,16 @@ na_status_t shared_ring::push(freelibcxx::vector<byte> &&bytes)
             }
         }
     }
-    if (result == NA_STATUS_OK)
-        ipc::notify_channel_waiters();
+    if (result == NA_STATUS_OK && was_empty)
+        observers_.notify(NA_SIGNAL_READABLE);
     return result;
 }
 
 na_status_t shared_ring::claim_pop(freelibcxx::vector<byte> &snapshot)
 {
     snapshot.clear();
+    if (mapped())
+        return NA_STATUS_NOT_SUPPORTED;
     uctx::RawSpinLockUninterruptibleContext context(lock_);
     if (!valid_ || count_ == 0)
         return NA_STATUS_WOULD_BLOCK;
@@ -169,25 +286,31 @@ na_status_t shared_ring::claim_pop(freelibcxx::vector<byte> &snapshot)
 
 void shared_ring::cancel_pop()
 {
+    na_signal_t raised = 0;
     {
         uctx::RawSpinLockUninterruptibleContext context(lock_);
+        const auto before = signals_locked();
         pop_claimed_ = false;
+        raised = signals_locked() & ~before;
     }
-    ipc::notify_channel_waiters();
+    observers_.notify(raised);
 }
 
 na_status_t shared_ring::commit_pop()
 {
+    na_signal_t raised = 0;
     {
         uctx::RawSpinLockUninterruptibleContext context(lock_);
         if (!pop_claimed_ || count_ == 0)
             return NA_STATUS_INVALID_ARGUMENT;
+        const auto before = signals_locked();
         slots_[head_].bytes.clear();
         head_ = (head_ + 1) % slots_.size();
         count_--;
         pop_claimed_ = false;
+        raised = signals_locked() & ~before;
     }
-    ipc::notify_channel_waiters();
+    observers_.notify(raised);
     return NA_STATUS_OK;
 }
 
@@ -9,9 +9,12 @@
 #include "kernel/irq.hpp"
 #include "kernel/kernel.hpp"
 #include "kernel/lock.hpp"
+#include "kernel/mm/big_page.hpp"
+#include "kernel/mm/kmalloc_size.hpp"
 #include "kernel/mm/msg_queue.hpp"
 #include "kernel/mm/new.hpp"
 #include "kernel/mm/slab.hpp"
+#include "kernel/mm/tlb.hpp"
 #include "kernel/mm/vm.hpp"
 #include "kernel/mm/zone.hpp"
 #include "kernel/trace.hpp"
@@ -27,7 +30,8 @@ KernelVirtualAllocator *KernelVirtualAllocatorV;
 MemoryAllocator *MemoryAllocatorV;
 zones *KernelBuddyAllocatorV;
 
-lock::spinlock_t buddy_lock;
+lock::lock_class buddy_lock_class("buddy");
+lock::spinlock_t buddy_lock(buddy_lock_class);
 lock::spinlock_t kernel_vmalloc_paging_lock;
 
 phy_addr_t PhyBootAllocator::base_ptr;
@@ -43,21 +47,15 @@ vm::info_t *kernel_vm_info;
 
 struct kmalloc_t
 {
-    u64 size;
     const char *name;
     slab_group *group;
-    kmalloc_t(u64 size, const char *name)
-        : size(size)
-        , name(name)
-        , group(nullptr) {};
 } kmalloc_fixed_slab_size[] = {
-    {8, "kmalloc-8"},       {16, "kmalloc-16"},     {24, "kmalloc-24"},     {32, "kmalloc-32"},
-    {40, "kmalloc-40"},     {48, "kmalloc-48"},     {56, "kmalloc-56"},     {64, "kmalloc-64"},
-    {80, "kmalloc-80"},     {96, "kmalloc-96"},     {112, "kmalloc-112"},   {128, "kmalloc-128"},
-    {160, "kmalloc-160"},   {192, "kmalloc-192"},   {256, "kmalloc-256"},   {384, "kmalloc-384"},
-    {448, "kmalloc-448"},   {512, "kmalloc-512"},   {768, "kmalloc-768"},   {960, "kmalloc-960"},
-    {1024, "kmalloc-1024"}, {1536, "kmalloc-1536"}, {2048, "kmalloc-2048"}, {3072, "kmalloc-3072"},
-    {4096, "kmalloc-4096"}, {6144, "kmalloc-6144"}, {8192, "kmalloc-8192"}};
+    {"kmalloc-8"},    {"kmalloc-16"},   {"kmalloc-24"},   {"kmalloc-32"},   {"kmalloc-40"},   {"kmalloc-48"},
+    {"kmalloc-56"},   {"kmalloc-64"},   {"kmalloc-80"},   {"kmalloc-96"},   {"kmalloc-112"},  {"kmalloc-128"},
+    {"kmalloc-160"},  {"kmalloc-192"},  {"kmalloc-256"},  {"kmalloc-384"},  {"kmalloc-448"},  {"kmalloc-512"},
+    {"kmalloc-768"},  {"kmalloc-960"},  {"kmalloc-1024"}, {"kmalloc-1536"}, {"kmalloc-2048"}, {"kmalloc-3072"},
+    {"kmalloc-4096"}, {"kmalloc-6144"}, {"kmalloc-8192"}};
+static_assert(sizeof(kmalloc_fixed_slab_size) / sizeof(kmalloc_fixed_slab_size[0]) == kmalloc_size::class_count);
 
 const char *get_type_str(map_type_t type)
 {
@@ -215,8 +213,10 @@ void init(kernel_start_args *args, u64 fix_memory_limit)
     global_zones = (memory::zones *)VirtBootAllocatorV->allocate(sizeof(zones) + zone_count * sizeof(zone), 8);
     global_zones = new (global_zones) memory::zones(zone_count, high_memory_index);
 
-    auto end_used_memory_addr =
-        reinterpret_cast<char *>(VirtBootAllocatorV->current_ptr_address()) + memory::page_size * 4;
+    // The kmalloc slab groups carry per-CPU magazine slots and are the bulk
+    // of what is allocated from the boot allocator below.
+    auto end_used_memory_addr = reinterpret_cast<char *>(VirtBootAllocatorV->current_ptr_address()) +
+                                memory::page_size * 4 + sizeof(slab_group) * kmalloc_size::class_count;
     end_used_memory_addr = align_up(end_used_memory_addr, memory::page_size);
 
     trace::debug("Build memory zones ", zone_count, " high memory zones ", zone_count - high_memory_index);
@@ -241,9 +241,10 @@ void init(kernel_start_args *args, u64 fix_memory_limit)
     global_object_slab_domain = New<slab_cache_pool>(VirtBootAllocatorV);
     global_acpi_slab_domain = New<slab_cache_pool>(VirtBootAllocatorV);
 
-    for (auto &i : kmalloc_fixed_slab_size)
+    for (u64 i = 0; i < kmalloc_size::class_count; i++)
     {
-        i.group = New<slab_group>(VirtBootAllocatorV, i.size, i.name, 8, 0);
+        auto &entry = kmalloc_fixed_slab_size[i];
+        entry.group = New<slab_group>(VirtBootAllocatorV, kmalloc_size::sizes[i], entry.name, 8, 0);
     }
 
     trace::debug("Kernel(code):", trace::hex(start_kernel()), "-", trace::hex(end_kernel()),
@@ -295,33 +296,12 @@ void *kmalloc(u64 size, u64 align)
     {
         trace::panic("align is larger than size");
     }
-    constexpr int tmp = sizeof(kmalloc_fixed_slab_size) / sizeof(kmalloc_fixed_slab_size[0]) - 1;
-    if (unlikely(size > kmalloc_fixed_slab_size[tmp].size))
+    if (unlikely(size > kmalloc_size::max_size))
     {
         trace::panic("allocate size is too large");
     }
 
-    u64 left = 0, right = sizeof(kmalloc_fixed_slab_size) / sizeof(kmalloc_fixed_slab_size[0]), mid = 0;
-
-    while (left < right)
-    {
-        mid = left + (right - left) / 2;
-        if (kmalloc_fixed_slab_size[mid].size >= size)
-        {
-            if (kmalloc_fixed_slab_size[mid - 1].size < size)
-            {
-                break;
-            }
-            right = mid;
-        }
-        else
-        {
-            left = mid + 1;
-        }
-    }
-    kassert(kmalloc_fixed_slab_size[mid].size >= size, "Kernel malloc check failed!");
-
-    SlabObjectAllocator allocator(kmalloc_fixed_slab_size[mid].group);
+    SlabObjectAllocator allocator(kmalloc_fixed_slab_size[kmalloc_size::class_of(size)].group);
     auto ptr = allocator.allocate(size, align);
     kassert((reinterpret_cast<u64>(ptr) & (align - 1)) == 0, "check alignment fail");
     return ptr;
@@ -342,13 +322,40 @@ void kfree(void *addr)
 
 void *vmalloc(u64 size, u64 align)
 {
-    auto vm = kernel_vm_info->vma().allocate_map(size, align, vm::page_fault_method::none, 0);
+    if (size >= big_page::size && align < big_page::size)
+        align = big_page::size;
+    if (align < page_size)
+        align = page_size;
+    auto vm = kernel_vm_info->vma().allocate_map(size, vm::flags::readable | vm::flags::writeable,
+                                                 vm::page_fault_method::none, 0, align);
     if (vm == nullptr)
         trace::panic("vmalloc exhausted");
     {
         uctx::RawSpinLockUninterruptibleContext icu(kernel_vmalloc_paging_lock);
-        kernel_vm_info->paging().map(reinterpret_cast<void *>(vm->start), (vm->end - vm->start) / page_size,
-                                     arch::paging::flags::writable, 0);
+        auto &paging = kernel_vm_info->paging();
+        // 2 MiB pages while aligned blocks are free, 4 KiB pages around them
+        auto span = big_page::inner(vm->start, vm->end);
+        u64 addr = vm->start;
+        for (u64 big = span.first; big < span.last; big += big_page::size)
+        {
+            void *block = global_zones->allocate_big_page();
+            if (block == nullptr)
+            {
+                break;
+            }
+            if (addr < big)
+            {
+                paging.map(reinterpret_cast<void *>(addr), (big - addr) / page_size, arch::paging::flags::writable, 0);
+            }
+            [[maybe_unused]] bool mapped =
+                paging.map_big_page(reinterpret_cast<void *>(big), block, arch::paging::flags::writable);
+            kassert(mapped, "vmalloc range already mapped at ", trace::hex(big));
+            addr = big + big_page::size;
+        }
+        if (addr < vm->end)
+        {
+            paging.map(reinterpret_cast<void *>(addr), (vm->end - addr) / page_size, arch::paging::flags::writable, 0);
+        }
     }
 
     arch::paging::page_table_t::reload();
@@ -367,6 +374,7 @@ void vfree(void *addr)
             uctx::RawSpinLockUninterruptibleContext icu(kernel_vmalloc_paging_lock);
             kernel_vm_info->paging().unmap(reinterpret_cast<void *>(start), (end - start) / page_size);
         }
+        tlb::flush_kernel(start, (end - start) / page_size);
     }
 }
 
@@ -0,0 +1,255 @@
+#include "kernel/mm/numa.hpp"
+#include "freelibcxx/hash_map.hpp"
+#include "kernel/arch/acpi/acpi.hpp"
+#include "kernel/mm/memory.hpp"
+#include "kernel/mm/new.hpp"
+#include "kernel/mm/zone.hpp"
+#include "kernel/task.hpp"
+#include "kernel/trace.hpp"
+
+namespace memory::numa
+{
+namespace
+{
+constexpr int max_zones = 32;
+
+/// Allocation and free counts of one CPU, by node. A CPU only adds to its
+/// own row.
+struct alignas(64) cpu_counters
+{
+    u64 allocs[max_nodes];
+    u64 frees[max_nodes];
+};
+
+bool numa_init = false;
+topology nodes;
+freelibcxx::hash_map<u32, u8> *apic_nodes = nullptr;
+u8 cpu_nodes[arch::cpu::max_cpu_support];
+u64 node_cpus[max_nodes];
+u8 zone_orders[max_nodes][max_zones];
+int zone_order_count = 0;
+cpu_counters counters[arch::cpu::max_cpu_support];
+
+cpu_counters &current_counters() { return counters[arch::cpu::has_init() ? arch::cpu::id() : 0]; }
+
+void add_domain(u32 domain)
+{
+    if (!nodes.add_domain(domain))
+    {
+        trace::warning("NUMA domain ", domain, " exceeds ", max_nodes, " nodes, using node 0");
+    }
+}
+
+u8 node_of(u32 domain)
+{
+    u8 node = nodes.node_of(domain);
+    return node == no_node ? 0 : node;
+}
+
+void tag_zones(const freelibcxx::vector<arch::ACPI::memory_affinity> &ranges)
+{
+    for (int i = 0; i < global_zones->zone_count(); i++)
+    {
+        zone *z = global_zones->at(i);
+        u8 node = 0;
+        for (auto &range : ranges)
+        {
+            phy_addr_t end = range.base + range.length;
+            if (z->range_beg() >= range.base && z->range_beg() < end)
+            {
+                node = node_of(range.domain);
+                // A zone cannot be split once its buddy allocator is built.
+                if (z->range_end() > end)
+                {
+                    trace::warning("Memory zone ", i, " extends past its SRAT range at ", trace::hex(end.get()));
+                }
+                break;
+            }
+        }
+        z->set_node(node);
+    }
+}
+
+void build_zone_orders()
+{
+    zone_order_count = global_zones->zone_count();
+    for (u32 node = 0; node < nodes.node_count(); node++)
+    {
+        const u8 *fallback = nodes.fallback(static_cast<u8>(node));
+        int count = 0;
+        for (u32 i = 0; i < nodes.node_count(); i++)
+        {
+            for (int index = 0; index < zone_order_count; index++)
+            {
+                if (global_zones->at(index)->node() == fallback[i])
+                {
+                    zone_orders[node][count++] = static_cast<u8>(index);
+                }
+            }
+        }
+    }
+}
+} // namespace
+
+void init()
+{
+    kassert(global_zones->zone_count() <= max_zones, "Too many memory zones ", global_zones->zone_count());
+    apic_nodes = New<freelibcxx::hash_map<u32, u8>>(KernelCommonAllocatorV, KernelCommonAllocatorV);
+
+    if (arch::ACPI::has_init())
+    {
+        auto ranges = arch::ACPI::get_memory_affinity_list();
+        auto cpus = arch::ACPI::get_numa_info();
+        for (auto &range : ranges)
+        {
+            add_domain(range.domain);
+        }
+        for (auto &item : cpus)
+        {
+            if (item.value.enabled)
+            {
+                add_domain(item.value.domain);
+            }
+        }
+        for (auto &item : cpus)
+        {
+            if (item.value.enabled)
+            {
+                apic_nodes->insert(item.value.apic_id, node_of(item.value.domain));
+            }
+        }
+
+        u64 localities = 0;
+        auto distance = arch::ACPI::get_numa_distance(localities);
+        nodes.build_fallback([&distance, localities](u32 from, u32 to) -> u32 {
+            if (from < localities && to < localities)
+            {
+                return distance[from * localities + to];
+            }
+            // The SLIT default for local and remote access
+            return from == to ? 10 : 20;
+        });
+        tag_zones(ranges);
+    }
+    build_zone_orders();
+    numa_init = true;
+
+    for (u32 node = 0; node < nodes.node_count(); node++)
+    {
+        u64 pages = 0;
+        for (int i = 0; i < global_zones->zone_count(); i++)
+        {
+            if (global_zones->at(i)->node() == node)
+            {
+                pages += global_zones->at(i)->total_pages();
+            }
+        }
+        trace::info("NUMA node ", node, " domain ", nodes.domain_of(static_cast<u8>(node)), " pages ", pages);
+    }
+}
+
+void bind_cpu(arch::cpu::cpuid_t cpu, u32 apic_id)
+{
+    u8 node = 0;
+    if (apic_nodes != nullptr)
+    {
+        node = apic_nodes->get(apic_id).value_or(0);
+    }
+    cpu_nodes[cpu] = node;
+    __atomic_or_fetch(&node_cpus[node], 1UL << cpu, __ATOMIC_RELAXED);
+}
+
+u32 node_count() { return nodes.node_count(); }
+
+u8 cpu_node(arch::cpu::cpuid_t cpu) { return cpu_nodes[cpu]; }
+
+u8 node_of_cpu_mask(u64 cpu_mask)
+{
+    if (nodes.node_count() == 1)
+    {
+        return 0;
+    }
+    u8 found = no_node;
+    for (u32 node = 0; node < nodes.node_count(); node++)
+    {
+        if ((cpu_mask & __atomic_load_n(&node_cpus[node], __ATOMIC_RELAXED)) != 0)
+        {
+            if (found != no_node)
+            {
+                return no_node;
+            }
+            found = static_cast<u8>(node);
+        }
+    }
+    return found;
+}
+
+u8 preferred_node()
+{
+    if (!numa_init || nodes.node_count() == 1)
+    {
+        return 0;
+    }
+    if (task::has_init())
+    {
+        auto *thread = task::current();
+        if (thread != nullptr && thread->numa_node != no_node)
+        {
+            return thread->numa_node;
+        }
+    }
+    return cpu_nodes[arch::cpu::id()];
+}
+
+const u8 *zone_order(u8 node, int &count)
+{
+    if (!numa_init)
+    {
+        count = 0;
+        return nullptr;
+    }
+    count = zone_order_count;
+    return zone_orders[node];
+}
+
+void count_alloc(u8 node, u64 blocks)
+{
+    __atomic_add_fetch(&current_counters().allocs[node], blocks, __ATOMIC_RELAXED);
+}
+
+void count_free(u8 node) { __atomic_add_fetch(&current_counters().frees[node], 1, __ATOMIC_RELAXED); }
+
+void get_stats(u8 node, node_stats &stats)
+{
+    stats.domain = nodes.domain_of(node);
+    stats.cpu_mask = __atomic_load_n(&node_cpus[node], __ATOMIC_RELAXED);
+    stats.total_pages = 0;
+    stats.free_pages = 0;
+    for (int i = 0; i < global_zones->active_zones(); i++)
+    {
+        zone *z = global_zones->at(i);
+        if (z->node() == node)
+        {
+            stats.total_pages += z->total_pages();
+            stats.free_pages += z->free_pages();
+        }
+    }
+    stats.local_allocs = 0;
+    stats.remote_allocs = 0;
+    stats.frees = 0;
+    for (u32 cpu = 0; cpu < arch::cpu::max_cpu_support; cpu++)
+    {
+        u64 allocs = __atomic_load_n(&counters[cpu].allocs[node], __ATOMIC_RELAXED);
+        if (cpu_nodes[cpu] == node)
+        {
+            stats.local_allocs += allocs;
+        }
+        else
+        {
+            stats.remote_allocs += allocs;
+        }
+        stats.frees += __atomic_load_n(&counters[cpu].frees[node], __ATOMIC_RELAXED);
+    }
+}
+
+} // namespace memory::numa
@@ -1,5 +1,6 @@
 #include "kernel/mm/slab.hpp"
 #include "freelibcxx/string.hpp"
+#include "kernel/arch/cpu.hpp"
 #include "kernel/lock.hpp"
 #include "kernel/mm/memory.hpp"
 #include "kernel/mm/new.hpp"
@@ -12,13 +13,16 @@ namespace memory
 
 slab_cache_pool *global_kmalloc_slab_domain, *global_dma_slab_domain, *global_object_slab_domain,
     *global_acpi_slab_domain;
+slab_group *slab_group::group_list;
+lock::spinlock_t slab_group::group_list_lock;
+
 slab *slab_group::new_memory_node()
 {
     slab *s = (slab *)memory::KernelBuddyAllocatorV->allocate(page_pre_slab * memory::page_size, 8);
-    new (s) slab(node_pre_slab, 0);
+    new (s) slab(node_pre_slab, color.take());
 
     s->data_ptr = (char *)s + sizeof(slab);
-    s->data_ptr = (char *)(((u64)s->data_ptr + align - 1) & ~(align - 1));
+    s->data_ptr = (char *)(((u64)s->data_ptr + align - 1) & ~(align - 1)) + s->color_offset;
     s->bitmap.reset_all();
     page *p = memory::global_zones->get_page(s);
     for(u32 i = 0; i < page_pre_slab; i++, p++) {
@@ -26,6 +30,7 @@ slab *slab_group::new_memory_node()
     }
 
     all_obj_count += node_pre_slab;
+    slab_count++;
     return s;
 }
 
@@ -33,6 +38,7 @@ void slab_group::delete_memory_node(slab *s)
 {
     kassert(s->rest == node_pre_slab, "slab error rest:", s->rest, " target:", node_pre_slab);
     all_obj_count -= node_pre_slab;
+    slab_count--;
     s->~slab();
     // page *p = memory::global_zones->get_page(s);
     // for(int i = 0; i < page_pre_slab; i++, p++) {
@@ -49,9 +55,18 @@ slab_group::slab_group(u64 size, const char *name, u64 align, u64 flags)
     , align(align)
     , all_obj_count(0)
     , all_obj_used(0)
+    , slab_count(0)
+    , slab_allocs(0)
+    , slab_frees(0)
     , free_head(nullptr)
     , used_head(nullptr)
 {
+    for (auto &cache : cpu_caches)
+    {
+        cache.allocs = 0;
+        cache.frees = 0;
+    }
+
     u64 restsize = memory::page_size - ((sizeof(slab) + align - 1) & ~(align - 1));
 
     if (obj_align_size * 64 > restsize)
@@ -90,9 +105,137 @@ slab_group::slab_group(u64 size, const char *name, u64 align, u64 flags)
         page_pre_slab = 1;
         node_pre_slab = restsize / obj_align_size;
     }
+    color = slab_color(restsize + memory::page_size * (page_pre_slab - 1) - node_pre_slab * obj_align_size, align);
+
+    uctx::RawSpinLockUninterruptibleContext ctx(group_list_lock);
+    next_group = group_list;
+    group_list = this;
 }
 
 void *slab_group::alloc()
+{
+    // Before the BSP has per-CPU data there is a single CPU and no id to
+    // index by, so early boot allocates from the slabs directly.
+    if (likely(arch::cpu::has_init()))
+    {
+        uctx::UninterruptibleContext icu;
+        auto &cache = cpu_caches[arch::cpu::id()];
+        auto &pair = cache.pair;
+        cache.allocs++;
+        void *object = pair.pop();
+        if (likely(object != nullptr))
+            return object;
+        magazine *full = depot_take_full();
+        if (full != nullptr)
+        {
+            depot_put_empty(pair.exchange_for_full(full));
+            return pair.pop();
+        }
+    }
+    else
+    {
+        cpu_caches[0].allocs++;
+    }
+    return slab_alloc();
+}
+
+void slab_group::free(void *ptr)
+{
+    if (likely(arch::cpu::has_init()))
+    {
+        uctx::UninterruptibleContext icu;
+        auto &cache = cpu_caches[arch::cpu::id()];
+        auto &pair = cache.pair;
+        cache.frees++;
+        if (likely(pair.push(ptr)))
+            return;
+        magazine *empty = depot_take_empty();
+        if (empty != nullptr)
+        {
+            magazine *full = pair.exchange_for_empty(empty);
+            if (full != nullptr)
+                depot_put_full(full);
+            pair.push(ptr);
+            return;
+        }
+    }
+    else
+    {
+        cpu_caches[0].frees++;
+    }
+    slab_free(ptr);
+}
+
+magazine *slab_group::depot_take_full()
+{
+    uctx::RawSpinLockUninterruptibleContext ctx(depot_lock);
+    return depot_full.pop();
+}
+
+magazine *slab_group::depot_take_empty()
+{
+    {
+        uctx::RawSpinLockUninterruptibleContext ctx(depot_lock);
+        magazine *m = depot_empty.pop();
+        if (m != nullptr)
+            return m;
+    }
+    // Magazines are carved from whole pages which are never returned. Their
+    // number stays bounded: a new page is only taken when no empty magazine
+    // exists, and the depot drains full magazines above depot_full_limit.
+    auto *page = reinterpret_cast<magazine *>(memory::KernelBuddyAllocatorV->allocate(memory::page_size, 0));
+    constexpr u64 per_page = memory::page_size / sizeof(magazine);
+    for (u64 i = 0; i < per_page; i++)
+        new (page + i) magazine();
+    uctx::RawSpinLockUninterruptibleContext ctx(depot_lock);
+    for (u64 i = 1; i < per_page; i++)
+        depot_empty.push(page + i);
+    return page;
+}
+
+void slab_group::depot_put_full(magazine *m)
+{
+    {
+        uctx::RawSpinLockUninterruptibleContext ctx(depot_lock);
+        if (depot_full.size() < depot_full_limit)
+        {
+            depot_full.push(m);
+            return;
+        }
+    }
+    drain(m);
+    depot_put_empty(m);
+}
+
+void slab_group::depot_put_empty(magazine *m)
+{
+    if (m == nullptr)
+        return;
+    uctx::RawSpinLockUninterruptibleContext ctx(depot_lock);
+    depot_empty.push(m);
+}
+
+void slab_group::drain(magazine *m)
+{
+    while (!m->empty())
+        slab_free(m->objects[--m->rounds]);
+}
+
+int slab_group::shrink()
+{
+    int count = 0;
+    for (;;)
+    {
+        magazine *m = depot_take_full();
+        if (m == nullptr)
+            return count;
+        count += m->rounds;
+        drain(m);
+        depot_put_empty(m);
+    }
+}
+
+void *slab_group::slab_alloc()
 {
     uctx::RawWriteLockUninterruptibleContext ctx(slab_lock);
     if (free_head == nullptr)
@@ -108,6 +251,7 @@ void *slab_group::alloc()
 
     slab->rest--;
     all_obj_used++;
+    slab_allocs++;
 
     if (slab->rest == 0)
     {
@@ -132,7 +276,7 @@ void *slab_group::alloc()
     return slab->data_ptr + i * obj_align_size;
 }
 
-void slab_group::free(void *ptr)
+void slab_group::slab_free(void *ptr)
 {
     uctx::RawWriteLockUninterruptibleContext ctx(slab_lock);
 
@@ -144,6 +288,7 @@ void slab_group::free(void *ptr)
     s->bitmap.reset_bit(index);
     s->rest++;
     all_obj_used--;
+    slab_frees++;
     if (s->rest == 1)
     {
         slab *p = s->prev;
@@ -166,6 +311,46 @@ void slab_group::free(void *ptr)
         {
             free_head->prev = s;
         }
+        free_head = s;
+    }
+}
+
+void slab_group::get_stats(slab_group_stats &stats)
+{
+    stats.object_size = size;
+    stats.object_stride = obj_align_size;
+    stats.objects_per_slab = node_pre_slab;
+    stats.pages_per_slab = page_pre_slab;
+    stats.colors = color.count();
+    // Per-CPU counters are read without stopping their owners, so the sums
+    // may be a few calls behind.
+    stats.allocs = 0;
+    stats.frees = 0;
+    for (auto &cache : cpu_caches)
+    {
+        stats.allocs += __atomic_load_n(&cache.allocs, __ATOMIC_RELAXED);
+        stats.frees += __atomic_load_n(&cache.frees, __ATOMIC_RELAXED);
+    }
+    {
+        uctx::RawSpinLockUninterruptibleContext ctx(depot_lock);
+        stats.depot_objects = depot_full.size() * magazine::capacity;
+    }
+    uctx::RawReadLockUninterruptibleContext ctx(slab_lock);
+    stats.objects = all_obj_count;
+    stats.objects_used = all_obj_used;
+    stats.slabs = slab_count;
+    stats.pages = slab_count * page_pre_slab;
+    stats.slab_allocs = slab_allocs;
+    stats.slab_frees = slab_frees;
+}
+
+void slab_group::for_each(freelibcxx::function_ref<bool(slab_group &)> fn)
+{
+    uctx::RawSpinLockUninterruptibleContext ctx(group_list_lock);
+    for (slab_group *group = group_list; group != nullptr; group = group->next_group)
+    {
+        if (!fn(*group))
+            return;
     }
 }
 
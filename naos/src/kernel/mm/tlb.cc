@@ -0,0 +1,133 @@
+#include "kernel/mm/tlb.hpp"
+#include "kernel/arch/cpu.hpp"
+#include "kernel/arch/klib.hpp"
+#include "kernel/cpu.hpp"
+#include "kernel/mm/memory.hpp"
+#include "kernel/mm/vm.hpp"
+#include "kernel/smp.hpp"
+#include "kernel/ucontext.hpp"
+#include <atomic>
+
+namespace memory::tlb
+{
+namespace
+{
+/// Lives on the sender's stack until every target CPU answered
+struct shootdown
+{
+    const arch::paging::page_table_t *table;
+    const flush_ranges *ranges;
+    std::atomic<u32> pending;
+};
+
+void apply(const flush_ranges &ranges)
+{
+    if (ranges.full())
+    {
+        arch::paging::page_table_t::reload();
+        return;
+    }
+    for (u32 i = 0; i < ranges.count(); i++)
+    {
+        const auto &range = ranges.at(i);
+        arch::paging::page_table_t::invalidate(reinterpret_cast<void *>(range.start), range.pages);
+    }
+}
+
+void shootdown_call(u64 data)
+{
+    auto *request = reinterpret_cast<shootdown *>(data);
+    // A CPU which switched away already dropped the entries, or keeps them by
+    // PCID until the generation bumped by the unmap makes it flush.
+    if (request->table->loaded_here())
+        apply(*request->ranges);
+    request->pending.fetch_sub(1, std::memory_order_release);
+}
+
+void release_call(u64 data)
+{
+    auto *request = reinterpret_cast<shootdown *>(data);
+    if (request->table->loaded_here())
+        memory::kernel_vm_info->paging().load();
+    request->pending.fetch_sub(1, std::memory_order_release);
+}
+
+/// Run \p func on the other CPUs in \p mask and wait for all of them.
+/// Interrupts must be off.
+void call_and_wait(u64 mask, cpu::call_cpu_func_t func, shootdown &request)
+{
+    mask &= ~(1UL << cpu::current().id());
+    u32 targets = 0;
+    for (u32 id = 0; id < arch::cpu::max_cpu_support; id++)
+    {
+        // A CPU still booting has no call queue, and no user page table loaded
+        if ((mask & (1UL << id)) != 0 && arch::cpu::get(id).get_user_data() != nullptr)
+            targets++;
+        else
+            mask &= ~(1UL << id);
+    }
+    if (targets == 0)
+        return;
+
+    request.pending.store(targets, std::memory_order_relaxed);
+    for (u32 id = 0; id < arch::cpu::max_cpu_support; id++)
+    {
+        if ((mask & (1UL << id)) != 0)
+            SMP::call_cpu(id, func, reinterpret_cast<u64>(&request));
+    }
+    while (request.pending.load(std::memory_order_acquire) != 0)
+    {
+        // A target may be waiting on this CPU in turn
+        SMP::run_calls();
+        cpu_pause();
+    }
+}
+} // namespace
+
+batch::batch(arch::paging::page_table_t &table)
+    : table_(table)
+    , released_(memory::KernelCommonAllocatorV)
+{
+}
+
+batch::~batch() { flush(); }
+
+void batch::unmap(u64 start, u64 pages)
+{
+    table_.unmap(reinterpret_cast<void *>(start), pages, [this](void *page) { released_.push_back(page); });
+    ranges_.add(start, pages);
+}
+
+void batch::flush()
+{
+    if (!ranges_.empty())
+    {
+        uctx::UninterruptibleContext icu;
+        if (table_.loaded_here())
+            apply(ranges_);
+        shootdown request{&table_, &ranges_, {0}};
+        call_and_wait(table_.cpu_mask(), shootdown_call, request);
+    }
+    for (auto *page : released_)
+        memory::KernelBuddyAllocatorV->deallocate(page);
+    released_.clear();
+    ranges_.clear();
+}
+
+void flush_kernel(u64 start, u64 pages)
+{
+    arch::paging::page_table_t::invalidate(reinterpret_cast<void *>(start), pages);
+    if (arch::cpu::count() > 1)
+        SMP::flush_all_tlb();
+}
+
+void release(arch::paging::page_table_t &table)
+{
+    uctx::UninterruptibleContext icu;
+    if (table.loaded_here())
+        memory::kernel_vm_info->paging().load();
+    shootdown request{&table, nullptr, {0}};
+    call_and_wait(table.cpu_mask(), release_call, request);
+}
+
+} // namespace memory::tlb
@@ -8,9 +8,13 @@
 #include "kernel/fs/vfs/file.hpp"
 #include "kernel/fs/vfs/vfs.hpp"
 #include "kernel/irq.hpp"
+#include "kernel/mm/big_page.hpp"
 #include "kernel/mm/data_plane.hpp"
+#include "kernel/mm/fault_around.hpp"
+#include "kernel/mm/object_window.hpp"
 #include "kernel/mm/memory.hpp"
 #include "kernel/mm/new.hpp"
+#include "kernel/mm/tlb.hpp"
 #include "kernel/signal.hpp"
 #include "kernel/task.hpp"
 #include "kernel/trace.hpp"
@@ -46,7 +50,9 @@ irq::request_result _ctx_interrupt_ page_fault_cow(const irq::interrupt_info *in
         }
         if (info->copy_at(extra_data))
         {
-            arch::paging::page_table_t::reload();
+            // Other threads of the process may still write to the old page
+            tlb::batch shootdown(info->paging());
+            shootdown.add(memory::align_down(extra_data, page_size), 1);
             return irq::request_result::ok;
         }
     }
@@ -88,7 +94,9 @@ irq::request_result _ctx_interrupt_ page_fault_present(const irq::interrupt_info
             {
                 return irq::request_result::no_handled;
             }
-            arch::paging::page_table_t::reload();
+            // Neighbours mapped around the fault were not present, so they
+            // have no TLB entries to drop.
+            arch::paging::page_table_t::invalidate(reinterpret_cast<void *>(alignment_page));
             return irq::request_result::ok;
         }
         else
@@ -108,6 +116,9 @@ irq::request_result _ctx_interrupt_ page_fault_func(const irq::interrupt_info *i
 {
     using flags = arch::paging::page_fault_flags;
     kassert(!(inter->error_code & flags::reserved_write), inter->error_code);
+    // The faulting copy holds spinlocks, neither COW nor demand paging may run
+    if (naos::usercopy::recover_no_fault(static_cast<regs_t *>(inter->regs)))
+        return irq::request_result::ok;
     if (inter->error_code & flags::user)
     {
     }
@@ -171,12 +182,12 @@ int search_vma(const vm_t &vm, u64 p)
     return 0;
 }
 
-const vm_t *vm_allocator::allocate_map(u64 size, u64 flags, page_fault_method method, u64 user_data)
+const vm_t *vm_allocator::allocate_map(u64 size, u64 flags, page_fault_method method, u64 user_data, u64 align)
 {
     size = (size + memory::page_size - 1) & ~(memory::page_size - 1);
 
     uctx::RawWriteLockUninterruptibleContext ctx(list_lock);
-    u64 low_bound = range_bottom;
+    u64 low_bound = align_up(range_bottom, align);
 
     if (!list.empty())
     {
@@ -184,11 +195,14 @@ const vm_t *vm_allocator::allocate_map(u64 size, u64 flags, page_fault_method me
         for (auto it = list.begin(); it != list.end(); ++it)
         {
             vm_t *vm = &it;
-            if (vm->start - low_bound >= size)
+            if (vm->start >= low_bound && vm->start - low_bound >= size)
             {
                 return &list.insert(vm_t(low_bound, low_bound + size, flags, method, user_data));
             }
-            low_bound = vm->end;
+            if (vm->end > low_bound)
+            {
+                low_bound = align_up(vm->end, align);
+            }
         }
     }
     if (range_top < low_bound + size)
@@ -300,6 +314,12 @@ void vm_allocator::clone(info_t *info, vm_allocator &to, flag_t flag)
     }
 }
 
+/// Whether a memory object or page cache mapping uses the shared pages directly.
+bool shares_memory_object(flag_t flags)
+{
+    return (flags & flags::shared) != 0 || (flags & flags::writeable) == 0;
+}
+
 u64 to_paging_flags(u64 flags)
 {
     u64 paging_flags = 0;
@@ -335,6 +355,9 @@ info_t::info_t(arch::paging::page_table_t paging)
 
 info_t::~info_t()
 {
+    // No CPU holds TLB entries of a table it has not loaded, so the unmaps
+    // below need no shootdown.
+    tlb::release(paging_);
     uctx::RawWriteLockUninterruptibleContext ctx(vma_.get_lock());
     uctx::RawSpinLockUninterruptibleContext icu(paging_spin_);
     auto &list = vma_.get_list();
@@ -377,6 +400,7 @@ bool info_t::set_brk(u64 ptr)
         return false;
     }
 
+    tlb::batch shootdown(paging_);
     if (ptr > heap_top_)
     {
         /// add page
@@ -386,7 +410,7 @@ bool info_t::set_brk(u64 ptr)
     {
         uctx::RawSpinLockUninterruptibleContext icu(paging_spin_);
         /// remove pages
-        paging_.unmap(reinterpret_cast<void *>(ptr), (heap_top_ - ptr) / page_size);
+        shootdown.unmap(ptr, (heap_top_ - ptr) / page_size);
     }
     heap_top_ = ptr;
     return true;
@@ -401,6 +425,7 @@ bool info_t::set_brk_now(u64 ptr)
         return false;
     }
 
+    tlb::batch shootdown(paging_);
     if (ptr > heap_top_)
     {
         /// add page
@@ -416,7 +441,7 @@ bool info_t::set_brk_now(u64 ptr)
     {
         uctx::RawSpinLockUninterruptibleContext icu(paging_spin_);
         /// remove pages
-        paging_.unmap(reinterpret_cast<void *>(ptr), (heap_top_ - ptr) / page_size);
+        shootdown.unmap(ptr, (heap_top_ - ptr) / page_size);
     }
     heap_top_ = ptr;
     return true;
@@ -469,6 +494,37 @@ bool info_t::expand_vm(u64 alignment_page, u64 access_address, vm_t *item)
         return false;
     }
     u64 page_flags = to_paging_flags(item->flags);
+    if (big_page::fits(item->start, item->end, alignment_page))
+    {
+        bool slot_free;
+        {
+            uctx::RawSpinLockUninterruptibleContext icu(paging_spin_);
+            slot_free = paging_.big_page_free(reinterpret_cast<void *>(alignment_page));
+        }
+        // Zero the block before taking the lock; another thread may map the
+        // range first.
+        void *block = slot_free ? global_zones->allocate_big_page() : nullptr;
+        if (block != nullptr)
+        {
+            memset(block, 0, big_page::size);
+            bool mapped;
+            bool present;
+            {
+                uctx::RawSpinLockUninterruptibleContext icu(paging_spin_);
+                mapped = paging_.map_big_page(reinterpret_cast<void *>(big_page::align_down(alignment_page)), block,
+                                              page_flags);
+                present = mapped || paging_.has_flags(reinterpret_cast<void *>(alignment_page));
+            }
+            if (!mapped)
+            {
+                global_zones->deallocate(block);
+            }
+            if (present)
+            {
+                return true;
+            }
+        }
+    }
     {
         uctx::RawSpinLockUninterruptibleContext icu(paging_spin_);
         paging_.map(reinterpret_cast<void *>(alignment_page), 1, page_flags, arch::paging::action_flags::override);
@@ -498,56 +554,141 @@ bool info_t::expand_bss(u64 alignment_page, u64 access_address, vm_t *item)
     return true;
 }
 
-bool info_t::expand_file(u64 alignment_page, u64 access_address, vm_t *item)
+byte *info_t::map_fresh_page(u64 page, u64 page_flags, bool only_missing)
+{
+    uctx::RawSpinLockUninterruptibleContext icu(paging_spin_);
+    if (only_missing && paging_.has_flags(reinterpret_cast<void *>(page)))
+    {
+        return nullptr;
+    }
+    paging_.map(reinterpret_cast<void *>(page), 1, page_flags, arch::paging::action_flags::override);
+    auto phy = paging_.get_map(reinterpret_cast<void *>(page));
+    if (!phy.has_value())
+    {
+        return nullptr;
+    }
+    return reinterpret_cast<byte *>(pa2va(phy.value()));
+}
+
+bool info_t::map_cached_page(u64 page, vm_t *item, bool only_missing)
 {
     map_t *mt = (map_t *)item->user_data;
-    u64 length_read = alignment_page - item->start;
+    if (only_missing)
+    {
+        uctx::RawSpinLockUninterruptibleContext icu(paging_spin_);
+        if (paging_.has_flags(reinterpret_cast<void *>(page)))
+        {
+            return true;
+        }
+    }
+    const u64 offset = mt->file_offset + (page - item->start);
+    byte *cached = only_missing ? mt->file->find_cached_page(offset) : mt->file->get_cached_page(offset);
+    if (cached == nullptr)
+    {
+        return false;
+    }
     u64 page_flags = to_paging_flags(item->flags);
-    byte *buffer;
+    // A private writable mapping maps the cached page read-only, copy_at()
+    // copies it on the first store.
+    if (!shares_memory_object(item->flags))
+    {
+        page_flags &= ~arch::paging::flags::writable;
+    }
     {
         uctx::RawSpinLockUninterruptibleContext icu(paging_spin_);
-        paging_.map(reinterpret_cast<void *>(alignment_page), 1, page_flags, arch::paging::action_flags::override);
-        auto phy = paging_.get_map(reinterpret_cast<void *>(alignment_page)).value();
-        buffer = (byte *)pa2va(phy);
+        if (!only_missing || !paging_.has_flags(reinterpret_cast<void *>(page)))
+        {
+            paging_.map_to(reinterpret_cast<void *>(page), 1, va2pa(cached), page_flags,
+                           arch::paging::action_flags::override);
+            return true;
+        }
     }
+    memory::free_page(cached);
+    return true;
+}
 
-    // A file-backed mapping may extend past EOF into the ELF BSS. Clear the
-    // whole fresh page before reading so the tail cannot expose stale page
-    // contents if the filesystem reports a short read at the boundary.
-    memset(buffer, 0, memory::page_size);
-    u64 length_can_read = length_read > mt->file_length ? 0 : mt->file_length - length_read;
-    auto ksize = mt->file->pread(mt->file_offset + length_read, buffer,
-                                 length_can_read > memory::page_size ? memory::page_size : length_can_read, 0);
-    if (ksize == -1)
+bool info_t::expand_file(u64 alignment_page, u64 access_address, vm_t *item)
+{
+    map_t *mt = (map_t *)item->user_data;
+    u64 page_flags = to_paging_flags(item->flags);
+
+    // Map the cached pages around the fault that hold file data. Only the
+    // faulting page reads the file, so a fault waits for one page of I/O.
+    // Pages past the data, the ELF BSS, are still mapped one fault at a time.
+    u64 data_end = item->start + align_up(mt->file_length, memory::page_size);
+    page_window window{alignment_page, alignment_page + memory::page_size};
+    if (alignment_page < data_end)
     {
-        ksize = 0;
+        window = fault_around(item->start, data_end < item->end ? data_end : item->end, alignment_page);
+    }
+
+    for (u64 page = window.first; page < window.last; page += memory::page_size)
+    {
+        // Whole pages of file data map the page cache. The partial last page
+        // and its BSS still get a private copy.
+        u64 relative = page - item->start;
+        const bool neighbour = page != alignment_page;
+        if (relative + memory::page_size <= mt->file_length &&
+            ((mt->file_offset + relative) & (memory::page_size - 1)) == 0 &&
+            map_cached_page(page, item, neighbour))
+        {
+            continue;
+        }
+        if (neighbour)
+        {
+            continue;
+        }
+        byte *buffer = map_fresh_page(page, page_flags, false);
+        if (buffer == nullptr)
+        {
+            continue;
+        }
+        // A file-backed mapping may extend past EOF into the ELF BSS. Clear the
+        // whole fresh page before reading so the tail cannot expose stale page
+        // contents if the filesystem reports a short read at the boundary.
+        memset(buffer, 0, memory::page_size);
+        u64 length_read = page - item->start;
+        u64 length_can_read = length_read > mt->file_length ? 0 : mt->file_length - length_read;
+        auto ksize = mt->file->pread(mt->file_offset + length_read, buffer,
+                                     length_can_read > memory::page_size ? memory::page_size : length_can_read, 0);
+        if (ksize == -1)
+        {
+            ksize = 0;
+        }
     }
     return true;
 }
 
-bool info_t::expand_memory_object(u64 alignment_page, u64 access_address, vm_t *item)
+bool info_t::load_memory_object_page(u64 page, vm_t *item, bool only_missing)
 {
-    (void)access_address;
     auto *mapping = reinterpret_cast<map_t *>(item->user_data);
-    if (mapping == nullptr || mapping->memory_object == nullptr)
-        return false;
-
-    byte *buffer = nullptr;
+    const u64 relative = page - item->start;
+    const u64 object_offset = mapping->file_offset + relative;
     const u64 page_flags = to_paging_flags(item->flags);
+
+    // A shared or read-only mapping maps the object's own page, so stores are
+    // visible to every process mapping it. Only a private writable mapping
+    // still needs a page of its own.
+    if (shares_memory_object(item->flags))
     {
         uctx::RawSpinLockUninterruptibleContext icu(paging_spin_);
-        paging_.map(reinterpret_cast<void *>(alignment_page), 1, page_flags, arch::paging::action_flags::override);
-        auto physical = paging_.get_map(reinterpret_cast<void *>(alignment_page));
-        if (!physical.has_value())
+        // A mapped entry already holds its page reference, mapping over it
+        // would leak that page. The faulting page may have been mapped by
+        // another thread meanwhile.
+        if (paging_.has_flags(reinterpret_cast<void *>(page)))
+            return true;
+        const phy_addr_t physical = mapping->memory_object->share_page(object_offset);
+        if (physical == nullptr)
             return false;
-        buffer = reinterpret_cast<byte *>(pa2va(physical.value()));
+        paging_.map_to(reinterpret_cast<void *>(page), 1, physical, page_flags, arch::paging::action_flags::override);
+        return true;
     }
 
+    byte *buffer = map_fresh_page(page, page_flags, only_missing);
+    if (buffer == nullptr)
+        return only_missing;
+
     memset(buffer, 0, memory::page_size);
-    const u64 relative = alignment_page - item->start;
-    if (relative >= mapping->file_length)
-        return true;
-    const u64 object_offset = mapping->file_offset + relative;
     const u64 available = mapping->file_length - relative;
     const u64 amount = available > memory::page_size ? memory::page_size : available;
     u64 actual = 0;
@@ -555,12 +696,38 @@ bool info_t::expand_memory_object(u64 alignment_page, u64 access_address, vm_t *
         mapping->memory_object->read(object_offset, buffer, amount, actual) == NA_STATUS_OK && actual == amount;
     if (!loaded)
     {
+        // Another thread may have reached the page since it was mapped
+        tlb::batch shootdown(paging_);
         uctx::RawSpinLockUninterruptibleContext icu(paging_spin_);
-        paging_.unmap(reinterpret_cast<void *>(alignment_page), 1);
+        shootdown.unmap(page, 1);
     }
     return loaded;
 }
 
+bool info_t::expand_memory_object(u64 alignment_page, u64 access_address, vm_t *item)
+{
+    (void)access_address;
+    auto *mapping = reinterpret_cast<map_t *>(item->user_data);
+    if (mapping == nullptr || mapping->memory_object == nullptr)
+        return false;
+
+    const u64 relative = alignment_page - item->start;
+    if (relative >= mapping->file_length)
+        return false;
+    if (!load_memory_object_page(alignment_page, item, false))
+        return false;
+
+    // The object's pages are all resident, so the neighbours cost no I/O.
+    const u64 object_end = item->start + align_up(mapping->file_length, memory::page_size);
+    const auto window = fault_around(item->start, object_end < item->end ? object_end : item->end, alignment_page);
+    for (u64 page = window.first; page < window.last; page += memory::page_size)
+    {
+        if (page != alignment_page && !load_memory_object_page(page, item, true))
+            break;
+    }
+    return true;
+}
+
 bool info_t::expand_physical(u64 alignment_page, u64 access_address, vm_t *item)
 {
     (void)access_address;
@@ -570,13 +737,40 @@ bool info_t::expand_physical(u64 alignment_page, u64 access_address, vm_t *item)
         return false;
     }
 
-    const auto offset = static_cast<ptrdiff_t>(alignment_page - item->start);
+    // Remapping a neighbour that is already present installs the same frame.
+    const auto window = fault_around(item->start, item->end, alignment_page);
+    const auto offset = static_cast<ptrdiff_t>(window.first - item->start);
     const phy_addr_t physical_address = mt->physical_address + offset;
 
     const u64 page_flags = to_paging_flags(item->flags);
     uctx::RawSpinLockUninterruptibleContext icu(paging_spin_);
-    paging_.map_to(reinterpret_cast<void *>(alignment_page), 1, physical_address, page_flags,
-                   arch::paging::action_flags::override);
+    paging_.map_to(reinterpret_cast<void *>(window.first), (window.last - window.first) / memory::page_size,
+                   physical_address, page_flags, arch::paging::action_flags::override);
+    return true;
+}
+
+bool info_t::populate(u64 start)
+{
+    vm_t *vm = vma_.get_vm_area(start);
+    if (vm == nullptr)
+    {
+        return false;
+    }
+    for (u64 page = vm->start; page < vm->end; page += memory::page_size)
+    {
+        bool present;
+        {
+            uctx::RawSpinLockUninterruptibleContext icu(paging_spin_);
+            present = paging_.has_flags(reinterpret_cast<void *>(page));
+        }
+        // Each expansion maps a whole fault-around window or big page.
+        if (!present && !expand(vm->method, page, page, vm))
+        {
+            return false;
+        }
+    }
+    // Only pages that were not present got mapped, no stale translation to
+    // flush
     return true;
 }
 
@@ -628,6 +822,9 @@ const vm_t *info_t::map_file(u64 start, fs::vfs::file *file, u64 file_offset, u6
         {
             user_data =
                 (u64)memory::KernelCommonAllocatorV->New<map_t>(file, file_offset, file_length, mmap_length, this);
+            // Private writable mappings map page cache pages read-only
+            if (!shares_memory_object(cflags))
+                cflags |= flags::cow;
         }
         if (user_data == 0)
             return nullptr;
@@ -636,7 +833,9 @@ const vm_t *info_t::map_file(u64 start, fs::vfs::file *file, u64 file_offset, u6
     const vm_t *vm = nullptr;
     if (start == 0)
     {
-        vm = vma().allocate_map(alen, cflags, method, user_data);
+        // Anonymous memory is faulted in 2 MiB pages where they fit
+        u64 align = method == page_fault_method::common && alen >= big_page::size ? big_page::size : page_size;
+        vm = vma().allocate_map(alen, cflags, method, user_data, align);
     }
     else
     {
@@ -661,7 +860,7 @@ const vm_t *info_t::map_memory_object(u64 start, khandle backing, naos::data_pla
     if (!backing || object == nullptr || length == 0 ||
         length > std::numeric_limits<u64>::max() - (memory::page_size - 1))
         return nullptr;
-    if (object_offset > object->size() || length > object->size() - object_offset)
+    if (memory::object_window::check(object_offset, length, object->size()) != NA_STATUS_OK)
         return nullptr;
     if (is_kernel_space_pointer(start))
         return nullptr;
@@ -703,10 +902,13 @@ bool info_t::umap_file(u64 addr, u64 size)
     const flag_t vm_flags = vm->flags;
     auto *map_data = reinterpret_cast<map_t *>(vm->user_data);
 
+    tlb::batch shootdown(paging_);
     {
         uctx::RawSpinLockUninterruptibleContext icu(paging_spin_);
-        paging_.unmap(reinterpret_cast<void *>(vm_start), vm_pages);
+        shootdown.unmap(vm_start, vm_pages);
     }
+    // Before the pseudo file hands its pages back
+    shootdown.flush();
 
     vma_.deallocate_map(vm);
     if (file_backed)
@@ -716,7 +918,6 @@ bool info_t::umap_file(u64 addr, u64 size)
         memory::Delete<>(memory::KernelCommonAllocatorV, map_data);
     }
 
-    arch::paging::page_table_t::reload();
     return true;
 }
 
@@ -812,12 +1013,16 @@ bool info_t::copy_at(u64 virt_addr)
         {
             return false;
         }
-        // TODO: big page COW
         u64 alignment_page = align_down(virt_addr, memory::page_size);
         if (vm->flags & vm::flags::cow)
         {
             uctx::RawSpinLockUninterruptibleContext icu(paging_spin_);
             u64 page_flags = to_paging_flags(vm->flags);
+            if (vm->method == page_fault_method::common &&
+                paging_.write_big_page(reinterpret_cast<void *>(alignment_page), page_flags))
+            {
+                return true;
+            }
             if (vm->method == page_fault_method::physical)
             {
                 auto *mapping = reinterpret_cast<map_t *>(vm->user_data);
@@ -829,6 +1034,18 @@ bool info_t::copy_at(u64 virt_addr)
                                page_flags, arch::paging::action_flags::override | arch::paging::action_flags::cow);
                 return true;
             }
+            if ((vm->method == page_fault_method::memory_object || vm->method == page_fault_method::file) &&
+                shares_memory_object(vm->flags))
+            {
+                // Both processes keep writing the shared page. The entry
+                // already holds its page reference from the fork.
+                auto physical = paging_.get_map(reinterpret_cast<void *>(alignment_page));
+                if (!physical.has_value())
+                    return false;
+                paging_.map_to(reinterpret_cast<void *>(alignment_page), 1, physical.value(), page_flags,
+                               arch::paging::action_flags::override | arch::paging::action_flags::cow);
+                return true;
+            }
 
             // trace::info("cow at ", trace::hex(alignment_page), " at ", task::current_process()->pid);
             paging_.map(reinterpret_cast<void *>(alignment_page), 1, page_flags,
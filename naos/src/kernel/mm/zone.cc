@@ -1,12 +1,18 @@
 #include "kernel/mm/zone.hpp"
 #include "freelibcxx/buddy.hpp"
+#include "kernel/arch/klib.hpp"
 #include "kernel/arch/mm.hpp"
 #include "kernel/clock.hpp"
 #include "kernel/common.hpp"
+#include "kernel/cpu.hpp"
+#include "kernel/mm/big_page.hpp"
 #include "kernel/mm/memory.hpp"
+#include "kernel/mm/numa.hpp"
 #include "kernel/mm/page.hpp"
+#include "kernel/smp.hpp"
 #include "kernel/trace.hpp"
 #include "kernel/ucontext.hpp"
+#include <atomic>
 
 namespace memory
 {
@@ -129,25 +135,211 @@ zone *zones::which(phy_addr_t ptr)
     return nullptr;
 }
 
+void *zones::try_allocate(u64 pages)
+{
+    int count = 0;
+    const u8 *order = numa::zone_order(numa::preferred_node(), count);
+    if (order == nullptr)
+    {
+        count = active_zones();
+    }
+    for (int i = 0; i < count; i++)
+    {
+        int index = order != nullptr ? order[i] : i;
+        if (index >= active_zones())
+        {
+            continue;
+        }
+        auto &z = zone_array_[index];
+        phy_addr_t p = z.malloc(pages);
+        if (p != nullptr)
+        {
+            numa::count_alloc(z.node());
+            return pa2va(p);
+        }
+    }
+    return nullptr;
+}
+
+namespace
+{
+/// Lives on the sender's stack until every target CPU drained
+struct drain_request
+{
+    zones *owner;
+    std::atomic<u32> pending;
+};
+
+void drain_call(u64 data)
+{
+    auto *request = reinterpret_cast<drain_request *>(data);
+    for (int i = 0; i < request->owner->active_zones(); i++)
+    {
+        request->owner->at(i)->drain_local();
+    }
+    request->pending.fetch_sub(1, std::memory_order_release);
+}
+} // namespace
+
+void zones::drain_all()
+{
+    uctx::UninterruptibleContext icu;
+    for (int i = 0; i < active_zones(); i++)
+    {
+        zone_array_[i].drain_local();
+    }
+    if (unlikely(!arch::cpu::has_init()))
+    {
+        return;
+    }
+    const u32 self = cpu::current().id();
+    u64 mask = 0;
+    u32 targets = 0;
+    for (u32 id = 0; id < arch::cpu::max_cpu_support; id++)
+    {
+        // A CPU still booting has no call queue, and caches nothing yet
+        if (id != self && arch::cpu::get(id).get_user_data() != nullptr)
+        {
+            mask |= 1UL << id;
+            targets++;
+        }
+    }
+    if (targets == 0)
+    {
+        return;
+    }
+    drain_request request{this, {targets}};
+    for (u32 id = 0; id < arch::cpu::max_cpu_support; id++)
+    {
+        if ((mask & (1UL << id)) != 0)
+        {
+            SMP::call_cpu(id, drain_call, reinterpret_cast<u64>(&request));
+        }
+    }
+    while (request.pending.load(std::memory_order_acquire) != 0)
+    {
+        // A target may be waiting on this CPU in turn
+        SMP::run_calls();
+        cpu_pause();
+    }
+}
+
 void *zones::allocate(size_t size, size_t align) noexcept
 {
     // ignore align
     size = align_up(size, memory::page_size);
     u64 pages = size / memory::page_size;
-    // select one zone
-    for (int i = 0; i < active_zones(); i++)
+    auto ptr = try_allocate(pages);
+    if (unlikely(ptr == nullptr))
     {
-        phy_addr_t p = zone_array_[i].malloc(pages);
-        if (p != nullptr)
+        drain_all();
+        ptr = try_allocate(pages);
+        if (ptr == nullptr && reclaim_ != nullptr && reclaim_(pages) != 0)
+        {
+            // Reclaimed pages are freed into this CPU's lists
+            for (int i = 0; i < active_zones(); i++)
+            {
+                zone_array_[i].drain_local();
+            }
+            ptr = try_allocate(pages);
+        }
+        if (ptr == nullptr)
         {
-            auto ptr = pa2va(p);
+            trace::panic("Kernel OOM allocate pages ", pages);
+        }
+    }
 #ifdef _DEBUG
-            memset(ptr, 0xFAFF'FEF0, size);
+    memset(ptr, 0xFAFF'FEF0, size);
 #endif
-            return ptr;
+    return ptr;
+}
+
+u64 zones::allocate_pages(u64 count, void **out) noexcept
+{
+    u64 allocated = try_allocate_pages(count, out);
+    if (allocated < count)
+    {
+        drain_all();
+        allocated += try_allocate_pages(count - allocated, out + allocated);
+    }
+    if (allocated < count && reclaim_ != nullptr && reclaim_(count - allocated) != 0)
+    {
+        allocated += try_allocate_pages(count - allocated, out + allocated);
+    }
+#ifdef _DEBUG
+    for (u64 i = 0; i < allocated; i++)
+    {
+        memset(out[i], 0xFAFF'FEF0, memory::page_size);
+    }
+#endif
+    return allocated;
+}
+
+u64 zones::try_allocate_pages(u64 count, void **out)
+{
+    int zone_count = 0;
+    const u8 *order = numa::zone_order(numa::preferred_node(), zone_count);
+    if (order == nullptr)
+    {
+        zone_count = active_zones();
+    }
+    u64 allocated = 0;
+    for (int i = 0; i < zone_count && allocated < count; i++)
+    {
+        int index = order != nullptr ? order[i] : i;
+        if (index >= active_zones())
+        {
+            continue;
+        }
+        auto &z = zone_array_[index];
+        u64 n = z.malloc_pages(count - allocated, out + allocated);
+        numa::count_alloc(z.node(), n);
+        allocated += n;
+    }
+    return allocated;
+}
+
+void *zones::allocate_big_page() noexcept
+{
+    constexpr u64 pages = big_page::pages;
+    int count = 0;
+    const u8 *order = numa::zone_order(numa::preferred_node(), count);
+    if (order == nullptr)
+    {
+        count = active_zones();
+    }
+    for (int i = 0; i < count; i++)
+    {
+        int index = order != nullptr ? order[i] : i;
+        if (index >= active_zones())
+        {
+            continue;
+        }
+        auto &z = zone_array_[index];
+        // Buddy blocks are aligned to their size relative to the zone start.
+        if ((reinterpret_cast<u64>(z.range_beg().get()) & (big_page::size - 1)) != 0)
+        {
+            continue;
+        }
+        phy_addr_t p = z.malloc(pages);
+        if (p != nullptr)
+        {
+            numa::count_alloc(z.node());
+            return pa2va(p);
         }
     }
-    trace::panic("Kernel OOM allocate pages ", pages);
+    return nullptr;
+}
+
+void zones::split(void *ptr)
+{
+    phy_addr_t p = va2pa(ptr);
+    zone *z = which(p);
+    kassert(z != nullptr, "Not found this zone at ", trace::hex(p()));
+    u64 pages = 1UL << z->address_to_page(p)->get_buddy_order();
+    // Each page is now freed, and counted, on its own.
+    numa::count_alloc(z->node(), pages - 1);
+    z->split(p);
 }
 
 void zones::deallocate(void *ptr) noexcept
@@ -155,6 +347,7 @@ void zones::deallocate(void *ptr) noexcept
     phy_addr_t p = va2pa(ptr);
     zone *z = which(p);
     kassert(z != nullptr, "Not found this zone at ", trace::hex(p()));
+    numa::count_free(z->node());
     z->free(p);
 }
 
@@ -194,28 +387,133 @@ void zone::tag_alloc(phy_addr_t start, phy_addr_t end)
 
 page *zone::page_end() const { return page_beg() + page_count; }
 
-phy_addr_t zone::malloc(u64 pages)
+page *zone::buddy_alloc(u64 pages)
 {
-    uctx::RawSpinLockUninterruptibleContext ctx(spin);
     auto impl = reinterpret_cast<buddy_t *>(impl_ptr_);
     auto index = impl->alloc(pages);
     if (likely(index.has_value()))
     {
-        page *p = page_array + index.value();
+        return page_array + index.value();
+    }
+    return nullptr;
+}
+
+void zone::buddy_free(page *p)
+{
+    auto impl = reinterpret_cast<buddy_t *>(impl_ptr_);
+    [[maybe_unused]] bool ok = impl->free(p - page_array);
+    kassert(ok, "fail ", p - page_array);
+}
+
+page *zone::cpu_alloc(int order)
+{
+    uctx::UninterruptibleContext icu;
+    auto &list = cpu_pages_[arch::cpu::id()].lists[order];
+    if (list.size() == 0)
+    {
+        uctx::RawSpinLockUninterruptibleContext ctx(spin);
+        for (u64 i = 0; i < cpu_pages::batch(order); i++)
+        {
+            page *p = buddy_alloc(1UL << order);
+            if (p == nullptr)
+            {
+                break;
+            }
+            list.push(p);
+        }
+    }
+    return list.pop();
+}
+
+void zone::cpu_free(page *p, int order)
+{
+    uctx::UninterruptibleContext icu;
+    auto &list = cpu_pages_[arch::cpu::id()].lists[order];
+    list.push(p);
+    if (list.size() <= cpu_pages::high(order))
+    {
+        return;
+    }
+    uctx::RawSpinLockUninterruptibleContext ctx(spin);
+    for (u64 i = 0; i < cpu_pages::batch(order); i++)
+    {
+        buddy_free(list.pop());
+    }
+}
+
+phy_addr_t zone::malloc(u64 pages)
+{
+    int order = page_order(pages);
+    page *p;
+    // Before the BSP has per-CPU data there is no id to index by.
+    if (order < cpu_pages::orders && likely(arch::cpu::has_init()))
+    {
+        p = cpu_alloc(order);
+    }
+    else
+    {
+        uctx::RawSpinLockUninterruptibleContext ctx(spin);
+        p = buddy_alloc(pages);
+    }
+    if (unlikely(p == nullptr))
+    {
+        return nullptr;
+    }
+    if (p->get_ref_count() != 0)
+    {
+        trace::panic("ref count == 0 malloc ", pages);
+    }
+    p->add_ref_count();
+    return page_to_address(p);
+}
+
+u64 zone::malloc_pages(u64 count, void **out)
+{
+    // Collect page pointers in out first, then turn them into addresses.
+    u64 allocated = 0;
+    if (likely(arch::cpu::has_init()))
+    {
+        uctx::UninterruptibleContext icu;
+        auto &list = cpu_pages_[arch::cpu::id()].lists[0];
+        for (; allocated < count; allocated++)
+        {
+            page *p = list.pop();
+            if (p == nullptr)
+            {
+                break;
+            }
+            out[allocated] = p;
+        }
+    }
+    if (allocated < count)
+    {
+        uctx::RawSpinLockUninterruptibleContext ctx(spin);
+        for (; allocated < count; allocated++)
+        {
+            page *p = buddy_alloc(1);
+            if (p == nullptr)
+            {
+                break;
+            }
+            out[allocated] = p;
+        }
+    }
+    for (u64 i = 0; i < allocated; i++)
+    {
+        page *p = static_cast<page *>(out[i]);
         if (p->get_ref_count() != 0)
         {
-            trace::panic("ref count == 0 malloc ", pages);
+            trace::panic("ref count == 0 malloc ", 1);
         }
         p->add_ref_count();
-        return page_to_address(p);
+        out[i] = pa2va(page_to_address(p));
     }
-    return nullptr;
+    return allocated;
 }
 
 void zone::page_add_reference(phy_addr_t ptr)
 {
     page *p = address_to_page(ptr);
-    uctx::RawSpinLockUninterruptibleContext ctx(spin);
     if (p->get_ref_count() > 0)
     {
         p->add_ref_count();
@@ -229,27 +527,58 @@ void zone::page_add_reference(phy_addr_t ptr)
 void zone::free(phy_addr_t ptr)
 {
     page *p = address_to_page(ptr);
-    bool free = false;
+    if (unlikely(p->get_ref_count() == 0))
     {
-        uctx::RawSpinLockUninterruptibleContext ctx(spin);
-        if (p->get_ref_count() > 0)
-        {
-            p->remove_ref_count();
-            if (p->get_ref_count() == 0)
-            {
-                free = true;
-            }
-        }
-        else
-        {
-            trace::panic("ref count == 0 at ", trace::hex(ptr.get()));
-        }
+        trace::panic("ref count == 0 at ", trace::hex(ptr.get()));
+    }
+    if (p->remove_ref_count() != 0)
+    {
+        return;
+    }
+
+    int order = p->get_buddy_order();
+    if (order < cpu_pages::orders && likely(arch::cpu::has_init()))
+    {
+        cpu_free(p, order);
+        return;
+    }
+    uctx::RawSpinLockUninterruptibleContext ctx(spin);
+    buddy_free(p);
+}
+
+void zone::split(phy_addr_t ptr)
+{
+    page *head = address_to_page(ptr);
+    u64 pages = 1UL << head->get_buddy_order();
+    u32 refs = head->get_ref_count();
+    kassert(refs != 0, "split free block at ", trace::hex(ptr.get()));
+    uctx::RawSpinLockUninterruptibleContext ctx(spin);
+    // The buddy allocator reads the order of a block from its first page, so
+    // every page becomes a used block of order 0.
+    for (u64 i = 0; i < pages; i++)
+    {
+        page &p = head[i];
+        p.set_buddy_order(0);
+        p.remove_flags(page::buddy_merged);
+        p.add_flags(page::buddy_used);
+        p.set_ref_count(refs);
+    }
+}
 
-        if (free)
+void zone::drain_local()
+{
+    if (unlikely(!arch::cpu::has_init()))
+    {
+        return;
+    }
+    uctx::UninterruptibleContext icu;
+    auto &cache = cpu_pages_[arch::cpu::id()];
+    uctx::RawSpinLockUninterruptibleContext ctx(spin);
+    for (auto &list : cache.lists)
+    {
+        while (page *p = list.pop())
         {
-            auto impl = reinterpret_cast<buddy_t *>(impl_ptr_);
-            [[maybe_unused]] bool ok = impl->free(p - page_array);
-            kassert(ok, "fail ", p - page_array);
+            buddy_free(p);
         }
     }
 }
@@ -257,7 +586,12 @@ void zone::free(phy_addr_t ptr)
 u64 zone::free_pages() const
 {
     auto impl = reinterpret_cast<const buddy_t *>(impl_ptr_);
-    return impl->free_pages();
+    u64 pages = impl->free_pages();
+    for (auto &cache : cpu_pages_)
+    {
+        pages += cache.cached_pages();
+    }
+    return pages;
 }
 
 page *zone::address_to_page(phy_addr_t ptr) const
@@ -1,8 +1,13 @@
 #include "kernel/scheduler.hpp"
 #include "freelibcxx/hash_map.hpp"
+#include "kernel/arch/cpu.hpp"
+#include "kernel/arch/cpu_info.hpp"
+#include "kernel/cmdline.hpp"
 #include "kernel/cpu.hpp"
 #include "kernel/irq.hpp"
 #include "kernel/mm/new.hpp"
+#include "kernel/mm/numa.hpp"
+#include "kernel/schedulers/balance.hpp"
 #include "kernel/schedulers/completely_fair.hpp"
 #include "kernel/schedulers/round_robin.hpp"
 #include "kernel/smp.hpp"
@@ -19,39 +24,140 @@ void timer_tick(timeclock::microsecond_t) noexcept;
 
 std::atomic_bool is_init = false;
 
-task::thread_t *thread_to_reschedule;
+namespace
+{
+/// Balancing state one CPU publishes to the others
+struct alignas(64) balance_cpu_t
+{
+    cpu_place place;
+    /// Threads waiting in the run queues, updated every tick
+    std::atomic<u64> waiting{0};
+    /// A steal request of this CPU is still unanswered
+    std::atomic_bool stealing{false};
+    /// No tick is scheduled, at most one thread wants this CPU
+    std::atomic_bool tick_stopped{false};
+    /// The tick stopped while the CPU was idle, a busy CPU may kick it
+    std::atomic_bool nohz_idle{false};
+};
+
+balance_cpu_t balance_cpus[arch::cpu::max_cpu_support];
+
+constexpr timeclock::microsecond_t tick_period_us = 5000;
 
-std::atomic_bool reschedule_ready;
-irq::registration *reschedule_registration;
+/// The scheduler tick stops while at most one thread wants the CPU
+bool nohz = true;
 
-irq::request_result reschedule_func(const irq::interrupt_info *, u64) noexcept
+timer::timer_entry tick_timers[arch::cpu::max_cpu_support];
+
+void arm_tick()
 {
-    task::thread_t *thd = thread_to_reschedule;
+    timer::arm_after(tick_timers[cpu::current().id()], tick_period_us, timer::timer_handler::bind<&timer_tick>());
+}
+
+u64 waiting_count()
+{
+    return real_time_schedulers->scheduleable_task_count() + normal_schedulers->scheduleable_task_count();
+}
+
+/// Restart this CPU's tick once threads compete for it. Run after a thread
+/// became ready here.
+void restart_tick()
+{
+    auto &own = balance_cpus[cpu::current().id()];
+    if (!own.tick_stopped.load(std::memory_order_relaxed))
+        return;
+    uctx::UninterruptibleContext icu;
+    own.nohz_idle.store(false, std::memory_order_relaxed);
+    // An idle CPU switches to the one ready thread without a tick
+    const u64 alone = current() == cpu::current().get_idle_task() ? 1 : 0;
+    if (waiting_count() <= alone)
+        return;
+    if (own.tick_stopped.exchange(false))
+        arm_tick();
+}
+
+/// Runs on the thief, the victim already took \p data off its run queue.
+void accept_migrate_ipi(u64 data)
+{
+    auto *thd = reinterpret_cast<thread_t *>(data);
+    thd->scheduler->on_migrate(thd);
+    thd->attributes &= ~(thread_attributes::on_migrate);
+    balance_cpus[cpu::current().id()].stealing.store(false, std::memory_order_release);
+    current()->attributes |= thread_attributes::need_schedule;
+    restart_tick();
+}
 
-    if (!reschedule_ready)
+/// Runs on the victim, hands one thread to the CPU \p data asking for it.
+void steal_ipi(u64 data)
+{
+    const u32 thief = static_cast<u32>(data);
+    scheduler *schedulers[] = {real_time_schedulers, normal_schedulers};
+    for (auto *scher : schedulers)
     {
-        thd->scheduler->on_migrate(thd);
-        thd->attributes &= ~(thread_attributes::on_migrate);
+        auto *thd = scher->get_migratable_task(thief);
+        if (thd == nullptr)
+            continue;
+        scher->commit_migrate(thd);
+        thd->attributes |= thread_attributes::on_migrate;
+        thd->cpuid = thief;
+        SMP::call_cpu(thief, accept_migrate_ipi, reinterpret_cast<u64>(thd));
+        return;
     }
-    reschedule_ready = true;
-    thread_to_reschedule = nullptr;
-    return irq::request_result::ok;
+    balance_cpus[thief].stealing.store(false, std::memory_order_release);
 }
 
-bool reschedule_task_push(thread_t *task, u32 cpuid)
+/// Ask the busiest CPU close to this one for a thread, if one has at least
+/// \p min_surplus more threads waiting than this CPU.
+void try_steal(u64 min_surplus)
 {
-    if (reschedule_ready)
+    const u32 self = cpu::current().id();
+    auto &own = balance_cpus[self];
+    if (own.stealing.load(std::memory_order_acquire))
+        return;
+
+    const u32 count = static_cast<u32>(cpu::count());
+    cpu_place places[arch::cpu::max_cpu_support];
+    u64 waiting[arch::cpu::max_cpu_support];
+    for (u32 i = 0; i < count; i++)
     {
-        if (!reschedule_ready.exchange(false))
-            return false;
-        // trace::debug("reschedule task cpu ", task->cpuid, " to cpu ", cpuid);
+        places[i] = balance_cpus[i].place;
+        waiting[i] = balance_cpus[i].waiting.load(std::memory_order_relaxed);
+    }
+    const u32 victim = find_victim(self, places, waiting, count, min_surplus);
+    if (victim == no_victim)
+        return;
 
-        thread_to_reschedule = task;
-        task->attributes |= thread_attributes::on_migrate;
-        return true;
+    own.stealing.store(true, std::memory_order_relaxed);
+    SMP::call_cpu(victim, steal_ipi, self);
+}
+
+/// Runs on an idle CPU without a tick, a busy CPU has threads to spare.
+void kick_ipi(u64) { try_steal(1); }
+
+/// Wake the nearest idle CPU whose tick is stopped, it cannot notice the
+/// threads waiting here by itself. One that is already stealing is skipped.
+void kick_idle_cpu()
+{
+    const u32 self = cpu::current().id();
+    const u32 count = static_cast<u32>(cpu::count());
+    const auto place = balance_cpus[self].place;
+    constexpr balance_domain domains[] = {balance_domain::core, balance_domain::package, balance_domain::node,
+                                          balance_domain::system};
+    for (auto domain : domains)
+    {
+        for (u32 step = 1; step < count; step++)
+        {
+            const u32 i = (self + step) % count;
+            auto &other = balance_cpus[i];
+            if (domain_between(place, other.place) != domain || !other.nohz_idle.load(std::memory_order_relaxed) ||
+                other.stealing.load(std::memory_order_relaxed))
+                continue;
+            SMP::call_cpu(i, kick_ipi, 0);
+            return;
+        }
     }
-    return false;
 }
+} // namespace
 
 void init()
 {
@@ -60,13 +166,10 @@ void init()
         real_time_schedulers = memory::New<round_robin_scheduler>(memory::KernelCommonAllocatorV);
         normal_schedulers = memory::New<completely_fair_scheduler>(memory::KernelCommonAllocatorV);
 
+        nohz = cmdline::get_bool("nohz", true);
         is_init = true;
-        reschedule_ready = true;
-        reschedule_registration = memory::New<irq::registration>(memory::KernelCommonAllocatorV);
-        *reschedule_registration =
-            irq::register_handler(irq::hard_vector::IPI_reschedule, irq::hard_handler::bind<&reschedule_func>());
     }
-    (void)timer::schedule_after(5000, timer::timer_handler::bind<&timer_tick>());
+    arm_tick();
 }
 
 void init_cpu()
@@ -77,6 +180,10 @@ void init_cpu()
     }
     real_time_schedulers->init_cpu();
     normal_schedulers->init_cpu();
+
+    const u32 id = cpu::current().id();
+    auto location = arch::cpu_info::locate(static_cast<int>(arch::cpu::current().get_apic_id()));
+    balance_cpus[id].place = cpu_place{memory::numa::cpu_node(id), location.chip_index, location.core_index};
 }
 
 void add(thread_t *thread, scheduler_class scher)
@@ -92,6 +199,7 @@ void add(thread_t *thread, scheduler_class scher)
     }
 
     thread->scheduler->add(thread);
+    restart_tick();
 }
 
 struct update_state_ipi_param
@@ -108,10 +216,37 @@ struct update_state_ipi_param
     }
 };
 
+/// \p thread sits in this CPU's run queues, it is not on its way to or from
+/// another CPU.
+bool settled_here(thread_t *thread)
+{
+    return thread->cpuid == cpu::current().id() && !(thread->attributes & thread_attributes::on_migrate);
+}
+
+/// Called on the CPU of \p thread once it is ready
+void hand_off(thread_t *thread)
+{
+    auto *cur = current();
+    if (!(cur->attributes & thread_attributes::sync_wakeup) || cur == thread || cur->scheduler != thread->scheduler)
+        return;
+    if (arch::cpu::current().is_in_interrupt_context())
+        return;
+    thread->scheduler->yield_to(cur, thread);
+}
+
 void update_state_ipi(u64 data)
 {
     update_state_ipi_param *p = reinterpret_cast<update_state_ipi_param *>(data);
+    if (!settled_here(p->thread))
+    {
+        // Migrated since the call was sent, follow it. Its accept call is
+        // queued on the thief before this one comes round again.
+        SMP::call_cpu(p->thread->cpuid, update_state_ipi, data);
+        return;
+    }
     p->thread->scheduler->update_state(p->thread, p->state);
+    if (p->state == thread_state::ready)
+        restart_tick();
     if (p->wait_for_completion)
         p->completed.store(true, std::memory_order_release);
     else
@@ -120,9 +255,14 @@ void update_state_ipi(u64 data)
 
 void update_state(thread_t *thread, thread_state state)
 {
-    if (thread->cpuid == cpu::current().id())
+    if (settled_here(thread))
     {
         thread->scheduler->update_state(thread, state);
+        if (state == thread_state::ready)
+        {
+            hand_off(thread);
+            restart_tick();
+        }
     }
     else
     {
@@ -133,16 +273,25 @@ void update_state(thread_t *thread, thread_state state)
 
 void update_state_sync(thread_t *thread, thread_state state)
 {
-    if (thread->cpuid == cpu::current().id())
+    if (settled_here(thread))
     {
         thread->scheduler->update_state(thread, state);
+        if (state == thread_state::ready)
+        {
+            hand_off(thread);
+            restart_tick();
+        }
     }
     else
     {
         auto *param = memory::New<update_state_ipi_param>(memory::KernelCommonAllocatorV, thread, state, true);
         SMP::call_cpu(thread->cpuid, update_state_ipi, (u64)param);
         while (!param->completed.load(std::memory_order_acquire))
+        {
+            // The thread may be migrating to this CPU
+            SMP::run_calls();
             cpu_pause();
+        }
         memory::Delete<>(memory::KernelCommonAllocatorV, param);
     }
 }
@@ -163,6 +312,12 @@ struct remove_task__ipi_param
 void remove_task_ipi(u64 data)
 {
     remove_task__ipi_param *p = (remove_task__ipi_param *)data;
+    if (p->thread->attributes & thread_attributes::on_migrate)
+    {
+        // Waiting here could hold up the accept call of this very CPU
+        SMP::call_cpu(p->thread->cpuid, remove_task_ipi, data);
+        return;
+    }
     remove(p->thread, p->func, p->data);
     memory::Delete<>(memory::KernelCommonAllocatorV, p);
 }
@@ -204,6 +359,13 @@ void schedule()
     {
         normal_schedulers->schedule();
     }
+    if (current() == cpu::current().get_idle_task())
+    {
+        // Gone idle without a tick, let busy CPUs kick this one
+        auto &own = balance_cpus[cpu::current().id()];
+        if (own.tick_stopped.load(std::memory_order_relaxed))
+            own.nohz_idle.store(true, std::memory_order_relaxed);
+    }
     auto &lock = cpu::current().get_microtask_lock();
     uctx::RawSpinLockUninterruptibleController icu(lock);
     icu.begin();
@@ -223,7 +385,6 @@ void schedule()
 
 void timer_tick(timeclock::microsecond_t) noexcept
 {
-    (void)timer::schedule_after(5000, timer::timer_handler::bind<&timer_tick>());
     thread_t *thd = current();
 
     uctx::UninterruptibleContext icu;
@@ -239,52 +400,35 @@ void timer_tick(timeclock::microsecond_t) noexcept
         normal_schedulers->schedule_tick();
     }
 
-    if (!migrate_pre_check())
+    const u64 waiting = waiting_count();
+    auto &own = balance_cpus[cpu::current().id()];
+    own.waiting.store(waiting, std::memory_order_relaxed);
+
+    // An idle CPU pulls work every tick, a busy one once per load period and
+    // only across a real imbalance.
+    const bool period = migrate_pre_check();
+    const bool idle = thd == cpu::current().get_idle_task();
+    if (idle)
     {
-        return;
+        if (waiting == 0)
+            try_steal(1);
     }
-
-    u64 cpu_count = cpu::count();
-    u64 min_fac = cpu::current().edit_load_data().recent_load_fac;
-    u64 cur_id = cpu::current().id();
-    cpu::cpu_data_t *targe_cpu = nullptr;
-    for (u64 i = 0; i < cpu_count; i++)
+    else if (period)
     {
-        if (cur_id == i)
-            continue;
-        auto &cpu = cpu::get(i);
-        if (min_fac >= cpu.edit_load_data().recent_load_fac)
-        {
-            min_fac = cpu.edit_load_data().recent_load_fac;
-            targe_cpu = &cpu;
-        }
+        try_steal(2);
+        if (waiting > 0)
+            kick_idle_cpu();
     }
 
-    if (targe_cpu != nullptr && (cpu::current().edit_load_data().recent_load_fac - min_fac) > 100)
+    // Nothing to preempt for, sleep until a thread is woken here or a busy
+    // CPU kicks this one.
+    if (nohz && waiting == 0)
     {
-        auto task = real_time_schedulers->get_migratable_task(targe_cpu->id());
-        if (task != nullptr)
-        {
-            if (reschedule_task_push(task, targe_cpu->id()))
-            {
-                real_time_schedulers->commit_migrate(task);
-                SMP::reschedule_cpu(targe_cpu->id());
-                return;
-            }
-        }
-
-        task = normal_schedulers->get_migratable_task(targe_cpu->id());
-        if (task != nullptr)
-        {
-            if (reschedule_task_push(task, targe_cpu->id()))
-            {
-                normal_schedulers->commit_migrate(task);
-                SMP::reschedule_cpu(targe_cpu->id());
-            }
-        }
+        own.tick_stopped.store(true, std::memory_order_relaxed);
+        own.nohz_idle.store(idle, std::memory_order_relaxed);
+        return;
     }
-
-    return;
+    arm_tick();
 }
 // 10ms allow to reschedule
 constexpr u64 load_calc_time_span = 10000;
@@ -1,55 +1,51 @@
 #include "kernel/schedulers/completely_fair.hpp"
-#include "freelibcxx/skip_list.hpp"
 #include "kernel/clock.hpp"
 #include "kernel/cpu.hpp"
 #include "kernel/mm/list_node_cache.hpp"
 #include "kernel/mm/memory.hpp"
+#include "kernel/schedulers/cfs_weight.hpp"
 #include "kernel/task.hpp"
 #include "kernel/timer.hpp"
 #include "kernel/ucontext.hpp"
+#include "kernel/util/intrusive_list.hpp"
+#include "kernel/util/intrusive_rbtree.hpp"
 
 namespace task::scheduler
 {
 struct thread_time_cf_t
 {
+    /// Weighted runtime in nanoseconds. While the thread migrates it holds
+    /// the lag behind the old queue's min_vruntime instead.
     i64 vtime;
-    u64 vtime_delta;
+    /// When the thread got the CPU or was last charged
+    timeclock::nanosecond_t exec_start;
 };
 
-struct less_cmp
+struct vtime_less
 {
-};
-
-struct cfs_thread_t
-{
-    thread_t *thread;
-    bool operator<(const cfs_thread_t &thd) const
+    bool operator()(const thread_t *lhs, const thread_t *rhs) const
     {
-        const auto lhs_vtime = ((thread_time_cf_t *)(thread->schedule_data))->vtime;
-        const auto rhs_vtime = ((thread_time_cf_t *)(thd.thread->schedule_data))->vtime;
+        const auto lhs_vtime = ((thread_time_cf_t *)(lhs->schedule_data))->vtime;
+        const auto rhs_vtime = ((thread_time_cf_t *)(rhs->schedule_data))->vtime;
         if (lhs_vtime != rhs_vtime)
             return lhs_vtime < rhs_vtime;
-        return thread->tid < thd.thread->tid;
-    }
-    bool operator==(const cfs_thread_t &thd) const { return thd.thread == thread; }
-    explicit cfs_thread_t(thread_t *thread)
-        : thread(thread)
-    {
+        return lhs->tid < rhs->tid;
     }
 };
 
-using thread_skip_list_t = freelibcxx::skip_list<cfs_thread_t>;
+/// Runnable threads ordered by vtime, through thread_t::run_node
+using thread_tree_t = util::intrusive_rbtree<thread_t, &thread_t::run_node, vtime_less>;
+/// Blocked threads, through thread_t::queue_node
+using block_list_t = util::intrusive_list<thread_t, &thread_t::queue_node>;
+
 struct cpu_task_list_cf_t
 {
-    thread_skip_list_t runable_list;
-    thread_list_t block_list;
-    u64 min_vruntime;
-
-    cpu_task_list_cf_t()
-        : runable_list(memory::KernelCommonAllocatorV)
-        , block_list(memory::KernelCommonAllocatorV)
-    {
-    }
+    thread_tree_t runable_list;
+    block_list_t block_list;
+    i64 min_vruntime = 0;
+    /// Picked before the leftmost thread while it is runnable and not too far
+    /// ahead of it, set by yield_to
+    thread_t *next = nullptr;
 };
 
 cpu_task_list_cf_t *get_cpu_task_list()
@@ -59,13 +55,62 @@ cpu_task_list_cf_t *get_cpu_task_list()
 
 thread_time_cf_t *get_schedule_data(thread_t *thd) { return (thread_time_cf_t *)thd->schedule_data; }
 
+bool is_idle(thread_t *thd) { return thd->process->pid == 0; }
+
+/// \param cur the running thread if it belongs to this queue, or nullptr
+void update_min_vruntime(cpu_task_list_cf_t *task_list, thread_t *cur)
+{
+    bool has_current = cur != nullptr && !is_idle(cur);
+    bool has_first = !task_list->runable_list.empty();
+    i64 current_vtime = has_current ? get_schedule_data(cur)->vtime : 0;
+    i64 first_vtime = has_first ? get_schedule_data(task_list->runable_list.first())->vtime : 0;
+    task_list->min_vruntime =
+        cfs::advance_min_vruntime(task_list->min_vruntime, has_current, current_vtime, has_first, first_vtime);
+}
+
+/// Charge the running thread for the time since it got the CPU or was last
+/// charged, scaled by the weight of its nice level.
+void update_current(cpu_task_list_cf_t *task_list, thread_t *cur)
+{
+    auto dt = get_schedule_data(cur);
+    auto now = timer::get_high_resolution_time_ns();
+    if (!is_idle(cur) && now > dt->exec_start)
+    {
+        dt->vtime += cfs::calc_delta(now - dt->exec_start, cfs::weight_of(cur->nice));
+    }
+    dt->exec_start = now;
+    update_min_vruntime(task_list, cur);
+}
+
+/// Preempt the running thread of this queue for \p woken if it is far enough
+/// ahead of \p woken.
+void check_wakeup_preempt(scheduler *self, cpu_task_list_cf_t *task_list, thread_t *woken, u64 granularity_ns)
+{
+    auto cur = current();
+    if (cur->scheduler != self)
+        return;
+    if (is_idle(cur))
+    {
+        cur->attributes |= thread_attributes::need_schedule;
+        return;
+    }
+    if (cur->state != thread_state::running)
+        return;
+    update_current(task_list, cur);
+    if (cfs::wakeup_preempt(get_schedule_data(cur)->vtime, get_schedule_data(woken)->vtime, granularity_ns,
+                            cfs::weight_of(woken->nice)))
+    {
+        cur->attributes |= thread_attributes::need_schedule;
+    }
+}
+
 void completely_fair_scheduler::init_cpu()
 {
     auto task_list = memory::New<cpu_task_list_cf_t>(memory::KernelCommonAllocatorV);
     cpu::current().set_schedule_data((int)clazz, task_list);
     auto dt = memory::New<thread_time_cf_t>(memory::KernelCommonAllocatorV);
-    dt->vtime_delta = 100;
     dt->vtime = 0;
+    dt->exec_start = 0;
     task_list->min_vruntime = 0;
     auto &data = cpu::current().edit_load_data();
     data.last_sched_time = timer::get_high_resolution_time();
@@ -85,12 +130,12 @@ void completely_fair_scheduler::add(thread_t *thread)
 {
     auto task_list = get_cpu_task_list();
     auto dt = memory::New<thread_time_cf_t>(memory::KernelCommonAllocatorV);
-    dt->vtime_delta = 100;
-    dt->vtime = 0;
+    dt->exec_start = 0;
     thread->cpuid = cpu::current().id();
     thread->schedule_data = dt;
     uctx::UninterruptibleContext icu;
-    task_list->runable_list.insert(cfs_thread_t(thread));
+    dt->vtime = task_list->min_vruntime;
+    task_list->runable_list.insert(thread);
 }
 
 void completely_fair_scheduler::remove(thread_t *thread)
@@ -98,22 +143,19 @@ void completely_fair_scheduler::remove(thread_t *thread)
     auto task_list = get_cpu_task_list();
 
     uctx::UninterruptibleContext icu;
-    auto node = task_list->block_list.find(thread);
-    if (node != task_list->block_list.end())
+    if (task_list->next == thread)
+        task_list->next = nullptr;
+    if (block_list_t::linked(thread))
     {
-        task_list->block_list.remove(node);
+        task_list->block_list.remove(thread);
+    }
+    else if (thread_tree_t::linked(thread))
+    {
+        task_list->runable_list.erase(thread);
     }
     else
     {
-        auto it = task_list->runable_list.find(cfs_thread_t(thread));
-        if (it != task_list->runable_list.end())
-        {
-            task_list->runable_list.remove(it);
-        }
-        else
-        {
-            trace::panic("Can't find task ", thread->tid, " pid: ", thread->process->pid);
-        }
+        trace::panic("Can't find task ", thread->tid, " pid: ", thread->process->pid);
     }
 
     auto scher_data = get_schedule_data(thread);
@@ -137,13 +179,15 @@ void completely_fair_scheduler::update_state(thread_t *thread, thread_state stat
         }
         if (thread->state == thread_state::stop)
         {
-            auto node = task_list->block_list.find(thread);
-            if (node != task_list->block_list.end())
+            if (block_list_t::linked(thread))
             {
                 thread->state = state;
-                task_list->block_list.remove(node);
+                task_list->block_list.remove(thread);
                 thread->attributes &= ~(thread_attributes::block_to_stop);
-                task_list->runable_list.insert(cfs_thread_t(thread));
+                auto dt = get_schedule_data(thread);
+                dt->vtime = cfs::place_woken(dt->vtime, task_list->min_vruntime, sleeper_credit());
+                task_list->runable_list.insert(thread);
+                check_wakeup_preempt(this, task_list, thread, sched_wakeup_granularity_us * 1000);
                 return;
             }
         }
@@ -169,11 +213,10 @@ void completely_fair_scheduler::update_state(thread_t *thread, thread_state stat
         }
         else if (thread->state == thread_state::ready)
         {
-            auto it = task_list->runable_list.find(cfs_thread_t(thread));
-            if (it != task_list->runable_list.end())
+            if (thread_tree_t::linked(thread))
             {
                 thread->state = state;
-                task_list->runable_list.remove(it);
+                task_list->runable_list.erase(thread);
                 task_list->block_list.push_back(thread);
                 return;
             }
@@ -191,6 +234,10 @@ void completely_fair_scheduler::update_state(thread_t *thread, thread_state stat
             return;
         }
 
+        if (thread->state == thread_state::running)
+        {
+            update_current(task_list, thread);
+        }
         if (thread->attributes & thread_attributes::block_to_stop)
         {
             thread->state = thread_state::stop;
@@ -201,7 +248,7 @@ void completely_fair_scheduler::update_state(thread_t *thread, thread_state stat
             if (thread->state == thread_state::running)
             {
                 thread->state = thread_state::ready;
-                task_list->runable_list.insert(cfs_thread_t(thread));
+                task_list->runable_list.insert(thread);
             }
         }
         return;
@@ -214,17 +261,30 @@ void completely_fair_scheduler::on_migrate(thread_t *thread)
     auto task_list = get_cpu_task_list();
     uctx::UninterruptibleContext icu;
     auto dt = (thread_time_cf_t *)thread->schedule_data;
-    dt->vtime_delta = 100;
-    dt->vtime = 0;
     thread->cpuid = cpu::current().id();
     if (thread->state == thread_state::ready)
-        task_list->runable_list.insert(cfs_thread_t(thread));
+    {
+        dt->vtime = cfs::place_migrated(dt->vtime, task_list->min_vruntime, sleeper_credit());
+        task_list->runable_list.insert(thread);
+    }
     else if (thread->state == thread_state::stop)
+    {
+        // Placed again when it wakes up
+        dt->vtime += task_list->min_vruntime;
         task_list->block_list.push_back(thread);
+    }
     else
         trace::panic("Unknown thread state when migrate(CFS). state: ", (u64)thread->state);
 }
 
+/// Whether \p buddy may run before the leftmost runnable thread
+bool buddy_eligible(cpu_task_list_cf_t *task_list, thread_t *buddy, u64 granularity_ns)
+{
+    return cfs::buddy_eligible(get_schedule_data(buddy)->vtime,
+                               get_schedule_data(task_list->runable_list.first())->vtime, granularity_ns,
+                               cfs::weight_of(buddy->nice));
+}
+
 thread_t *completely_fair_scheduler::pick_available_task()
 {
     auto task_list = get_cpu_task_list();
@@ -233,15 +293,22 @@ thread_t *completely_fair_scheduler::pick_available_task()
     {
         return cpu::current().get_idle_task();
     }
-    auto thd = task_list->runable_list.front();
-    task_list->runable_list.remove(thd);
-    if (!task_list->runable_list.empty())
+    auto thd = task_list->runable_list.first();
+    // A thread handed the CPU runs out of vtime order, once
+    const bool handed = task_list->next != nullptr && thread_tree_t::linked(task_list->next) &&
+                        buddy_eligible(task_list, task_list->next, sched_wakeup_granularity_us * 1000);
+    if (handed)
+        thd = task_list->next;
+    task_list->next = nullptr;
+    task_list->runable_list.erase(thd);
+    if (!handed && !task_list->runable_list.empty())
     {
-        kassert(get_schedule_data(thd.thread)->vtime <=
-                    get_schedule_data(task_list->runable_list.front().thread)->vtime,
+        kassert(get_schedule_data(thd)->vtime <= get_schedule_data(task_list->runable_list.first())->vtime,
                 "CFS running list check failed!");
     }
-    return thd.thread;
+    get_schedule_data(thd)->exec_start = timer::get_high_resolution_time_ns();
+    update_min_vruntime(task_list, thd);
+    return thd;
 }
 
 bool completely_fair_scheduler::schedule()
@@ -288,17 +355,16 @@ void completely_fair_scheduler::schedule_tick()
     cpu.edit_load_data().running_task_time += ctime - cpu.edit_load_data().last_tick_time;
     cpu.edit_load_data().last_tick_time = ctime;
 
-    scher_data->vtime += scher_data->vtime_delta;
+    update_current(task_list, cur);
 
-    u64 delta = timer::get_high_resolution_time() - cpu.edit_load_data().last_sched_time;
+    u64 delta = ctime - cpu.edit_load_data().last_sched_time;
     if (delta >= sched_min_granularity_us)
     {
         if (!task_list->runable_list.empty())
         {
-            uctx::UninterruptibleContext icu;
-            auto next = task_list->runable_list.front();
+            auto next = task_list->runable_list.first();
 
-            if (cur->process->pid == 0 || get_schedule_data(next.thread)->vtime <= scher_data->vtime)
+            if (is_idle(cur) || get_schedule_data(next)->vtime <= scher_data->vtime)
                 cur->attributes |= thread_attributes::need_schedule;
         }
     }
@@ -312,10 +378,10 @@ thread_t *completely_fair_scheduler::get_migratable_task(u32 cpuid)
     if (list->runable_list.empty())
         return nullptr;
     uctx::UninterruptibleContext icu;
-    for (auto thd : list->runable_list)
+    for (auto thd = list->runable_list.first(); thd != nullptr; thd = thread_tree_t::next(thd))
     {
-        if (thd.thread->cpumask.mask & (1ul << cpuid))
-            return thd.thread;
+        if (thd->cpumask.mask & (1ul << cpuid))
+            return thd;
     }
     return nullptr;
 }
@@ -325,19 +391,32 @@ void completely_fair_scheduler::commit_migrate(thread_t *thd)
     auto list = get_cpu_task_list();
     uctx::UninterruptibleContext icu;
 
-    // The source entry is removed before the destination CPU can reset its
-    // vtime during migration, so the ordered lookup key is still valid here.
-    auto it = list->runable_list.find(cfs_thread_t(thd));
-    kassert(it != list->runable_list.end(), "commit task failed!");
+    kassert(thread_tree_t::linked(thd), "commit task failed!");
 
     // don't free scher_data
 
-    list->runable_list.remove(it);
+    if (list->next == thd)
+        list->next = nullptr;
+    // Erase before the vtime becomes a lag, the tree still orders by it
+    list->runable_list.erase(thd);
+    get_schedule_data(thd)->vtime -= list->min_vruntime;
+}
+
+void completely_fair_scheduler::yield_to(thread_t *from, thread_t *to)
+{
+    auto task_list = get_cpu_task_list();
+    uctx::UninterruptibleContext icu;
+    if (is_idle(from) || from->state != thread_state::running || !thread_tree_t::linked(to))
+        return;
+    // Too far ahead, the yield still happens in vtime order
+    if (buddy_eligible(task_list, to, sched_wakeup_granularity_us * 1000))
+        task_list->next = to;
+    from->attributes |= thread_attributes::need_schedule;
 }
 
 completely_fair_scheduler::completely_fair_scheduler()
     : sched_min_granularity_us(2000)
-    , sched_wakeup_granularity_us(1)
+    , sched_wakeup_granularity_us(1000)
 {
 }
 
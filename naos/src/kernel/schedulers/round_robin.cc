@@ -2,6 +2,7 @@
 #include "kernel/cpu.hpp"
 #include "kernel/mm/list_node_cache.hpp"
 #include "kernel/timer.hpp"
+#include "kernel/util/intrusive_list.hpp"
 
 namespace task::scheduler
 {
@@ -12,16 +13,10 @@ struct thread_data_rr_t
 
 struct cpu_task_rr_t
 {
-    using thread_list_t = freelibcxx::linked_list<task::thread_t *>;
+    using thread_list_t = util::intrusive_list<thread_t, &thread_t::queue_node>;
 
     thread_list_t runable_list;
     thread_list_t block_threads;
-
-    cpu_task_rr_t()
-        : runable_list(memory::KernelCommonAllocatorV)
-        , block_threads(memory::KernelCommonAllocatorV)
-    {
-    }
 };
 
 i64 calc_span(thread_t *);
@@ -44,23 +39,14 @@ void round_robin_scheduler::remove(thread_t *thread)
     auto l = reinterpret_cast<cpu_task_rr_t *>(cpu::current().get_schedule_data(static_cast<int>(clazz)));
     uctx::UninterruptibleContext icu;
 
-    auto it = l->runable_list.find(thread);
-    if (it != l->runable_list.end())
+    if (!cpu_task_rr_t::thread_list_t::linked(thread))
     {
-        l->runable_list.remove(it);
+        trace::panic("Can't find task ", thread->tid, " pid: ", thread->process->pid);
     }
+    if (thread->state == thread_state::ready)
+        l->runable_list.remove(thread);
     else
-    {
-        auto it2 = l->block_threads.find(thread);
-        if (it2 != l->block_threads.end())
-        {
-            l->block_threads.remove(it2);
-        }
-        else
-        {
-            trace::panic("Can't find task ", thread->tid, " pid: ", thread->process->pid);
-        }
-    }
+        l->block_threads.remove(thread);
     memory::Delete<>(memory::KernelCommonAllocatorV, (thread_data_rr_t *)thread->schedule_data);
 }
 
@@ -73,11 +59,10 @@ void round_robin_scheduler::update_state(thread_t *thread, thread_state state)
     {
         if (thread->state == thread_state::ready)
         {
-            auto it = l->runable_list.find(thread);
-            if (it != l->runable_list.end())
+            if (cpu_task_rr_t::thread_list_t::linked(thread))
             {
                 thread->state = state;
-                l->runable_list.remove(it);
+                l->runable_list.remove(thread);
                 l->block_threads.push_back(thread);
                 return;
             }
@@ -94,11 +79,10 @@ void round_robin_scheduler::update_state(thread_t *thread, thread_state state)
             return;
         if (thread->state == thread_state::stop)
         {
-            auto it = l->block_threads.find(thread);
-            if (it != l->block_threads.end())
+            if (cpu_task_rr_t::thread_list_t::linked(thread))
             {
                 thread->state = state;
-                l->block_threads.remove(it);
+                l->block_threads.remove(thread);
                 thread->attributes &= ~(thread_attributes::block_to_stop);
                 l->runable_list.push_back(thread);
                 return;
@@ -179,11 +163,11 @@ bool round_robin_scheduler::schedule()
 
                 if (cur->scheduler == this)
                 {
+                    // Already queued at the back by sched_switch_to_ready
                     auto rr = (thread_data_rr_t *)cur->schedule_data;
                     if (rr->rest_span <= 0)
                     {
                         rr->rest_span = calc_span(cur);
-                        l->runable_list.push_back(cur);
                     }
                 }
                 auto next = l->runable_list.pop_front();
@@ -241,7 +225,7 @@ thread_t *round_robin_scheduler::get_migratable_task(u32 cpuid)
     if (l->runable_list.empty())
         return nullptr;
     uctx::UninterruptibleContext icu;
-    for (auto thd : l->runable_list)
+    for (auto thd = l->runable_list.front(); thd != nullptr; thd = cpu_task_rr_t::thread_list_t::next(thd))
     {
         if (thd->cpumask.mask & (1ul << cpuid))
             return thd;
@@ -253,14 +237,13 @@ void round_robin_scheduler::commit_migrate(thread_t *thd)
 {
     auto l = reinterpret_cast<cpu_task_rr_t *>(cpu::current().get_schedule_data(static_cast<int>(clazz)));
     uctx::UninterruptibleContext icu;
-    auto it = l->runable_list.find(thd);
-    kassert(it != l->runable_list.end(), "commit task failed!");
+    kassert(cpu_task_rr_t::thread_list_t::linked(thd), "commit task failed!");
 
     auto scher_data = (thread_data_rr_t *)thd->schedule_data;
     thd->schedule_data = nullptr;
     memory::Delete<>(memory::KernelCommonAllocatorV, scher_data);
 
-    l->runable_list.remove(it);
+    l->runable_list.remove(thd);
 }
 
 void round_robin_scheduler::init_cpu()
@@ -19,17 +19,13 @@ irq::registration *call_registration;
 
 irq::request_result flush_tlb_irq(const irq::interrupt_info *, u64) noexcept
 {
-    arch::paging::page_table_t::reload();
+    arch::paging::page_table_t::flush_all();
     return irq::request_result::ok;
 }
 
 irq::request_result ipi_call(const irq::interrupt_info *, u64) noexcept
 {
-    auto &cpu = cpu::current();
-    cpu::call_cpu_operation_t operation;
-    while (cpu.try_dequeue_call_cpu(operation))
-        operation.func(operation.data);
-
+    run_calls();
     return irq::request_result::ok;
 }
 
@@ -51,9 +47,12 @@ void init()
 
 void flush_all_tlb() { arch::APIC::local_post_IPI_all_notself(irq::hard_vector::IPI_tlb); }
 
-void reschedule_cpu(u32 cpuid)
+void run_calls()
 {
-    arch::APIC::local_post_IPI_mask(irq::hard_vector::IPI_reschedule, arch::cpu::get(cpuid).get_apic_id());
+    auto &cpu = cpu::current();
+    cpu::call_cpu_operation_t operation;
+    while (cpu.try_dequeue_call_cpu(operation))
+        operation.func(operation.data);
 }
 
 void call_cpu(u32 cpuid, cpu::call_cpu_func_t call_func, u64 user_data)
@@ -132,10 +132,7 @@ bool valid_bootstrap_service_directory(task::resource_table_t &resources, na_han
 
 na_status_t handle_close(na_handle_t handle)
 {
-    const auto status = task::current_process()->resource.close_native(handle);
-    if (status == NA_STATUS_OK)
-        ipc::collect_orphaned_channels();
-    return status;
+    return task::current_process()->resource.close_native(handle);
 }
 
 na_status_t handle_duplicate(na_handle_t source, na_meta_rights_t rights, na_handle_t *result)
@@ -195,7 +192,6 @@ na_status_t channel_create(const na_channel_options_t *options, na_handle_t *lef
     {
         left_object.reset();
         right_object.reset();
-        ipc::collect_orphaned_channels();
         return NA_STATUS_INVALID_ARGUMENT;
     }
     if (options != nullptr && naos::usercopy::ranges_overlap(reinterpret_cast<u64>(options), sizeof(*options),
@@ -203,7 +199,6 @@ na_status_t channel_create(const na_channel_options_t *options, na_handle_t *lef
     {
         left_object.reset();
         right_object.reset();
-        ipc::collect_orphaned_channels();
         return NA_STATUS_INVALID_ARGUMENT;
     }
     if (naos::usercopy::ranges_overlap(reinterpret_cast<u64>(left), sizeof(*left), reinterpret_cast<u64>(right),
@@ -211,7 +206,6 @@ na_status_t channel_create(const na_channel_options_t *options, na_handle_t *lef
     {
         left_object.reset();
         right_object.reset();
-        ipc::collect_orphaned_channels();
         return NA_STATUS_INVALID_ARGUMENT;
     }
 
@@ -222,7 +216,6 @@ na_status_t channel_create(const na_channel_options_t *options, na_handle_t *lef
     {
         left_object.reset();
         right_object.reset();
-        ipc::collect_orphaned_channels();
         return status;
     }
 
@@ -349,6 +342,11 @@ na_status_t invocation_take_result(na_handle_t invocation, na_result_frame_t *fr
     return ipc::invocation_take_result(task::current_process()->resource, invocation, frame);
 }
 
+na_status_t invoke_call(na_handle_t target, const na_submit_frame_t *submit, na_result_frame_t *result)
+{
+    return ipc::invoke_call(task::current_process()->resource, target, submit, result);
+}
+
 na_status_t responder_reply(na_handle_t responder, const na_reply_frame_t *frame)
 {
     return ipc::responder_reply(task::current_process()->resource, responder, frame);
@@ -627,6 +625,7 @@ SYSCALL(NA_SYSCALL_INVOKE_SUBMIT, invoke_submit)
 SYSCALL(NA_SYSCALL_INVOKE_SEND_ONEWAY, invoke_send_oneway)
 SYSCALL(NA_SYSCALL_INVOCATION_CANCEL, invocation_cancel)
 SYSCALL(NA_SYSCALL_INVOCATION_TAKE_RESULT, invocation_take_result)
+SYSCALL(NA_SYSCALL_INVOKE_CALL, invoke_call)
 SYSCALL(NA_SYSCALL_RESPONDER_REPLY, responder_reply)
 SYSCALL(NA_SYSCALL_RESPONDER_FAIL, responder_fail)
 SYSCALL(NA_SYSCALL_BOOTSTRAP, bootstrap)
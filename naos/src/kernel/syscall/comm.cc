@@ -3,6 +3,7 @@
 #include "kernel/errno.hpp"
 #include "kernel/fs/vfs/file.hpp"
 #include "kernel/kobject.hpp"
+#include "kernel/lock.hpp"
 #include "kernel/syscall.hpp"
 #include "kernel/task.hpp"
 #include "kernel/time.hpp"
@@ -66,8 +67,43 @@ int clock_get(int clock_index, timeclock::time *time)
     return naos::usercopy::copy_to(reinterpret_cast<u64>(time), &value, sizeof(value)) == NA_STATUS_OK ? 0 : EFAULT;
 }
 
+na_status_t lockstat_read(na_lockstat_entry_t *entries, u64 capacity, u64 *count)
+{
+#ifdef LOCKSTAT
+    const u64 address = reinterpret_cast<u64>(entries);
+    if (capacity > ~0UL / sizeof(*entries) || !naos::usercopy::valid_output_range(address, capacity * sizeof(*entries)))
+        return NA_STATUS_FAULT;
+    if (count == nullptr || !is_user_space_range(count, sizeof(*count)))
+        return NA_STATUS_FAULT;
+
+    u64 total = 0;
+    for (auto *cls = lock::first_class(); cls != nullptr; cls = cls->next, total++)
+    {
+        if (total >= capacity)
+            continue;
+        na_lockstat_entry_t entry = {};
+        for (u64 index = 0; index + 1 < sizeof(entry.name) && cls->name[index] != '\0'; index++)
+            entry.name[index] = cls->name[index];
+        entry.acquisitions = cls->acquisitions.load(std::memory_order_relaxed);
+        entry.contended = cls->contended.load(std::memory_order_relaxed);
+        entry.total_wait_cycles = cls->total_wait_cycles.load(std::memory_order_relaxed);
+        entry.max_wait_cycles = cls->max_wait_cycles.load(std::memory_order_relaxed);
+        auto status = naos::usercopy::copy_to(address + total * sizeof(entry), &entry, sizeof(entry));
+        if (status != NA_STATUS_OK)
+            return status;
+    }
+    return naos::usercopy::copy_to(reinterpret_cast<u64>(count), &total, sizeof(total));
+#else
+    (void)entries;
+    (void)capacity;
+    (void)count;
+    return NA_STATUS_NOT_SUPPORTED;
+#endif
+}
+
 BEGIN_SYSCALL
 SYSCALL(NA_SYSCALL_LOG, log)
 SYSCALL(NA_SYSCALL_CLOCK_GET, clock_get)
+SYSCALL(NA_SYSCALL_LOCKSTAT_READ, lockstat_read)
 END_SYSCALL
 } // namespace naos::syscall
@@ -1,8 +1,15 @@
 #include "kernel/mm/data_plane.hpp"
 
+#include "freelibcxx/utils.hpp"
 #include "kernel/arch/klib.hpp"
+#include "kernel/errno.hpp"
+#include "kernel/fs/vfs/defines.hpp"
+#include "kernel/fs/vfs/dentry.hpp"
 #include "kernel/fs/vfs/file.hpp"
+#include "kernel/fs/vfs/inode.hpp"
+#include "kernel/fs/vfs/pseudo.hpp"
 #include "kernel/ipc/channel.hpp"
+#include "kernel/mm/object_window.hpp"
 #include "kernel/mm/vm.hpp"
 #include "kernel/syscall.hpp"
 #include "kernel/task.hpp"
@@ -18,6 +25,144 @@ template <typename T> na_status_t copy_in(const T *source, T &destination)
 {
     return usercopy::copy_versioned(destination, source);
 }
+
+/// A pipe, regular file or memory object a splice reads or writes
+struct splice_end
+{
+    khandle object;
+    fs::vfs::file *file = nullptr;
+    fs::vfs::pseudo_pipe_t *pipe = nullptr;
+    naos::data_plane::memory_object *memory_object = nullptr;
+};
+
+na_status_t lookup_splice_end(na_handle_t handle, bool source, splice_end &end)
+{
+    capability::entry entry;
+    if (!task::current_process()->resource.lookup_native(handle, entry) || !entry.object)
+        return NA_STATUS_INVALID_HANDLE;
+    if (entry.meta.binding == NA_BINDING_MEMORY_OBJECT && entry.meta.scope == NA_SCOPE_MEMORY_OBJECT)
+    {
+        if ((entry.meta.protocol_rights & (source ? NA_MEMORY_RIGHT_READ : NA_MEMORY_RIGHT_WRITE)) == 0)
+            return NA_STATUS_ACCESS_DENIED;
+        end.memory_object = entry.object->get<naos::data_plane::memory_object>();
+        if (end.memory_object == nullptr)
+            return NA_STATUS_WRONG_BINDING;
+    }
+    else
+    {
+        if (entry.meta.scope != NA_SCOPE_FILE && entry.meta.scope != NA_SCOPE_STREAM)
+            return NA_STATUS_WRONG_SCOPE;
+        end.file = entry.object->get<fs::vfs::file>();
+        if (end.file == nullptr)
+            return NA_STATUS_WRONG_BINDING;
+        if ((end.file->get_mode() & (source ? fs::mode::read : fs::mode::write)) == 0)
+            return NA_STATUS_ACCESS_DENIED;
+        auto *node = end.file->get_entry() != nullptr ? end.file->get_entry()->get_inode() : nullptr;
+        if (node == nullptr)
+            return NA_STATUS_INVALID_HANDLE;
+        if (node->get_type() == fs::inode_type_t::pipe)
+        {
+            end.pipe = static_cast<fs::vfs::pseudo_pipe_t *>(end.file->get_pseudo());
+            if (end.pipe == nullptr)
+                return NA_STATUS_INVALID_HANDLE;
+        }
+        else if (node->get_type() != fs::inode_type_t::file)
+            return NA_STATUS_NOT_SUPPORTED;
+    }
+    end.object = entry.object;
+    return NA_STATUS_OK;
+}
+
+na_status_t splice_status(i64 result)
+{
+    if (result >= 0)
+        return NA_STATUS_OK;
+    if (result == EAGAIN)
+        return NA_STATUS_WOULD_BLOCK;
+    if (result == EOF)
+        return NA_STATUS_PEER_CLOSED;
+    if (result == EINVAL)
+        return NA_STATUS_INVALID_ARGUMENT;
+    return NA_STATUS_IO_ERROR;
+}
+
+/// Link the pages of \p size bytes of a file or memory object at \p offset
+/// into \p pipe
+i64 splice_into_pipe(splice_end &source, u64 offset, u64 size, fs::vfs::pseudo_pipe_t &pipe, flag_t flags)
+{
+    if (source.memory_object != nullptr)
+    {
+        auto *object = source.memory_object;
+        if (!object->readable(offset, size))
+            return EINVAL;
+        return pipe.splice_in(size, flags, [object, offset, size](u64 done, util::pipe_buffer &buffer) {
+            const u64 position = offset + done;
+            const u64 in_page = position % memory::page_size;
+            byte *page = object->reference_page(position);
+            if (page == nullptr)
+                return false;
+            const u64 chunk = freelibcxx::min(memory::page_size - in_page, size - done);
+            buffer = util::pipe_buffer{page, static_cast<u32>(in_page), static_cast<u32>(chunk), true};
+            return true;
+        });
+    }
+
+    auto *file = source.file;
+    const u64 file_size = file->size();
+    if (offset >= file_size)
+        return 0;
+    size = freelibcxx::min(size, file_size - offset);
+    return pipe.splice_in(size, flags, [file, offset, size](u64 done, util::pipe_buffer &buffer) {
+        const u64 position = offset + done;
+        const u64 in_page = position % memory::page_size;
+        u64 chunk = freelibcxx::min(memory::page_size - in_page, size - done);
+        byte *page = file->get_cached_page(position - in_page);
+        bool shared = true;
+        if (page == nullptr)
+        {
+            // Not cacheable, read it into a page of the pipe's own
+            page = reinterpret_cast<byte *>(memory::malloc_page());
+            const auto read = file->pread(static_cast<i64>(position), page + in_page, chunk, 0);
+            if (read <= 0)
+            {
+                memory::free_page(page);
+                return false;
+            }
+            chunk = static_cast<u64>(read);
+            shared = false;
+        }
+        buffer = util::pipe_buffer{page, static_cast<u32>(in_page), static_cast<u32>(chunk), shared};
+        return true;
+    });
+}
+
+/// Copy up to \p size bytes out of \p pipe into a file or memory object at
+/// \p offset
+i64 splice_from_pipe(fs::vfs::pseudo_pipe_t &pipe, u64 size, splice_end &target, u64 offset, flag_t flags)
+{
+    u64 stored = 0;
+    if (target.memory_object != nullptr)
+    {
+        auto *object = target.memory_object;
+        if (!object->writable(offset, size))
+            return EINVAL;
+        return pipe.splice_out(size, flags, [object, offset, &stored](const util::pipe_buffer &buffer) {
+            u64 actual = 0;
+            const auto status = object->write(offset + stored, buffer.page + buffer.offset, buffer.length, actual);
+            stored += actual;
+            return status == NA_STATUS_OK;
+        });
+    }
+
+    auto *file = target.file;
+    return pipe.splice_out(size, flags, [file, offset, &stored](const util::pipe_buffer &buffer) {
+        const auto written =
+            file->pwrite(static_cast<i64>(offset + stored), buffer.page + buffer.offset, buffer.length, 0);
+        if (written > 0)
+            stored += static_cast<u64>(written);
+        return written == static_cast<i64>(buffer.length);
+    });
+}
 } // namespace
 
 na_status_t memory_map(na_memory_map_frame_t *frame)
@@ -27,7 +172,8 @@ na_status_t memory_map(na_memory_map_frame_t *frame)
     if (status != NA_STATUS_OK)
         return status;
     if (values.struct_size < sizeof(values) ||
-        values.flags & ~(NA_MEMORY_MAP_READ | NA_MEMORY_MAP_WRITE | NA_MEMORY_MAP_EXEC | NA_MEMORY_MAP_SHARED) ||
+        values.flags & ~(NA_MEMORY_MAP_READ | NA_MEMORY_MAP_WRITE | NA_MEMORY_MAP_EXEC | NA_MEMORY_MAP_SHARED |
+                         NA_MEMORY_MAP_POPULATE) ||
         (values.object == NA_HANDLE_INVALID && values.offset != 0) || values.length == 0 || values.address != 0 ||
         values.reserved0 != 0 || values.reserved1 != 0 || (values.offset & (memory::page_size - 1)) != 0 ||
         (values.hint != 0 && (!is_user_space_pointer(values.hint) || (values.hint & (memory::page_size - 1)) != 0)) ||
@@ -50,11 +196,30 @@ na_status_t memory_map(na_memory_map_frame_t *frame)
             if ((values.flags & NA_MEMORY_MAP_WRITE) != 0 && (entry.meta.protocol_rights & NA_MEMORY_RIGHT_WRITE) == 0)
                 return NA_STATUS_ACCESS_DENIED;
             memory_object = entry.object->get<naos::data_plane::memory_object>();
-            if (memory_object == nullptr || values.offset > memory_object->size() ||
-                values.length > memory_object->size() - values.offset)
+            if (memory_object == nullptr)
                 return NA_STATUS_INVALID_ARGUMENT;
+            status = memory::object_window::check(values.offset, values.length, memory_object->size());
+            if (status != NA_STATUS_OK)
+                return status;
             backing = entry.object;
         }
+        else if (entry.meta.binding == NA_BINDING_SHARED_RING && entry.meta.scope == NA_SCOPE_SHARED_RING)
+        {
+            // Both ends write the header, so a mapped ring is only ever
+            // mapped shared and read-write, by a holder of either ring right.
+            if ((entry.meta.protocol_rights & (NA_RING_RIGHT_PUSH | NA_RING_RIGHT_POP)) == 0)
+                return NA_STATUS_ACCESS_DENIED;
+            constexpr u32 ring_map = NA_MEMORY_MAP_READ | NA_MEMORY_MAP_WRITE | NA_MEMORY_MAP_SHARED;
+            auto *ring = entry.object->get<naos::data_plane::shared_ring>();
+            if (ring == nullptr || !ring->mapped() ||
+                (values.flags & ~(NA_MEMORY_MAP_EXEC | NA_MEMORY_MAP_POPULATE)) != ring_map)
+                return NA_STATUS_INVALID_ARGUMENT;
+            backing = ring->mapping();
+            memory_object = backing->get<naos::data_plane::memory_object>();
+            status = memory::object_window::check(values.offset, values.length, memory_object->size());
+            if (status != NA_STATUS_OK)
+                return status;
+        }
         else
         {
             if (entry.meta.scope != NA_SCOPE_FILE && entry.meta.scope != NA_SCOPE_STREAM)
@@ -87,6 +252,8 @@ na_status_t memory_map(na_memory_map_frame_t *frame)
         vm_flags |= memory::vm::flags::executeable;
     if ((values.flags & NA_MEMORY_MAP_SHARED) != 0)
         vm_flags |= memory::vm::flags::shared;
+    if ((values.flags & NA_MEMORY_MAP_POPULATE) != 0)
+        vm_flags |= memory::vm::flags::populate;
     auto *vm_info = reinterpret_cast<memory::vm::info_t *>(task::current_process()->mm_info);
     const auto *vm = memory_object != nullptr
                          ? vm_info->map_memory_object(values.hint, std::move(backing), memory_object, values.offset,
@@ -95,6 +262,11 @@ na_status_t memory_map(na_memory_map_frame_t *frame)
     if (vm == nullptr)
         return NA_STATUS_RESOURCE_EXHAUSTED;
     values.address = vm->start;
+    if ((values.flags & NA_MEMORY_MAP_POPULATE) != 0 && !vm_info->populate(vm->start))
+    {
+        vm_info->umap_file(vm->start, vm->end - vm->start);
+        return NA_STATUS_RESOURCE_EXHAUSTED;
+    }
     status = usercopy::copy_to(reinterpret_cast<u64>(frame), &values, sizeof(values));
     if (status != NA_STATUS_OK)
     {
@@ -121,8 +293,110 @@ na_status_t memory_unmap(na_memory_unmap_frame_t *frame)
     return vm_info->umap_file(values.address, rounded) ? NA_STATUS_OK : NA_STATUS_INVALID_ARGUMENT;
 }
 
+na_status_t shared_ring_notify(na_handle_t handle)
+{
+    capability::entry entry;
+    if (!task::current_process()->resource.lookup_native(handle, entry) || !entry.object)
+        return NA_STATUS_INVALID_HANDLE;
+    if (entry.meta.scope != NA_SCOPE_SHARED_RING)
+        return NA_STATUS_WRONG_SCOPE;
+    auto *ring = entry.object->get<naos::data_plane::shared_ring>();
+    if (ring == nullptr)
+        return NA_STATUS_WRONG_BINDING;
+    if ((entry.meta.protocol_rights & (NA_RING_RIGHT_PUSH | NA_RING_RIGHT_POP)) == 0)
+        return NA_STATUS_ACCESS_DENIED;
+    return ring->notify_mapped();
+}
+
+na_status_t splice(na_splice_frame_t *frame)
+{
+    na_splice_frame_t values{};
+    auto status = copy_in(frame, values);
+    if (status != NA_STATUS_OK)
+        return status;
+    if (values.struct_size < sizeof(values) || values.flags & ~(NA_SPLICE_NONBLOCK | NA_SPLICE_KEEP) ||
+        values.reserved0 != 0 || values.size > NA_MEMORY_MAP_MAX_BYTES)
+        return NA_STATUS_INVALID_ARGUMENT;
+    splice_end source;
+    splice_end target;
+    status = lookup_splice_end(values.source, true, source);
+    if (status != NA_STATUS_OK)
+        return status;
+    status = lookup_splice_end(values.target, false, target);
+    if (status != NA_STATUS_OK)
+        return status;
+    if (source.pipe == nullptr && target.pipe == nullptr)
+        return NA_STATUS_NOT_SUPPORTED;
+    if ((source.pipe != nullptr && values.source_offset != 0) ||
+        (target.pipe != nullptr && values.target_offset != 0) ||
+        ((values.flags & NA_SPLICE_KEEP) != 0 && (source.pipe == nullptr || target.pipe == nullptr)))
+        return NA_STATUS_INVALID_ARGUMENT;
+
+    const flag_t flags = (values.flags & NA_SPLICE_NONBLOCK) != 0 ? fs::rw_flags::no_block : 0;
+    i64 result = 0;
+    if (values.size == 0)
+        result = 0;
+    else if (source.pipe != nullptr && target.pipe != nullptr)
+        result = source.pipe->splice_to(*target.pipe, values.size, flags, (values.flags & NA_SPLICE_KEEP) != 0);
+    else if (target.pipe != nullptr)
+        result = splice_into_pipe(source, values.source_offset, values.size, *target.pipe, flags);
+    else
+        result = splice_from_pipe(*source.pipe, values.size, target, values.target_offset, flags);
+    status = splice_status(result);
+    if (status != NA_STATUS_OK)
+        return status;
+    values.actual = static_cast<u64>(result);
+    return usercopy::copy_to(reinterpret_cast<u64>(frame), &values, sizeof(values));
+}
+
+na_status_t vmsplice(na_vmsplice_frame_t *frame)
+{
+    na_vmsplice_frame_t values{};
+    auto status = copy_in(frame, values);
+    if (status != NA_STATUS_OK)
+        return status;
+    if (values.struct_size < sizeof(values) || values.flags & ~NA_SPLICE_NONBLOCK || values.reserved0 != 0 ||
+        values.size > NA_MEMORY_MAP_MAX_BYTES || !usercopy::valid_range(values.address, values.size))
+        return NA_STATUS_INVALID_ARGUMENT;
+    splice_end target;
+    status = lookup_splice_end(values.pipe, false, target);
+    if (status != NA_STATUS_OK)
+        return status;
+    if (target.pipe == nullptr)
+        return NA_STATUS_NOT_SUPPORTED;
+
+    const flag_t flags = (values.flags & NA_SPLICE_NONBLOCK) != 0 ? fs::rw_flags::no_block : 0;
+    const u64 address = values.address;
+    const u64 size = values.size;
+    na_status_t copy_status = NA_STATUS_OK;
+    // The copy faults in user pages, so it runs outside the pipe lock
+    const i64 result =
+        target.pipe->splice_in(size, flags, [address, size, &copy_status](u64 done, util::pipe_buffer &buffer) {
+            const u64 chunk = freelibcxx::min(memory::page_size, size - done);
+            auto *page = reinterpret_cast<byte *>(memory::malloc_page());
+            copy_status = usercopy::copy_from(page, address + done, chunk);
+            if (copy_status != NA_STATUS_OK)
+            {
+                memory::free_page(page);
+                return false;
+            }
+            buffer = util::pipe_buffer{page, 0, static_cast<u32>(chunk), false};
+            return true;
+        });
+    if (result == 0 && copy_status != NA_STATUS_OK)
+        return copy_status;
+    status = splice_status(result);
+    if (status != NA_STATUS_OK)
+        return status;
+    values.actual = static_cast<u64>(result);
+    return usercopy::copy_to(reinterpret_cast<u64>(frame), &values, sizeof(values));
+}
+
 BEGIN_SYSCALL
 SYSCALL(NA_SYSCALL_MEMORY_MAP, memory_map)
 SYSCALL(NA_SYSCALL_MEMORY_UNMAP, memory_unmap)
+SYSCALL(NA_SYSCALL_SHARED_RING_NOTIFY, shared_ring_notify)
+SYSCALL(NA_SYSCALL_SPLICE, splice)
+SYSCALL(NA_SYSCALL_VMSPLICE, vmsplice)
 END_SYSCALL
 } // namespace naos::syscall
@@ -3,11 +3,14 @@
 #include "kernel/errno.hpp"
 #include "kernel/fs/vfs/file.hpp"
 #include "kernel/fs/vfs/vfs.hpp"
+#include "kernel/futex.hpp"
 #include "kernel/ipc/channel.hpp"
 #include "kernel/mm/new.hpp"
+#include "kernel/schedulers/cfs_weight.hpp"
 #include "kernel/syscall.hpp"
 #include "kernel/time.hpp"
 #include "kernel/timer.hpp"
+#include "kernel/ucontext.hpp"
 #include "kernel/usercopy.hpp"
 #include "naos/abi.h"
 #include "naos/bootstrap.hpp"
@@ -46,123 +49,89 @@ na_status_t native_status_from_errno(i64 error)
         return NA_STATUS_IO_ERROR;
     }
 }
-} // namespace
-
-enum futex_op
-{
-    futex_wake = 1,
-    futex_wait = 2,
-};
 
-struct futex_bucket
+/// Turn the user \p timeout into a futex deadline, \p absolute on the
+/// monotonic clock or relative to now
+int futex_deadline(const timeclock::time *timeout, bool absolute, timeclock::microsecond_t &deadline)
 {
-    task::wait_queue_t waiters;
-    std::atomic_uint64_t generation{0};
-
-    void wake(timeclock::microsecond_t) noexcept
-    {
-        generation.fetch_add(1, std::memory_order_release);
-        waiters.do_wake_up();
-    }
-};
-
-constexpr u64 futex_bucket_count = 64;
-std::atomic<futex_bucket *> futex_buckets{nullptr};
-std::atomic_flag futex_buckets_lock = ATOMIC_FLAG_INIT;
+    deadline = futex::no_deadline;
+    if (timeout == nullptr)
+        return 0;
+    timeclock::time value(0, 0);
+    if (naos::usercopy::copy_from(&value, reinterpret_cast<u64>(timeout), sizeof(value)) != NA_STATUS_OK)
+        return EFAULT;
+    if (value.tv_sec < 0 || value.tv_nsec < 0 || value.tv_nsec >= 1000000000)
+        return EPARAM;
 
-futex_bucket *ensure_futex_buckets()
-{
-    auto *buckets = futex_buckets.load(std::memory_order_acquire);
-    if (buckets != nullptr)
-        return buckets;
-    while (futex_buckets_lock.test_and_set(std::memory_order_acquire))
-        cpu_pause();
-    buckets = futex_buckets.load(std::memory_order_relaxed);
-    if (buckets == nullptr)
+    const auto seconds = static_cast<u64>(value.tv_sec);
+    const auto nanoseconds = static_cast<u64>(value.tv_nsec);
+    if (seconds > std::numeric_limits<u64>::max() / 1000000 ||
+        seconds * 1000000 > std::numeric_limits<u64>::max() - nanoseconds / 1000)
+        return EOVERFLOW;
+    const auto duration = seconds * 1000000 + nanoseconds / 1000;
+    const auto now = timer::get_high_resolution_time();
+    if (absolute)
     {
-        buckets = memory::NewArray<futex_bucket>(memory::KernelCommonAllocatorV, futex_bucket_count);
-        futex_buckets.store(buckets, std::memory_order_release);
+        if (duration <= now)
+            return ETIMEDOUT;
+        deadline = duration;
+        return 0;
     }
-    futex_buckets_lock.clear(std::memory_order_release);
-    return buckets;
+    if (duration > std::numeric_limits<u64>::max() - now)
+        return EOVERFLOW;
+    if (duration == 0)
+        return ETIMEDOUT;
+    deadline = now + duration;
+    return 0;
 }
 
-futex_bucket &bucket_for(futex_bucket *buckets, const int *ptr)
-{
-    const auto key = reinterpret_cast<u64>(ptr) >> 2;
-    return buckets[key % futex_bucket_count];
-}
+u32 futex_count(int value) { return value <= 0 ? 0 : static_cast<u32>(value); }
+} // namespace
 
-int futex(int *ptr, int op, int val, const timeclock::time *timeout, int val2)
+int futex(int *ptr, int op, int val, const timeclock::time *timeout, int *ptr2, int val3)
 {
-    (void)val2;
-    if (ptr == nullptr || !is_user_space_range(ptr, sizeof(*ptr)))
-        return EFAULT;
-
-    auto *buckets = ensure_futex_buckets();
-    if (buckets == nullptr)
-        return EFAILED;
-    auto &bucket = bucket_for(buckets, ptr);
-    if (op == futex_op::futex_wait)
+    const auto address = reinterpret_cast<u64>(ptr);
+    const auto target = reinterpret_cast<u64>(ptr2);
+    const bool shared = (op & NA_FUTEX_PRIVATE) == 0;
+    // Requeue and wake-op pass a count in place of the timeout
+    const auto val2 = static_cast<i64>(reinterpret_cast<u64>(timeout));
+    const auto cmd = op & ~NA_FUTEX_PRIVATE;
+    timeclock::microsecond_t deadline = futex::no_deadline;
+    switch (cmd)
     {
-        int observed = 0;
-        if (naos::usercopy::copy_from(&observed, reinterpret_cast<u64>(ptr), sizeof(observed)) != NA_STATUS_OK)
-            return EFAULT;
-        if (observed != val)
-            return EAGAIN;
-
-        timeclock::time relative(0, 0);
-        bool has_timeout = timeout != nullptr;
-        if (has_timeout &&
-            naos::usercopy::copy_from(&relative, reinterpret_cast<u64>(timeout), sizeof(relative)) != NA_STATUS_OK)
-            return EFAULT;
-        if (has_timeout && (relative.tv_sec < 0 || relative.tv_nsec < 0 || relative.tv_nsec >= 1000000000))
-            return EPARAM;
-
-        const auto generation = bucket.generation.load(std::memory_order_acquire);
-        timer::watcher_id deadline_watcher = timer::invalid_watcher_id;
-        if (has_timeout)
-        {
-            const auto seconds = static_cast<u64>(relative.tv_sec);
-            const auto nanoseconds = static_cast<u64>(relative.tv_nsec);
-            if (seconds > std::numeric_limits<u64>::max() / 1000000 ||
-                seconds * 1000000 > std::numeric_limits<u64>::max() - nanoseconds / 1000)
-                return EOVERFLOW;
-            const auto duration = seconds * 1000000 + nanoseconds / 1000;
-            const auto now = timer::get_high_resolution_time();
-            if (duration > std::numeric_limits<u64>::max() - now)
-                return EOVERFLOW;
-            if (duration == 0)
-                return ETIMEDOUT;
-            deadline_watcher =
-                timer::schedule_at(now + duration, timer::timer_handler::bind<&futex_bucket::wake>(bucket));
-            if (deadline_watcher == timer::invalid_watcher_id)
-                return EFAILED;
-        }
-
-        bucket.waiters.do_wait([&bucket, generation, ptr, val] {
-            int current = 0;
-            if (naos::usercopy::copy_from(&current, reinterpret_cast<u64>(ptr), sizeof(current)) != NA_STATUS_OK)
-                return true;
-            return bucket.generation.load(std::memory_order_acquire) != generation || current != val;
-        });
-        if (deadline_watcher != timer::invalid_watcher_id)
-            (void)timer::cancel(deadline_watcher);
-
-        if (naos::usercopy::copy_from(&observed, reinterpret_cast<u64>(ptr), sizeof(observed)) != NA_STATUS_OK)
-            return EFAULT;
-        if (observed == val && bucket.generation.load(std::memory_order_acquire) == generation)
-            return has_timeout ? ETIMEDOUT : EAGAIN;
-        return 0;
+    case NA_FUTEX_WAIT:
+    case NA_FUTEX_WAIT_BITSET: {
+        if (auto ret = futex_deadline(timeout, cmd == NA_FUTEX_WAIT_BITSET, deadline); ret != 0)
+            return ret;
+        const u32 bitset = cmd == NA_FUTEX_WAIT ? NA_FUTEX_BITSET_MATCH_ANY : static_cast<u32>(val3);
+        return futex::wait(address, shared, static_cast<u32>(val), bitset, deadline);
     }
-    else if (op == futex_op::futex_wake)
-    {
-        bucket.generation.fetch_add(1, std::memory_order_release);
-        if (val <= 0)
-            return 0;
-        return static_cast<int>(bucket.waiters.do_wake_up(static_cast<u64>(val)));
+    case NA_FUTEX_WAKE:
+        return futex::wake(address, shared, futex_count(val), NA_FUTEX_BITSET_MATCH_ANY);
+    case NA_FUTEX_WAKE_BITSET:
+        return futex::wake(address, shared, futex_count(val), static_cast<u32>(val3));
+    case NA_FUTEX_REQUEUE:
+    case NA_FUTEX_CMP_REQUEUE:
+        if (val2 < 0 || val2 > std::numeric_limits<int>::max())
+            return EINVAL;
+        return futex::requeue(address, target, shared, futex_count(val), static_cast<u32>(val2),
+                              cmd == NA_FUTEX_CMP_REQUEUE, static_cast<u32>(val3));
+    case NA_FUTEX_WAKE_OP:
+        if (val2 < 0 || val2 > std::numeric_limits<int>::max())
+            return EINVAL;
+        return futex::wake_op(address, target, shared, futex_count(val), static_cast<u32>(val2),
+                              static_cast<u32>(val3));
+    case NA_FUTEX_LOCK_PI:
+        if (auto ret = futex_deadline(timeout, true, deadline); ret != 0)
+            return ret;
+        return futex::lock_pi(address, false, deadline);
+    case NA_FUTEX_TRYLOCK_PI:
+        return futex::lock_pi(address, true, futex::no_deadline);
+    case NA_FUTEX_UNLOCK_PI:
+        return futex::unlock_pi(address);
+    default:
+        return EINVAL;
     }
-    return EPARAM;
 }
 
 /// exit process with return value
@@ -608,6 +577,27 @@ na_status_t process_spawn(const na_process_spawn_frame_t *frame)
 }
 int yield() { return 0; }
 
+na_status_t thread_set_nice(i64 nice)
+{
+    if (nice < task::scheduler::cfs::nice_min || nice > task::scheduler::cfs::nice_max)
+        return NA_STATUS_INVALID_ARGUMENT;
+    auto *thd = task::current();
+    uctx::RawSpinLockUninterruptibleContext icu(thd->process->thread_list_lock);
+    // Read by CFS the next time it charges this thread. A nice level lent
+    // by priority inheritance waiters stays until the futex is unlocked.
+    if (thd->pi_boosted)
+    {
+        thd->pi_base_nice = static_cast<i8>(nice);
+        if (nice < thd->nice)
+            thd->nice = static_cast<i8>(nice);
+    }
+    else
+    {
+        thd->nice = static_cast<i8>(nice);
+    }
+    return NA_STATUS_OK;
+}
+
 na_status_t pipe_create(na_pipe_create_frame_t *frame)
 {
     if (frame == nullptr || !is_user_space_range(frame, sizeof(*frame)))
@@ -666,6 +656,7 @@ SYSCALL(NA_SYSCALL_PROCESS_EXEC, process_exec)
 SYSCALL(NA_SYSCALL_PROCESS_HANDLE_OPEN, process_handle_open)
 SYSCALL(NA_SYSCALL_PROCESS_SPAWN, process_spawn)
 SYSCALL(NA_SYSCALL_PIPE_CREATE, pipe_create)
+SYSCALL(NA_SYSCALL_THREAD_SET_NICE, thread_set_nice)
 
 END_SYSCALL
 
@@ -5,13 +5,16 @@
 #include "kernel/arch/task.hpp"
 
 #include "kernel/fs/vfs/defines.hpp"
+#include "kernel/futex.hpp"
 #include "kernel/handle.hpp"
 #include "kernel/ipc/channel.hpp"
 #include "kernel/kobject.hpp"
 #include "kernel/mm/list_node_cache.hpp"
 #include "kernel/mm/memory.hpp"
 #include "kernel/mm/new.hpp"
+#include "kernel/mm/numa.hpp"
 #include "kernel/mm/slab.hpp"
+#include "kernel/mm/tlb.hpp"
 #include "kernel/mm/vm.hpp"
 
 #include "freelibcxx/hash_map.hpp"
@@ -52,7 +55,12 @@
 #include "kernel/wait.hpp"
 #include "naos/generated/system/Stream.hpp"
 
+#include "kernel/dev/dispatchinfo.hpp"
 #include "kernel/dev/framebuffer.hpp"
+#include "kernel/dev/numainfo.hpp"
+#include "kernel/dev/slabinfo.hpp"
+#include "kernel/dev/timerinfo.hpp"
+#include "kernel/dev/tlbinfo.hpp"
 #include "kernel/dev/tty/console_pseudo.hpp"
 
 using mm_info_t = memory::vm::info_t;
@@ -484,8 +492,10 @@ void delete_thread(thread_t *thd)
     kassert(thd->state == thread_state::destroy, "thread state check failed.");
     if (thd->do_wait_queue_now)
         thd->do_wait_queue_now->remove(thd);
+    futex::remove(thd);
     while (thd->wait_queue_wake_refs.load(std::memory_order_acquire) != 0)
         cpu_pause();
+    (void)timer::cancel(thd->sleep_timer);
 
     uctx::RawSpinLockUninterruptibleContext icu(thd->process->thread_list_lock);
 
@@ -569,6 +579,18 @@ void create_devs()
         // handle explicitly; its close() below releases the writer.
         (void)fb->open(fs::mode::read | fs::mode::write, task::access_context{task::current_process()});
     }
+
+    auto create_report = [&](const char *name, dev::report_pseudo_t *ps) {
+        fs::vfs::create(name, root, root, fs::create_flags::chr);
+        auto f = fs::vfs::open(name, root, root, fs::mode::read, 0);
+        fs::vfs::fcntl(f, fs::fcntl_type::set, 0, fs::fcntl_attr::pseudo_func, reinterpret_cast<u64 *>(&ps), 8);
+    };
+    create_report("/dev/slabinfo", memory::KernelCommonAllocatorV->New<dev::slabinfo::slabinfo_pseudo_t>());
+    create_report("/dev/numainfo", memory::KernelCommonAllocatorV->New<dev::numainfo::numainfo_pseudo_t>());
+    create_report("/dev/tlbinfo", memory::KernelCommonAllocatorV->New<dev::tlbinfo::tlbinfo_pseudo_t>());
+    create_report("/dev/timerinfo", memory::KernelCommonAllocatorV->New<dev::timerinfo::timerinfo_pseudo_t>());
+    create_report("/dev/dispatchinfo",
+                  memory::KernelCommonAllocatorV->New<dev::dispatchinfo::dispatchinfo_pseudo_t>());
 }
 
 std::atomic_bool is_init = false, init_ok = false;
@@ -702,6 +724,9 @@ thread_t *create_thread(process_t *process, thread_start_func start_func, void *
     if (thd == nullptr)
         return nullptr;
     thd->state = thread_state::ready;
+    // A nice level lent through a PI futex stays with the lender's lock
+    if (process == current_process())
+        thd->nice = current()->pi_boosted ? current()->pi_base_nice : current()->nice;
 
     auto &vma = ((mm_info_t *)process->mm_info)->vma();
 
@@ -1094,6 +1119,13 @@ int fork()
     auto process = copy_process(parent);
     if (!process)
         return -1;
+    {
+        // The parent's writable pages are read-only now, drop the writable
+        // entries of all of its threads. Not under process_list_lock, the
+        // shootdown waits for other CPUs.
+        memory::tlb::batch shootdown(((mm_info_t *)parent->mm_info)->paging());
+        shootdown.add_all();
+    }
 
     if (process->resource.clone_fork_bindings(parent->resource) != NA_STATUS_OK)
     {
@@ -1121,6 +1153,7 @@ int fork()
     thd->user_stack_top = current_thread->user_stack_top;
     thd->user_stack_bottom = current_thread->user_stack_bottom;
     thd->tcb = current_thread->tcb;
+    thd->nice = current_thread->pi_boosted ? current_thread->pi_base_nice : current_thread->nice;
 
     regs_t *regs = memory::New<regs_t>(memory::KernelCommonAllocatorV);
     arch::task::get_syscall_regs(*regs);
@@ -1129,7 +1162,6 @@ int fork()
     arch::task::create_thread(thd, (void *)fork_start_func, reinterpret_cast<u64>(regs), 0, 0, 0);
 
     paging.map_kernel_space();
-    paging.load();
 
     if (current()->attributes & thread_attributes::real_time)
     {
@@ -1205,7 +1237,8 @@ void do_sleep(const timeclock::time &time)
     if (us != 0)
     {
         scheduler::update_state(current(), thread_state::stop);
-        (void)timer::schedule_after(us, timer::timer_handler::bind<&thread_t::wake_from_sleep>(*current()));
+        auto *thd = current();
+        timer::arm_after(thd->sleep_timer, us, timer::timer_handler::bind<&thread_t::wake_from_sleep>(*thd));
     }
     else
     {
@@ -1244,7 +1277,6 @@ void exit_process_thread(process_t *process)
         if (services)
             services->cleanup_owner(process->pid);
         process->resource.clear();
-        naos::ipc::collect_orphaned_channels();
         process->attributes |= process_attributes::no_thread;
         if (process == get_init_process())
         {
@@ -2162,15 +2194,33 @@ thread_t *find_tid(process_t *process, thread_id tid)
     return nullptr;
 }
 
+bool visit_tid(process_t *process, thread_id tid, freelibcxx::function_ref<void(thread_t *)> fn)
+{
+    uctx::RawSpinLockUninterruptibleContext icu(process->thread_list_lock);
+    auto &list = *(thread_list_t *)process->thread_list;
+    for (auto thd : list)
+    {
+        if (thd->tid == tid)
+        {
+            fn(thd);
+            return true;
+        }
+    }
+    return false;
+}
+
 void switch_thread(thread_t *old, thread_t *new_task)
 {
     kassert(!arch::idt::is_enable(), "expect failed");
 
     cpu::current().set_task(new_task);
 
-    if (old->process != new_task->process && old->process->mm_info != new_task->process->mm_info)
+    // Kernel threads only touch kernel space, they keep the user page table
+    // loaded before them and the TLB entries with it.
+    auto *mm_info = (mm_info_t *)new_task->process->mm_info;
+    if (mm_info != memory::kernel_vm_info && !mm_info->paging().loaded_here())
     {
-        ((mm_info_t *)new_task->process->mm_info)->paging().load();
+        mm_info->paging().load();
     }
 
     arch::task::update_fs(new_task);
@@ -2180,6 +2230,7 @@ void switch_thread(thread_t *old, thread_t *new_task)
 void set_cpu_mask(thread_t *thd, cpu_mask_t mask)
 {
     thd->cpumask = mask;
+    thd->numa_node = memory::numa::node_of_cpu_mask(mask.mask);
     thd->attributes |= thread_attributes::need_schedule;
 }
 
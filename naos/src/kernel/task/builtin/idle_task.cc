@@ -2,6 +2,7 @@
 #include "kernel/arch/idt.hpp"
 #include "kernel/fs/vfs/file.hpp"
 #include "kernel/fs/vfs/vfs.hpp"
+#include "kernel/ipc/channel.hpp"
 #include "kernel/ipc/invocation.hpp"
 #include "kernel/scheduler.hpp"
 #include "kernel/smp.hpp"
@@ -58,6 +59,7 @@ void main(void *arg)
         is_init = true;
         task::create_kernel_process(builtin::input::main, 0, create_thread_flags::real_time_rr);
         naos::ipc::init_kernel_dispatch_worker();
+        naos::ipc::init_channel_reclaim_worker();
 
         auto file = fs::vfs::open("/bin/init", fs::vfs::global_root, fs::vfs::global_root,
                                   fs::mode::read | fs::mode::bin, fs::path_walk_flags::file);
@@ -445,13 +445,15 @@ freelibcxx::tuple<stand_term_char_t *, int, int> stand_terminal::previous_term_c
     return freelibcxx::make_tuple(nullptr, row, col);
 }
 
+timer::timer_entry flush_timer;
+
 void flush_terminal(timeclock::microsecond_t) noexcept
 {
     if (use_stand_terminal)
     {
         manager->flush_active_terminal();
     }
-    (void)timer::schedule_after(1000000 / 60, timer::timer_handler::bind<&flush_terminal>());
+    timer::arm_after(flush_timer, 1000000 / 60, timer::timer_handler::bind<&flush_terminal>());
 }
 
 terminal_manager::terminal_manager(int nums, const fb::framebuffer_backend &backend)
@@ -463,7 +465,7 @@ terminal_manager::terminal_manager(int nums, const fb::framebuffer_backend &back
         terms_.push_back(1000);
     }
     switch_term(0);
-    (void)timer::schedule_after(1000000 / 60, timer::timer_handler::bind<&flush_terminal>());
+    timer::arm_after(flush_timer, 1000000 / 60, timer::timer_handler::bind<&flush_terminal>());
 }
 
 bool terminal_manager::switch_term(int index)
@@ -476,16 +478,13 @@ bool terminal_manager::switch_term(int index)
     if (index == user_terminal_index)
     {
         framebuffer_user_enabled_state.store(true, std::memory_order_release);
-        timer::watcher_id watcher = timer::invalid_watcher_id;
         {
             uctx::RawSpinLockUninterruptibleContext icu(manager_lock_);
             pending_switch_ = -1;
             cur_ = index;
-            watcher = framebuffer_handoff_watcher_;
-            framebuffer_handoff_watcher_ = timer::invalid_watcher_id;
+            framebuffer_handoff_pending_ = false;
+            (void)timer::cancel(framebuffer_handoff_timer_);
         }
-        if (watcher != timer::invalid_watcher_id)
-            (void)timer::cancel(watcher);
         // The frontend may have been offline while the kernel term was
         // active.  Re-enabling is idempotent and is intentionally sent even
         // when the writer is already present.
@@ -508,35 +507,28 @@ bool terminal_manager::switch_term(int index)
         if (notify)
         {
             dev::input::publish_framebuffer_event(false);
-            const auto watcher = timer::schedule_after(
-                250'000, timer::timer_handler::bind<&terminal_manager::force_framebuffer_handoff>(*this));
-            bool keep_watcher = false;
+            // The handler takes the manager lock without the timer's, so the
+            // timer is armed and canceled under it
+            uctx::RawSpinLockUninterruptibleContext icu(manager_lock_);
+            if (pending_switch_ == index && !framebuffer_handoff_pending_)
             {
-                uctx::RawSpinLockUninterruptibleContext icu(manager_lock_);
-                if (pending_switch_ == index && framebuffer_handoff_watcher_ == timer::invalid_watcher_id)
-                {
-                    framebuffer_handoff_watcher_ = watcher;
-                    keep_watcher = true;
-                }
+                framebuffer_handoff_pending_ = true;
+                timer::arm_after(framebuffer_handoff_timer_, 250'000,
+                                 timer::timer_handler::bind<&terminal_manager::force_framebuffer_handoff>(*this));
             }
-            if (!keep_watcher)
-                (void)timer::cancel(watcher);
         }
         return true;
     }
 
-    timer::watcher_id watcher = timer::invalid_watcher_id;
     {
         uctx::RawSpinLockUninterruptibleContext icu(manager_lock_);
         pending_switch_ = -1;
-        watcher = framebuffer_handoff_watcher_;
-        framebuffer_handoff_watcher_ = timer::invalid_watcher_id;
+        framebuffer_handoff_pending_ = false;
+        (void)timer::cancel(framebuffer_handoff_timer_);
         if (cur_ >= 0 && cur_ != index)
             terms_[cur_].detach_backend();
         cur_ = index;
     }
-    if (watcher != timer::invalid_watcher_id)
-        (void)timer::cancel(watcher);
     if (index == kernel_console_index)
     {
         reset_panic_term();
@@ -549,20 +541,17 @@ bool terminal_manager::switch_term(int index)
 void terminal_manager::framebuffer_writer_released()
 {
     int pending = -1;
-    timer::watcher_id watcher = timer::invalid_watcher_id;
     {
         uctx::RawSpinLockUninterruptibleContext icu(manager_lock_);
         pending = pending_switch_;
-        watcher = framebuffer_handoff_watcher_;
-        framebuffer_handoff_watcher_ = timer::invalid_watcher_id;
+        framebuffer_handoff_pending_ = false;
+        (void)timer::cancel(framebuffer_handoff_timer_);
         if (pending == kernel_console_index)
         {
             pending_switch_ = -1;
             cur_ = kernel_console_index;
         }
     }
-    if (watcher != timer::invalid_watcher_id)
-        (void)timer::cancel(watcher);
     if (pending == kernel_console_index)
     {
         reset_panic_term();
@@ -577,8 +566,8 @@ void terminal_manager::force_framebuffer_handoff(timeclock::microsecond_t expira
     bool pending = false;
     {
         uctx::RawSpinLockUninterruptibleContext icu(manager_lock_);
-        pending = pending_switch_ == kernel_console_index && framebuffer_handoff_watcher_ != timer::invalid_watcher_id;
-        framebuffer_handoff_watcher_ = timer::invalid_watcher_id;
+        pending = pending_switch_ == kernel_console_index && framebuffer_handoff_pending_;
+        framebuffer_handoff_pending_ = false;
     }
     if (pending && framebuffer_user_writer.load(std::memory_order_acquire))
         (void)dev::framebuffer::force_user_offline();
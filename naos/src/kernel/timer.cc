@@ -1,8 +1,7 @@
 #include "kernel/timer.hpp"
-#include "freelibcxx/linked_list.hpp"
-#include "freelibcxx/skip_list.hpp"
 #include "freelibcxx/vector.hpp"
 #include "kernel/arch/acpipm.hpp"
+#include "kernel/arch/cpu_info.hpp"
 #include "kernel/arch/hpet.hpp"
 #include "kernel/arch/io_apic.hpp"
 #include "kernel/arch/local_apic.hpp"
@@ -16,7 +15,6 @@
 #include "kernel/cpu.hpp"
 #include "kernel/irq.hpp"
 #include "kernel/lock.hpp"
-#include "kernel/mm/list_node_cache.hpp"
 #include "kernel/trace.hpp"
 #include "kernel/ucontext.hpp"
 
@@ -24,46 +22,23 @@ namespace timer
 {
 
 using clock_source_array_t = freelibcxx::vector<timeclock::clock_source *>;
+using wheel_t = util::timer_wheel<timer_entry, &timer_entry::node>;
 
-struct watcher_t
-{
-    enum class state : u8
-    {
-        enabled,
-        canceled,
-    };
-
-    watcher_id id;
-    /// target time microsecond
-    u64 expires;
-    timer_handler handler;
-    state current_state = state::enabled;
-
-    watcher_t(watcher_id id, u64 expires, timer_handler handler)
-        : id(id)
-        , expires(expires)
-        , handler(handler)
-    {
-    }
+/// The wheel ticks every 128us, and a timer fires at the first tick not
+/// before its deadline
+constexpr u64 wheel_tick_shift = 7;
 
-    bool operator==(const watcher_t &w) { return id == w.id; }
-    bool operator<(const watcher_t &w) { return expires < w.expires; }
-    bool is_enabled() const { return current_state == state::enabled; }
-};
-
-using watcher_list_t = freelibcxx::linked_list<watcher_t>;
-using tick_list_t = freelibcxx::skip_list<watcher_t>;
+lock::lock_class timer_lock_class("timer_wheel");
 
 struct cpu_timer_t
 {
-    watcher_list_t watcher_list;
-    tick_list_t tick_list;
-
-    cpu_timer_t()
-        : watcher_list(memory::KernelCommonAllocatorV)
-        , tick_list(memory::KernelCommonAllocatorV)
-    {
-    }
+    /// Other CPUs take it to cancel timers armed here
+    lock::spinlock_t lock{timer_lock_class};
+    wheel_t wheel;
+    /// The clock event fires only at the deadlines armed below
+    bool one_shot = false;
+    /// The deadline the clock event is armed for, 0 if none
+    timeclock::microsecond_t armed = 0;
 };
 
 timeclock::clock_source *get_clock_source()
@@ -84,40 +59,80 @@ timeclock::clock_event *get_clock_event()
     return nullptr;
 }
 
-constexpr u64 tick_us = 1000;
+cpu_timer_t &local_timer() { return *reinterpret_cast<cpu_timer_t *>(cpu::current().get_timer_queue()); }
 
-void on_tick(u64 vector) noexcept
+/// Program the clock event for \p deadline, unless it already fires earlier.
+/// Interrupts must be off.
+void program(cpu_timer_t &cpu_timer, timeclock::microsecond_t deadline)
+{
+    if (!cpu_timer.one_shot || (cpu_timer.armed != 0 && cpu_timer.armed <= deadline))
+        return;
+    cpu_timer.armed = deadline;
+    auto now = get_clock_source()->current();
+    get_clock_event()->one_shot(deadline > now ? deadline - now : 1);
+}
+
+/// Program the clock event for the next work of the wheel, if any. The wheel
+/// lock must be held.
+void program_next(cpu_timer_t &cpu_timer)
 {
-    auto &cpu_timer = *reinterpret_cast<cpu_timer_t *>(cpu::current().get_timer_queue());
-    u64 us = get_clock_source()->current();
+    u64 next = cpu_timer.wheel.next_tick();
+    if (next != wheel_t::no_tick)
+        program(cpu_timer, next << wheel_tick_shift);
+}
 
+/// Take \p entry off the wheel it is armed on. Interrupts must be off.
+bool detach(timer_entry &entry)
+{
+    for (;;)
     {
-        // add to tick list
-        uctx::UninterruptibleContext icu;
-        for (auto &ws : cpu_timer.watcher_list)
+        auto *base = entry.base.load(std::memory_order_acquire);
+        if (base == nullptr)
+            return false;
+        uctx::RawSpinLockContext guard(base->lock);
+        // It may have fired or moved before the lock was taken
+        if (entry.base.load(std::memory_order_relaxed) == base)
         {
-            if (likely(ws.is_enabled()))
-            {
-                cpu_timer.tick_list.insert(ws);
-            }
+            base->wheel.erase(&entry);
+            entry.base.store(nullptr, std::memory_order_relaxed);
+            return true;
         }
-        cpu_timer.watcher_list.clear();
     }
-    uctx::UninterruptibleController icc;
+}
+
+/// Arm a detached \p entry on this CPU. Interrupts must be off.
+void insert(timer_entry &entry, timeclock::microsecond_t deadline, timer_handler handler)
+{
+    auto &cpu_timer = local_timer();
+    uctx::RawSpinLockContext guard(cpu_timer.lock);
+    entry.expires = deadline;
+    entry.handler = handler;
+    const u64 tick = (deadline + (1UL << wheel_tick_shift) - 1) >> wheel_tick_shift;
+    cpu_timer.wheel.insert(&entry, tick);
+    entry.base.store(&cpu_timer, std::memory_order_release);
+    program(cpu_timer, tick << wheel_tick_shift);
+}
+
+void on_tick(u64 vector) noexcept
+{
+    auto &cpu_timer = local_timer();
+    const u64 tick = get_clock_source()->current() >> wheel_tick_shift;
+
+    uctx::RawSpinLockUninterruptibleController icc(cpu_timer.lock);
     icc.begin();
-    auto it = cpu_timer.tick_list.begin();
-    for (; it != cpu_timer.tick_list.end() && it->expires <= us + tick_us / 2;)
+    // The one-shot deadline has fired
+    cpu_timer.armed = 0;
+    while (timer_entry *entry = cpu_timer.wheel.pop_expired(tick))
     {
-        if (likely(it->is_enabled()))
-        {
-            auto handler = it->handler;
-            auto exp = it->expires;
-            icc.end();
-            handler(exp);
-            icc.begin();
-        }
-        it = cpu_timer.tick_list.remove(it);
+        auto handler = entry->handler;
+        auto expires = entry->expires;
+        // The entry is its owner's again, it is not touched after this
+        entry->base.store(nullptr, std::memory_order_release);
+        icc.end();
+        handler(expires);
+        icc.begin();
     }
+    program_next(cpu_timer);
     icc.end();
 }
 
@@ -152,18 +167,20 @@ bool check_source(timeclock::clock_source *cs)
 
 lock::spinlock_t timer_spinlock;
 timeclock::clock_source *global_source = nullptr;
-std::atomic_uint64_t next_watcher_id{1};
 irq::registration *tick_registration;
 void init()
 {
     timer_spinlock.lock();
     clock_source_array_t clock_sources(memory::KernelCommonAllocatorV);
+    cpu_timer_t *cpu_timer;
+    arch::TSC::clock_source *tsc;
+    timeclock::clock_source *local_apic;
     {
         bool enable_pit = cmdline::get_bool("pit", true);
         bool enable_hpet = cmdline::get_bool("hpet", false);
         bool enable_acpipm = cmdline::get_bool("acpipm", true);
 
-        auto cpu_timer = memory::New<cpu_timer_t>(memory::KernelCommonAllocatorV);
+        cpu_timer = memory::New<cpu_timer_t>(memory::KernelCommonAllocatorV);
         cpu::current().set_timer_queue(cpu_timer);
         arch::device::PIT::disable_all();
 
@@ -214,7 +231,6 @@ void init()
         {
             trace::info("Use ", global_source->name(), " as timer");
         }
-        timeclock::clock_source *tsc, *local_apic;
         {
             uctx::UninterruptibleContext ctx;
             tsc = arch::TSC::make_clock();
@@ -250,6 +266,24 @@ void init()
     ev->resume();
     get_clock_source()->reinit();
 
+    // The local APIC clock source counts periodic interrupts, so the event
+    // can only go one-shot when the TSC keeps time.
+    if (tsc != nullptr && cmdline::get_bool("nohz", true))
+    {
+        auto lapic_ev = static_cast<arch::APIC::clock_event *>(ev);
+        if (arch::cpu_info::has_feature(arch::cpu_info::feature::tsc_deadline))
+        {
+            lapic_ev->use_tsc_deadline(tsc->frequency());
+        }
+        uctx::RawSpinLockUninterruptibleContext icu(cpu_timer->lock);
+        cpu_timer->one_shot = lapic_ev->set_one_shot();
+        program_next(*cpu_timer);
+        if (cpu::current().is_bsp())
+        {
+            trace::info("Timer is tickless", lapic_ev->tsc_deadline() ? " with TSC deadline" : "");
+        }
+    }
+
     if (cpu::current().is_bsp())
     {
         timeclock::init();
@@ -271,6 +305,16 @@ timeclock::microsecond_t get_high_resolution_time()
     return 0;
 }
 
+timeclock::nanosecond_t get_high_resolution_time_ns()
+{
+    auto source = get_clock_source();
+    if (likely(source != nullptr))
+    {
+        return source->current_ns();
+    }
+    return 0;
+}
+
 void busywait(timeclock::microsecond_t duration)
 {
     timeclock::microsecond_t t = get_high_resolution_time() + duration;
@@ -284,55 +328,27 @@ void busywait(timeclock::microsecond_t duration)
     }
 }
 
-watcher_id schedule_after(timeclock::microsecond_t duration, timer_handler handler)
+bool arm_at(timer_entry &entry, timeclock::microsecond_t deadline, timer_handler handler)
 {
-    auto &cpu_timer = *reinterpret_cast<cpu_timer_t *>(cpu::current().get_timer_queue());
-    const auto id = next_watcher_id.fetch_add(1);
-    cpu_timer.watcher_list.push_back(watcher_t(id, duration + get_high_resolution_time(), handler));
-    return id;
+    uctx::UninterruptibleContext icu;
+    (void)detach(entry);
+    if (deadline <= get_high_resolution_time())
+        return false;
+    insert(entry, deadline, handler);
+    return true;
 }
 
-watcher_id schedule_at(timeclock::microsecond_t expires_time_point, timer_handler handler)
+void arm_after(timer_entry &entry, timeclock::microsecond_t duration, timer_handler handler)
 {
-    auto &cpu_timer = *reinterpret_cast<cpu_timer_t *>(cpu::current().get_timer_queue());
-
-    if (get_high_resolution_time() < expires_time_point)
-    {
-        const auto id = next_watcher_id.fetch_add(1);
-        cpu_timer.watcher_list.push_back(watcher_t(id, expires_time_point, handler));
-        return id;
-    }
-    return invalid_watcher_id;
+    uctx::UninterruptibleContext icu;
+    (void)detach(entry);
+    insert(entry, get_high_resolution_time() + duration, handler);
 }
 
-bool cancel(watcher_id id)
+bool cancel(timer_entry &entry)
 {
-    if (id == invalid_watcher_id)
-        return false;
-    auto &cpu_timer = *reinterpret_cast<cpu_timer_t *>(cpu::current().get_timer_queue());
-
-    for (auto it = cpu_timer.watcher_list.begin(); it != cpu_timer.watcher_list.end(); ++it)
-    {
-        if (it->id == id)
-        {
-            cpu_timer.watcher_list.remove(it);
-            return true;
-        }
-    }
     uctx::UninterruptibleContext icu;
-    for (auto it = cpu_timer.tick_list.begin(); it != cpu_timer.tick_list.end();)
-    {
-        if (it->id == id)
-        {
-            it->current_state = watcher_t::state::canceled;
-            return true;
-        }
-        else
-        {
-            ++it;
-        }
-    }
-    return false;
+    return detach(entry);
 }
 
 } // namespace timer
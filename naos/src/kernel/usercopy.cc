@@ -58,6 +58,53 @@ na_status_t copy_to(u64 destination, const void *source, u64 size)
     return copy_bytes(reinterpret_cast<void *>(destination), source, size);
 }
 
+na_status_t compare_exchange(u64 address, u32 &expected, u32 desired)
+{
+    if ((address & (sizeof(u32) - 1)) != 0 ||
+        !is_user_space_range(reinterpret_cast<const void *>(address), sizeof(u32)))
+        return NA_STATUS_FAULT;
+    auto *thread = task::current();
+    if (thread == nullptr)
+        return NA_STATUS_FAULT;
+
+    // Recovered like copy_bytes, a fault resumes at exchange_fault
+    u32 value = expected;
+    thread->usercopy_active = true;
+    thread->usercopy_resume = reinterpret_cast<u64>(&&exchange_fault);
+    asm volatile("lock cmpxchgl %2, %1"
+                 : "+a"(value), "+m"(*reinterpret_cast<volatile u32 *>(address))
+                 : "r"(desired)
+                 : "memory");
+    thread->usercopy_active = false;
+    thread->usercopy_resume = 0;
+    expected = value;
+    return NA_STATUS_OK;
+
+exchange_fault:
+    thread->usercopy_active = false;
+    thread->usercopy_resume = 0;
+    return NA_STATUS_FAULT;
+}
+
+na_status_t compare_exchange_no_fault(u64 address, u32 &expected, u32 desired)
+{
+    auto *thread = task::current();
+    if (thread == nullptr)
+        return NA_STATUS_FAULT;
+    thread->usercopy_no_fault = true;
+    const auto status = compare_exchange(address, expected, desired);
+    thread->usercopy_no_fault = false;
+    return status;
+}
+
+bool recover_no_fault(regs_t *regs)
+{
+    auto *thread = task::current();
+    if (thread == nullptr || !thread->usercopy_no_fault)
+        return false;
+    return recover_page_fault(regs);
+}
+
 bool recover_page_fault(regs_t *regs)
 {
     auto *thread = task::current();
@@ -0,0 +1,174 @@
+#include "freelibcxx/string.hpp"
+#include "nanobox.hpp"
+#include <naos/libnao.hpp>
+#include <naos/syscall.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace
+{
+/// Private to this benchmark, never handed to another process
+constexpr uint64_t echo_scope = 0x63616c6c62656e63ULL;
+constexpr uint64_t echo_method = 1;
+constexpr uint64_t message_bytes = 64;
+
+uint64_t now_ns()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+bool create_echo_endpoints(na_handle_t &client, na_handle_t &server)
+{
+    na_protocol_descriptor_t descriptor{};
+    descriptor.struct_size = sizeof(descriptor);
+    const char name[] = "nanobox-callbench";
+    memcpy(descriptor.uuid.bytes, name, sizeof(descriptor.uuid.bytes));
+    descriptor.scope = echo_scope;
+    descriptor.revision = 1;
+    descriptor.protocol_rights = NA_PROTOCOL_RIGHT_INVOKE;
+    descriptor.method_count = 1;
+    descriptor.max_request_bytes = message_bytes;
+    descriptor.max_response_bytes = message_bytes;
+    descriptor.method_bitmap[0] = 1ULL << (echo_method - 1);
+    descriptor.method_rights[echo_method - 1] = NA_PROTOCOL_RIGHT_INVOKE;
+
+    na_handle_t handle = NA_HANDLE_INVALID;
+    if (_na_protocol_descriptor_create(&descriptor, &handle) != NA_STATUS_OK)
+        return false;
+    const auto status = _na_protocol_endpoint_create(handle, nullptr, &client, &server);
+    (void)_na_handle_close(handle);
+    return status == NA_STATUS_OK;
+}
+
+/// Reply to every request with its own bytes until the client end closes
+void serve_echo(na_handle_t server)
+{
+    uint8_t bytes[message_bytes];
+    for (;;)
+    {
+        na_wait_item_t item{server, NA_SIGNAL_READABLE | NA_SIGNAL_PEER_CLOSED, 0};
+        if (nao::event_loop::wait(&item, 1) != NA_STATUS_OK)
+            return;
+        if ((item.observed & NA_SIGNAL_READABLE) == 0)
+            return;
+        na_channel_receive_frame_t frame{};
+        frame.struct_size = sizeof(frame);
+        frame.bytes = reinterpret_cast<uint64_t>(bytes);
+        frame.byte_capacity = sizeof(bytes);
+        if (_na_channel_receive(server, &frame) != NA_STATUS_OK)
+            continue;
+        na_reply_frame_t reply{};
+        reply.struct_size = sizeof(reply);
+        reply.bytes = reinterpret_cast<uint64_t>(bytes);
+        reply.byte_count = frame.actual_bytes;
+        (void)_na_responder_reply(frame.responder, &reply);
+    }
+}
+
+void init_frames(na_submit_frame_t &submit, na_result_frame_t &result, uint8_t *request, uint8_t *response)
+{
+    submit = {};
+    submit.struct_size = sizeof(submit);
+    submit.method_id = echo_method;
+    submit.request = reinterpret_cast<uint64_t>(request);
+    submit.request_bytes = message_bytes;
+    result = {};
+    result.struct_size = sizeof(result);
+    result.bytes = reinterpret_cast<uint64_t>(response);
+    result.byte_capacity = message_bytes;
+}
+
+/// Average round trip in nanoseconds, or 0 when a call fails
+uint64_t run_async(na_handle_t client, int rounds)
+{
+    uint8_t request[message_bytes]{};
+    uint8_t response[message_bytes]{};
+    na_submit_frame_t submit;
+    na_result_frame_t result;
+    const auto start = now_ns();
+    for (int i = 0; i < rounds; i++)
+    {
+        init_frames(submit, result, request, response);
+        na_handle_t invocation = NA_HANDLE_INVALID;
+        if (nao::event_loop::submit(client, submit, invocation) != NA_STATUS_OK)
+            return 0;
+        auto status = nao::event_loop::wait_invocation(invocation);
+        if (status == NA_STATUS_OK)
+            status = nao::event_loop::take(invocation, result);
+        (void)_na_handle_close(invocation);
+        if (status != NA_STATUS_OK || result.execution_outcome != NA_EXECUTION_NONE)
+            return 0;
+    }
+    return (now_ns() - start) / rounds;
+}
+
+uint64_t run_call(na_handle_t client, int rounds)
+{
+    uint8_t request[message_bytes]{};
+    uint8_t response[message_bytes]{};
+    na_submit_frame_t submit;
+    na_result_frame_t result;
+    const auto start = now_ns();
+    for (int i = 0; i < rounds; i++)
+    {
+        init_frames(submit, result, request, response);
+        if (nao::event_loop::call(client, submit, result) != NA_STATUS_OK ||
+            result.execution_outcome != NA_EXECUTION_NONE)
+            return 0;
+    }
+    return (now_ns() - start) / rounds;
+}
+} // namespace
+
+int callbench(int argc, char **argv)
+{
+    int rounds = 10000;
+    if (argc > 1)
+        rounds = freelibcxx::const_string_view(argv[1]).to_int().value_or(10000);
+    if (rounds <= 0)
+        rounds = 1;
+
+    na_handle_t client = NA_HANDLE_INVALID;
+    na_handle_t server = NA_HANDLE_INVALID;
+    if (!create_echo_endpoints(client, server))
+    {
+        printf("callbench: can't create echo endpoints\n");
+        return 1;
+    }
+
+    int pid = fork();
+    if (pid < 0)
+    {
+        printf("callbench: fork failed\n");
+        return 1;
+    }
+    if (pid == 0)
+    {
+        // The server end is not inherited, the parent answers
+        const auto async_ns = run_async(client, rounds);
+        const auto call_ns = run_call(client, rounds);
+        if (async_ns == 0 || call_ns == 0)
+        {
+            printf("callbench: echo call failed\n");
+            exit(1);
+        }
+        printf("callbench: %d round trips of %lu bytes\n", rounds, (unsigned long)message_bytes);
+        printf("  submit+wait+take %lu ns\n", (unsigned long)async_ns);
+        printf("  call             %lu ns\n", (unsigned long)call_ns);
+        exit(0);
+    }
+
+    // Only the child holds the client end, so its exit closes the endpoint
+    (void)_na_handle_close(client);
+    serve_echo(server);
+    (void)_na_handle_close(server);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
@@ -24,6 +24,7 @@ entry(touch);
 entry(rm);
 entry(env);
 entry(simd_test);
+entry(callbench);
 
 #define entry_p(name)                                                                                                  \
     {                                                                                                                  \
@@ -36,7 +37,7 @@ struct
     entry_function *fn;
 } static_commands[] = {
     entry_p(nsh),   entry_p(cat), entry_p(ls),  entry_p(mkdir),     entry_p(rmdir),
-    entry_p(touch), entry_p(rm),  entry_p(env), entry_p(simd_test),
+    entry_p(touch), entry_p(rm),  entry_p(env), entry_p(simd_test), entry_p(callbench),
 };
 
 using namespace freelibcxx;
@@ -0,0 +1,44 @@
+#include "catch2_compat.hpp"
+#include "kernel/mm/big_page.hpp"
+
+#include <cstdint>
+
+namespace
+{
+using namespace memory;
+
+constexpr std::uint64_t mib = 0x100000;
+
+void test_fits_needs_the_whole_big_page()
+{
+    REQUIRE(big_page::fits(0, 4 * mib, 0));
+    REQUIRE(big_page::fits(0, 4 * mib, 3 * mib));
+    REQUIRE(big_page::fits(2 * mib, 4 * mib, 2 * mib + 0x1000));
+    REQUIRE_FALSE(big_page::fits(0, 3 * mib, 2 * mib));
+    REQUIRE_FALSE(big_page::fits(1 * mib, 4 * mib, 1 * mib));
+    REQUIRE_FALSE(big_page::fits(0x1000, 2 * mib + 0x1000, 0x2000));
+}
+
+void test_inner_span_of_unaligned_ranges()
+{
+    auto whole = big_page::inner(2 * mib, 8 * mib);
+    REQUIRE(whole.first == 2 * mib);
+    REQUIRE(whole.last == 8 * mib);
+
+    auto trimmed = big_page::inner(1 * mib, 7 * mib);
+    REQUIRE(trimmed.first == 2 * mib);
+    REQUIRE(trimmed.last == 6 * mib);
+
+    auto none = big_page::inner(1 * mib, 3 * mib);
+    REQUIRE(none.first == none.last);
+
+    auto top = big_page::inner(UINT64_MAX - 3 * mib, UINT64_MAX);
+    REQUIRE(top.first == top.last);
+}
+} // namespace
+
+TEST_CASE("big page ranges", "[mm][paging]")
+{
+    test_fits_needs_the_whole_big_page();
+    test_inner_span_of_unaligned_ranges();
+}
@@ -0,0 +1,97 @@
+#include "catch2_compat.hpp"
+#include "kernel/schedulers/cfs_weight.hpp"
+
+#include <cstdint>
+
+namespace
+{
+namespace cfs = task::scheduler::cfs;
+
+constexpr std::uint64_t tick_ns = 5'000'000;
+
+void test_weights()
+{
+    REQUIRE(cfs::weight_of(0) == cfs::nice_0_weight);
+    REQUIRE(cfs::weight_of(-20) == 88761);
+    REQUIRE(cfs::weight_of(19) == 15);
+    REQUIRE(cfs::weight_of(-100) == cfs::weight_of(cfs::nice_min));
+    REQUIRE(cfs::weight_of(100) == cfs::weight_of(cfs::nice_max));
+    for (std::int64_t nice = cfs::nice_min; nice < cfs::nice_max; nice++)
+    {
+        REQUIRE(cfs::weight_of(nice) > cfs::weight_of(nice + 1));
+    }
+    REQUIRE(cfs::calc_delta(tick_ns, cfs::nice_0_weight) == static_cast<std::int64_t>(tick_ns));
+    REQUIRE(cfs::calc_delta(tick_ns, cfs::weight_of(5)) > static_cast<std::int64_t>(tick_ns));
+}
+
+/// Two busy threads on one CPU share it in proportion to their weights.
+void test_busy_threads_share_by_weight()
+{
+    const std::int64_t nices[] = {0, 5};
+    std::int64_t vtime[] = {0, 0};
+    std::uint64_t ran[] = {0, 0};
+    for (int tick = 0; tick < 10000; tick++)
+    {
+        int next = vtime[0] <= vtime[1] ? 0 : 1;
+        vtime[next] += cfs::calc_delta(tick_ns, cfs::weight_of(nices[next]));
+        ran[next]++;
+    }
+    const double share = static_cast<double>(ran[0]) / static_cast<double>(ran[0] + ran[1]);
+    const double expected = static_cast<double>(cfs::weight_of(0)) / (cfs::weight_of(0) + cfs::weight_of(5));
+    REQUIRE(share > expected - 0.01);
+    REQUIRE(share < expected + 0.01);
+}
+
+void test_placement()
+{
+    const std::int64_t credit = 2'000'000;
+    // A long sleeper runs soon but cannot bank its sleep
+    REQUIRE(cfs::place_woken(0, 100'000'000, credit) == 100'000'000 - credit);
+    // A thread that ran ahead keeps its lead
+    REQUIRE(cfs::place_woken(120'000'000, 100'000'000, credit) == 120'000'000);
+
+    // A migrated thread keeps its lag relative to the new queue
+    REQUIRE(cfs::place_migrated(1'000'000, 5'000'000'000, credit) == 5'001'000'000);
+    REQUIRE(cfs::place_migrated(-1'000'000, 5'000'000'000, credit) == 4'999'000'000);
+    // It does not jump the whole new queue
+    REQUIRE(cfs::place_migrated(-7'000'000'000, 5'000'000'000, credit) == 5'000'000'000 - credit);
+}
+
+void test_min_vruntime_only_advances()
+{
+    REQUIRE(cfs::advance_min_vruntime(100, true, 300, true, 200) == 200);
+    REQUIRE(cfs::advance_min_vruntime(100, true, 300, false, 0) == 300);
+    REQUIRE(cfs::advance_min_vruntime(100, false, 0, true, 50) == 100);
+    REQUIRE(cfs::advance_min_vruntime(100, false, 0, false, 0) == 100);
+}
+
+void test_wakeup_preemption()
+{
+    const std::uint64_t granularity = 1'000'000;
+    REQUIRE(cfs::wakeup_preempt(10'000'000, 8'000'000, granularity, cfs::weight_of(0)));
+    REQUIRE_FALSE(cfs::wakeup_preempt(10'000'000, 9'500'000, granularity, cfs::weight_of(0)));
+    // A heavier woken thread preempts sooner, a lighter one later
+    REQUIRE(cfs::wakeup_preempt(10'000'000, 9'500'000, granularity, cfs::weight_of(-5)));
+    REQUIRE_FALSE(cfs::wakeup_preempt(10'000'000, 8'000'000, granularity, cfs::weight_of(5)));
+}
+
+void test_buddy_eligibility()
+{
+    const std::uint64_t granularity = 1'000'000;
+    REQUIRE(cfs::buddy_eligible(8'000'000, 9'000'000, granularity, cfs::weight_of(0)));
+    REQUIRE(cfs::buddy_eligible(10'000'000, 9'000'000, granularity, cfs::weight_of(0)));
+    REQUIRE_FALSE(cfs::buddy_eligible(10'500'000, 9'000'000, granularity, cfs::weight_of(0)));
+    // The granularity is measured at the buddy's weight
+    REQUIRE_FALSE(cfs::buddy_eligible(10'000'000, 9'000'000, granularity, cfs::weight_of(-5)));
+}
+} // namespace
+
+TEST_CASE("cfs weights and placement", "[scheduler]")
+{
+    test_weights();
+    test_busy_threads_share_by_weight();
+    test_placement();
+    test_min_vruntime_only_advances();
+    test_wakeup_preemption();
+    test_buddy_eligibility();
+}
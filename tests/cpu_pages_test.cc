@@ -0,0 +1,118 @@
+#include "catch2_compat.hpp"
+#include "kernel/mm/cpu_pages.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace
+{
+using memory::cpu_pages;
+using memory::page;
+using memory::page_list;
+
+/// Mirror zone::cpu_alloc/cpu_free for order 0 over an unbounded buddy,
+/// counting how often the zone lock would be taken.
+struct model
+{
+    page_list list;
+    std::vector<page> pool = std::vector<page>(4096);
+    std::size_t next = 0;
+    std::uint64_t lock_rounds = 0;
+    std::uint64_t buddy_pages = 0;
+
+    page *alloc()
+    {
+        if (list.size() == 0)
+        {
+            lock_rounds++;
+            for (std::uint64_t i = 0; i < cpu_pages::batch(0); i++)
+                list.push(&pool[next++]);
+        }
+        return list.pop();
+    }
+
+    void free(page *p)
+    {
+        list.push(p);
+        if (list.size() <= cpu_pages::high(0))
+            return;
+        lock_rounds++;
+        for (std::uint64_t i = 0; i < cpu_pages::batch(0); i++)
+        {
+            list.pop();
+            buddy_pages++;
+        }
+    }
+};
+
+void test_list_is_lifo()
+{
+    page a;
+    page b;
+    page_list list;
+    REQUIRE(list.pop() == nullptr);
+    list.push(&a);
+    list.push(&b);
+    REQUIRE(list.size() == 2);
+    REQUIRE(list.pop() == &b);
+    REQUIRE(list.pop() == &a);
+    REQUIRE(list.pop() == nullptr);
+    REQUIRE(list.size() == 0);
+}
+
+void test_cached_pages_counts_orders()
+{
+    page blocks[3];
+    cpu_pages cache;
+    cache.lists[0].push(&blocks[0]);
+    cache.lists[2].push(&blocks[1]);
+    cache.lists[3].push(&blocks[2]);
+    REQUIRE(cache.cached_pages() == 1 + 4 + 8);
+}
+
+void test_orders()
+{
+    REQUIRE(memory::page_order(1) == 0);
+    REQUIRE(memory::page_order(2) == 1);
+    REQUIRE(memory::page_order(5) == 3);
+    REQUIRE(memory::page_order(16) == 4);
+    for (int order = 0; order < cpu_pages::orders; order++)
+    {
+        REQUIRE(cpu_pages::batch(order) > 0);
+        REQUIRE(cpu_pages::batch(order) < cpu_pages::high(order));
+    }
+}
+
+/// Single-page traffic takes the zone lock once per batch, not per page,
+/// and the cache never holds more than its high watermark.
+void test_lock_rounds_are_batched()
+{
+    model m;
+    std::vector<page *> live;
+    for (int round = 0; round < 100; round++)
+    {
+        for (int i = 0; i < 40; i++)
+            live.push_back(m.alloc());
+        for (page *p : live)
+            m.free(p);
+        live.clear();
+        REQUIRE(m.list.size() <= cpu_pages::high(0));
+    }
+    REQUIRE(m.lock_rounds <= 8);
+
+    for (int i = 0; i < 1000; i++)
+        live.push_back(m.alloc());
+    for (page *p : live)
+        m.free(p);
+    REQUIRE(m.lock_rounds <= 8 + 2 * 1000 / cpu_pages::batch(0) + 2);
+    REQUIRE(m.list.size() + m.buddy_pages == m.next);
+}
+} // namespace
+
+TEST_CASE("per-CPU page lists", "[mm][zone]")
+{
+    test_list_is_lifo();
+    test_cached_pages_counts_orders();
+    test_orders();
+    test_lock_rounds_are_batched();
+}
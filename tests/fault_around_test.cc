@@ -0,0 +1,62 @@
+#include "catch2_compat.hpp"
+#include "kernel/mm/fault_around.hpp"
+
+#include <cstdint>
+
+namespace
+{
+using memory::vm::fault_around;
+using memory::vm::fault_around_pages;
+
+constexpr std::uint64_t page = 0x1000;
+constexpr std::uint64_t window = fault_around_pages * page;
+
+void test_window_is_aligned_and_holds_the_fault()
+{
+    auto w = fault_around(0x400000, 0x800000, 0x400000 + 5 * page);
+    REQUIRE(w.first == 0x400000);
+    REQUIRE(w.last == 0x400000 + window);
+
+    w = fault_around(0x400000, 0x800000, 0x400000 + window + 3 * page);
+    REQUIRE(w.first == 0x400000 + window);
+    REQUIRE(w.last == 0x400000 + 2 * window);
+}
+
+void test_window_is_clipped_to_the_mapping()
+{
+    auto w = fault_around(0x401000, 0x403000, 0x402000);
+    REQUIRE(w.first == 0x401000);
+    REQUIRE(w.last == 0x403000);
+
+    w = fault_around(0x400000 + 3 * page, 0x400000 + window + 2 * page, 0x400000 + window);
+    REQUIRE(w.first == 0x400000 + window);
+    REQUIRE(w.last == 0x400000 + window + 2 * page);
+}
+
+/// A sequential scan of a mapping faults once per window.
+void test_scan_faults_once_per_window()
+{
+    const std::uint64_t start = 0x10000 + 7 * page;
+    const std::uint64_t end = start + 200 * page;
+    std::uint64_t mapped_to = start;
+    std::uint64_t faults = 0;
+    for (std::uint64_t p = start; p < end; p += page)
+    {
+        if (p < mapped_to)
+            continue;
+        auto w = fault_around(start, end, p);
+        REQUIRE(w.first <= p);
+        REQUIRE(w.last > p);
+        mapped_to = w.last;
+        faults++;
+    }
+    REQUIRE(faults <= 200 / fault_around_pages + 2);
+}
+} // namespace
+
+TEST_CASE("fault around windows", "[mm][vm]")
+{
+    test_window_is_aligned_and_holds_the_fault();
+    test_window_is_clipped_to_the_mapping();
+    test_scan_faults_once_per_window();
+}
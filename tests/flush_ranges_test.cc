@@ -0,0 +1,61 @@
+#include "catch2_compat.hpp"
+#include "kernel/mm/flush_ranges.hpp"
+
+#include <cstdint>
+
+namespace
+{
+using memory::tlb::flush_ranges;
+using memory::tlb::max_flush_ranges;
+
+constexpr std::uint64_t page = 0x1000;
+
+void test_adjacent_ranges_merge()
+{
+    flush_ranges r;
+    REQUIRE(r.empty());
+    r.add(0x10000, 2);
+    r.add(0x12000, 3);
+    r.add(0xF000, 1);
+    REQUIRE(r.count() == 1);
+    REQUIRE(r.at(0).start == 0xF000);
+    REQUIRE(r.at(0).pages == 6);
+
+    r.add(0x11000, 10);
+    REQUIRE(r.count() == 1);
+    REQUIRE(r.at(0).pages == (0x1B000 - 0xF000) / page);
+}
+
+void test_disjoint_ranges_are_kept_apart()
+{
+    flush_ranges r;
+    r.add(0x10000, 1);
+    r.add(0x20000, 1);
+    r.add(0x10000, 0);
+    REQUIRE(r.count() == 2);
+    REQUIRE_FALSE(r.full());
+}
+
+void test_too_many_ranges_flush_everything()
+{
+    flush_ranges r;
+    for (std::uint64_t i = 0; i < max_flush_ranges; i++)
+        r.add(i * 0x100000, 1);
+    REQUIRE_FALSE(r.full());
+    r.add(0x10000000, 1);
+    REQUIRE(r.full());
+    REQUIRE_FALSE(r.empty());
+
+    r.clear();
+    REQUIRE(r.empty());
+    r.add_all();
+    REQUIRE(r.full());
+}
+} // namespace
+
+TEST_CASE("tlb flush ranges", "[mm][tlb]")
+{
+    test_adjacent_ranges_merge();
+    test_disjoint_ranges_are_kept_apart();
+    test_too_many_ranges_flush_everything();
+}
@@ -0,0 +1,52 @@
+#include "catch2_compat.hpp"
+#include "kernel/util/futex_op.hpp"
+
+#include <cstdint>
+
+namespace
+{
+void test_operations()
+{
+    REQUIRE(util::futex_wake_op(NA_FUTEX_OP(NA_FUTEX_OP_SET, 7, NA_FUTEX_OP_CMP_EQ, 0)).apply(3) == 7);
+    REQUIRE(util::futex_wake_op(NA_FUTEX_OP(NA_FUTEX_OP_ADD, 1, NA_FUTEX_OP_CMP_EQ, 0)).apply(3) == 4);
+    REQUIRE(util::futex_wake_op(NA_FUTEX_OP(NA_FUTEX_OP_OR, 4, NA_FUTEX_OP_CMP_EQ, 0)).apply(3) == 7);
+    REQUIRE(util::futex_wake_op(NA_FUTEX_OP(NA_FUTEX_OP_ANDN, 1, NA_FUTEX_OP_CMP_EQ, 0)).apply(3) == 2);
+    REQUIRE(util::futex_wake_op(NA_FUTEX_OP(NA_FUTEX_OP_XOR, 1, NA_FUTEX_OP_CMP_EQ, 0)).apply(3) == 2);
+
+    // Operands are 12 bit signed
+    REQUIRE(util::futex_wake_op(NA_FUTEX_OP(NA_FUTEX_OP_ADD, -1, NA_FUTEX_OP_CMP_EQ, 0)).apply(3) == 2);
+    // 1 << oparg
+    const auto shift = NA_FUTEX_OP(NA_FUTEX_OP_OR | NA_FUTEX_OP_OPARG_SHIFT, 31, NA_FUTEX_OP_CMP_EQ, 0);
+    REQUIRE(util::futex_wake_op(shift).apply(1) == 0x80000001U);
+}
+
+void test_comparisons()
+{
+    const auto cmp = [](int cmp, int cmparg, std::uint32_t old) {
+        return util::futex_wake_op(NA_FUTEX_OP(NA_FUTEX_OP_SET, 0, cmp, cmparg)).compare(old);
+    };
+    REQUIRE(cmp(NA_FUTEX_OP_CMP_EQ, 1, 1));
+    REQUIRE_FALSE(cmp(NA_FUTEX_OP_CMP_NE, 1, 1));
+    REQUIRE(cmp(NA_FUTEX_OP_CMP_LT, 1, 0));
+    REQUIRE(cmp(NA_FUTEX_OP_CMP_LE, 1, 1));
+    REQUIRE_FALSE(cmp(NA_FUTEX_OP_CMP_GT, 1, 1));
+    REQUIRE(cmp(NA_FUTEX_OP_CMP_GE, 1, 2));
+    // The old value compares signed, as on Linux
+    REQUIRE(cmp(NA_FUTEX_OP_CMP_LT, 0, 0xFFFFFFFFU));
+    REQUIRE(cmp(NA_FUTEX_OP_CMP_EQ, -1, 0xFFFFFFFFU));
+}
+
+void test_validity()
+{
+    REQUIRE(util::futex_wake_op(NA_FUTEX_OP(NA_FUTEX_OP_XOR, 0, NA_FUTEX_OP_CMP_GE, 0)).valid());
+    REQUIRE_FALSE(util::futex_wake_op(NA_FUTEX_OP(5, 0, NA_FUTEX_OP_CMP_EQ, 0)).valid());
+    REQUIRE_FALSE(util::futex_wake_op(NA_FUTEX_OP(NA_FUTEX_OP_SET, 0, 6, 0)).valid());
+}
+} // namespace
+
+TEST_CASE("futex wake-op decoding", "[futex]")
+{
+    test_operations();
+    test_comparisons();
+    test_validity();
+}
@@ -0,0 +1,142 @@
+#include "catch2_compat.hpp"
+#include "kernel/util/intrusive_list.hpp"
+#include "kernel/util/intrusive_rbtree.hpp"
+
+#include <cstdint>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace
+{
+struct item
+{
+    std::int64_t key = 0;
+    int id = 0;
+    util::rb_node<item> tree_node;
+    util::list_node<item> list_node;
+};
+
+struct item_less
+{
+    bool operator()(const item *lhs, const item *rhs) const { return lhs->key < rhs->key; }
+};
+
+using tree_t = util::intrusive_rbtree<item, &item::tree_node, item_less>;
+using list_t = util::intrusive_list<item, &item::list_node>;
+
+/// Black nodes on every path below \p node, or -1 if the tree is broken
+int black_height(const item *node, const item *parent)
+{
+    if (node == nullptr)
+        return 1;
+    if (node->tree_node.parent != parent)
+        return -1;
+    const auto *l = node->tree_node.left;
+    const auto *r = node->tree_node.right;
+    if (node->tree_node.red && ((l != nullptr && l->tree_node.red) || (r != nullptr && r->tree_node.red)))
+        return -1;
+    if ((l != nullptr && l->key > node->key) || (r != nullptr && r->key < node->key))
+        return -1;
+    int lh = black_height(l, node);
+    int rh = black_height(r, node);
+    if (lh < 0 || lh != rh)
+        return -1;
+    return lh + (node->tree_node.red ? 0 : 1);
+}
+
+void check_tree(tree_t &tree, const std::multiset<std::pair<std::int64_t, int>> &expected)
+{
+    REQUIRE(tree.size() == expected.size());
+    if (tree.empty())
+    {
+        REQUIRE(tree.first() == nullptr);
+        return;
+    }
+    item *root = tree.first();
+    while (root->tree_node.parent != nullptr)
+        root = root->tree_node.parent;
+    REQUIRE_FALSE(root->tree_node.red);
+    REQUIRE(black_height(root, nullptr) > 0);
+
+    auto it = expected.begin();
+    for (item *x = tree.first(); x != nullptr; x = tree_t::next(x), ++it)
+    {
+        REQUIRE(it != expected.end());
+        REQUIRE(x->key == it->first);
+    }
+    REQUIRE(it == expected.end());
+}
+
+void test_tree_matches_multiset()
+{
+    std::vector<item> items(512);
+    for (int i = 0; i < static_cast<int>(items.size()); i++)
+        items[i].id = i;
+
+    std::mt19937 rng(7);
+    tree_t tree;
+    std::multiset<std::pair<std::int64_t, int>> expected;
+    for (int step = 0; step < 20000; step++)
+    {
+        auto &x = items[rng() % items.size()];
+        if (tree_t::linked(&x))
+        {
+            tree.erase(&x);
+            expected.erase(expected.find({x.key, x.id}));
+        }
+        else
+        {
+            x.key = static_cast<std::int64_t>(rng() % 64);
+            tree.insert(&x);
+            expected.insert({x.key, x.id});
+        }
+        if (step % 97 == 0)
+            check_tree(tree, expected);
+    }
+    check_tree(tree, expected);
+}
+
+void test_tree_keeps_equal_keys_in_insertion_order()
+{
+    item items[4];
+    tree_t tree;
+    for (int i = 0; i < 4; i++)
+    {
+        items[i].id = i;
+        tree.insert(&items[i]);
+    }
+    int id = 0;
+    for (item *x = tree.first(); x != nullptr; x = tree_t::next(x))
+        REQUIRE(x->id == id++);
+    tree.erase(tree.first());
+    REQUIRE(tree.first()->id == 1);
+}
+
+void test_list()
+{
+    item items[3];
+    list_t list;
+    for (auto &x : items)
+        list.push_back(&x);
+    REQUIRE(list.size() == 3);
+
+    list.remove(&items[1]);
+    REQUIRE_FALSE(list_t::linked(&items[1]));
+    REQUIRE(list.front() == &items[0]);
+    REQUIRE(list_t::next(&items[0]) == &items[2]);
+
+    REQUIRE(list.pop_front() == &items[0]);
+    REQUIRE(list.pop_front() == &items[2]);
+    REQUIRE(list.empty());
+    REQUIRE(list.pop_front() == nullptr);
+}
+} // namespace
+
+TEST_CASE("intrusive run queue containers", "[util][scheduler]")
+{
+    test_tree_matches_multiset();
+    test_tree_keeps_equal_keys_in_insertion_order();
+    test_list();
+}
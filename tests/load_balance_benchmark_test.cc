@@ -0,0 +1,190 @@
+#include "catch2_compat.hpp"
+#include "kernel/schedulers/balance.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+using task::scheduler::balance_domain;
+using task::scheduler::cpu_place;
+using task::scheduler::domain_between;
+using task::scheduler::find_victim;
+using task::scheduler::no_victim;
+
+/// 2 nodes of one package each, 8 cores of 2 threads per package
+std::vector<cpu_place> machine(std::uint32_t cpus)
+{
+    std::vector<cpu_place> places(cpus);
+    for (std::uint32_t i = 0; i < cpus; i++)
+    {
+        places[i].core = static_cast<std::uint8_t>(i / 2);
+        places[i].package = static_cast<std::uint8_t>(i / 16);
+        places[i].node = static_cast<std::uint8_t>(i / 16);
+    }
+    return places;
+}
+
+void test_domains()
+{
+    auto places = machine(32);
+    REQUIRE(domain_between(places[0], places[1]) == balance_domain::core);
+    REQUIRE(domain_between(places[0], places[2]) == balance_domain::package);
+    REQUIRE(domain_between(places[0], places[16]) == balance_domain::system);
+}
+
+void test_victim_is_closest_busy_cpu()
+{
+    auto places = machine(32);
+    std::vector<std::uint64_t> waiting(32, 0);
+    waiting[20] = 9;
+    waiting[5] = 2;
+    REQUIRE(find_victim(0, places.data(), waiting.data(), 32, 1) == 5);
+    waiting[1] = 1;
+    REQUIRE(find_victim(0, places.data(), waiting.data(), 32, 1) == 1);
+    REQUIRE(find_victim(16, places.data(), waiting.data(), 32, 1) == 20);
+
+    // A busy CPU only pulls across a real imbalance
+    waiting[0] = 1;
+    waiting[1] = 2;
+    waiting[5] = 0;
+    waiting[20] = 2;
+    REQUIRE(find_victim(0, places.data(), waiting.data(), 32, 2) == no_victim);
+    waiting[20] = 3;
+    REQUIRE(find_victim(0, places.data(), waiting.data(), 32, 2) == 20);
+}
+
+void test_ties_spread_over_victims()
+{
+    auto places = machine(4);
+    for (auto &place : places)
+        place = cpu_place{};
+    std::vector<std::uint64_t> waiting{3, 0, 3, 0};
+    REQUIRE(find_victim(1, places.data(), waiting.data(), 4, 1) == 2);
+    REQUIRE(find_victim(3, places.data(), waiting.data(), 4, 1) == 0);
+}
+
+/// Run queues of the simulated machine, one balancing tick (5 ms) per step.
+struct simulation
+{
+    explicit simulation(std::uint32_t cpus, std::uint64_t threads)
+        : places(machine(cpus))
+        , running(cpus, false)
+        , waiting(cpus, 0)
+    {
+        // A burst of forks leaves every thread on the forking CPU
+        running[0] = true;
+        waiting[0] = threads - 1;
+    }
+
+    std::uint64_t total(std::uint32_t cpu) const { return waiting[cpu] + (running[cpu] ? 1 : 0); }
+
+    bool even() const
+    {
+        std::uint64_t low = ~0UL, high = 0;
+        for (std::uint32_t i = 0; i < places.size(); i++)
+        {
+            low = total(i) < low ? total(i) : low;
+            high = total(i) > high ? total(i) : high;
+        }
+        return high - low <= 1;
+    }
+
+    void move(std::uint32_t from, std::uint32_t to)
+    {
+        waiting[from]--;
+        if (running[to])
+            waiting[to]++;
+        else
+            running[to] = true;
+    }
+
+    std::vector<cpu_place> places;
+    std::vector<bool> running;
+    std::vector<std::uint64_t> waiting;
+};
+
+/// Ticks between two load samples of one CPU: load_calc_time_span *
+/// load_calc_times over the 5 ms tick
+constexpr std::uint32_t balance_period = 10;
+
+/// The balancer this replaced: a CPU pushes one thread to the least loaded
+/// CPU once per period, through a single slot freed on the next tick.
+std::uint32_t push_ticks(std::uint32_t cpus, std::uint64_t threads)
+{
+    simulation sim(cpus, threads);
+    std::uint32_t tick = 0;
+    for (; !sim.even() && tick < 100000; tick++)
+    {
+        bool slot_free = true;
+        for (std::uint32_t cpu = 0; cpu < cpus && slot_free; cpu++)
+        {
+            if ((tick + cpu) % balance_period != 0 || sim.waiting[cpu] == 0)
+                continue;
+            std::uint32_t target = cpu;
+            for (std::uint32_t i = 0; i < cpus; i++)
+            {
+                if (sim.total(i) <= sim.total(target))
+                    target = i;
+            }
+            if (target != cpu && sim.total(cpu) - sim.total(target) > 1)
+            {
+                sim.move(cpu, target);
+                slot_free = false;
+            }
+        }
+    }
+    return tick;
+}
+
+/// Idle CPUs steal every tick, busy ones pull once per period. Requests use
+/// the waiting counts published on the previous tick.
+std::uint32_t steal_ticks(std::uint32_t cpus, std::uint64_t threads)
+{
+    simulation sim(cpus, threads);
+    std::uint32_t tick = 0;
+    for (; !sim.even() && tick < 100000; tick++)
+    {
+        const std::vector<std::uint64_t> published = sim.waiting;
+        for (std::uint32_t cpu = 0; cpu < cpus; cpu++)
+        {
+            const bool idle = !sim.running[cpu];
+            if (!idle && (tick + cpu) % balance_period != 0)
+                continue;
+            const std::uint32_t victim = find_victim(cpu, sim.places.data(), published.data(), cpus, idle ? 1 : 2);
+            // The victim checks its own queue when the request arrives
+            if (victim != no_victim && sim.waiting[victim] > 0 &&
+                (idle || sim.total(victim) > sim.total(cpu) + 1))
+                sim.move(victim, cpu);
+        }
+    }
+    return tick;
+}
+
+/// Simulated time for a burst of forks on one CPU to spread over 32 CPUs.
+void test_spread_time()
+{
+    constexpr std::uint32_t cpus = 32;
+    for (std::uint64_t threads : {32UL, 64UL, 256UL})
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const std::uint32_t pull = steal_ticks(cpus, threads);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        const std::uint32_t push = push_ticks(cpus, threads);
+        std::printf("spread %lu threads over %u cpus: work stealing %u ms, single push slot %u ms (%.0f us host)\n",
+                    threads, cpus, pull * 5, push * 5, elapsed.count() * 1e6);
+        REQUIRE(pull < push);
+        REQUIRE(pull <= balance_period * (threads / cpus + 2));
+    }
+}
+} // namespace
+
+TEST_CASE("work stealing load balance", "[scheduler][balance]")
+{
+    test_domains();
+    test_victim_is_closest_busy_cpu();
+    test_ties_spread_over_victims();
+    test_spread_time();
+}
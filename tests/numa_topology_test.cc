@@ -0,0 +1,73 @@
+#include "catch2_compat.hpp"
+#include "kernel/mm/numa_topology.hpp"
+
+#include <cstdint>
+
+namespace
+{
+using memory::numa::max_nodes;
+using memory::numa::no_node;
+using memory::numa::topology;
+
+void test_domains_compact_in_order()
+{
+    topology t;
+    REQUIRE(t.node_count() == 1);
+    REQUIRE(t.add_domain(7));
+    REQUIRE(t.add_domain(2));
+    REQUIRE(t.add_domain(7));
+    REQUIRE(t.add_domain(40));
+    REQUIRE(t.node_count() == 3);
+    REQUIRE(t.node_of(2) == 0);
+    REQUIRE(t.node_of(7) == 1);
+    REQUIRE(t.node_of(40) == 2);
+    REQUIRE(t.node_of(3) == no_node);
+    REQUIRE(t.domain_of(2) == 40);
+
+    topology full;
+    for (std::uint32_t d = 0; d < max_nodes; d++)
+        REQUIRE(full.add_domain(d * 10));
+    REQUIRE_FALSE(full.add_domain(1000));
+    REQUIRE(full.add_domain(0));
+}
+
+/// Four sockets on a ring: 0-1-2-3-0, neighbours at 20, opposite at 30.
+void test_fallback_follows_distance()
+{
+    topology t;
+    for (std::uint32_t d = 0; d < 4; d++)
+        REQUIRE(t.add_domain(d));
+    t.build_fallback([](std::uint32_t from, std::uint32_t to) -> std::uint32_t {
+        if (from == to)
+            return 10;
+        std::uint32_t hops = from > to ? from - to : to - from;
+        return hops == 2 ? 30 : 20;
+    });
+    const std::uint8_t *order = t.fallback(0);
+    REQUIRE(order[0] == 0);
+    REQUIRE(order[1] == 1);
+    REQUIRE(order[2] == 3);
+    REQUIRE(order[3] == 2);
+    order = t.fallback(2);
+    REQUIRE(order[0] == 2);
+    REQUIRE(order[1] == 1);
+    REQUIRE(order[2] == 3);
+    REQUIRE(order[3] == 0);
+}
+
+void test_default_fallback_lists_every_node()
+{
+    topology t;
+    REQUIRE(t.add_domain(5));
+    REQUIRE(t.add_domain(9));
+    REQUIRE(t.fallback(1)[0] == 1);
+    REQUIRE(t.fallback(1)[1] == 0);
+}
+} // namespace
+
+TEST_CASE("NUMA topology", "[mm][numa]")
+{
+    test_domains_compact_in_order();
+    test_fallback_follows_distance();
+    test_default_fallback_lists_every_node();
+}
@@ -0,0 +1,40 @@
+#include "catch2_compat.hpp"
+#include "kernel/mm/object_window.hpp"
+
+#include <cstdint>
+
+namespace
+{
+using memory::object_window::check;
+using memory::object_window::page_size;
+
+constexpr std::uint64_t object = 4 * page_size;
+
+void test_page_aligned_windows()
+{
+    REQUIRE(check(0, object, object) == NA_STATUS_OK);
+    REQUIRE(check(page_size, 1, object) == NA_STATUS_OK);
+    REQUIRE(check(object, 0, object) == NA_STATUS_OK);
+}
+
+void test_unaligned_offset_is_refused()
+{
+    REQUIRE(check(1, page_size, object) == NA_STATUS_INVALID_ARGUMENT);
+    REQUIRE(check(page_size + 8, 8, object) == NA_STATUS_INVALID_ARGUMENT);
+    REQUIRE(check(page_size - 1, 1, object) == NA_STATUS_INVALID_ARGUMENT);
+}
+
+void test_window_past_the_object_is_refused()
+{
+    REQUIRE(check(object + page_size, 0, object) == NA_STATUS_INVALID_ARGUMENT);
+    REQUIRE(check(page_size, object, object) == NA_STATUS_INVALID_ARGUMENT);
+    REQUIRE(check(page_size, ~std::uint64_t(0), object) == NA_STATUS_INVALID_ARGUMENT);
+}
+} // namespace
+
+TEST_CASE("memory object map windows", "[mm]")
+{
+    test_page_aligned_windows();
+    test_unaligned_offset_is_refused();
+    test_window_past_the_object_is_refused();
+}
@@ -0,0 +1,73 @@
+#include "catch2_compat.hpp"
+#include "kernel/arch/pcid.hpp"
+
+#include <cstdint>
+
+namespace
+{
+using arch::paging::pcid_cache;
+using arch::paging::pcid_slots;
+
+void test_switching_back_keeps_the_tlb()
+{
+    pcid_cache cache;
+    auto a = cache.assign(1, 0);
+    auto b = cache.assign(2, 0);
+    REQUIRE(a.flush);
+    REQUIRE(b.flush);
+    REQUIRE(a.pcid != b.pcid);
+    REQUIRE(a.pcid != 0);
+
+    auto again = cache.assign(1, 0);
+    REQUIRE(again.pcid == a.pcid);
+    REQUIRE_FALSE(again.flush);
+}
+
+void test_changed_table_is_flushed_once()
+{
+    pcid_cache cache;
+    cache.assign(1, 0);
+    cache.assign(2, 0);
+    auto changed = cache.assign(1, 3);
+    REQUIRE(changed.flush);
+    REQUIRE_FALSE(cache.assign(1, 3).flush);
+}
+
+void test_evicted_table_gets_a_flushed_pcid()
+{
+    pcid_cache cache;
+    for (std::uint64_t id = 1; id <= pcid_slots; id++)
+        REQUIRE(cache.assign(id, 0).flush);
+    for (std::uint64_t id = 1; id <= pcid_slots; id++)
+        REQUIRE_FALSE(cache.assign(id, 0).flush);
+
+    auto newcomer = cache.assign(pcid_slots + 1, 0);
+    REQUIRE(newcomer.flush);
+    REQUIRE(newcomer.pcid >= 1);
+    REQUIRE(newcomer.pcid <= pcid_slots);
+    // The table that lost its slot starts over with a flush.
+    int flushed = 0;
+    for (std::uint64_t id = 1; id <= pcid_slots; id++)
+        flushed += cache.assign(id, 0).flush ? 1 : 0;
+    REQUIRE(flushed >= 1);
+}
+
+void test_invalidate_all_flushes_every_pcid()
+{
+    pcid_cache cache;
+    cache.assign(1, 0);
+    cache.assign(2, 5);
+    cache.invalidate_all();
+    REQUIRE(cache.assign(1, 0).flush);
+    REQUIRE(cache.assign(2, 5).flush);
+    REQUIRE_FALSE(cache.assign(2, 5).flush);
+}
+} // namespace
+
+TEST_CASE("pcid assignment", "[arch][paging]")
+{
+    test_switching_back_keeps_the_tlb();
+    test_changed_table_is_flushed_once();
+    test_evicted_table_gets_a_flushed_pcid();
+    test_invalidate_all_flushes_every_pcid();
+}
@@ -13,7 +13,7 @@ namespace
 {
 constexpr bool syscall_numbers_are_dense()
 {
-    constexpr std::array<std::uint32_t, 41> numbers = {
+    constexpr std::array<std::uint32_t, 47> numbers = {
         NA_SYSCALL_LOG,
         NA_SYSCALL_CLOCK_GET,
         NA_SYSCALL_FUTEX,
@@ -55,6 +55,12 @@ constexpr bool syscall_numbers_are_dense()
         NA_SYSCALL_PROCESS_HANDLE_OPEN,
         NA_SYSCALL_PROCESS_SPAWN,
         NA_SYSCALL_PIPE_CREATE,
+        NA_SYSCALL_SHARED_RING_NOTIFY,
+        NA_SYSCALL_THREAD_SET_NICE,
+        NA_SYSCALL_LOCKSTAT_READ,
+        NA_SYSCALL_INVOKE_CALL,
+        NA_SYSCALL_SPLICE,
+        NA_SYSCALL_VMSPLICE,
     };
     for (std::uint32_t index = 0; index < numbers.size(); index++)
     {
@@ -77,6 +83,10 @@ void test_layouts()
     static_assert(sizeof(na_process_spawn_frame_t) == 80);
     static_assert(sizeof(na_fail_frame_t) == 24);
     static_assert(offsetof(na_channel_receive_frame_t, caller_pid) == 88);
+    static_assert(sizeof(na_shared_ring_header_t) == 192);
+    static_assert(offsetof(na_shared_ring_header_t, tail) == 64);
+    static_assert(offsetof(na_shared_ring_header_t, slots) == 128);
+    static_assert(sizeof(na_shared_ring_header_t) % NA_SHARED_RING_SLOT_ALIGN == 0);
     static_assert(offsetof(na_submit_frame_t, method_id) == 8);
     static_assert(offsetof(na_submit_frame_t, resources) == 32);
     static_assert(offsetof(na_result_frame_t, execution_outcome) == 80);
@@ -84,7 +94,10 @@ void test_layouts()
     static_assert(NA_CHANNEL_MAX_RESOURCES == 64);
     static_assert(NA_HANDLE_INVALID == 0);
     static_assert(NA_SYSCALL_NONE == 0);
-    static_assert(NA_SYSCALL_COUNT == 42);
+    static_assert(NA_SYSCALL_COUNT == 48);
+    static_assert(sizeof(na_lockstat_entry_t) == 64);
+    static_assert(sizeof(na_splice_frame_t) == 64);
+    static_assert(sizeof(na_vmsplice_frame_t) == 48);
     static_assert(NA_SYSCALL_MEMORY_MAP == 36);
     static_assert(NA_SYSCALL_PROCESS_SPAWN == 40);
     static_assert(syscall_numbers_are_dense());
@@ -0,0 +1,176 @@
+#include "catch2_compat.hpp"
+#include "kernel/util/pipe_ring.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+
+namespace
+{
+constexpr u64 page_size = 64;
+using ring_t = util::pipe_ring<4, page_size>;
+
+/// Pages with a reference count, standing in for the page allocator
+struct pages
+{
+    std::map<byte *, int> refs;
+
+    byte *alloc()
+    {
+        auto *page = static_cast<byte *>(std::malloc(page_size));
+        refs[page] = 1;
+        return page;
+    }
+    void reference(byte *page) { refs.at(page)++; }
+    void release(byte *page)
+    {
+        if (--refs.at(page) == 0)
+        {
+            refs.erase(page);
+            std::free(page);
+        }
+    }
+    auto alloc_fn()
+    {
+        return [this] { return alloc(); };
+    }
+    auto reference_fn()
+    {
+        return [this](byte *page) { reference(page); };
+    }
+    auto release_fn()
+    {
+        return [this](byte *page) { release(page); };
+    }
+};
+
+std::vector<byte> pattern(u64 size, u8 seed)
+{
+    std::vector<byte> data(size);
+    for (u64 i = 0; i < size; i++)
+        data[i] = static_cast<byte>(seed + i);
+    return data;
+}
+
+void test_write_read_across_pages()
+{
+    pages p;
+    ring_t ring;
+    const auto data = pattern(page_size * 4 + 10, 1);
+    // Full after four pages
+    REQUIRE(ring.write(data.data(), data.size(), p.alloc_fn()) == page_size * 4);
+    REQUIRE(ring.count() == 4);
+    REQUIRE(ring.bytes() == page_size * 4);
+    REQUIRE_FALSE(ring.writable());
+
+    std::vector<byte> out(page_size * 4);
+    REQUIRE(ring.read(out.data(), page_size + 3, p.release_fn()) == page_size + 3);
+    REQUIRE(std::memcmp(out.data(), data.data(), page_size + 3) == 0);
+    REQUIRE(ring.count() == 3);
+    REQUIRE(p.refs.size() == 3);
+
+    // The freed slot takes a new page
+    REQUIRE(ring.write(data.data() + page_size * 4, 10, p.alloc_fn()) == 10);
+    REQUIRE(ring.count() == 4);
+    REQUIRE(ring.read(out.data(), out.size(), p.release_fn()) == page_size * 3 - 3 + 10);
+    REQUIRE(std::memcmp(out.data(), data.data() + page_size + 3, page_size * 3 - 3 + 10) == 0);
+    REQUIRE(ring.empty());
+    REQUIRE(p.refs.empty());
+}
+
+void test_small_writes_share_a_page()
+{
+    pages p;
+    ring_t ring;
+    const auto data = pattern(page_size, 7);
+    for (u64 i = 0; i < page_size; i += 8)
+        REQUIRE(ring.write(data.data() + i, 8, p.alloc_fn()) == 8);
+    REQUIRE(ring.count() == 1);
+    REQUIRE(p.refs.size() == 1);
+    ring.clear(p.release_fn());
+    REQUIRE(p.refs.empty());
+}
+
+void test_pop_splits_and_marks_shared()
+{
+    pages p;
+    ring_t ring;
+    const auto data = pattern(20, 3);
+    REQUIRE(ring.write(data.data(), data.size(), p.alloc_fn()) == 20);
+
+    util::pipe_buffer front;
+    REQUIRE(ring.pop(8, front, p.reference_fn()));
+    REQUIRE(front.length == 8);
+    REQUIRE(front.shared);
+    REQUIRE(ring.at(0).shared);
+    REQUIRE(ring.bytes() == 12);
+    REQUIRE(p.refs.at(front.page) == 2);
+
+    // A shared tail takes no more bytes, the next write starts a page
+    REQUIRE(ring.write(data.data(), 4, p.alloc_fn()) == 4);
+    REQUIRE(ring.count() == 2);
+
+    util::pipe_buffer rest;
+    REQUIRE(ring.pop(page_size, rest, p.reference_fn()));
+    REQUIRE(rest.page == front.page);
+    REQUIRE(rest.offset == 8);
+    REQUIRE(rest.length == 12);
+    REQUIRE(std::memcmp(rest.page + rest.offset, data.data() + 8, 12) == 0);
+    p.release(front.page);
+    p.release(rest.page);
+    ring.clear(p.release_fn());
+    REQUIRE(p.refs.empty());
+}
+
+void test_push_moves_between_rings()
+{
+    pages p;
+    ring_t source;
+    ring_t target;
+    const auto data = pattern(page_size * 2, 9);
+    REQUIRE(source.write(data.data(), data.size(), p.alloc_fn()) == data.size());
+    util::pipe_buffer buffer;
+    while (source.pop(page_size * 2, buffer, p.reference_fn()))
+        REQUIRE(target.push(buffer));
+    REQUIRE(source.empty());
+    REQUIRE(target.bytes() == data.size());
+    REQUIRE(p.refs.size() == 2);
+
+    std::vector<byte> out(data.size());
+    REQUIRE(target.read(out.data(), out.size(), p.release_fn()) == data.size());
+    REQUIRE(out == data);
+    REQUIRE(p.refs.empty());
+}
+
+void test_share_keeps_source()
+{
+    pages p;
+    ring_t source;
+    ring_t target;
+    const auto data = pattern(page_size + 16, 5);
+    REQUIRE(source.write(data.data(), data.size(), p.alloc_fn()) == data.size());
+    for (u32 i = 0; i < source.count(); i++)
+        REQUIRE(target.push(source.share(i, page_size * 2, p.reference_fn())));
+    REQUIRE(source.bytes() == data.size());
+    REQUIRE(target.bytes() == data.size());
+    REQUIRE(p.refs.at(source.at(0).page) == 2);
+
+    std::vector<byte> a(data.size());
+    std::vector<byte> b(data.size());
+    REQUIRE(target.read(b.data(), b.size(), p.release_fn()) == data.size());
+    REQUIRE(source.read(a.data(), a.size(), p.release_fn()) == data.size());
+    REQUIRE(a == data);
+    REQUIRE(b == data);
+    REQUIRE(p.refs.empty());
+}
+} // namespace
+
+TEST_CASE("pipe ring", "[pipe]")
+{
+    test_write_read_across_pages();
+    test_small_writes_share_a_page();
+    test_pop_splits_and_marks_shared();
+    test_push_moves_between_rings();
+    test_share_keeps_source();
+}
@@ -0,0 +1,160 @@
+#include "catch2_compat.hpp"
+#include "kernel/util/queued_lock.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+namespace
+{
+void relax() { std::this_thread::yield(); }
+
+/// One node per thread, as the kernel keeps one per CPU and nesting level
+thread_local util::queue_node node;
+
+void lock(util::queued_spinlock &l)
+{
+    if (!l.try_lock())
+        l.lock_queued(&node, relax);
+}
+
+void lock_read(util::queued_rwlock &l)
+{
+    if (!l.lock_read_fast())
+        l.lock_read_slow(
+            false, [&l] { lock(l.queue()); }, [&l] { l.queue().unlock(); }, relax);
+}
+
+void lock_write(util::queued_rwlock &l)
+{
+    if (!l.try_lock_write())
+        l.lock_write_slow([&l] { lock(l.queue()); }, [&l] { l.queue().unlock(); }, relax);
+}
+
+void test_spinlock_excludes()
+{
+    constexpr int threads = 8;
+    constexpr int rounds = 20000;
+    util::queued_spinlock l;
+    std::uint64_t counter = 0;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&] {
+            for (int i = 0; i < rounds; i++)
+            {
+                lock(l);
+                counter = counter + 1;
+                l.unlock();
+            }
+        });
+    }
+    for (auto &w : workers)
+        w.join();
+    REQUIRE(counter == threads * rounds);
+    REQUIRE_FALSE(l.is_locked());
+    REQUIRE_FALSE(l.is_contended());
+}
+
+void test_spinlock_serves_in_order()
+{
+    util::queued_spinlock l;
+    REQUIRE(l.try_lock());
+    std::vector<int> order;
+    std::vector<std::thread> waiters;
+    for (int t = 0; t < 4; t++)
+    {
+        waiters.emplace_back([&, t] {
+            lock(l);
+            order.push_back(t);
+            l.unlock();
+        });
+        // Let each waiter queue before the next one starts
+        while (!l.is_contended())
+            relax();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    // A newcomer does not pass the queue
+    REQUIRE_FALSE(l.try_lock());
+    l.unlock();
+    for (auto &w : waiters)
+        w.join();
+    REQUIRE(order == std::vector<int>{0, 1, 2, 3});
+}
+
+void test_rwlock_prefers_writers()
+{
+    util::queued_rwlock l;
+    lock_read(l);
+    std::atomic_bool written{false};
+    std::thread writer([&] {
+        lock_write(l);
+        written = true;
+        l.unlock_write();
+    });
+    while (!l.has_waiting_writer())
+        relax();
+    // New readers wait behind the writer
+    REQUIRE_FALSE(l.try_lock_read());
+    // A reader nested in an interrupt passes it
+    REQUIRE_FALSE(l.lock_read_fast());
+    l.lock_read_slow(
+        true, [] {}, [] {}, relax);
+    REQUIRE(l.readers() == 2);
+    l.unlock_read();
+    REQUIRE_FALSE(written);
+
+    l.unlock_read();
+    writer.join();
+    REQUIRE(written);
+    REQUIRE(l.readers() == 0);
+    REQUIRE_FALSE(l.is_write_locked());
+}
+
+void test_rwlock_excludes()
+{
+    constexpr int rounds = 20000;
+    util::queued_rwlock l;
+    std::uint64_t a = 0;
+    std::uint64_t b = 0;
+    std::atomic_bool torn{false};
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 6; t++)
+    {
+        workers.emplace_back([&, t] {
+            for (int i = 0; i < rounds; i++)
+            {
+                if ((i + t) % 4 == 0)
+                {
+                    lock_write(l);
+                    a = a + 1;
+                    b = b + 1;
+                    l.unlock_write();
+                }
+                else
+                {
+                    lock_read(l);
+                    if (a != b)
+                        torn = true;
+                    l.unlock_read();
+                }
+            }
+        });
+    }
+    for (auto &w : workers)
+        w.join();
+    REQUIRE_FALSE(torn);
+    REQUIRE(a == 6 * rounds / 4);
+}
+} // namespace
+
+TEST_CASE("queued spinlock and rwlock", "[lock]")
+{
+    test_spinlock_excludes();
+    test_spinlock_serves_in_order();
+    test_rwlock_prefers_writers();
+    test_rwlock_excludes();
+}
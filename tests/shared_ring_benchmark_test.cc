@@ -0,0 +1,264 @@
+#include "catch2_compat.hpp"
+#include "naos/shared_ring.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+using nao::shared_ring_view;
+
+struct ring_memory
+{
+    ring_memory(std::uint32_t slots, std::uint32_t slot_bytes)
+        : bytes(shared_ring_view::mapping_bytes(slots, slot_bytes) / sizeof(std::uint64_t) + 1, 0)
+    {
+        shared_ring_view::initialize(bytes.data(), slots, slot_bytes);
+    }
+
+    void *base() { return bytes.data(); }
+
+    std::vector<std::uint64_t> bytes;
+};
+
+/// The copy protocol a non-mapped ring implements in the kernel: push copies
+/// into a slot, pop copies into a snapshot, then commits. Each step holds the
+/// ring lock, as each one is a syscall today.
+class claim_commit_ring
+{
+  public:
+    claim_commit_ring(std::size_t slots)
+        : slots_(slots)
+    {
+    }
+
+    bool push(const std::uint8_t *data, std::size_t size)
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        if (count_ == slots_.size())
+            return false;
+        slots_[tail_].assign(data, data + size);
+        tail_ = (tail_ + 1) % slots_.size();
+        count_++;
+        return true;
+    }
+
+    bool pop(std::vector<std::uint8_t> &snapshot)
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            if (count_ == 0 || claimed_)
+                return false;
+            snapshot = slots_[head_];
+            claimed_ = true;
+        }
+        std::lock_guard<std::mutex> guard(lock_);
+        slots_[head_].clear();
+        head_ = (head_ + 1) % slots_.size();
+        count_--;
+        claimed_ = false;
+        return true;
+    }
+
+  private:
+    std::mutex lock_;
+    std::vector<std::vector<std::uint8_t>> slots_;
+    std::size_t head_ = 0;
+    std::size_t tail_ = 0;
+    std::size_t count_ = 0;
+    bool claimed_ = false;
+};
+
+void test_push_pop_wraps()
+{
+    ring_memory memory(4, 16);
+    shared_ring_view ring(memory.base());
+    REQUIRE(ring.valid());
+    REQUIRE(ring.slots() == 4);
+
+    std::uint8_t out[16]{};
+    std::uint32_t size = 0;
+    REQUIRE(ring.try_pop(out, sizeof(out), size) == NA_STATUS_WOULD_BLOCK);
+    for (std::uint32_t round = 0; round < 10; round++)
+    {
+        for (std::uint8_t i = 0; i < 4; i++)
+        {
+            const std::uint8_t value = static_cast<std::uint8_t>(round * 4 + i);
+            REQUIRE(ring.try_push(&value, 1) == NA_STATUS_OK);
+        }
+        const std::uint8_t extra = 0;
+        REQUIRE(ring.try_push(&extra, 1) == NA_STATUS_WOULD_BLOCK);
+        REQUIRE(ring.queued() == 4);
+        for (std::uint8_t i = 0; i < 4; i++)
+        {
+            REQUIRE(ring.try_pop(out, sizeof(out), size) == NA_STATUS_OK);
+            REQUIRE(size == 1);
+            REQUIRE(out[0] == round * 4 + i);
+        }
+    }
+}
+
+void test_rejects_bad_sizes()
+{
+    ring_memory memory(2, 8);
+    shared_ring_view ring(memory.base());
+    const std::uint8_t data[9]{};
+    REQUIRE(ring.try_push(data, sizeof(data)) == NA_STATUS_INVALID_ARGUMENT);
+    REQUIRE(ring.try_push(data, 8) == NA_STATUS_OK);
+
+    std::uint8_t out[4]{};
+    std::uint32_t size = 0;
+    REQUIRE(ring.try_pop(out, sizeof(out), size) == NA_STATUS_BUFFER_TOO_SMALL);
+    REQUIRE(size == 8);
+    REQUIRE(ring.queued() == 1);
+
+    // A peer scribbling over the slot header must not make the consumer read
+    // past the slot.
+    auto *slot = reinterpret_cast<na_shared_ring_slot_t *>(static_cast<std::uint8_t *>(memory.base()) +
+                                                           sizeof(na_shared_ring_header_t));
+    slot->size = 1 << 20;
+    REQUIRE(ring.try_pop(out, sizeof(out), size) == NA_STATUS_INVALID_MESSAGE);
+
+    ring_memory broken(2, 8);
+    reinterpret_cast<na_shared_ring_header_t *>(broken.base())->slot_stride = 8;
+    REQUIRE_FALSE(shared_ring_view(broken.base()).valid());
+}
+
+void test_wakeup_handshake()
+{
+    ring_memory memory(2, 8);
+    shared_ring_view producer(memory.base());
+    shared_ring_view consumer(memory.base());
+    const std::uint8_t value = 7;
+
+    // Nobody sleeps: pushes never need the kernel.
+    REQUIRE(producer.try_push(&value, 1) == NA_STATUS_OK);
+    REQUIRE_FALSE(producer.take_consumer_wakeup());
+
+    // A message is pending, so the consumer must not go to sleep.
+    REQUIRE_FALSE(consumer.prepare_consumer_wait());
+    std::uint8_t out[8]{};
+    std::uint32_t size = 0;
+    REQUIRE(consumer.try_pop(out, sizeof(out), size) == NA_STATUS_OK);
+
+    REQUIRE(consumer.prepare_consumer_wait());
+    REQUIRE(producer.try_push(&value, 1) == NA_STATUS_OK);
+    REQUIRE(producer.take_consumer_wakeup());
+    REQUIRE_FALSE(producer.take_consumer_wakeup());
+
+    REQUIRE(producer.try_push(&value, 1) == NA_STATUS_OK);
+    REQUIRE(producer.prepare_producer_wait());
+    REQUIRE(consumer.try_pop(out, sizeof(out), size) == NA_STATUS_OK);
+    REQUIRE(consumer.take_producer_wakeup());
+}
+
+constexpr std::uint32_t message_bytes = 64;
+constexpr std::uint64_t messages = 200000;
+
+double mapped_ring_rate()
+{
+    ring_memory memory(256, message_bytes);
+    shared_ring_view producer(memory.base());
+    shared_ring_view consumer(memory.base());
+    std::atomic_bool ordered{true};
+
+    const auto start = std::chrono::steady_clock::now();
+    std::thread reader([&] {
+        std::uint8_t out[message_bytes];
+        std::uint32_t size = 0;
+        for (std::uint64_t i = 0; i < messages;)
+        {
+            if (consumer.try_pop(out, sizeof(out), size) != NA_STATUS_OK)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            std::uint64_t value = 0;
+            std::memcpy(&value, out, sizeof(value));
+            if (value != i)
+                ordered = false;
+            i++;
+        }
+    });
+    std::uint8_t data[message_bytes]{};
+    for (std::uint64_t i = 0; i < messages;)
+    {
+        std::memcpy(data, &i, sizeof(i));
+        if (producer.try_push(data, sizeof(data)) != NA_STATUS_OK)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        i++;
+    }
+    reader.join();
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    REQUIRE(ordered);
+    return messages / elapsed.count();
+}
+
+double claim_commit_rate()
+{
+    claim_commit_ring ring(256);
+    std::atomic_bool ordered{true};
+
+    const auto start = std::chrono::steady_clock::now();
+    std::thread reader([&] {
+        std::vector<std::uint8_t> snapshot;
+        for (std::uint64_t i = 0; i < messages;)
+        {
+            if (!ring.pop(snapshot))
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            std::uint64_t value = 0;
+            std::memcpy(&value, snapshot.data(), sizeof(value));
+            if (value != i)
+                ordered = false;
+            i++;
+        }
+    });
+    std::uint8_t data[message_bytes]{};
+    for (std::uint64_t i = 0; i < messages;)
+    {
+        std::memcpy(data, &i, sizeof(i));
+        if (!ring.push(data, sizeof(data)))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        i++;
+    }
+    reader.join();
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    REQUIRE(ordered);
+    return messages / elapsed.count();
+}
+
+/// Host throughput of the two protocols without syscall cost, which only
+/// widens the gap on the target: claim/commit pays three syscalls a message.
+void test_throughput_against_claim_commit()
+{
+    const double mapped = mapped_ring_rate();
+    const double copied = claim_commit_rate();
+    std::printf("shared ring %u-byte messages: mapped %.0f msg/s, claim/commit %.0f msg/s\n", message_bytes, mapped,
+                copied);
+    REQUIRE(mapped > 0);
+    REQUIRE(copied > 0);
+}
+} // namespace
+
+TEST_CASE("mapped shared ring", "[data_plane][ring]")
+{
+    test_push_pop_wraps();
+    test_rejects_bad_sizes();
+    test_wakeup_handshake();
+    test_throughput_against_claim_commit();
+}
@@ -0,0 +1,136 @@
+#include "catch2_compat.hpp"
+#include "kernel/ipc/signal_observer.hpp"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace
+{
+using naos::ipc::signal_observer;
+using naos::ipc::signal_observer_list;
+
+struct fake_waiter
+{
+    std::uint64_t wakeups = 0;
+};
+
+/// Mirror signal_source::notify: drain the list in fixed batches.
+std::uint64_t notify(signal_observer_list &list, na_signal_t raised)
+{
+    constexpr std::uint64_t batch_size = 16;
+    const auto round = list.next_round();
+    std::uint64_t woken = 0;
+    for (;;)
+    {
+        std::array<void *, batch_size> batch{};
+        const auto count = list.collect(raised, round, batch.data(), batch.size());
+        for (std::uint64_t i = 0; i < count; i++)
+            static_cast<fake_waiter *>(batch[i])->wakeups++;
+        woken += count;
+        if (count < batch_size)
+            return woken;
+    }
+}
+
+void observe(signal_observer_list &list, signal_observer &observer, fake_waiter &waiter, na_signal_t signals)
+{
+    observer.signals = signals;
+    observer.waiter = &waiter;
+    list.link(&observer);
+}
+
+void test_link_and_unlink()
+{
+    signal_observer_list list;
+    fake_waiter waiter;
+    std::array<signal_observer, 3> observers{};
+    for (auto &observer : observers)
+        observe(list, observer, waiter, NA_SIGNAL_READABLE);
+    REQUIRE(list.size() == 3);
+
+    list.unlink(&observers[1]);
+    list.unlink(&observers[0]);
+    REQUIRE(list.size() == 1);
+    REQUIRE(notify(list, NA_SIGNAL_READABLE) == 1);
+    list.unlink(&observers[2]);
+    REQUIRE(list.empty());
+    REQUIRE(notify(list, NA_SIGNAL_READABLE) == 0);
+}
+
+void test_mask_filters_waiters()
+{
+    signal_observer_list list;
+    fake_waiter reader;
+    fake_waiter writer;
+    signal_observer read_observer;
+    signal_observer write_observer;
+    observe(list, read_observer, reader, NA_SIGNAL_READABLE | NA_SIGNAL_PEER_CLOSED);
+    observe(list, write_observer, writer, NA_SIGNAL_WRITABLE | NA_SIGNAL_PEER_CLOSED);
+
+    REQUIRE(notify(list, NA_SIGNAL_READABLE) == 1);
+    REQUIRE(reader.wakeups == 1);
+    REQUIRE(writer.wakeups == 0);
+    REQUIRE(notify(list, NA_SIGNAL_PEER_CLOSED) == 2);
+    REQUIRE(reader.wakeups == 2);
+    REQUIRE(writer.wakeups == 1);
+}
+
+void test_batches_collect_each_observer_once()
+{
+    signal_observer_list list;
+    std::vector<fake_waiter> waiters(100);
+    std::vector<signal_observer> observers(waiters.size());
+    for (std::size_t i = 0; i < waiters.size(); i++)
+        observe(list, observers[i], waiters[i], NA_SIGNAL_READABLE);
+
+    REQUIRE(notify(list, NA_SIGNAL_READABLE) == waiters.size());
+    for (const auto &waiter : waiters)
+        REQUIRE(waiter.wakeups == 1);
+}
+
+/// A notifier drops the list lock between batches. Observers that leave in
+/// the gap are not collected, and the rest are collected exactly once.
+void test_round_survives_unlinks_between_batches()
+{
+    constexpr std::uint64_t batch_size = 16;
+    signal_observer_list list;
+    std::vector<fake_waiter> waiters(40);
+    std::vector<signal_observer> observers(waiters.size());
+    for (std::size_t i = 0; i < waiters.size(); i++)
+        observe(list, observers[i], waiters[i], NA_SIGNAL_READABLE);
+
+    const auto round = list.next_round();
+    std::array<void *, batch_size> batch{};
+    auto collect = [&] {
+        const auto count = list.collect(NA_SIGNAL_READABLE, round, batch.data(), batch.size());
+        for (std::uint64_t i = 0; i < count; i++)
+            static_cast<fake_waiter *>(batch[i])->wakeups++;
+        return count;
+    };
+    REQUIRE(collect() == batch_size);
+    // One collected and one pending waiter finish their waits
+    list.unlink(&observers[0]);
+    list.unlink(&observers[30]);
+    std::uint64_t rest = 0;
+    for (auto count = collect(); count != 0; count = collect())
+        rest += count;
+    REQUIRE(rest == waiters.size() - batch_size - 1);
+    for (std::size_t i = 0; i < waiters.size(); i++)
+        REQUIRE(waiters[i].wakeups == (i == 30 ? 0u : 1u));
+
+    // A waiter that comes back starts a new registration and is collected
+    // again in the same round
+    observe(list, observers[0], waiters[0], NA_SIGNAL_READABLE);
+    REQUIRE(collect() == 1);
+    REQUIRE(waiters[0].wakeups == 2);
+}
+} // namespace
+
+TEST_CASE("signal observer lists", "[ipc][wait]")
+{
+    test_link_and_unlink();
+    test_mask_filters_waiters();
+    test_batches_collect_each_observer_once();
+    test_round_survives_unlinks_between_batches();
+}
@@ -0,0 +1,172 @@
+#include "catch2_compat.hpp"
+#include "kernel/mm/kmalloc_size.hpp"
+#include "kernel/mm/magazine.hpp"
+#include "kernel/mm/slab_color.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace
+{
+using memory::magazine;
+using memory::magazine_list;
+using memory::magazine_pair;
+using memory::slab_color;
+
+/// Mirror slab_group::alloc/free over a depot, counting slab layer visits.
+struct model
+{
+    magazine_pair pair;
+    magazine_list full;
+    magazine_list empty;
+    std::vector<magazine> storage = std::vector<magazine>(64);
+    std::uint64_t slab_allocs = 0;
+    std::uint64_t slab_frees = 0;
+    std::uint64_t next_object = 1;
+
+    model()
+    {
+        for (auto &m : storage)
+            empty.push(&m);
+    }
+
+    void *alloc()
+    {
+        if (void *object = pair.pop())
+            return object;
+        if (magazine *m = full.pop())
+        {
+            if (magazine *spare = pair.exchange_for_full(m))
+                empty.push(spare);
+            return pair.pop();
+        }
+        slab_allocs++;
+        return reinterpret_cast<void *>(next_object++);
+    }
+
+    void free(void *object)
+    {
+        if (pair.push(object))
+            return;
+        if (magazine *m = empty.pop())
+        {
+            if (magazine *spare = pair.exchange_for_empty(m))
+                full.push(spare);
+            pair.push(object);
+            return;
+        }
+        slab_frees++;
+    }
+};
+
+void test_pair_swaps_before_depot()
+{
+    magazine loaded;
+    magazine previous;
+    magazine_pair pair{&loaded, &previous};
+    for (std::uintptr_t i = 1; i <= 2 * magazine::capacity; i++)
+        REQUIRE(pair.push(reinterpret_cast<void *>(i)));
+    REQUIRE_FALSE(pair.push(reinterpret_cast<void *>(std::uintptr_t(0))));
+    REQUIRE(loaded.full());
+    REQUIRE(previous.full());
+
+    for (std::uint64_t i = 0; i < 2 * magazine::capacity; i++)
+        REQUIRE(pair.pop() != nullptr);
+    REQUIRE(pair.pop() == nullptr);
+}
+
+void test_missing_magazines_fall_through()
+{
+    magazine_pair pair;
+    REQUIRE(pair.pop() == nullptr);
+    REQUIRE_FALSE(pair.push(reinterpret_cast<void *>(std::uintptr_t(1))));
+}
+
+/// A steady alloc/free loop settles into the per-CPU magazines and stops
+/// visiting the slab layer, which is the lock the magazines avoid.
+void test_steady_state_stays_local()
+{
+    model m;
+    std::vector<void *> live;
+    for (int i = 0; i < 200; i++)
+        live.push_back(m.alloc());
+    for (void *object : live)
+        m.free(object);
+    live.clear();
+    const auto allocs = m.slab_allocs;
+
+    for (int round = 0; round < 1000; round++)
+    {
+        for (int i = 0; i < 40; i++)
+            live.push_back(m.alloc());
+        for (void *object : live)
+            m.free(object);
+        live.clear();
+    }
+    REQUIRE(m.slab_allocs == allocs);
+    REQUIRE(m.slab_frees == 0);
+}
+
+void test_objects_are_not_lost()
+{
+    model m;
+    std::vector<void *> live;
+    for (int i = 0; i < 500; i++)
+        live.push_back(m.alloc());
+    for (void *object : live)
+        m.free(object);
+
+    std::uint64_t cached = m.full.size() * magazine::capacity;
+    cached += m.pair.loaded != nullptr ? m.pair.loaded->rounds : 0;
+    cached += m.pair.previous != nullptr ? m.pair.previous->rounds : 0;
+    REQUIRE(cached + m.slab_frees == 500);
+}
+
+void test_size_classes_match_linear_search()
+{
+    using namespace memory::kmalloc_size;
+    for (std::uint64_t size = 0; size <= max_size; size++)
+    {
+        std::uint64_t expected = 0;
+        while (sizes[expected] < size)
+            expected++;
+        REQUIRE(class_of(size) == expected);
+    }
+}
+/// Offsets are cache-line multiples inside the slack and visit every color
+/// before repeating.
+void test_colors_rotate_within_slack()
+{
+    slab_color color(200, 8);
+    REQUIRE(color.count() == 4);
+    for (int round = 0; round < 3; round++)
+    {
+        for (std::uint32_t expected = 0; expected <= 192; expected += 64)
+            REQUIRE(color.take() == expected);
+    }
+
+    slab_color wide(1000, 256);
+    REQUIRE(wide.count() == 4);
+    for (std::uint32_t expected = 0; expected <= 768; expected += 256)
+        REQUIRE(wide.take() == expected);
+
+    slab_color none(63, 8);
+    REQUIRE(none.count() == 1);
+    REQUIRE(none.take() == 0);
+    REQUIRE(none.take() == 0);
+}
+} // namespace
+
+TEST_CASE("slab colors", "[mm][slab]")
+{
+    test_colors_rotate_within_slack();
+}
+
+TEST_CASE("slab magazines", "[mm][slab]")
+{
+    test_pair_swaps_before_depot();
+    test_missing_magazines_fall_through();
+    test_steady_state_stays_local();
+    test_objects_are_not_lost();
+    test_size_classes_match_linear_search();
+}
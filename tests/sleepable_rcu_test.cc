@@ -0,0 +1,110 @@
+#include "catch2_compat.hpp"
+#include "kernel/util/sleepable_rcu.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace
+{
+void relax() { std::this_thread::yield(); }
+
+void test_synchronize_waits_for_readers()
+{
+    util::sleepable_rcu<4> rcu;
+    const auto epoch = rcu.read_lock(1);
+    std::atomic_bool done{false};
+    std::thread writer([&] {
+        rcu.synchronize(relax);
+        done = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    REQUIRE_FALSE(done);
+    // A reader entering after the switch is not waited for
+    const auto late = rcu.read_lock(2);
+    REQUIRE(late != epoch);
+    rcu.read_unlock(1, epoch);
+    writer.join();
+    REQUIRE(done);
+    rcu.read_unlock(2, late);
+    REQUIRE(rcu.readers(0) == 0);
+    REQUIRE(rcu.readers(1) == 0);
+}
+
+/// A reader stalls between loading the epoch and counting itself in, while a
+/// grace period ends. The next grace period must still wait for it.
+void test_stalled_reader_is_waited_for()
+{
+    util::sleepable_rcu<4> rcu;
+    const auto epoch = rcu.epoch();
+    rcu.synchronize(relax);
+    // The reader counts in to the epoch it loaded and picks up an object
+    rcu.read_lock(1, epoch);
+    std::atomic_bool done{false};
+    std::thread writer([&] {
+        rcu.synchronize(relax);
+        done = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    REQUIRE_FALSE(done);
+    rcu.read_unlock(1, epoch);
+    writer.join();
+    REQUIRE(done);
+}
+
+struct object
+{
+    std::atomic<std::uint64_t> value{0};
+};
+
+constexpr std::uint64_t live = 1;
+constexpr std::uint64_t freed = 2;
+
+void test_readers_never_see_freed()
+{
+    constexpr int readers = 6;
+    constexpr int rounds = 2000;
+    util::sleepable_rcu<readers> rcu;
+    std::vector<object> objects(rounds + 1);
+    objects[0].value = live;
+    std::atomic<object *> current{&objects[0]};
+    std::atomic_bool stop{false};
+    std::atomic_bool use_after_free{false};
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < readers; t++)
+    {
+        workers.emplace_back([&, t] {
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                const auto epoch = rcu.read_lock(t);
+                auto *o = current.load(std::memory_order_acquire);
+                for (int i = 0; i < 8; i++)
+                    if (o->value.load(std::memory_order_relaxed) != live)
+                        use_after_free = true;
+                rcu.read_unlock(t, epoch);
+            }
+        });
+    }
+    for (int i = 1; i <= rounds; i++)
+    {
+        objects[i].value = live;
+        auto *old = current.exchange(&objects[i], std::memory_order_acq_rel);
+        rcu.synchronize(relax);
+        old->value.store(freed, std::memory_order_relaxed);
+    }
+    stop = true;
+    for (auto &w : workers)
+        w.join();
+    REQUIRE_FALSE(use_after_free);
+}
+} // namespace
+
+TEST_CASE("sleepable rcu", "[rcu]")
+{
+    test_synchronize_waits_for_readers();
+    test_stalled_reader_is_waited_for();
+    test_readers_never_see_freed();
+}
@@ -6,6 +6,8 @@
 static_assert(std::is_same_v<decltype(&_s_log), void (*)(const char *)>);
 static_assert(std::is_same_v<decltype(&_s_clock), int (*)(int, na_time_clock_t *)>);
 static_assert(std::is_same_v<decltype(&_s_futex), int (*)(int *, int, int, const na_time_clock_t *)>);
+static_assert(std::is_same_v<decltype(&_s_futex_ext),
+                             int (*)(int *, int, int, const na_time_clock_t *, int *, int)>);
 static_assert(std::is_same_v<decltype(&_s_sigsend), int (*)(na_signal_target_t *, int, na_signal_info_t *)>);
 static_assert(
     std::is_same_v<decltype(&_s_sigmask), int (*)(int, na_signal_mask_t *, na_signal_mask_t *, na_signal_mask_t *)>);
@@ -41,6 +43,14 @@ static_assert(std::is_same_v<decltype(&_na_process_exec), na_status_t (*)(const
 static_assert(std::is_same_v<decltype(&_na_process_handle_open), na_status_t (*)(int64_t, na_handle_t *)>);
 static_assert(std::is_same_v<decltype(&_na_process_spawn), na_status_t (*)(const na_process_spawn_frame_t *)>);
 static_assert(std::is_same_v<decltype(&_na_pipe_create), na_status_t (*)(na_pipe_create_frame_t *)>);
+static_assert(std::is_same_v<decltype(&_na_shared_ring_notify), na_status_t (*)(na_handle_t)>);
+static_assert(std::is_same_v<decltype(&_na_thread_set_nice), na_status_t (*)(int64_t)>);
+static_assert(std::is_same_v<decltype(&_na_lockstat_read),
+                             na_status_t (*)(na_lockstat_entry_t *, uint64_t, uint64_t *)>);
+static_assert(std::is_same_v<decltype(&_na_invoke_call),
+                             na_status_t (*)(na_handle_t, const na_submit_frame_t *, na_result_frame_t *)>);
+static_assert(std::is_same_v<decltype(&_na_splice), na_status_t (*)(na_splice_frame_t *)>);
+static_assert(std::is_same_v<decltype(&_na_vmsplice), na_status_t (*)(na_vmsplice_frame_t *)>);
 static_assert(std::is_same_v<decltype(&_na_memory_map), na_status_t (*)(na_memory_map_frame_t *)>);
 static_assert(std::is_same_v<decltype(&_na_memory_unmap), na_status_t (*)(na_memory_unmap_frame_t *)>);
 